@@ -0,0 +1,161 @@
+#ifndef CAR_CALIBRATION_H
+#define CAR_CALIBRATION_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "scalextric_protocol.h"
+#include "car_lut.h"
+
+// Self-calibrating car bands, one table per sensor
+// CAR_FREQUENCIES are nominal; a real car's emitter sits a few percent off and wanders
+// with battery, temperature and LED age, and a median near the edge of the
+// FREQUENCY_TOLERANCE_PCT band comes out as car 0. An identified pass whose median is
+// clearly that car (calibrationUpdate) feeds it into an exponentially weighted estimate
+// of the car's period on that sensor (centre) and of how far passes stray from it
+// (spread). Once a car has CAL_MIN_SAMPLES passes:
+//   - its band is re-centred on the learned period (at most CAL_MAX_SHIFT_PCT from
+//     nominal, so it can't walk into a neighbour), keeping FREQUENCY_TOLERANCE_PCT
+//     either side: a car that drifts slowly out of its nominal band is still named
+//   - a tight inner band of CAL_SPREAD_FACTOR spreads (CAL_MIN_TOLERANCE_PCT..
+//     FREQUENCY_TOLERANCE_PCT) marks medians that are clearly this car, which the
+//     detector accepts after CAL_MIN_PULSES_FOR_ID pulses instead of MIN_PULSES_FOR_ID
+// Each sensor's interval -> car table (like car_lut.h, but built at runtime) is rebuilt
+// after every update, so classifying stays one load.
+//
+// The table is a plain struct so it can be stored as-is in NVS (CalibrationBlob).
+
+const float CAL_ALPHA = 1.0f / 16;           // EWMA weight of a pass once settled
+const int CAL_MIN_SAMPLES = 8;               // passes of a car before its band moves
+const float CAL_MAX_SHIFT_PCT = 0.04;        // learned period stays this close to nominal
+const float CAL_SPREAD_FACTOR = 4.0;         // inner band = this many mean deviations
+const float CAL_MIN_TOLERANCE_PCT = 0.02;    // inner band never narrower than this
+const uint8_t CAL_INNER_BAND = 0x80;         // LUT flag: in a calibrated car's inner band
+
+struct CarCalibration {
+  float centerUs[6];    // learned median interval per car
+  float spreadUs[6];    // EWMA of |median - centre|
+  uint16_t samples[6];  // passes learned from, saturates
+};
+
+inline float nominalIntervalUs(int car) { return 1000000.0f / CAR_FREQUENCIES[car]; }
+
+void calibrationReset(CarCalibration& cal) {
+  for (int c = 0; c < 6; c++) {
+    cal.centerUs[c] = nominalIntervalUs(c);
+    cal.spreadUs[c] = 0;
+    cal.samples[c] = 0;
+  }
+}
+
+inline bool carCalibrated(const CarCalibration& cal, int c) { return cal.samples[c] >= CAL_MIN_SAMPLES; }
+
+// Centre of car c's band: nominal until the car has enough passes
+inline float bandCenterUs(const CarCalibration& cal, int c) {
+  return carCalibrated(cal, c) ? cal.centerUs[c] : nominalIntervalUs(c);
+}
+
+// Half-width of the inner band, 0 if the car isn't calibrated yet
+float innerToleranceUs(const CarCalibration& cal, int c) {
+  if (!carCalibrated(cal, c)) return 0;
+  float tol = CAL_SPREAD_FACTOR * cal.spreadUs[c];
+  float lo = cal.centerUs[c] * CAL_MIN_TOLERANCE_PCT;
+  float hi = cal.centerUs[c] * FREQUENCY_TOLERANCE_PCT;
+  return tol < lo ? lo : tol > hi ? hi : tol;
+}
+
+// Interval -> car for one sensor, same layout and rule as IntervalCarTable (nearest
+// band centre in Hz within FREQUENCY_TOLERANCE_PCT) plus the CAL_INNER_BAND flag, so
+// an uncalibrated table is identical to the compile-time one. Each car only visits
+// the entries of its own band, so a rebuild per pass is cheap.
+void buildCalibratedLut(const CarCalibration& cal, uint8_t* lut) {
+  float centerHz[6];
+  for (int c = 0; c < 6; c++) {
+    centerHz[c] = carCalibrated(cal, c) ? 1000000.0f / cal.centerUs[c] : (float)CAR_FREQUENCIES[c];
+  }
+  for (int i = 0; i < CAR_LUT_SIZE; i++) lut[i] = 0;
+  for (int c = 0; c < 6; c++) {
+    float outer = centerHz[c] * FREQUENCY_TOLERANCE_PCT;
+    float inner = carCalibrated(cal, c) ? centerHz[c] * innerToleranceUs(cal, c) / cal.centerUs[c] : -1;
+    int lo = (int)(1000000.0f / (centerHz[c] + outer)) - (int)MIN_VALID_INTERVAL;
+    int hi = (int)(1000000.0f / (centerHz[c] - outer)) + 1 - (int)MIN_VALID_INTERVAL;
+    if (lo < 0) lo = 0;
+    if (hi > CAR_LUT_SIZE - 1) hi = CAR_LUT_SIZE - 1;
+    for (int i = lo; i <= hi; i++) {
+      float hz = intervalToFrequency(MIN_VALID_INTERVAL + i);
+      float d = hz > centerHz[c] ? hz - centerHz[c] : centerHz[c] - hz;
+      if (d >= outer) continue;
+      int other = (lut[i] & ~CAL_INNER_BAND) - 1;
+      if (other >= 0) {
+        float od = hz > centerHz[other] ? hz - centerHz[other] : centerHz[other] - hz;
+        if (od <= d) continue;
+      }
+      lut[i] = (uint8_t)(c + 1) | (d <= inner ? CAL_INNER_BAND : 0);
+    }
+  }
+}
+
+// Learn from a pass identified as car (1-6) with this median interval. Returns false
+// (and learns nothing) if the median isn't inside the car's inner band, or, until the
+// car is calibrated and has one, its nominal band: a misidentified pass sits near the
+// edge of the wrong car's band, and mustn't drag that band further towards it.
+bool calibrationUpdate(CarCalibration& cal, int car, uint32_t medianUs) {
+  if (car < 1 || car > 6) return false;
+  int c = car - 1;
+  float center = bandCenterUs(cal, c);
+  float d = medianUs - center;
+  float distance = d < 0 ? -d : d;
+  float tolerance = carCalibrated(cal, c) ? innerToleranceUs(cal, c) : center * FREQUENCY_TOLERANCE_PCT;
+  if (distance >= tolerance) return false;
+
+  // Plain average over the first passes, then a fixed weight that tracks drift
+  float alpha = cal.samples[c] + 1 < 1 / CAL_ALPHA ? 1.0f / (cal.samples[c] + 1) : CAL_ALPHA;
+  float deviation = medianUs - cal.centerUs[c];
+  cal.spreadUs[c] += alpha * ((deviation < 0 ? -deviation : deviation) - cal.spreadUs[c]);
+  cal.centerUs[c] += alpha * deviation;
+
+  float nominal = nominalIntervalUs(c);
+  float maxShift = nominal * CAL_MAX_SHIFT_PCT;
+  if (cal.centerUs[c] > nominal + maxShift) cal.centerUs[c] = nominal + maxShift;
+  if (cal.centerUs[c] < nominal - maxShift) cal.centerUs[c] = nominal - maxShift;
+  if (cal.samples[c] < 0xFFFF) cal.samples[c]++;
+  return true;
+}
+
+// ========== PERSISTENCE ==========
+
+const uint32_t CALIBRATION_MAGIC = 0x4C435853;  // "SXCL"
+const uint16_t CALIBRATION_VERSION = 1;
+
+// What goes into NVS: every sensor's table, rejected on load if it was written by a
+// different layout (version, sensor count) or is corrupt (CRC)
+struct CalibrationBlob {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t numSensors;
+  CarCalibration table[NUM_SENSORS];
+  uint32_t crc;
+};
+
+uint32_t calibrationCrc(const CalibrationBlob& blob) {
+  const uint8_t* p = (const uint8_t*)&blob;
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < offsetof(CalibrationBlob, crc); i++) {
+    crc ^= p[i];
+    for (int b = 0; b < 8; b++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
+
+void sealCalibrationBlob(CalibrationBlob& blob) {
+  blob.magic = CALIBRATION_MAGIC;
+  blob.version = CALIBRATION_VERSION;
+  blob.numSensors = NUM_SENSORS;
+  blob.crc = calibrationCrc(blob);
+}
+
+bool calibrationBlobValid(const CalibrationBlob& blob) {
+  return blob.magic == CALIBRATION_MAGIC && blob.version == CALIBRATION_VERSION &&
+         blob.numSensors == NUM_SENSORS && blob.crc == calibrationCrc(blob);
+}
+
+#endif
@@ -3,63 +3,396 @@
 
 #include <Arduino.h>
 #include "scalextric_protocol.h"
+#include "sliding_median.h"
+#include "edge_ring.h"
+#include "edge_capture.h"
+#include "car_lut.h"
+#include "deadline_heap.h"
+#ifdef ESP32
+#include "esp_timer.h"
+#endif
 
 // Scalextric Car Detector - Shared Detection Logic
 // Header-only library used by both parent and child nodes
 
+// ========== TIME BASE ==========
+
+// 64-bit monotonic micros since boot; doesn't wrap (micros() wraps every ~71 minutes).
+// Its low 32 bits are micros(), so the ISRs keep pushing 32-bit micros() into the
+// edge ring and the loop widens each edge with extendEdgeTime.
+inline uint64_t micros64() { return (uint64_t)esp_timer_get_time(); }
+
+// Full time of a 32-bit edge timestamp taken within ~35 minutes of now
+inline uint64_t extendEdgeTime(uint32_t edgeUs, uint64_t now) {
+  return now - (int64_t)(int32_t)((uint32_t)now - edgeUs);
+}
+
 // Callback type for car detection events
 typedef void (*CarDetectedCallback)(uint8_t sensorId, int car, float freq);
 
+// ========== PASS TIMING ==========
+
+// Length of track over which a sensor sees a car's IR LED (depends on LED height and
+// sensor aperture). Speed from one sensor = SENSOR_VIEW_MM / beam-crossing time.
+#ifndef SENSOR_VIEW_MM
+#define SENSOR_VIEW_MM 25  // Override via build_flags: -DSENSOR_VIEW_MM=30
+#endif
+
+// Distance from sensor 0 to sensor 1 along the track. When set, a car seen on both
+// gets its speed from the time between the two passes instead.
+#ifndef SPEED_TRAP_MM
+#define SPEED_TRAP_MM 0  // Override via build_flags: -DSPEED_TRAP_MM=100 (0 = no speed trap)
+#endif
+
+const float SPEED_TRAP_MIN_MPS = 1.0;  // slower than this between the sensors isn't the same car
+const uint64_t SPEED_TRAP_MAX_US = (uint64_t)(SPEED_TRAP_MM * 1000 / SPEED_TRAP_MIN_MPS);
+
+// One completed pass over a sensor, reported DETECTION_TIMEOUT after its last edge
+struct PassInfo {
+  uint8_t sensorId;
+  int car;               // car reported during the pass, 0 = unknown
+  uint64_t firstEdgeUs;  // micros64() of the first edge of the first valid interval
+  uint64_t lastEdgeUs;   // micros64() of the last valid edge
+  int pulseCount;        // valid intervals
+  uint16_t speedMmps;    // 0 if it couldn't be estimated
+  bool speedFromTrap;    // speed from SPEED_TRAP_MM rather than SENSOR_VIEW_MM
+};
+
+typedef void (*PassCompleteCallback)(const PassInfo& pass);
+
+// ========== CLASSIFIER SELECTION ==========
+
+#define CLASSIFIER_MEDIAN    0  // median interval between falling edges
+#define CLASSIFIER_TONE_BANK 1  // Goertzel-style bank over raw edge timestamps (tone_bank.h)
+#define CLASSIFIER_SPRT      2  // sequential likelihood test per interval (sprt_classifier.h)
+
+#ifndef CAR_CLASSIFIER
+#define CAR_CLASSIFIER CLASSIFIER_MEDIAN  // Override via build_flags: -DCAR_CLASSIFIER=1
+#endif
+
+#if CAR_CLASSIFIER == CLASSIFIER_TONE_BANK
+#include "tone_bank.h"
+
+const int TONE_WINDOW = 12;                // most recent edges scored per decision
+const int TONE_MIN_EDGES = 6;              // edges needed before the first decision
+const float TONE_MIN_COHERENCE = 0.6;      // best car must be at least this periodic
+const float TONE_MIN_CONFIDENCE = 0.3;     // and this far ahead of the runner-up
+const int TONE_CONFIRM_COUNT = 1;          // consecutive agreeing decisions (one per new edge batch)
+const unsigned long TONE_MAX_SPAN = 6000;  // ignore edges older than this (micros)
+static_assert(TONE_MAX_SPAN < TONE_MAX_PRODUCT_SPAN_US, "tone bank dt * f would overflow 32 bits");
+#endif
+
+#if CAR_CLASSIFIER == CLASSIFIER_SPRT
+#include "sprt_classifier.h"
+#endif
+
+// ========== OVERLAP DETECTION ==========
+
+// OVERLAP_DETECTION=1 keeps the raw edges of each pass and looks for a second car's
+// pulse train among them (overlap_detector.h), so two cars over one sensor within
+// DETECTION_TIMEOUT are reported as two events instead of one (or a wrong one).
+// Independent of CAR_CLASSIFIER; costs about 320 bytes per sensor (the raw edge window).
+#ifndef OVERLAP_DETECTION
+#define OVERLAP_DETECTION 1  // Override via build_flags: -DOVERLAP_DETECTION=0
+#endif
+
+#if OVERLAP_DETECTION
+#include "overlap_detector.h"
+
+const int OVERLAP_CHECK_EDGES = 8;         // new raw edges between checks
+const int OVERLAP_MAX_CHECK_EDGES = 16;    // spacing doubles up to this while searches find nothing
+const int OVERLAP_MIXED_PCT = 60;          // check when this share of them breaks the median
+const int OVERLAP_CONFIRM_COUNT = 2;       // consecutive checks agreeing on the second car
+const float OVERLAP_TAKEOVER_CONFIDENCE = 0.85;  // one clean train of another car: it replaced the first
+#endif
+
+// ========== CAR CALIBRATION ==========
+
+// CAR_CALIBRATION=1 learns each car's period on each sensor from the passes it
+// identifies (car_calibration.h): bands follow the real cars instead of the nominal
+// CAR_FREQUENCIES, and a median inside a car's learned inner band is accepted after
+// CAL_MIN_PULSES_FOR_ID pulses. Median classifier only. Firmwares keep the tables in
+// NVS (loadCalibration / saveCalibrationIfDue), so a node boots calibrated.
+#ifndef CAR_CALIBRATION
+#define CAR_CALIBRATION 0  // Override via build_flags: -DCAR_CALIBRATION=1
+#endif
+
+#if CAR_CALIBRATION && CAR_CLASSIFIER != CLASSIFIER_MEDIAN
+#error "CAR_CALIBRATION learns the median classifier's bands; build it with CAR_CLASSIFIER=0"
+#endif
+
+#if CAR_CALIBRATION
+#include "car_calibration.h"
+#ifdef ESP32
+#include <Preferences.h>
+#endif
+
+const int CAL_MIN_PULSES_FOR_ID = 4;                // inside a learned inner band
+const unsigned long CAL_SAVE_INTERVAL_MS = 300000;  // NVS writes at most this often
+const int EARLIEST_ID_PULSES = CAL_MIN_PULSES_FOR_ID;
+#else
+const int EARLIEST_ID_PULSES = MIN_PULSES_FOR_ID;
+#endif
+
+// ========== SENSOR HEALTH ==========
+
+// SENSOR_HEALTH=1 watches each sensor's edge, glitch and out-of-band rates over a
+// sliding window (sensor_health.h). A sensor in an interrupt storm (sunlight on the
+// phototransistor, a floating input) has its interrupt detached for a while, so it
+// stops costing ISR time on the others, and is rearmed with exponential backoff.
+// monitorSensorHealth reports every sensor every HEALTH_REPORT_MS and straight away
+// when one changes status; firmwares publish the reports (HealthEvent / H: lines).
+#ifndef SENSOR_HEALTH
+#define SENSOR_HEALTH 1  // Override via build_flags: -DSENSOR_HEALTH=0
+#endif
+
+#if SENSOR_HEALTH
+#include "sensor_health.h"
+#endif
+
+// One sensor's health as reported by monitorSensorHealth
+struct HealthInfo {
+  uint8_t sensorId;
+  uint8_t status;             // HEALTH_*
+  uint32_t edgesPerSec;       // over the last second
+  uint32_t glitchesPerSec;
+  uint32_t outOfBandPerSec;
+  uint32_t idleMs;            // since the last edge
+  uint16_t throttles;         // since boot
+};
+
+typedef void (*HealthReportCallback)(const HealthInfo& health);
+
+// Wire form of a health report (ESP-NOW / queues)
+HealthEvent toHealthEvent(uint8_t nodeId, const HealthInfo& health) {
+  HealthEvent event;
+  event.magic = HEALTH_EVENT_MAGIC;
+  event.nodeId = nodeId;
+  event.sensorId = health.sensorId;
+  event.status = health.status;
+  event.edgesPerSec = health.edgesPerSec > 0xFFFF ? 0xFFFF : health.edgesPerSec;
+  event.glitchesPerSec = health.glitchesPerSec > 0xFFFF ? 0xFFFF : health.glitchesPerSec;
+  event.outOfBandPerSec = health.outOfBandPerSec > 0xFFFF ? 0xFFFF : health.outOfBandPerSec;
+  event.idleSec = health.idleMs / 1000 > 0xFFFF ? 0xFFFF : health.idleMs / 1000;
+  event.throttles = health.throttles > 255 ? 255 : health.throttles;
+  return event;
+}
+
+// ========== DETECTION TASK ==========
+
+// DETECTION_TASK=1 runs processSensor in its own FreeRTOS task (startDetectionTask)
+// instead of loop(). The capture ISRs notify the task after each edge, and otherwise
+// it sleeps until an esp_timer fires at the earliest DETECTION_TIMEOUT deadline, so detection is not
+// quantised to loop()'s delay(1) and an empty track costs no CPU.
+// Callbacks then run in the detection task, not loop().
+#ifndef DETECTION_TASK
+#define DETECTION_TASK 0  // Override via build_flags: -DDETECTION_TASK=1
+#endif
+
+#ifndef DETECTION_TASK_CORE
+#define DETECTION_TASK_CORE 1  // Override via build_flags: -DDETECTION_TASK_CORE=0
+#endif
+
+#ifndef DETECTION_TASK_PRIORITY
+#define DETECTION_TASK_PRIORITY 5  // above loop() (1) so an edge preempts it
+#endif
+
+// The task decides on every new edge rather than once per 1ms loop pass (~2-5 edges),
+// so confirmation counts edges. A fast pass has too few for the count, so a decision
+// is also confirmed once no other car was named for DECISION_CONFIRM_US after it
+// (about the CONFIRM_COUNT loop passes), checked on later edges or, if none come, by
+// a confirm deadline. Tuned with scalextric_golden_suite -DDETECTION_TASK=1.
+#if DETECTION_TASK
+const int DECISION_CONFIRM_COUNT = 5;
+const uint32_t DECISION_CONFIRM_US = 1500;
+#else
+const int DECISION_CONFIRM_COUNT = CONFIRM_COUNT;
+const uint32_t DECISION_CONFIRM_US = 0;  // the count alone
+#endif
+
+#if CAR_CLASSIFIER == CLASSIFIER_TONE_BANK
+const int TONE_DECISION_CONFIRM = DETECTION_TASK ? 3 : TONE_CONFIRM_COUNT;
+#endif
+
+// ========== EDGE TRACE ==========
+
+// EDGE_TRACE=1 records every raw edge, reported car and ring overflow into edgeTrace
+// (see edge_trace.h). The firmware drains edgeTrace.buffer, e.g. to USB serial.
+#ifndef EDGE_TRACE
+#define EDGE_TRACE 0  // Override via build_flags: -DEDGE_TRACE=1
+#endif
+
+#if EDGE_TRACE
+#include "edge_trace.h"
+static_assert(NUM_SENSORS <= TRACE_MAX_SENSORS, "edge trace records up to 14 sensors");
+TraceWriter edgeTrace;
+#endif
+
 // ========== SENSOR STATE ==========
 
+// Edges buffered between the ISR and loop(). At 5.5 kHz, 128 edges cover ~23ms of
+// loop stall per sensor before anything is dropped.
+#ifndef EDGE_RING_SIZE
+#define EDGE_RING_SIZE 128  // Override via build_flags: -DEDGE_RING_SIZE=... (power of two)
+#endif
+
+typedef SlidingMedian<HISTORY_SIZE, MIN_VALID_INTERVAL, MAX_VALID_INTERVAL> IntervalWindow;
+typedef EdgeRing<EDGE_RING_SIZE> SensorEdgeRing;
+
+// processAllSensors keeps per-sensor flags in 32-bit masks
+static_assert(NUM_SENSORS <= 32, "at most 32 sensors");
+
+// ISR-shared state, one array per field across sensors, kept apart from the loop-owned
+// SensorState so an edge interrupt only touches its ring, its clock and one mask word.
+SensorEdgeRing sensorEdges[NUM_SENSORS];   // raw falling-edge times from onPulse / onCapture
+CaptureClock sensorClocks[NUM_SENSORS];    // CAPTURE_MCPWM: latched ticks -> micros (ISR side)
+std::atomic<uint32_t> pendingSensors(0);   // bit i: sensor i pushed an edge since the last batch
+
+// Loop-owned state; the ISRs never touch it
 struct SensorState {
   uint8_t id;
   int pin;
-  volatile unsigned long lastPulseTime;
-  volatile unsigned long pulseInterval;
-  volatile int pulseCount;
-  volatile bool newPulseData;
-  volatile unsigned long intervalHistory[HISTORY_SIZE];
-  volatile int historyIndex;
-  unsigned long lastActivityTime;
+  uint64_t lastPulseTime;       // last edge that passed the glitch filter
+  bool hasLastPulse;            // lastPulseTime is valid (false at the start of a pass)
+  int pulseCount;               // valid intervals since the pass started
+#if EDGE_TRACE
+  uint32_t tracedOverflows;     // ring overflows already written to the trace
+#endif
+#if CAR_CLASSIFIER == CLASSIFIER_TONE_BANK
+  uint32_t edgeHistory[TONE_WINDOW];  // raw edge times, including out-of-band edges
+  int edgeCount;
+  int scoredEdgeCount;
+  ToneScores scores;                  // last tone-bank result
+#endif
+#if CAR_CLASSIFIER == CLASSIFIER_SPRT
+  SprtState sprt;                     // per-car log-likelihoods of this pass
+#endif
+#if OVERLAP_DETECTION
+  uint32_t rawEdges[OVERLAP_WINDOW];  // raw edge times of this pass, before the glitch filter
+  int rawEdgeCount;
+  int checkedEdgeCount;               // rawEdgeCount at the last overlap check
+  int checkSpacing;                   // raw edges until the next check
+  int overlapCandidate;               // second car seen by the last check(s)
+  int overlapConfirm;
+  int secondCar;                      // second car reported in this pass, 0 = none
+  OverlapResult overlap;              // last check, with each car's confidence
+#endif
+  IntervalWindow window;        // sliding median over valid intervals
+  uint32_t edgesSeen;           // raw edges since boot (event quality, sensor health)
+  uint32_t glitchesSeen;        // of those, dropped by the bounce filter
+  uint32_t outOfBandSeen;       // intervals outside MIN..MAX_VALID_INTERVAL
+  uint32_t passStartEdges;      // the three counts where this pass started
+  uint32_t passStartGlitches;
+  uint32_t passStartOutOfBand;
+  EventQuality quality;         // of the last car reported, read by the callback
+  uint64_t firstEdgeTime;       // start of the first valid interval of this pass
+  uint64_t lastActivityTime;    // edge time of the last valid interval
   bool detecting;
   int lastCarDetected;
   int candidateCar;
   int confirmCount;
+  uint64_t candidateSince;      // edge time of the first decision naming candidateCar
 };
 
 SensorState sensors[NUM_SENSORS];
 
+#if CAR_CALIBRATION
+CarCalibration sensorCalibration[NUM_SENSORS];
+uint8_t sensorCarLut[NUM_SENSORS][CAR_LUT_SIZE];  // buildCalibratedLut of each table
+bool calibrationLearning = true;                 // false: use the tables, stop updating them
+bool calibrationDirty = false;                   // learned since the last save
+unsigned long calibrationSavedMs = 0;
+#endif
+
+// Bit i: sensors[i].detecting, so processAllSensors finds pass-in-progress sensors
+// without reading every SensorState
+uint32_t detectingSensors = 0;
+
+// One DETECTION_TIMEOUT deadline per detecting sensor (lastActivityTime + timeout),
+// re-armed on new pulse data and expired by processDeadlines. Ids NUM_SENSORS and up
+// are the task's confirm deadlines, one per sensor with an unconfirmed decision.
+DeadlineHeap<2 * NUM_SENSORS> sensorDeadlines;
+
+inline int confirmDeadlineId(int sensorId) { return NUM_SENSORS + sensorId; }
+
+#if SENSOR_HEALTH
+SensorHealth sensorHealth[NUM_SENSORS];
+uint32_t completedPasses = 0;   // on any sensor, for HEALTH_SILENT
+uint32_t healthTickMs = 0;      // millis() of the last health tick
+uint32_t healthReportMs = 0;    // and of the last full report
+#endif
+
+// Edge -> callback latency of reported cars (micros() at the callback minus the
+// timestamp of the last edge processed), for comparing loop polling with DETECTION_TASK
+struct LatencyStats {
+  uint32_t count;
+  uint32_t totalUs;
+  uint32_t maxUs;
+};
+
+LatencyStats detectionLatency = {0, 0, 0};
+
 // ========== ISRs (attachInterrupt needs separate function pointers) ==========
 
+#if DETECTION_TASK && defined(ESP32)
+TaskHandle_t detectionTaskHandle = nullptr;
+
+void IRAM_ATTR wakeDetectionTask() {
+  if (detectionTaskHandle == nullptr) return;
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(detectionTaskHandle, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+#else
+inline void wakeDetectionTask() {}
+#endif
+
+// Set after the push (also when the ring was full, so the overflow gets noticed)
+inline void IRAM_ATTR markPending(int i) {
+  pendingSensors.fetch_or(1u << i, std::memory_order_release);
+}
+
+// CAPTURE_GPIO_ISR: just timestamp the edge; filtering and classification happen in processSensor
 void IRAM_ATTR onPulse(int i) {
-  unsigned long now = micros();
-  SensorState& s = sensors[i];
-  unsigned long delta = now - s.lastPulseTime;
-
-  if (delta < 40) return;  // ignore bounce/glitch
-
-  if (s.lastPulseTime > 0) {
-    s.pulseInterval = delta;
-    if (delta >= MIN_VALID_INTERVAL && delta <= MAX_VALID_INTERVAL) {
-      s.intervalHistory[s.historyIndex] = delta;
-      s.historyIndex = (s.historyIndex + 1) % HISTORY_SIZE;
-      s.pulseCount++;
-      s.newPulseData = true;
-    }
-  }
-  s.lastPulseTime = now;
+  sensorEdges[i].push(micros());
+  markPending(i);
+  wakeDetectionTask();
+}
+
+// One trampoline per sensor, with the sensor index baked in as a constant
+template <int I>
+void IRAM_ATTR onPulseIsr() {
+  sensorEdges[I].push(micros());
+  markPending(I);
+  wakeDetectionTask();
 }
 
-void IRAM_ATTR onPulse0() { onPulse(0); }
-void IRAM_ATTR onPulse1() { onPulse(1); }
-void IRAM_ATTR onPulse2() { onPulse(2); }
-void IRAM_ATTR onPulse3() { onPulse(3); }
+typedef void (*IsrFunction)();
+
+// IsrTable<N>::isr = {onPulseIsr<0>, ..., onPulseIsr<N - 1>}, built at compile time
+template <int N, int... I>
+struct IsrTable : IsrTable<N - 1, N - 1, I...> {};
+
+template <int... I>
+struct IsrTable<0, I...> {
+  static constexpr IsrFunction isr[sizeof...(I)] = {onPulseIsr<I>...};
+};
+
+template <int... I>
+constexpr IsrFunction IsrTable<0, I...>::isr[sizeof...(I)];
 
-void (*isrFunctions[])() = {onPulse0, onPulse1, onPulse2, onPulse3};
+const IsrFunction* const isrFunctions = IsrTable<NUM_SENSORS>::isr;
+
+// CAPTURE_MCPWM: the edge was timestamped in hardware, only convert it
+void IRAM_ATTR onCapture(int i, uint32_t ticks) {
+  sensorEdges[i].push(sensorClocks[i].toMicros(ticks));
+  markPending(i);
+  wakeDetectionTask();
+}
 
 // ========== DETECTION FUNCTIONS ==========
 
+// Float reference for identifyCarByInterval (car_lut.h), which the median path uses
 int identifyCar(float frequency) {
   int bestCar = 0;
   float bestDiff = frequency;
@@ -74,108 +407,806 @@ int identifyCar(float frequency) {
   return bestCar;
 }
 
-float calculateMedianFrequency(volatile unsigned long* history) {
-  unsigned long temp[HISTORY_SIZE];
-  int validSamples = 0;
-  noInterrupts();
-  for (int i = 0; i < HISTORY_SIZE; i++) {
-    if (history[i] > 0) {
-      temp[validSamples++] = history[i];
+// Car for a median interval on this sensor: its learned bands with CAR_CALIBRATION,
+// otherwise the compile-time table
+inline int identifySensorCar(int id, uint32_t intervalUs) {
+#if CAR_CALIBRATION
+  if (intervalUs < MIN_VALID_INTERVAL || intervalUs > MAX_VALID_INTERVAL) return 0;
+  return sensorCarLut[id][intervalUs - MIN_VALID_INTERVAL] & ~CAL_INNER_BAND;
+#else
+  (void)id;
+  return identifyCarByInterval(intervalUs);
+#endif
+}
+
+// Median clearly one calibrated car: identify it early (CAL_MIN_PULSES_FOR_ID)
+inline bool inInnerBand(int id, uint32_t intervalUs) {
+#if CAR_CALIBRATION
+  if (intervalUs < MIN_VALID_INTERVAL || intervalUs > MAX_VALID_INTERVAL) return false;
+  return sensorCarLut[id][intervalUs - MIN_VALID_INTERVAL] & CAL_INNER_BAND;
+#else
+  (void)id;
+  (void)intervalUs;
+  return false;
+#endif
+}
+
+// Drain the edge ring: drop bounce/glitch edges, feed valid intervals into the
+// sliding window. Returns true if at least one valid interval was added.
+bool consumeEdges(SensorState& sensor) {
+  bool newPulseData = false;
+  uint32_t edgeUs;
+  uint64_t clock = 0;
+#if EDGE_TRACE
+  uint32_t overflows = sensorEdges[sensor.id].overflowCount();
+  if (overflows != sensor.tracedOverflows) {
+    edgeTrace.lost(sensor.id, overflows - sensor.tracedOverflows, micros64());
+    sensor.tracedOverflows = overflows;
+  }
+#endif
+  SensorEdgeRing& ring = sensorEdges[sensor.id];
+  while (ring.pop(edgeUs)) {
+    if (clock == 0) clock = micros64();
+    uint64_t now = extendEdgeTime(edgeUs, clock);
+#if EDGE_TRACE
+    edgeTrace.edge(sensor.id, now);
+#endif
+#if OVERLAP_DETECTION
+    // Two cars' edges can be closer than the glitch filter, so keep them all
+    sensor.rawEdges[sensor.rawEdgeCount % OVERLAP_WINDOW] = edgeUs;
+    sensor.rawEdgeCount++;
+#endif
+    uint64_t delta = now - sensor.lastPulseTime;
+    // Stray edges between passes: the quality counts start again with the next pass
+    if (sensor.pulseCount == 0 && (!sensor.hasLastPulse || delta > DETECTION_TIMEOUT)) {
+      sensor.passStartEdges = sensor.edgesSeen;
+      sensor.passStartGlitches = sensor.glitchesSeen;
+      sensor.passStartOutOfBand = sensor.outOfBandSeen;
+    }
+    sensor.edgesSeen++;
+    if (sensor.hasLastPulse && delta < 40) {  // ignore bounce/glitch
+      sensor.glitchesSeen++;
+      continue;
     }
+
+#if CAR_CLASSIFIER == CLASSIFIER_TONE_BANK
+    sensor.edgeHistory[sensor.edgeCount % TONE_WINDOW] = edgeUs;  // tone bank only uses differences
+    sensor.edgeCount++;
+#endif
+
+    if (sensor.hasLastPulse && delta >= MIN_VALID_INTERVAL && delta <= MAX_VALID_INTERVAL) {
+      sensor.window.push(delta);
+#if CAR_CLASSIFIER == CLASSIFIER_SPRT
+      sprtUpdate(sensor.sprt, delta);
+#endif
+      if (sensor.pulseCount == 0) sensor.firstEdgeTime = sensor.lastPulseTime;
+      sensor.pulseCount++;
+      sensor.lastActivityTime = now;
+      newPulseData = true;
+    } else if (sensor.hasLastPulse) {
+      sensor.outOfBandSeen++;
+    }
+    sensor.lastPulseTime = now;
+    sensor.hasLastPulse = true;
+  }
+  return newPulseData;
+}
+
+// Median interval in micros, 0 until the window holds 3 intervals
+uint32_t medianInterval(const IntervalWindow& window) {
+  if (window.size() < 3) return 0;
+  return window.median();
+}
+
+float calculateMedianFrequency(const IntervalWindow& window) {
+  uint32_t median = medianInterval(window);
+  return median ? intervalToFrequency(median) : 0;
+}
+
+// Frequency reported with an event, only computed when one is emitted.
+// Falls back to the car's nominal frequency if there is no median yet.
+float eventFrequency(uint32_t medianUs, int car) {
+  if (medianUs > 0) return intervalToFrequency(medianUs);
+  return car > 0 ? CAR_FREQUENCIES[car - 1] : 0;
+}
+
+#if CAR_CLASSIFIER == CLASSIFIER_TONE_BANK
+// Score the most recent edges (within TONE_MAX_SPAN of the newest) against all cars.
+// Returns the best car, or 0 if it is not periodic or distinct enough.
+int classifyToneBank(SensorState& sensor) {
+  uint32_t edges[TONE_WINDOW];
+  int produced = sensor.edgeCount;
+  int n = produced < TONE_WINDOW ? produced : TONE_WINDOW;
+  for (int i = 0; i < n; i++) {
+    edges[i] = sensor.edgeHistory[(produced - n + i) % TONE_WINDOW];
   }
-  interrupts();
-  if (validSamples < 3) return 0;
-  for (int i = 0; i < validSamples - 1; i++) {
-    for (int j = 0; j < validSamples - i - 1; j++) {
-      if (temp[j] > temp[j + 1]) {
-        unsigned long swap = temp[j];
-        temp[j] = temp[j + 1];
-        temp[j + 1] = swap;
-      }
+  int first = 0;
+  while (first < n - 1 && edges[n - 1] - edges[first] > TONE_MAX_SPAN) first++;
+
+  sensor.scoredEdgeCount = produced;
+  if (n - first < TONE_MIN_EDGES) return 0;
+
+  scoreToneBank(edges + first, n - first, sensor.scores);
+  if (sensor.scores.coherence[sensor.scores.bestCar - 1] < TONE_MIN_COHERENCE) return 0;
+  if (sensor.scores.confidence < TONE_MIN_CONFIDENCE) return 0;
+  return sensor.scores.bestCar;
+}
+#endif
+
+// ========== EVENT QUALITY ==========
+
+inline uint8_t saturate8(int n) { return n > 255 ? 255 : (uint8_t)n; }
+
+// How clean the pass looked when car was reported at freq: see EventQuality
+EventQuality eventQuality(const SensorState& sensor, int car, float freq) {
+  EventQuality q;
+  q.pulses = saturate8(sensor.pulseCount);
+  int intervals = (int)(sensor.edgesSeen - sensor.passStartEdges) - 1;
+  q.validPct = intervals > 0 ? saturate8(sensor.pulseCount * 100 / intervals) : 0;
+  if (q.validPct > 100) q.validPct = 100;
+  q.glitches = saturate8(sensor.glitchesSeen - sensor.passStartGlitches);
+  q.outOfBand = saturate8(sensor.outOfBandSeen - sensor.passStartOutOfBand);
+
+  int n = sensor.window.size();
+  q.iqrUs = n >= 4 ? sensor.window.kthSmallest(3 * n / 4 + 1) - sensor.window.kthSmallest(n / 4 + 1) : 0;
+
+  // Nominal frequencies: how much nearer the reported car is than the runner-up
+  float own = 1, other = 1;
+  for (int c = 0; c < 6; c++) {
+    float d = (freq - CAR_FREQUENCIES[c]) / CAR_FREQUENCIES[c];
+    if (d < 0) d = -d;
+    if (c == car - 1) {
+      own = d;
+    } else if (d < other) {
+      other = d;
     }
   }
-  return 1000000.0 / temp[validSamples / 2];
+  float margin = other > own ? other - own : 0;
+  q.marginPermille = (uint16_t)(margin * 1000 + 0.5f);
+
+  q.overlapPct = 0;
+#if OVERLAP_DETECTION
+  const OverlapResult& r = sensor.overlap;
+  if (r.count == 2) q.overlapPct = (uint8_t)(100 * (r.car[0] == car ? r.confidence[1] : r.confidence[0]));
+#endif
+  return q;
 }
 
+// Quality of the car just reported on this sensor, for the CarDetectedCallback
+inline const EventQuality& lastEventQuality(uint8_t sensorId) { return sensors[sensorId].quality; }
+
+// Report a car seen during the pass (latency stats, trace, quality, callback)
+void reportCar(SensorState& sensor, int car, float freq, CarDetectedCallback onCarDetected) {
+  uint32_t latency = micros64() - sensor.lastPulseTime;
+  detectionLatency.count++;
+  detectionLatency.totalUs += latency;
+  if (latency > detectionLatency.maxUs) detectionLatency.maxUs = latency;
+
+#if EDGE_TRACE
+  edgeTrace.detection(sensor.id, car, micros64());
+#endif
+  sensor.quality = eventQuality(sensor, car, freq);
+  onCarDetected(sensor.id, car, freq);
+}
+
+// Count consecutive agreeing decisions and report the car once confirmCount is reached,
+// or once confirmUs (if any) has passed since the first of them. The confirm deadline
+// reports it then if no edge comes to check, unless a later decision names another car.
+void confirmCar(SensorState& sensor, int car, uint32_t medianUs, int confirmCount,
+                CarDetectedCallback onCarDetected, uint32_t confirmUs = 0) {
+  if (car <= 0) return;
+
+  if (car == sensor.candidateCar) {
+    sensor.confirmCount++;
+  } else {
+    sensor.candidateCar = car;
+    sensor.confirmCount = 1;
+    sensor.candidateSince = sensor.lastActivityTime;
+    if (confirmUs > 0 && sensor.lastCarDetected == 0) {
+      sensorDeadlines.arm(confirmDeadlineId(sensor.id), sensor.candidateSince + confirmUs);
+    }
+  }
+
+  bool held = confirmUs > 0 && sensor.lastActivityTime - sensor.candidateSince >= confirmUs;
+  if ((sensor.confirmCount >= confirmCount || held) && sensor.lastCarDetected == 0) {
+    sensorDeadlines.cancel(confirmDeadlineId(sensor.id));
+    reportCar(sensor, car, eventFrequency(medianUs, car), onCarDetected);
+    sensor.lastCarDetected = car;
+  }
+}
+
+// Confirm deadline: the candidate went unchallenged for its confirm time
+void confirmPending(SensorState& sensor, CarDetectedCallback onCarDetected) {
+  if (sensor.candidateCar <= 0 || sensor.lastCarDetected != 0) return;
+  reportCar(sensor, sensor.candidateCar, eventFrequency(medianInterval(sensor.window), sensor.candidateCar),
+            onCarDetected);
+  sensor.lastCarDetected = sensor.candidateCar;
+}
+
+#if OVERLAP_DETECTION
+// Cheap test before the full search: while one car is over the sensor nearly every
+// raw edge is a median interval after the previous one, and the median still names
+// the reported car. A second car breaks one or the other.
+bool overlapSuspected(const SensorState& sensor) {
+  uint32_t median = medianInterval(sensor.window);
+  if (median == 0) return false;
+  int car = identifySensorCar(sensor.id, median);
+  if (sensor.lastCarDetected > 0 && car != sensor.lastCarDetected) return true;
+
+  uint32_t tolerance = (uint32_t)(median * FREQUENCY_TOLERANCE_PCT);
+  int mixed = 0;
+  int n = sensor.rawEdgeCount - sensor.checkedEdgeCount;
+  if (n > OVERLAP_WINDOW - 1) n = OVERLAP_WINDOW - 1;
+  for (int k = sensor.rawEdgeCount - n; k < sensor.rawEdgeCount; k++) {
+    if (k == 0) continue;
+    uint32_t d = sensor.rawEdges[k % OVERLAP_WINDOW] - sensor.rawEdges[(k - 1) % OVERLAP_WINDOW];
+    if (d + tolerance < median || d > median + tolerance) mixed++;
+  }
+  return mixed * 100 >= n * OVERLAP_MIXED_PCT;
+}
+
+// Every checkSpacing raw edges: look for a second car in this pass. Reports it
+// once OVERLAP_CONFIRM_COUNT checks in a row agree, at most one second car per pass.
+// If the classifier hasn't named a car yet, or named neither train's car (the median
+// of two interleaved trains can land on a third car), two trains report both.
+void checkOverlap(SensorState& sensor, CarDetectedCallback onCarDetected) {
+  bool suspected = sensor.secondCar == 0 && overlapSuspected(sensor);
+  sensor.checkedEdgeCount = sensor.rawEdgeCount;
+  if (!suspected) {
+    sensor.overlapCandidate = 0;
+    sensor.overlapConfirm = 0;
+    return;
+  }
+
+  uint32_t edges[OVERLAP_WINDOW];
+  int n = sensor.rawEdgeCount < OVERLAP_WINDOW ? sensor.rawEdgeCount : OVERLAP_WINDOW;
+  for (int i = 0; i < n; i++) {
+    edges[i] = sensor.rawEdges[(sensor.rawEdgeCount - n + i) % OVERLAP_WINDOW];
+  }
+  OverlapResult& r = sensor.overlap;
+  detectOverlap(edges, n, r);
+
+  int first = sensor.lastCarDetected;
+  int slot = -1;  // train of the car to report as the second one
+  bool both = false;  // report the other train's car as well
+  if (r.count == 2) {
+    slot = first == r.car[1] ? 0 : 1;
+    both = first != r.car[0] && first != r.car[1];
+  } else if (r.count == 1 && first > 0 && r.car[0] != first &&
+             periodError(r.periodUs[0], first - 1) > FREQUENCY_TOLERANCE_PCT &&
+             r.confidence[0] >= OVERLAP_TAKEOVER_CONFIDENCE) {
+    slot = 0;  // a following car has taken over the sensor
+  }
+  int car = slot >= 0 ? r.car[slot] : 0;
+  if (car == 0 || car == first) {
+    // Noise (reflections, ambient IR) keeps the cheap test firing; back off the search
+    sensor.overlapCandidate = 0;
+    sensor.overlapConfirm = 0;
+    if (sensor.checkSpacing < OVERLAP_MAX_CHECK_EDGES) sensor.checkSpacing *= 2;
+    return;
+  }
+  sensor.checkSpacing = OVERLAP_CHECK_EDGES;
+  if (car == sensor.overlapCandidate) {
+    sensor.overlapConfirm++;
+  } else {
+    sensor.overlapCandidate = car;
+    sensor.overlapConfirm = 1;
+  }
+  if (sensor.overlapConfirm < OVERLAP_CONFIRM_COUNT) return;
+
+  if (both) {
+    int other = r.car[1 - slot];
+    reportCar(sensor, other, intervalToFrequency(r.periodUs[1 - slot]), onCarDetected);
+    sensor.lastCarDetected = other;
+  }
+  reportCar(sensor, car, intervalToFrequency(r.periodUs[slot]), onCarDetected);
+  sensor.secondCar = car;
+}
+#endif
+
+// Loop-side state only: edges still in the ring belong to the next pass
 void resetSensor(SensorState& sensor) {
-  noInterrupts();
   sensor.pulseCount = 0;
-  sensor.historyIndex = 0;
-  sensor.lastPulseTime = 0;
-  sensor.newPulseData = false;
-  for (int i = 0; i < HISTORY_SIZE; i++) {
-    sensor.intervalHistory[i] = 0;
-  }
-  interrupts();
+  sensor.hasLastPulse = false;
+  sensorClocks[sensor.id].requestAnchor();
+  sensorDeadlines.cancel(sensor.id);
+  sensorDeadlines.cancel(confirmDeadlineId(sensor.id));
+  detectingSensors &= ~(1u << sensor.id);
+#if CAR_CLASSIFIER == CLASSIFIER_TONE_BANK
+  sensor.edgeCount = 0;
+  sensor.scoredEdgeCount = 0;
+#endif
+#if CAR_CLASSIFIER == CLASSIFIER_SPRT
+  sprtClear(sensor.sprt);
+#endif
+#if OVERLAP_DETECTION
+  sensor.rawEdgeCount = 0;
+  sensor.checkedEdgeCount = 0;
+  sensor.checkSpacing = OVERLAP_CHECK_EDGES;
+  sensor.overlapCandidate = 0;
+  sensor.overlapConfirm = 0;
+  sensor.secondCar = 0;
+  sensor.overlap.count = 0;
+#endif
+  sensor.window.clear();
   sensor.detecting = false;
   sensor.lastCarDetected = 0;
   sensor.candidateCar = 0;
   sensor.confirmCount = 0;
+  sensor.candidateSince = 0;
+}
+
+// Classification step of processSensor, after consumeEdges
+void classifySensor(SensorState& sensor, bool newPulseData, CarDetectedCallback onCarDetected) {
+  if (newPulseData) {
+    sensor.detecting = true;
+    detectingSensors |= 1u << sensor.id;
+    // Measured from the edge itself, not from when the loop got round to it
+    sensorDeadlines.arm(sensor.id, sensor.lastActivityTime + DETECTION_TIMEOUT);
+  }
+
+#if CAR_CLASSIFIER == CLASSIFIER_TONE_BANK
+  if (sensor.detecting && sensor.edgeCount != sensor.scoredEdgeCount) {
+    int car = classifyToneBank(sensor);
+    if (car > 0) {
+      confirmCar(sensor, car, medianInterval(sensor.window), TONE_DECISION_CONFIRM, onCarDetected,
+                 DECISION_CONFIRM_US);
+    }
+  }
+#elif CAR_CLASSIFIER == CLASSIFIER_SPRT
+  // The test already demands SPRT_ERROR_RATE certainty, so no further confirmation
+  if (sensor.detecting && newPulseData) {
+    confirmCar(sensor, sprtDecision(sensor.sprt), medianInterval(sensor.window), 1, onCarDetected);
+  }
+#else
+  if (sensor.detecting && sensor.pulseCount >= EARLIEST_ID_PULSES && (newPulseData || !DETECTION_TASK)) {
+    uint32_t median = medianInterval(sensor.window);
+    if (sensor.pulseCount >= MIN_PULSES_FOR_ID || inInnerBand(sensor.id, median)) {
+      confirmCar(sensor, identifySensorCar(sensor.id, median), median, DECISION_CONFIRM_COUNT, onCarDetected,
+                 DECISION_CONFIRM_US);
+    }
+  }
+#endif
+
+#if OVERLAP_DETECTION
+  if (sensor.detecting && sensor.rawEdgeCount - sensor.checkedEdgeCount >= sensor.checkSpacing) {
+    checkOverlap(sensor, onCarDetected);
+  }
+#endif
 }
 
 void processSensor(SensorState& sensor, CarDetectedCallback onCarDetected) {
-  if (sensor.newPulseData) {
-    sensor.newPulseData = false;
-    sensor.lastActivityTime = micros();
-    if (!sensor.detecting) {
-      sensor.detecting = true;
+  classifySensor(sensor, consumeEdges(sensor), onCarDetected);
+}
+
+// Same as processSensor on every sensor, in one batch: a single atomic exchange
+// collects which sensors have new edges, all of those rings are drained back to back,
+// then the sensors are classified together. Idle sensors (no new edges, no pass in
+// progress) are skipped without reading their rings or state, so the cost of a loop
+// pass follows the number of busy sensors rather than NUM_SENSORS.
+void processAllSensors(CarDetectedCallback onCarDetected) {
+  uint32_t pending = pendingSensors.exchange(0, std::memory_order_acquire);
+  uint32_t visit = pending | detectingSensors;
+  if (visit == 0) return;
+
+  uint32_t fresh = 0;  // bit i: sensor i got at least one valid interval
+  for (uint32_t m = pending; m != 0; m &= m - 1) {
+    int i = __builtin_ctz(m);
+    if (consumeEdges(sensors[i])) fresh |= 1u << i;
+  }
+  for (uint32_t m = visit; m != 0; m &= m - 1) {
+    int i = __builtin_ctz(m);
+    classifySensor(sensors[i], (fresh >> i) & 1, onCarDetected);
+  }
+}
+
+// Sensor 0's most recent pass, waiting for the same car on sensor 1
+struct SpeedTrapEntry {
+  bool valid;
+  uint64_t firstEdgeUs;
+  int car;
+};
+
+SpeedTrapEntry speedTrapEntry = {false, 0, 0};
+
+// Beam crossing: the edges span the view width less one emitter period
+uint16_t beamSpeed(const SensorState& sensor) {
+  uint64_t crossingUs = sensor.lastActivityTime - sensor.firstEdgeTime + medianInterval(sensor.window);
+  if (crossingUs == 0) return 0;
+  uint64_t mmps = (uint64_t)SENSOR_VIEW_MM * 1000000 / crossingUs;
+  return mmps > 0xFFFF ? 0xFFFF : (uint16_t)mmps;
+}
+
+// Sensor 1 pass: pair with sensor 0's pass just before it, unless both were
+// identified as different cars
+bool trapSpeed(const SensorState& sensor, uint16_t& mmps) {
+  if (SPEED_TRAP_MM == 0 || NUM_SENSORS < 2 || sensor.id != 1 || !speedTrapEntry.valid) return false;
+  int car = sensor.lastCarDetected;
+  if (car > 0 && speedTrapEntry.car > 0 && speedTrapEntry.car != car) return false;
+  uint64_t gapUs = sensor.firstEdgeTime - speedTrapEntry.firstEdgeUs;
+  if (sensor.firstEdgeTime <= speedTrapEntry.firstEdgeUs || gapUs > SPEED_TRAP_MAX_US) return false;
+  uint64_t speed = (uint64_t)SPEED_TRAP_MM * 1000000 / gapUs;
+  mmps = speed > 0xFFFF ? 0xFFFF : (uint16_t)speed;
+  speedTrapEntry.valid = false;
+  return true;
+}
+
+PassInfo passInfo(const SensorState& sensor) {
+  PassInfo pass;
+  pass.sensorId = sensor.id;
+  pass.car = sensor.lastCarDetected;
+  pass.firstEdgeUs = sensor.firstEdgeTime;
+  pass.lastEdgeUs = sensor.lastActivityTime;
+  pass.pulseCount = sensor.pulseCount;
+  pass.speedFromTrap = trapSpeed(sensor, pass.speedMmps);
+  if (!pass.speedFromTrap) pass.speedMmps = beamSpeed(sensor);
+  return pass;
+}
+
+// Wire form of a pass (ESP-NOW / queues)
+PassEvent toPassEvent(uint8_t nodeId, const PassInfo& pass) {
+  PassEvent event;
+  event.magic = PASS_EVENT_MAGIC;
+  event.nodeId = nodeId;
+  event.sensorId = pass.sensorId;
+  event.carNumber = pass.car;
+  event.firstEdgeUs = pass.firstEdgeUs;
+  event.durationUs = (uint32_t)(pass.lastEdgeUs - pass.firstEdgeUs);
+  event.speedMmps = pass.speedMmps;
+  event.flags = pass.speedFromTrap ? PASS_FLAG_SPEED_TRAP : 0;
+  event.pulseCount = pass.pulseCount > 255 ? 255 : pass.pulseCount;
+  return event;
+}
+
+#if CAR_CALIBRATION
+// A finished pass of an identified car teaches its sensor that car's period.
+// Passes shared with a second car are skipped: their median is of both.
+void learnPass(const SensorState& sensor) {
+  if (!calibrationLearning || sensor.lastCarDetected == 0 || sensor.pulseCount < MIN_PULSES_FOR_ID) return;
+#if OVERLAP_DETECTION
+  if (sensor.secondCar != 0) return;
+#endif
+  // The whole pass's median must still name the car reported early in it
+  uint32_t median = medianInterval(sensor.window);
+  if (identifySensorCar(sensor.id, median) != sensor.lastCarDetected) return;
+  CarCalibration& cal = sensorCalibration[sensor.id];
+  if (calibrationUpdate(cal, sensor.lastCarDetected, median)) {
+    buildCalibratedLut(cal, sensorCarLut[sensor.id]);
+    calibrationDirty = true;
+  }
+}
+
+// Every sensor's table, sealed for storage
+void exportCalibration(CalibrationBlob& blob) {
+  memset(&blob, 0, sizeof(blob));
+  for (int i = 0; i < NUM_SENSORS; i++) blob.table[i] = sensorCalibration[i];
+  sealCalibrationBlob(blob);
+}
+
+// Adopt stored tables; false (tables untouched) if the blob is invalid
+bool importCalibration(const CalibrationBlob& blob) {
+  if (!calibrationBlobValid(blob)) return false;
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    sensorCalibration[i] = blob.table[i];
+    buildCalibratedLut(sensorCalibration[i], sensorCarLut[i]);
+  }
+  calibrationDirty = false;
+  return true;
+}
+
+#ifdef ESP32
+const char* const CALIBRATION_NVS_NAMESPACE = "sxcal";
+
+// After initSensors: start from the tables the node learned before it was reset
+bool loadCalibration() {
+  static CalibrationBlob blob;  // ~60 bytes per sensor, off the loop stack
+  Preferences prefs;
+  if (!prefs.begin(CALIBRATION_NVS_NAMESPACE, true)) return false;
+  size_t n = prefs.getBytes("tables", &blob, sizeof(blob));
+  prefs.end();
+  return n == sizeof(blob) && importCalibration(blob);
+}
+
+void saveCalibration() {
+  static CalibrationBlob blob;
+  exportCalibration(blob);
+  Preferences prefs;
+  if (!prefs.begin(CALIBRATION_NVS_NAMESPACE, false)) return;
+  prefs.putBytes("tables", &blob, sizeof(blob));
+  prefs.end();
+  calibrationDirty = false;
+  calibrationSavedMs = millis();
+}
+
+// From loop(): save what was learned, at most every CAL_SAVE_INTERVAL_MS (flash wear)
+// and only while no car is over a sensor, since an NVS write stalls for milliseconds
+bool saveCalibrationIfDue() {
+  if (!calibrationDirty || detectingSensors != 0) return false;
+  if (millis() - calibrationSavedMs < CAL_SAVE_INTERVAL_MS) return false;
+  saveCalibration();
+  return true;
+}
+#endif
+#endif
+
+// DETECTION_TIMEOUT after the last valid interval: the car has gone
+void expireSensor(SensorState& sensor, CarDetectedCallback onCarDetected,
+                  PassCompleteCallback onPassComplete = nullptr) {
+  // Report unknown car if we had enough pulses but never matched
+  if (sensor.lastCarDetected == 0 && sensor.pulseCount >= MIN_PULSES_FOR_ID) {
+    uint32_t median = medianInterval(sensor.window);
+    if (median > 0) {
+      float freq = intervalToFrequency(median);
+#if EDGE_TRACE
+      edgeTrace.detection(sensor.id, 0, micros64());
+#endif
+      sensor.quality = eventQuality(sensor, 0, freq);
+      onCarDetected(sensor.id, 0, freq);
     }
   }
 
-  if (sensor.detecting && sensor.pulseCount >= MIN_PULSES_FOR_ID) {
-    float freq = calculateMedianFrequency(sensor.intervalHistory);
-    int car = identifyCar(freq);
+  // Passes too short to have been reported either way are noise, not cars
+  if (sensor.lastCarDetected > 0 || sensor.pulseCount >= MIN_PULSES_FOR_ID) {
+    if (SPEED_TRAP_MM > 0 && sensor.id == 0) {
+      speedTrapEntry = {true, sensor.firstEdgeTime, sensor.lastCarDetected};
+    }
+    if (onPassComplete) onPassComplete(passInfo(sensor));
+#if SENSOR_HEALTH
+    completedPasses++;
+#endif
+  }
+#if CAR_CALIBRATION
+  learnPass(sensor);
+#endif
+#if EDGE_TRACE
+  edgeTrace.flush();  // one pass per frame or so, so the logger streams it promptly
+#endif
+  resetSensor(sensor);
+}
 
-    if (car > 0) {
-      if (car == sensor.candidateCar) {
-        sensor.confirmCount++;
-      } else {
-        sensor.candidateCar = car;
-        sensor.confirmCount = 1;
-      }
-
-      if (sensor.confirmCount >= CONFIRM_COUNT && sensor.lastCarDetected == 0) {
-        onCarDetected(sensor.id, car, freq);
-        sensor.lastCarDetected = car;
-      }
+// Run the timeout path of every sensor whose deadline has passed, once each, and
+// report every decision whose confirm deadline has.
+// Call before processSensor, so edges of a following car that are already in the
+// ring start a new pass instead of extending the old one.
+void processDeadlines(CarDetectedCallback onCarDetected, PassCompleteCallback onPassComplete = nullptr) {
+  int id;
+  while (sensorDeadlines.popExpired(micros64(), id)) {
+    if (id >= NUM_SENSORS) {
+      confirmPending(sensors[id - NUM_SENSORS], onCarDetected);
+    } else {
+      expireSensor(sensors[id], onCarDetected, onPassComplete);
     }
   }
+}
+
+#if SENSOR_HEALTH
+// ========== SENSOR HEALTH MONITOR ==========
+
+// Edges the sensor produced: consumed by the loop, plus those a full ring dropped
+inline uint32_t sensorEdgeTotal(const SensorState& sensor) {
+  return sensor.edgesSeen + sensorEdges[sensor.id].overflowCount();
+}
+
+void pauseSensorCapture(int i) {
+#if EDGE_CAPTURE == CAPTURE_GPIO_ISR
+  detachInterrupt(digitalPinToInterrupt(SENSOR_PINS[i]));
+#elif EDGE_CAPTURE == CAPTURE_MCPWM
+  stopMcpwmCapture(i);
+#endif
+}
 
-  if (sensor.detecting && (micros() - sensor.lastActivityTime > DETECTION_TIMEOUT)) {
-    // Report unknown car if we had enough pulses but never matched
-    if (sensor.lastCarDetected == 0 && sensor.pulseCount >= MIN_PULSES_FOR_ID) {
-      float freq = calculateMedianFrequency(sensor.intervalHistory);
-      if (freq > 0) {
-        onCarDetected(sensor.id, 0, freq);
-      }
+void resumeSensorCapture(int i) {
+#if EDGE_CAPTURE == CAPTURE_GPIO_ISR
+  attachInterrupt(digitalPinToInterrupt(SENSOR_PINS[i]), isrFunctions[i], FALLING);
+#elif EDGE_CAPTURE == CAPTURE_MCPWM
+  resumeMcpwmCapture(i);
+#endif
+}
+
+// Interrupt storm: stop taking the sensor's edges until healthRearmDue. Whatever pass
+// it had is noise, and so is what is still in its ring.
+void throttleSensor(SensorState& sensor, uint32_t nowMs) {
+  pauseSensorCapture(sensor.id);
+  healthThrottle(sensorHealth[sensor.id], nowMs);
+  sensorEdges[sensor.id].drain();
+  resetSensor(sensor);
+}
+
+void rearmSensor(SensorState& sensor, uint32_t nowMs) {
+  sensorEdges[sensor.id].drain();
+  resetSensor(sensor);
+  healthRearm(sensorHealth[sensor.id], sensorEdgeTotal(sensor), sensor.glitchesSeen, sensor.outOfBandSeen, nowMs);
+  resumeSensorCapture(sensor.id);
+}
+
+HealthInfo healthInfo(const SensorState& sensor, uint32_t nowMs) {
+  const SensorHealth& h = sensorHealth[sensor.id];
+  HealthInfo info;
+  info.sensorId = sensor.id;
+  info.status = h.status;
+  info.edgesPerSec = healthEdgeRate(h);
+  info.glitchesPerSec = healthRate(h.windowGlitches);
+  info.outOfBandPerSec = healthRate(h.windowOutOfBand);
+  info.idleMs = nowMs - h.lastEdgeMs;
+  info.throttles = h.throttles;
+  return info;
+}
+
+// Call wherever processAllSensors runs (loop, or the detection task). Every
+// HEALTH_TICK_MS: slide each sensor's window, throttle a storming sensor or rearm one
+// whose throttle has run out, and report the sensors whose status changed (all of
+// them every HEALTH_REPORT_MS). Returns true on a tick.
+bool monitorSensorHealth(HealthReportCallback onReport) {
+  uint32_t now = millis();
+  uint32_t elapsed = now - healthTickMs;
+  if (elapsed < HEALTH_TICK_MS) return false;
+  healthTickMs = now;
+  bool reportAll = now - healthReportMs >= HEALTH_REPORT_MS;
+  if (reportAll) healthReportMs = now;
+
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    SensorState& sensor = sensors[i];
+    SensorHealth& h = sensorHealth[i];
+    if (h.throttled) {
+      if (healthRearmDue(h, now)) rearmSensor(sensor, now);
+    } else {
+      bool pinLow = digitalRead(sensor.pin) == LOW;
+      uint32_t edges = healthTick(h, sensorEdgeTotal(sensor), sensor.glitchesSeen, sensor.outOfBandSeen, pinLow,
+                                  completedPasses, now);
+      if (healthStorm(edges, elapsed)) throttleSensor(sensor, now);
     }
-    resetSensor(sensor);
+    uint8_t status = healthStatus(h, completedPasses);
+    bool changed = status != h.status;
+    h.status = status;
+    if ((changed || reportAll) && onReport) onReport(healthInfo(sensor, now));
   }
+  return true;
 }
+#endif
 
 // ========== SENSOR INITIALISATION ==========
 
 void initSensors() {
+  sensorDeadlines.clear();
+#if EDGE_TRACE
+  edgeTrace.reset();
+#endif
+  speedTrapEntry.valid = false;
+  pendingSensors.store(0, std::memory_order_relaxed);
+#if CAR_CALIBRATION
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    calibrationReset(sensorCalibration[i]);
+    buildCalibratedLut(sensorCalibration[i], sensorCarLut[i]);
+  }
+  calibrationDirty = false;
+#endif
+  detectingSensors = 0;
+#if SENSOR_HEALTH
+  completedPasses = 0;
+  healthTickMs = millis();
+  healthReportMs = millis();
+#endif
   for (int i = 0; i < NUM_SENSORS; i++) {
     sensors[i].id = i;
     sensors[i].pin = SENSOR_PINS[i];
+    sensorEdges[i].clear();
+    sensorClocks[i].reset();
     sensors[i].lastPulseTime = 0;
-    sensors[i].pulseInterval = 0;
+    sensors[i].hasLastPulse = false;
     sensors[i].pulseCount = 0;
-    sensors[i].newPulseData = false;
-    sensors[i].historyIndex = 0;
+    sensors[i].edgesSeen = 0;
+    sensors[i].glitchesSeen = 0;
+    sensors[i].outOfBandSeen = 0;
+    sensors[i].passStartEdges = 0;
+    sensors[i].passStartGlitches = 0;
+    sensors[i].passStartOutOfBand = 0;
+#if SENSOR_HEALTH
+    healthReset(sensorHealth[i], millis());
+#endif
+#if EDGE_TRACE
+    sensors[i].tracedOverflows = 0;
+#endif
+#if CAR_CLASSIFIER == CLASSIFIER_TONE_BANK
+    sensors[i].edgeCount = 0;
+    sensors[i].scoredEdgeCount = 0;
+#endif
+#if CAR_CLASSIFIER == CLASSIFIER_SPRT
+    sprtClear(sensors[i].sprt);
+#endif
+#if OVERLAP_DETECTION
+    sensors[i].rawEdgeCount = 0;
+    sensors[i].checkedEdgeCount = 0;
+    sensors[i].checkSpacing = OVERLAP_CHECK_EDGES;
+    sensors[i].overlapCandidate = 0;
+    sensors[i].overlapConfirm = 0;
+    sensors[i].secondCar = 0;
+    sensors[i].overlap.count = 0;
+#endif
+    sensors[i].window.clear();
+    sensors[i].firstEdgeTime = 0;
     sensors[i].lastActivityTime = 0;
     sensors[i].detecting = false;
     sensors[i].lastCarDetected = 0;
     sensors[i].candidateCar = 0;
     sensors[i].confirmCount = 0;
-    for (int j = 0; j < HISTORY_SIZE; j++) {
-      sensors[i].intervalHistory[j] = 0;
-    }
+    sensors[i].candidateSince = 0;
 
     pinMode(SENSOR_PINS[i], INPUT_PULLUP);
+#if EDGE_CAPTURE == CAPTURE_GPIO_ISR
     attachInterrupt(digitalPinToInterrupt(SENSOR_PINS[i]), isrFunctions[i], FALLING);
+#endif
+  }
+
+#if EDGE_CAPTURE == CAPTURE_MCPWM
+  startMcpwmCapture(onCapture);
+#endif
+}
+
+// ========== DETECTION TASK ==========
+
+#if DETECTION_TASK && defined(ESP32)
+CarDetectedCallback detectionCallback = nullptr;
+PassCompleteCallback passCallback = nullptr;
+HealthReportCallback healthCallback = nullptr;
+
+// One-shot timer at the earliest sensor deadline; microsecond resolution rather than
+// the 1ms FreeRTOS tick a timed ulTaskNotifyTake would round to
+esp_timer_handle_t deadlineTimer = nullptr;
+bool deadlineTimerArmed = false;
+uint64_t deadlineTimerAt = 0;
+
+void onDeadlineTimer(void* param) {
+  (void)param;
+  xTaskNotifyGive(detectionTaskHandle);
+}
+
+// Point the timer at the earliest deadline; left alone if that hasn't changed
+void armDeadlineTimer() {
+  if (sensorDeadlines.empty()) {
+    if (deadlineTimerArmed) esp_timer_stop(deadlineTimer);
+    deadlineTimerArmed = false;
+    return;
   }
+  uint64_t at = sensorDeadlines.earliest();
+  if (deadlineTimerArmed && at == deadlineTimerAt) return;
+  if (deadlineTimerArmed) esp_timer_stop(deadlineTimer);
+  int64_t remaining = (int64_t)(at - micros64());
+  esp_timer_start_once(deadlineTimer, remaining > 0 ? remaining : 1);
+  deadlineTimerArmed = true;
+  deadlineTimerAt = at;
 }
 
+void detectionTask(void* param) {
+  (void)param;
+  for (;;) {
+#if SENSOR_HEALTH
+    // Woken at least every health tick, so a silent sensor is still watched
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(HEALTH_TICK_MS));
+#else
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+#endif
+    processDeadlines(detectionCallback, passCallback);
+    processAllSensors(detectionCallback);
+#if SENSOR_HEALTH
+    monitorSensorHealth(healthCallback);
+#endif
+    armDeadlineTimer();
+  }
+}
+
+// Call after initSensors(); loop() must not call processSensor (or monitorSensorHealth) as well
+void startDetectionTask(CarDetectedCallback onCarDetected, PassCompleteCallback onPassComplete = nullptr,
+                        HealthReportCallback onHealthReport = nullptr) {
+  detectionCallback = onCarDetected;
+  passCallback = onPassComplete;
+  healthCallback = onHealthReport;
+  esp_timer_create_args_t timerArgs = {};
+  timerArgs.callback = onDeadlineTimer;
+  timerArgs.name = "detect_deadline";
+  esp_timer_create(&timerArgs, &deadlineTimer);
+  xTaskCreatePinnedToCore(detectionTask, "detect", 4096, NULL, DETECTION_TASK_PRIORITY,
+                          &detectionTaskHandle, DETECTION_TASK_CORE);
+}
+#endif
+
 #endif
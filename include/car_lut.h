@@ -0,0 +1,61 @@
+#ifndef CAR_LUT_H
+#define CAR_LUT_H
+
+#include <stdint.h>
+#include "scalextric_protocol.h"
+
+// Interval -> car lookup table
+// One entry per whole microsecond of median interval over MIN_VALID_INTERVAL..
+// MAX_VALID_INTERVAL (301 bytes). Every entry is computed at compile time with the
+// same float arithmetic identifyCar() does at runtime (1e6 / interval, nearest car
+// within FREQUENCY_TOLERANCE_PCT), so classifying a median is one bounds check and
+// one load, with no division or float maths in the loop.
+//
+// Changing CAR_FREQUENCIES or FREQUENCY_TOLERANCE_PCT regenerates the table.
+
+// Frequency in Hz for a median interval, exactly as calculateMedianFrequency computes it
+constexpr float intervalToFrequency(uint32_t intervalUs) {
+  return 1000000.0 / intervalUs;
+}
+
+constexpr float carFrequencyDiff(float frequency, int car) {
+  return frequency > CAR_FREQUENCIES[car] ? frequency - CAR_FREQUENCIES[car]
+                                          : CAR_FREQUENCIES[car] - frequency;
+}
+
+// identifyCar() as a recursive constexpr: best car in [car, 6) or the best so far
+constexpr int closestCar(float frequency, int car, int bestCar, float bestDiff) {
+  return car == 6 ? bestCar
+       : (carFrequencyDiff(frequency, car) < CAR_FREQUENCIES[car] * FREQUENCY_TOLERANCE_PCT &&
+          carFrequencyDiff(frequency, car) < bestDiff)
+           ? closestCar(frequency, car + 1, car + 1, carFrequencyDiff(frequency, car))
+           : closestCar(frequency, car + 1, bestCar, bestDiff);
+}
+
+constexpr uint8_t carForInterval(uint32_t intervalUs) {
+  return closestCar(intervalToFrequency(intervalUs), 0, 0, intervalToFrequency(intervalUs));
+}
+
+const int CAR_LUT_SIZE = MAX_VALID_INTERVAL - MIN_VALID_INTERVAL + 1;
+
+// CarLut<N>::car = {carForInterval(MIN_VALID_INTERVAL + 0), ..., (+ N - 1)}
+template <int N, int... I>
+struct CarLut : CarLut<N - 1, N - 1, I...> {};
+
+template <int... I>
+struct CarLut<0, I...> {
+  static constexpr uint8_t car[sizeof...(I)] = {carForInterval(MIN_VALID_INTERVAL + I)...};
+};
+
+template <int... I>
+constexpr uint8_t CarLut<0, I...>::car[sizeof...(I)];
+
+typedef CarLut<CAR_LUT_SIZE> IntervalCarTable;
+
+// Car 1-6 for a median interval in micros, 0 if out of range or between bands
+inline int identifyCarByInterval(uint32_t intervalUs) {
+  if (intervalUs < MIN_VALID_INTERVAL || intervalUs > MAX_VALID_INTERVAL) return 0;
+  return IntervalCarTable::car[intervalUs - MIN_VALID_INTERVAL];
+}
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef CHANNEL_SCAN_H
+#define CHANNEL_SCAN_H
+
+#include <stdint.h>
+#include <string.h>
+#include "scalextric_protocol.h"
+
+// Finding the parent's channel
+// A child doesn't know which channel its parent is on (a WiFi parent is on its
+// router's), so it probes channels until a parent answers. It used to probe 1-13 in
+// order, 3 rounds, 150 ms on each and an OLED redraw per channel: up to ~7 s blind
+// at every boot and every 30 s while the parent was away. Now:
+// - The child keeps the channel and parent MAC of the last parent it found (NVS), and
+//   tries that channel first: a unicast probe to the parent's MAC, whose ACK comes
+//   back from its radio within a millisecond or two, plus a broadcast probe for any
+//   other parent there.
+// - Then every channel, the ones routers use most first, with a short dwell that
+//   doubles each round: a parent that answers at once is found in the first round,
+//   a busy one (BLE on the same radio) in a later one. The common channels get long
+//   enough for a busy parent in the first round too.
+// - Parents broadcast an unasked probe answer every PROBE_BEACON_MS, so a child on
+//   their channel hears them even if its probes or their answers are lost, and a child
+//   whose parent went away finds it again without a scan by staying on its channel.
+// A probe answer tells its parent's channel, so one heard from a neighbouring channel
+// still finds it.
+
+#ifndef PROBE_BEACON_MS
+#define PROBE_BEACON_MS 100  // Override via build_flags: -DPROBE_BEACON_MS=0 (parents only answer probes)
+#endif
+
+const uint8_t SCAN_CHANNEL_COUNT = 13;
+const uint8_t SCAN_ORDER[SCAN_CHANNEL_COUNT] = {1, 6, 11, 3, 9, 2, 4, 5, 7, 8, 10, 12, 13};  // routers favour 1, 6, 11
+const int SCAN_COMMON_CHANNELS = 3;         // the first SCAN_ORDER entries
+const int SCAN_ROUNDS = 4;
+const uint16_t SCAN_DWELL_MS = 20;         // per channel in the first round, then doubling
+const uint16_t SCAN_COMMON_DWELL_MS = 60;  // at least, on the common ones: a BLE parent's answer (BLE parents use 1)
+const uint16_t SCAN_MAX_DWELL_MS = 160;    // more than a beacon interval
+const uint16_t SCAN_CACHED_DWELL_MS = PROBE_BEACON_MS ? PROBE_BEACON_MS + 20 : 60;  // last parent's channel
+
+// What the child remembers of the last parent it found
+struct __attribute__((packed)) LinkCache {
+  uint8_t channel;  // 0 = none
+  uint8_t parentMac[6];
+};
+
+inline bool linkCacheValid(const LinkCache& cache) {
+  return cache.channel >= 1 && cache.channel <= SCAN_CHANNEL_COUNT;
+}
+
+struct ScanStep {
+  uint8_t channel;
+  uint16_t dwellMs;  // wait for an answer this long before the next step
+  int round;         // -1 = the cached channel
+};
+
+// Step i of a scan: the cached channel (if any) first, then SCAN_ROUNDS rounds over
+// SCAN_ORDER, skipping the cached channel in the first. False once the scan is over.
+bool scanStep(const LinkCache& cache, int i, ScanStep& step) {
+  bool cached = linkCacheValid(cache);
+  if (cached) {
+    if (i == 0) {
+      step.channel = cache.channel;
+      step.dwellMs = SCAN_CACHED_DWELL_MS;
+      step.round = -1;
+      return true;
+    }
+    i--;
+  }
+  for (int round = 0; round < SCAN_ROUNDS; round++) {
+    for (int k = 0; k < SCAN_CHANNEL_COUNT; k++) {
+      if (round == 0 && cached && SCAN_ORDER[k] == cache.channel) continue;
+      if (i-- > 0) continue;
+      uint32_t dwell = (uint32_t)SCAN_DWELL_MS << round;
+      if (k < SCAN_COMMON_CHANNELS && dwell < SCAN_COMMON_DWELL_MS) dwell = SCAN_COMMON_DWELL_MS;
+      step.channel = SCAN_ORDER[k];
+      step.dwellMs = dwell < SCAN_MAX_DWELL_MS ? dwell : SCAN_MAX_DWELL_MS;
+      step.round = round;
+      return true;
+    }
+  }
+  return false;
+}
+
+#ifdef ESP32
+#include <Preferences.h>
+#include <esp_now.h>
+
+const char* const LINK_NVS_NAMESPACE = "sxlink";
+
+bool loadLinkCache(LinkCache& cache) {
+  Preferences prefs;
+  memset(&cache, 0, sizeof(cache));
+  if (!prefs.begin(LINK_NVS_NAMESPACE, true)) return false;
+  size_t n = prefs.getBytes("parent", &cache, sizeof(cache));
+  prefs.end();
+  if (n != sizeof(cache) || !linkCacheValid(cache)) memset(&cache, 0, sizeof(cache));
+  return linkCacheValid(cache);
+}
+
+// Only when it changed (flash wear; an NVS write stalls for milliseconds)
+void saveLinkCache(LinkCache& cache, uint8_t channel, const uint8_t* parentMac) {
+  if (cache.channel == channel && memcmp(cache.parentMac, parentMac, 6) == 0) return;
+  cache.channel = channel;
+  memcpy(cache.parentMac, parentMac, 6);
+  Preferences prefs;
+  if (!prefs.begin(LINK_NVS_NAMESPACE, false)) return;
+  prefs.putBytes("parent", &cache, sizeof(cache));
+  prefs.end();
+}
+
+// ========== PARENT SIDE ==========
+
+const uint8_t PROBE_BEACON_ADDR[] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+// After esp_now_init: beacons go to the broadcast peer
+bool startProbeBeacon() {
+  if (PROBE_BEACON_MS == 0 || esp_now_is_peer_exist(PROBE_BEACON_ADDR)) return true;
+  esp_now_peer_info_t peer = {};
+  memcpy(peer.peer_addr, PROBE_BEACON_ADDR, 6);
+  peer.channel = 0;
+  peer.encrypt = false;
+  return esp_now_add_peer(&peer) == ESP_OK;
+}
+
+// From loop(): the answer to a probe, to every child on our channel, every
+// PROBE_BEACON_MS (nothing if ESP-NOW or startProbeBeacon failed)
+void sendProbeBeacon(uint8_t nodeId, uint8_t channel) {
+  static unsigned long lastBeacon = 0;
+  if (PROBE_BEACON_MS == 0 || millis() - lastBeacon < PROBE_BEACON_MS) return;
+  lastBeacon = millis();
+  if (!esp_now_is_peer_exist(PROBE_BEACON_ADDR)) return;
+  ProbeMsg beacon;
+  beacon.magic = PROBE_RESPONSE_MAGIC;
+  beacon.nodeId = nodeId;
+  beacon.channel = channel;
+  esp_now_send(PROBE_BEACON_ADDR, (uint8_t*)&beacon, sizeof(beacon));
+}
+#endif
+
+#endif
@@ -0,0 +1,205 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scalextric_protocol.h"
+
+// Child clock to parent clock, from two-way exchanges (as NTP does)
+// A child's CarEvent.timestamp is its own millis(), so parents stamp child events as
+// they arrive, radio and queue delay included (a batch window, resends, up to ~55 ms
+// behind BLE on the parent). Instead, every CLOCK_SYNC_INTERVAL_MS the child sends its
+// parent a SyncMsg with its clock (t1); the parent sends it back with its clock as the
+// request arrived (t2) and as it replies (t3), and the child notes when the reply
+// arrives (t4). Then
+//   offset = ((t2 - t1) + (t3 - t4)) / 2   parent minus child, exact if both legs took as long
+//   delay  = (t4 - t1) - (t3 - t2)         time on the air and in the two stacks
+// and the offset is off by at most delay / 2. An exchange that waited for the channel
+// or behind BLE has a long delay and the least trustworthy offset, so of the last
+// CLOCK_SYNC_SAMPLES exchanges only the half with the shorter delays count, and of
+// those none more than CLOCK_SYNC_KEEP_US over the shortest (a MAC retry). A line
+// through their offsets against the child's clock gives the offset now and the drift
+// between the two crystals (each within ~20 ppm: up to 40 us a second), which carries
+// the conversion between exchanges. The line needs the long window: each exchange's
+// offset is off by up to ~300 us (the two legs' channel access differs), so the fit
+// averages many of them. The child then stamps each car event with its parent-clock
+// time (CarEventTimed), and the parent uses that instead of the arrival time.
+
+#ifndef CLOCK_SYNC
+#define CLOCK_SYNC 1  // Override via build_flags: -DCLOCK_SYNC=0 (parents stamp child events on arrival)
+#endif
+
+const uint32_t CLOCK_SYNC_INTERVAL_MS = 1000;      // between exchanges
+const uint32_t CLOCK_SYNC_FAST_MS = 100;           // between exchanges until there are CLOCK_SYNC_MIN_SAMPLES
+const int CLOCK_SYNC_SAMPLES = 64;                 // exchanges the fit looks at
+const int CLOCK_SYNC_MIN_SAMPLES = 4;              // before events carry parent time
+const uint32_t CLOCK_SYNC_KEEP_US = 800;           // delay over the shortest that still counts
+const uint32_t CLOCK_SYNC_MAX_DELAY_US = 20000;    // longer exchanges tell nothing
+const uint32_t CLOCK_SYNC_DRIFT_SPAN_US = 4000000; // kept exchanges this far apart before fitting drift
+const double CLOCK_SYNC_MAX_DRIFT = 200e-6;        // a steeper fit is noise, not crystals
+const uint32_t CLOCK_SYNC_STEP_US = 2000;          // an offset this far off the fit: new parent clock, start over
+const uint32_t CLOCK_SYNC_STALE_MS = 10000;        // without an exchange: stop stamping events
+const uint32_t CLOCK_SYNC_MAX_AGE_US = 1000000;    // parent side: an older (or future) detection time is wrong
+
+struct ClockSample {
+  uint64_t childUs;   // middle of the exchange, child's clock
+  int64_t offsetUs;   // parent minus child
+  uint32_t delayUs;
+};
+
+// parent = child + offsetUs + drift * (child - baseUs)
+struct ClockMap {
+  uint64_t baseUs;
+  int64_t offsetUs;
+  double drift;
+  uint32_t errorUs;   // half the longest delay kept: the worst a kept exchange can be off
+  uint64_t syncedUs;  // child's clock at the last exchange; 0 = not in sync
+};
+
+struct ClockSync {
+  ClockSample samples[CLOCK_SYNC_SAMPLES];  // ring
+  int count;
+  int next;
+  ClockMap map;
+  uint32_t exchanges;  // accepted
+  uint32_t rejected;   // delay out of range
+  uint32_t restarts;   // offset jumped: the parent rebooted, or is another one
+};
+
+void clockSyncInit(ClockSync& s) { memset(&s, 0, sizeof(s)); }
+
+inline uint64_t clockToParent(const ClockMap& m, uint64_t childUs) {
+  return childUs + m.offsetUs + (int64_t)(m.drift * (double)(int64_t)(childUs - m.baseUs));
+}
+
+// In sync and not stale: events may carry parent time
+inline bool clockMapFresh(const ClockMap& m, uint64_t nowUs) {
+  return m.syncedUs != 0 && nowUs - m.syncedUs < (uint64_t)CLOCK_SYNC_STALE_MS * 1000;
+}
+
+// The longest delay a sample may have to count: the median (the upper one of an even
+// count), at most CLOCK_SYNC_KEEP_US over the shortest
+uint32_t clockSyncKeepDelay(const ClockSync& s) {
+  uint32_t delays[CLOCK_SYNC_SAMPLES];
+  for (int i = 0; i < s.count; i++) {
+    uint32_t d = s.samples[i].delayUs;
+    int j = i;
+    for (; j > 0 && delays[j - 1] > d; j--) delays[j] = delays[j - 1];
+    delays[j] = d;
+  }
+  uint32_t median = delays[s.count / 2];
+  return median < delays[0] + CLOCK_SYNC_KEEP_US ? median : delays[0] + CLOCK_SYNC_KEEP_US;
+}
+
+// Least squares through the kept samples, about the newest; drift only once they
+// span CLOCK_SYNC_DRIFT_SPAN_US, else the last drift stands
+void clockSyncFit(ClockSync& s) {
+  uint32_t keep = clockSyncKeepDelay(s);
+  const ClockSample& newest = s.samples[(s.next + CLOCK_SYNC_SAMPLES - 1) % CLOCK_SYNC_SAMPLES];
+  double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0, minX = 0;
+  for (int i = 0; i < s.count; i++) {
+    const ClockSample& c = s.samples[i];
+    if (c.delayUs > keep) continue;
+    double x = (double)(int64_t)(c.childUs - newest.childUs);
+    double y = (double)(c.offsetUs - newest.offsetUs);
+    n++;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+    if (x < minX) minX = x;
+  }
+  double drift = s.map.drift;
+  if (n >= 3 && -minX >= CLOCK_SYNC_DRIFT_SPAN_US) {
+    double fit = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+    if (fit > -CLOCK_SYNC_MAX_DRIFT && fit < CLOCK_SYNC_MAX_DRIFT) drift = fit;
+  }
+  s.map.baseUs = newest.childUs;
+  s.map.offsetUs = newest.offsetUs + (int64_t)((sy - drift * sx) / n);
+  s.map.drift = drift;
+  s.map.errorUs = keep / 2;
+}
+
+// One exchange, t1..t4 as above. False if its delay is out of range.
+bool clockSyncAdd(ClockSync& s, uint64_t t1, uint64_t t2, uint64_t t3, uint64_t t4) {
+  int64_t delay = (int64_t)(t4 - t1) - (int64_t)(t3 - t2);
+  if (t4 < t1 || t3 < t2 || delay < 0 || delay > CLOCK_SYNC_MAX_DELAY_US) {
+    s.rejected++;
+    return false;
+  }
+  ClockSample sample;
+  sample.childUs = t1 + (t4 - t1) / 2;
+  sample.offsetUs = ((int64_t)(t2 - t1) + (int64_t)(t3 - t4)) / 2;
+  sample.delayUs = (uint32_t)delay;
+
+  if (s.count >= CLOCK_SYNC_MIN_SAMPLES) {
+    int64_t predicted = (int64_t)(clockToParent(s.map, sample.childUs) - sample.childUs);
+    if (llabs(sample.offsetUs - predicted) > delay / 2 + CLOCK_SYNC_STEP_US) {
+      s.count = 0;
+      s.next = 0;
+      s.map.drift = 0;
+      s.map.syncedUs = 0;
+      s.restarts++;
+    }
+  }
+  s.samples[s.next] = sample;
+  s.next = (s.next + 1) % CLOCK_SYNC_SAMPLES;
+  if (s.count < CLOCK_SYNC_SAMPLES) s.count++;
+  s.exchanges++;
+  clockSyncFit(s);
+  if (s.count >= CLOCK_SYNC_MIN_SAMPLES) s.map.syncedUs = t4;
+  return true;
+}
+
+inline uint32_t clockSyncIntervalMs(const ClockSync& s) {
+  return s.count < CLOCK_SYNC_MIN_SAMPLES ? CLOCK_SYNC_FAST_MS : CLOCK_SYNC_INTERVAL_MS;
+}
+
+// For CarEventTimed.syncError
+inline uint8_t syncErrorCode(uint32_t errorUs) { return errorUs / 4 > 255 ? 255 : (uint8_t)(errorUs / 4); }
+
+// ========== PARENT SIDE ==========
+
+// The response to a child's request, with our clock as it arrived; set parentTxUs
+// just before sending
+inline void answerClockSync(const uint8_t* request, SyncMsg& response, uint64_t receivedUs) {
+  memcpy(&response, request, sizeof(response));
+  response.magic = SYNC_RESPONSE_MAGIC;
+  response.parentRxUs = receivedUs;
+}
+
+// When a child's car event happened on our clock: the time it sent, if it sent one
+// that makes sense (not ahead of now, not older than CLOCK_SYNC_MAX_AGE_US: a child
+// still on the clock we had before a reboot), else now
+inline uint64_t eventTimeUs(uint64_t detectedUs, uint64_t nowUs) {
+  if (detectedUs == 0 || detectedUs > nowUs || nowUs - detectedUs > CLOCK_SYNC_MAX_AGE_US) return nowUs;
+  return detectedUs;
+}
+
+#ifdef ESP32
+#include <esp_now.h>
+#include <esp_timer.h>
+
+// A parent's whole answer to a child's request (data, len as ESP-NOW received them):
+// adds the child as a peer if it isn't one, and stamps our clock as it arrived and as
+// we send. Returns false if data isn't a sync request.
+inline bool replyClockSync(const uint8_t* mac, const uint8_t* data, int len) {
+  if (len != sizeof(SyncMsg) || data[0] != SYNC_REQUEST_MAGIC) return false;
+  uint64_t receivedUs = esp_timer_get_time();
+  if (!esp_now_is_peer_exist(mac)) {
+    esp_now_peer_info_t peer = {};
+    memcpy(peer.peer_addr, mac, 6);
+    peer.channel = 0;
+    peer.encrypt = false;
+    esp_now_add_peer(&peer);
+  }
+  SyncMsg response;
+  answerClockSync(data, response, receivedUs);
+  response.parentTxUs = esp_timer_get_time();
+  esp_now_send(mac, (uint8_t*)&response, sizeof(response));
+  return true;
+}
+#endif
+
+#endif
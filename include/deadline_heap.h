@@ -0,0 +1,103 @@
+#ifndef DEADLINE_HEAP_H
+#define DEADLINE_HEAP_H
+
+#include <stdint.h>
+
+// Indexed min-heap of deadlines, at most one per id (0..Capacity-1)
+// arm() inserts an id or moves its existing deadline, cancel() removes it, and
+// popExpired() hands back ids whose deadline has passed, earliest first. Each is
+// O(log Capacity) and earliest() is O(1), so checking for timeouts costs one
+// comparison per loop pass no matter how many sensors are active.
+//
+// Deadlines are 64-bit micros64() values, so they never wrap.
+
+template <int Capacity>
+class DeadlineHeap {
+ public:
+  DeadlineHeap() { clear(); }
+
+  void clear() {
+    count = 0;
+    for (int id = 0; id < Capacity; id++) pos[id] = -1;
+  }
+
+  bool armed(int id) const { return pos[id] >= 0; }
+  bool empty() const { return count == 0; }
+  int size() const { return count; }
+
+  // Earliest deadline; only valid when !empty()
+  uint64_t earliest() const { return deadline[heap[0]]; }
+
+  void arm(int id, uint64_t at) {
+    if (pos[id] < 0) {
+      pos[id] = count;
+      heap[count++] = id;
+      deadline[id] = at;
+      siftUp(pos[id]);
+    } else {
+      bool later = before(deadline[id], at);
+      deadline[id] = at;
+      if (later) siftDown(pos[id]);
+      else siftUp(pos[id]);
+    }
+  }
+
+  void cancel(int id) {
+    int i = pos[id];
+    if (i < 0) return;
+    pos[id] = -1;
+    if (--count == i) return;
+    heap[i] = heap[count];
+    pos[heap[i]] = i;
+    siftDown(i);
+    siftUp(i);
+  }
+
+  // Removes and returns (in id) the earliest deadline if it is at or before now
+  bool popExpired(uint64_t now, int& id) {
+    if (count == 0 || before(now, deadline[heap[0]])) return false;
+    id = heap[0];
+    cancel(id);
+    return true;
+  }
+
+ private:
+  uint64_t deadline[Capacity];  // by id
+  int heap[Capacity];           // ids, heap-ordered by deadline
+  int pos[Capacity];            // index of each id in heap, -1 if not armed
+  int count;
+
+  static bool before(uint64_t a, uint64_t b) { return a < b; }
+
+  void swap(int i, int j) {
+    int t = heap[i];
+    heap[i] = heap[j];
+    heap[j] = t;
+    pos[heap[i]] = i;
+    pos[heap[j]] = j;
+  }
+
+  void siftUp(int i) {
+    while (i > 0) {
+      int parent = (i - 1) / 2;
+      if (!before(deadline[heap[i]], deadline[heap[parent]])) break;
+      swap(i, parent);
+      i = parent;
+    }
+  }
+
+  void siftDown(int i) {
+    for (;;) {
+      int smallest = i;
+      int left = 2 * i + 1;
+      int right = left + 1;
+      if (left < count && before(deadline[heap[left]], deadline[heap[smallest]])) smallest = left;
+      if (right < count && before(deadline[heap[right]], deadline[heap[smallest]])) smallest = right;
+      if (smallest == i) break;
+      swap(i, smallest);
+      i = smallest;
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef EDGE_CAPTURE_H
+#define EDGE_CAPTURE_H
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <atomic>
+#include "scalextric_protocol.h"
+#ifdef ESP32
+#include "esp_timer.h"
+#endif
+
+// Edge capture backends
+// Every backend delivers falling-edge times (micros) into the sensor's EdgeRing, and
+// processSensor only ever pops from that ring, so detection cannot tell them apart:
+//
+//   CAPTURE_GPIO_ISR  attachInterrupt per pin; onPulse timestamps with micros()
+//   CAPTURE_MCPWM     the MCPWM capture channels latch the 80 MHz APB timer on each
+//                     falling edge in hardware; onCapture converts the latched ticks
+//                     to micros (CaptureClock), so edge times carry no ISR latency
+//                     (the ISR reads the clock only to notice a long idle gap)
+//
+// MCPWM improves timestamp accuracy only: each capture still raises its own interrupt,
+// so the interrupt rate (one per edge, up to 5.5k/s per sensor under a car) is unchanged.
+// The capture unit latches one value per channel, so a late ISR can't collect several
+// edges at once; the handler is shorter (no GPIO dispatch, no micros()), not rarer.
+//
+// The ESP32 has 2 MCPWM units x 3 capture channels, so up to 6 sensors.
+// RMT receive was considered, but on the original ESP32 it only hands over a buffer
+// once the line has been idle (i.e. after the car has gone) and has no wrap mode,
+// so a slow pass overflows the channel memory.
+//
+// Host builds call onPulse / onCapture directly with simulated edges and ticks.
+
+#define CAPTURE_GPIO_ISR 0
+#define CAPTURE_MCPWM    1
+
+#ifndef EDGE_CAPTURE
+#define EDGE_CAPTURE CAPTURE_GPIO_ISR  // Override via build_flags: -DEDGE_CAPTURE=1
+#endif
+
+const uint32_t CAPTURE_TICKS_PER_US = 80;                         // APB clock
+const uint64_t CAPTURE_MAX_GAP_US = 1000000;                      // re-anchor after 1s idle
+
+// Converts latched capture ticks into the micros() time base.
+// Anchors to micros() on the first edge (and after a long gap or requestAnchor()),
+// then advances by tick deltas carrying the sub-microsecond remainder, so intervals
+// are exact to 1us regardless of how late the capture ISR runs.
+// The 32-bit tick counter wraps every ~53.7s, so a tick delta can't tell a short gap
+// from one a whole number of wraps longer. The idle gap is measured on the 64-bit
+// esp_timer instead, which also catches a stray edge long after the last one (the loop
+// only re-anchors at the end of a pass, and a lone edge never starts one).
+struct CaptureClock {
+  uint32_t lastTicks;
+  uint32_t lastMicros;
+  uint32_t remainder;              // ticks not yet counted as a whole microsecond
+  uint64_t lastIsrUs;              // esp_timer time of the last edge's ISR
+  std::atomic<bool> anchored;      // cleared by the loop, set by the ISR
+
+  void reset() {
+    lastTicks = 0;
+    lastMicros = 0;
+    remainder = 0;
+    lastIsrUs = 0;
+    anchored.store(false, std::memory_order_relaxed);
+  }
+
+  // Loop side: the next edge starts a new pass
+  void requestAnchor() { anchored.store(false, std::memory_order_release); }
+
+  // ISR side
+  uint32_t IRAM_ATTR toMicros(uint32_t ticks) {
+    uint64_t now = (uint64_t)esp_timer_get_time();
+    if (!anchored.load(std::memory_order_acquire) || now - lastIsrUs > CAPTURE_MAX_GAP_US) {
+      lastMicros = micros();
+      remainder = 0;
+      anchored.store(true, std::memory_order_relaxed);
+    } else {
+      uint32_t total = (ticks - lastTicks) + remainder;
+      lastMicros += total / CAPTURE_TICKS_PER_US;
+      remainder = total % CAPTURE_TICKS_PER_US;
+    }
+    lastTicks = ticks;
+    lastIsrUs = now;
+    return lastMicros;
+  }
+};
+
+#if EDGE_CAPTURE == CAPTURE_MCPWM
+#include "driver/mcpwm.h"
+
+static_assert(NUM_SENSORS <= 6, "MCPWM has 6 capture channels");
+
+typedef void (*CaptureHandler)(int sensor, uint32_t ticks);
+
+struct CaptureSlot {
+  mcpwm_unit_t unit;
+  mcpwm_io_signals_t signal;
+  mcpwm_capture_channel_id_t channel;
+};
+
+const CaptureSlot CAPTURE_SLOTS[6] = {
+  {MCPWM_UNIT_0, MCPWM_CAP_0, MCPWM_SELECT_CAP0},
+  {MCPWM_UNIT_0, MCPWM_CAP_1, MCPWM_SELECT_CAP1},
+  {MCPWM_UNIT_0, MCPWM_CAP_2, MCPWM_SELECT_CAP2},
+  {MCPWM_UNIT_1, MCPWM_CAP_0, MCPWM_SELECT_CAP0},
+  {MCPWM_UNIT_1, MCPWM_CAP_1, MCPWM_SELECT_CAP1},
+  {MCPWM_UNIT_1, MCPWM_CAP_2, MCPWM_SELECT_CAP2},
+};
+
+static CaptureHandler captureHandler = nullptr;
+
+static bool IRAM_ATTR onMcpwmCapture(mcpwm_unit_t unit, mcpwm_capture_channel_id_t channel,
+                                     const cap_event_data_t* edata, void* userData) {
+  (void)unit;
+  (void)channel;
+  captureHandler((int)(intptr_t)userData, edata->cap_value);
+  return false;  // no task woken
+}
+
+// Capture falling edges on sensor i's channel again (after stopMcpwmCapture)
+void resumeMcpwmCapture(int i) {
+  const CaptureSlot& slot = CAPTURE_SLOTS[i];
+  mcpwm_capture_config_t config = {};
+  config.cap_edge = MCPWM_NEG_EDGE;
+  config.cap_prescale = 1;
+  config.capture_cb = onMcpwmCapture;
+  config.user_data = (void*)(intptr_t)i;
+  mcpwm_capture_enable_channel(slot.unit, slot.channel, &config);
+}
+
+// No more capture interrupts from sensor i (sensor health throttling)
+void stopMcpwmCapture(int i) {
+  const CaptureSlot& slot = CAPTURE_SLOTS[i];
+  mcpwm_capture_disable_channel(slot.unit, slot.channel);
+}
+
+// Route each SENSOR_PINS[i] to a capture channel; handler(i, ticks) runs per falling edge
+void startMcpwmCapture(CaptureHandler handler) {
+  captureHandler = handler;
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    const CaptureSlot& slot = CAPTURE_SLOTS[i];
+    mcpwm_gpio_init(slot.unit, slot.signal, SENSOR_PINS[i]);
+    resumeMcpwmCapture(i);
+  }
+}
+#endif
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef EDGE_RING_H
+#define EDGE_RING_H
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <atomic>
+
+// Single-producer / single-consumer ring of edge timestamps
+// The ISR is the only writer of head and the loop the only writer of tail, so
+// neither side needs to mask interrupts: a slot is published by the release store
+// of head after it is written, and handed back by the release store of tail after
+// it is read. Indices are free-running 32-bit counters; Capacity must be a power
+// of two so (head - tail) and (index & MASK) stay correct across wraparound.
+//
+// When the ring is full the new edge is dropped and overflowCount() is bumped,
+// so lost edges are visible rather than silently overwriting unread ones.
+
+template <int Capacity>
+class EdgeRing {
+ public:
+  static const uint32_t MASK = Capacity - 1;
+
+  EdgeRing() { clear(); }
+
+  // Only call while the producer is stopped (before attachInterrupt)
+  void clear() {
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+    overflows.store(0, std::memory_order_relaxed);
+  }
+
+  // Producer (ISR) side
+  bool IRAM_ATTR push(uint32_t value) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= (uint32_t)Capacity) {
+      overflows.store(overflows.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return false;
+    }
+    slots[h & MASK] = value;
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer (loop) side
+  bool pop(uint32_t& value) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) return false;
+    value = slots[t & MASK];
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Discard everything published so far (consumer side, ISR may keep pushing)
+  void drain() {
+    tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+  }
+
+  uint32_t size() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed);
+  }
+
+  // Edges dropped because the ring was full (written by the producer only)
+  uint32_t overflowCount() const { return overflows.load(std::memory_order_relaxed); }
+
+ private:
+  uint32_t slots[Capacity];
+  std::atomic<uint32_t> head;       // next slot to write (producer)
+  std::atomic<uint32_t> tail;       // next slot to read (consumer)
+  std::atomic<uint32_t> overflows;
+
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+};
+
+#endif
@@ -0,0 +1,272 @@
+#ifndef EDGE_TRACE_H
+#define EDGE_TRACE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+// Raw edge trace: compact binary record of what each sensor saw
+// Built with -DEDGE_TRACE=1, the detector logs every edge it pops from a ring
+// (before the glitch filter), every car it reports and every edge the ring dropped.
+// scalextric_trace_logger streams the trace over USB serial, and the host replayer
+// (src/native/scalextric_trace_replay.cpp) feeds it back through processSensor.
+//
+// Records are varint(zigzag(delta) << 4 | tag), where delta is the time in micros
+// since the previous record (any sensor, so it may be slightly negative when loop()
+// drains sensors one after another):
+//   tag 0..13   edge on that sensor                         ~2 bytes per edge
+//   tag 14      detection: + sensor byte, car byte (0 = unknown)
+//   tag 15      lost edges: + sensor byte, varint count (edge ring overflows)
+//
+// Records are packed into self-contained frames so a reader can start anywhere in
+// a serial stream (boot messages, dropped bytes) and lose at most one frame:
+//   'S' 'X' len payload[len] crc16(payload)
+//   payload = uint64 base time (LE) + records, the first delta relative to base
+// Frames are closed when full and at the end of each pass.
+
+const uint8_t TRACE_MAGIC_0 = 'S';
+const uint8_t TRACE_MAGIC_1 = 'X';
+const int TRACE_MAX_PAYLOAD = 240;
+const int TRACE_FRAME_OVERHEAD = 5;  // magic, len, crc
+const int TRACE_MAX_SENSORS = 14;
+const uint8_t TRACE_TAG_DETECTION = 14;
+const uint8_t TRACE_TAG_LOST = 15;
+
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE 16384  // Override via build_flags: -DTRACE_BUFFER_SIZE=... (power of two)
+#endif
+
+enum TraceRecordType { TRACE_EDGE, TRACE_DETECTION, TRACE_LOST };
+
+struct TraceRecord {
+  TraceRecordType type;
+  uint8_t sensor;
+  uint64_t timeUs;
+  uint32_t value;  // TRACE_DETECTION: car, TRACE_LOST: edges lost
+};
+
+// CRC-16/CCITT-FALSE
+inline uint16_t traceCrc16(const uint8_t* data, int len) {
+  uint16_t crc = 0xFFFF;
+  for (int i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int b = 0; b < 8; b++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+// ========== BYTE FIFO ==========
+
+// Finished frames, single producer (detector) / single consumer (whatever drains it
+// to serial), same scheme as EdgeRing. A frame that doesn't fit is dropped whole.
+template <int Capacity>
+class TraceBuffer {
+ public:
+  TraceBuffer() { clear(); }
+
+  void clear() {
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+    droppedFrames = 0;
+  }
+
+  bool push(const uint8_t* data, int len) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (Capacity - (h - tail.load(std::memory_order_acquire)) < (uint32_t)len) {
+      droppedFrames++;
+      return false;
+    }
+    for (int i = 0; i < len; i++) bytes[(h + i) & MASK] = data[i];
+    head.store(h + len, std::memory_order_release);
+    return true;
+  }
+
+  // Copies up to max bytes out, returns how many
+  int pop(uint8_t* out, int max) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t available = head.load(std::memory_order_acquire) - t;
+    int n = available < (uint32_t)max ? (int)available : max;
+    for (int i = 0; i < n; i++) out[i] = bytes[(t + i) & MASK];
+    tail.store(t + n, std::memory_order_release);
+    return n;
+  }
+
+  uint32_t size() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed);
+  }
+
+  uint32_t droppedFrames;  // written by the producer only
+
+ private:
+  static const uint32_t MASK = Capacity - 1;
+  uint8_t bytes[Capacity];
+  std::atomic<uint32_t> head;
+  std::atomic<uint32_t> tail;
+
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+};
+
+// ========== WRITER ==========
+
+class TraceWriter {
+ public:
+  TraceWriter() { reset(); }
+
+  void reset() {
+    len = 0;
+    buffer.clear();
+  }
+
+  void edge(uint8_t sensor, uint64_t timeUs) {
+    reserve(timeUs, 10);
+    record(sensor, timeUs);
+  }
+
+  void detection(uint8_t sensor, int car, uint64_t timeUs) {
+    reserve(timeUs, 12);
+    record(TRACE_TAG_DETECTION, timeUs);
+    payload[len++] = sensor;
+    payload[len++] = (uint8_t)car;
+  }
+
+  void lost(uint8_t sensor, uint32_t count, uint64_t timeUs) {
+    reserve(timeUs, 16);
+    record(TRACE_TAG_LOST, timeUs);
+    payload[len++] = sensor;
+    varint(count);
+  }
+
+  // Close the current frame and queue it
+  void flush() {
+    if (len <= 8) return;
+    uint8_t frame[TRACE_MAX_PAYLOAD + TRACE_FRAME_OVERHEAD];
+    frame[0] = TRACE_MAGIC_0;
+    frame[1] = TRACE_MAGIC_1;
+    frame[2] = (uint8_t)len;
+    memcpy(frame + 3, payload, len);
+    uint16_t crc = traceCrc16(payload, len);
+    frame[3 + len] = crc & 0xFF;
+    frame[4 + len] = crc >> 8;
+    buffer.push(frame, len + TRACE_FRAME_OVERHEAD);
+    len = 0;
+  }
+
+  TraceBuffer<TRACE_BUFFER_SIZE> buffer;
+
+ private:
+  uint8_t payload[TRACE_MAX_PAYLOAD];
+  int len;            // 0 = no frame open
+  uint64_t lastUs;    // time of the previous record in this frame
+
+  // Room for one record of up to bytes, opening a frame at timeUs if needed
+  void reserve(uint64_t timeUs, int bytes) {
+    if (len > 0 && len + bytes > TRACE_MAX_PAYLOAD) flush();
+    if (len == 0) {
+      for (int i = 0; i < 8; i++) payload[i] = (uint8_t)(timeUs >> (8 * i));
+      len = 8;
+      lastUs = timeUs;
+    }
+  }
+
+  void record(uint8_t tag, uint64_t timeUs) {
+    int64_t delta = (int64_t)(timeUs - lastUs);
+    uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+    varint((zigzag << 4) | tag);
+    lastUs = timeUs;
+  }
+
+  void varint(uint64_t value) {
+    while (value >= 0x80) {
+      payload[len++] = (uint8_t)(value | 0x80);
+      value >>= 7;
+    }
+    payload[len++] = (uint8_t)value;
+  }
+};
+
+// ========== READER ==========
+
+typedef void (*TraceRecordCallback)(const TraceRecord& record);
+
+struct TraceStats {
+  uint32_t frames;     // frames with a good CRC
+  uint32_t badFrames;  // magic and length found but CRC or contents wrong
+  uint32_t skippedBytes;
+};
+
+// Decodes one frame payload; false if it doesn't parse to the end exactly
+inline bool decodeTracePayload(const uint8_t* p, int len, TraceRecordCallback onRecord) {
+  if (len < 8) return false;
+  uint64_t t = 0;
+  for (int i = 0; i < 8; i++) t |= (uint64_t)p[i] << (8 * i);
+  int i = 8;
+  while (i < len) {
+    uint64_t v = 0;
+    int shift = 0;
+    do {
+      if (i >= len || shift > 63) return false;
+      v |= (uint64_t)(p[i] & 0x7F) << shift;
+      shift += 7;
+    } while (p[i++] & 0x80);
+
+    uint8_t tag = v & 0x0F;
+    uint64_t zigzag = v >> 4;
+    t += (uint64_t)((int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1));
+    TraceRecord r = {TRACE_EDGE, tag, t, 0};
+    if (tag == TRACE_TAG_DETECTION) {
+      if (i + 2 > len) return false;
+      r.type = TRACE_DETECTION;
+      r.sensor = p[i++];
+      r.value = p[i++];
+    } else if (tag == TRACE_TAG_LOST) {
+      if (i + 2 > len) return false;
+      r.type = TRACE_LOST;
+      r.sensor = p[i++];
+      uint32_t count = 0;
+      shift = 0;
+      do {
+        if (i >= len || shift > 28) return false;
+        count |= (uint32_t)(p[i] & 0x7F) << shift;
+        shift += 7;
+      } while (p[i++] & 0x80);
+      r.value = count;
+    }
+    if (onRecord) onRecord(r);
+  }
+  return true;
+}
+
+// Scans a byte stream for frames and decodes every one with a good CRC.
+// Anything between frames (text, garbage, partial frames) is skipped.
+inline TraceStats decodeTrace(const uint8_t* data, size_t size, TraceRecordCallback onRecord) {
+  TraceStats stats = {0, 0, 0};
+  size_t i = 0;
+  while (i + TRACE_FRAME_OVERHEAD <= size) {
+    if (data[i] != TRACE_MAGIC_0 || data[i + 1] != TRACE_MAGIC_1) {
+      i++;
+      stats.skippedBytes++;
+      continue;
+    }
+    int len = data[i + 2];
+    if (len < 8 || len > TRACE_MAX_PAYLOAD || i + TRACE_FRAME_OVERHEAD + len > size) {
+      i++;
+      stats.skippedBytes++;
+      continue;
+    }
+    const uint8_t* payload = data + i + 3;
+    uint16_t crc = payload[len] | (payload[len + 1] << 8);
+    // Validate before emitting anything, so a bad frame contributes no records
+    if (crc != traceCrc16(payload, len) || !decodeTracePayload(payload, len, nullptr)) {
+      stats.badFrames++;
+      i++;
+      continue;
+    }
+    decodeTracePayload(payload, len, onRecord);
+    stats.frames++;
+    i += TRACE_FRAME_OVERHEAD + len;
+  }
+  stats.skippedBytes += size - i;
+  return stats;
+}
+
+#endif
@@ -0,0 +1,180 @@
+#ifndef ESPNOW_BATCH_H
+#define ESPNOW_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "scalextric_protocol.h"
+
+// Batched ESP-NOW frames
+// Every esp_now_send is a whole 802.11 action frame: at ESP-NOW's 1 Mbps the preamble,
+// MAC header and vendor element take ~0.54 ms of airtime before the first payload
+// byte (an 18-byte car event adds 0.14 ms), and each frame contends for the channel
+// on its own. A child instead collects its messages for ESPNOW_BATCH_US after the
+// first one, or until the next would pass ESPNOW_MAX_PAYLOAD, and sends them as one
+// frame: a BatchHeader, then each message with its length in front.
+// Receivers hand each message of a batch to their usual handler (unpackBatch), and
+// track each child's batch sequence for gaps and repeats (BatchTracker; repeats come
+// from espnow_reliable.h resending a batch whose ACK was lost).
+
+// ESPNOW_BATCH_US=0: one frame per message, as before. Receivers accept both, so this
+// only needs to be 0 for children of a receiver older than it.
+#ifndef ESPNOW_BATCH_US
+#define ESPNOW_BATCH_US 3000  // Override via build_flags: -DESPNOW_BATCH_US=0
+#endif
+
+const uint16_t BATCH_MAX_GAP = 1000;  // a bigger jump is a rebooted child, not loss
+const int BATCH_WINDOW = 64;          // batch sequence numbers a receiver remembers per child
+
+// The messages a batch may carry, by length (as receivers already tell them apart)
+inline bool batchMessageLength(int len) {
+  return len == sizeof(CarEvent) || len == sizeof(CarEventWithQuality) || len == sizeof(CarEventTimed) ||
+         len == sizeof(PassEvent) || len == sizeof(HealthEvent);
+}
+
+// ========== SENDING ==========
+
+struct EspNowBatch {
+  uint8_t frame[ESPNOW_MAX_PAYLOAD];
+  int length;        // bytes so far, header included; 0 = nothing queued
+  uint16_t nextSeq;
+  uint8_t nodeId;
+  uint64_t dueUs;    // first message + the window
+};
+
+void batchInit(EspNowBatch& b, uint8_t nodeId, uint16_t firstSeq = 0) {
+  b.length = 0;
+  b.nextSeq = firstSeq;
+  b.nodeId = nodeId;
+  b.dueUs = 0;
+}
+
+inline bool batchFits(const EspNowBatch& b, int len) {
+  return (b.length ? b.length : (int)sizeof(BatchHeader)) + 1 + len <= ESPNOW_MAX_PAYLOAD;
+}
+
+// Append a message; the caller takes the frame first if it doesn't fit
+void batchAdd(EspNowBatch& b, const void* msg, int len, uint64_t nowUs, uint32_t windowUs) {
+  if (b.length == 0) {
+    BatchHeader header = {BATCH_MAGIC, b.nodeId, b.nextSeq, 0};
+    memcpy(b.frame, &header, sizeof(header));
+    b.length = sizeof(header);
+    b.dueUs = nowUs + windowUs;
+  }
+  b.frame[b.length] = (uint8_t)len;
+  memcpy(b.frame + b.length + 1, msg, len);
+  b.length += 1 + len;
+  b.frame[offsetof(BatchHeader, count)]++;
+}
+
+inline bool batchDue(const EspNowBatch& b, uint64_t nowUs) { return b.length > 0 && nowUs >= b.dueUs; }
+
+// Move the frame out (to send outside any lock) and start the next one. Returns its
+// length, 0 if nothing was queued.
+int batchTake(EspNowBatch& b, uint8_t* out) {
+  int n = b.length;
+  if (n == 0) return 0;
+  memcpy(out, b.frame, n);
+  b.length = 0;
+  b.nextSeq++;
+  return n;
+}
+
+// ========== RECEIVING ==========
+
+// Batches received, missed and repeated, over all children
+struct BatchTracker {
+  uint16_t highest[256];  // per node, newest batch sequence
+  uint64_t window[256];   // bit i: batch highest - i arrived
+  uint8_t depth[256];     // bits of window that count (since the node's sequence started)
+  uint8_t seen[32];       // bit per node: its sequence has started
+  uint32_t received;
+  uint32_t lost;          // gaps, less the batches that came late to fill them
+  uint32_t duplicates;    // resent batches that had arrived, dropped
+  uint32_t reported;      // lost + duplicates at the last batchLossReportDue
+  uint32_t reportedAtMs;
+};
+
+// False for a batch that already arrived (resent because its ACK was lost). A gap
+// counts as lost when the batch after it arrives, until a late batch fills it. A jump
+// back past the window or far ahead restarts the node's sequence: the child rebooted
+// (children start theirs at random, so a reboot rarely lands in the window).
+bool batchTrack(BatchTracker& t, uint8_t nodeId, uint16_t seq) {
+  uint8_t bit = 1 << (nodeId & 7);
+  bool started = t.seen[nodeId >> 3] & bit;
+  int16_t ahead = (int16_t)(seq - t.highest[nodeId]);
+  if (started && ahead > 0 && ahead < BATCH_MAX_GAP) {
+    t.lost += ahead - 1;
+    t.window[nodeId] = ahead < BATCH_WINDOW ? t.window[nodeId] << ahead | 1 : 1;
+    int depth = t.depth[nodeId] + ahead;
+    t.depth[nodeId] = depth < BATCH_WINDOW - 1 ? depth : BATCH_WINDOW - 1;
+    t.highest[nodeId] = seq;
+  } else if (started && ahead <= 0 && -ahead <= t.depth[nodeId]) {
+    uint64_t mask = 1ULL << -ahead;
+    if (t.window[nodeId] & mask) {
+      t.duplicates++;
+      return false;
+    }
+    t.window[nodeId] |= mask;
+    t.lost--;
+  } else if (!started || ahead > 0 || -ahead >= BATCH_WINDOW) {
+    t.highest[nodeId] = seq;
+    t.window[nodeId] = 1;
+    t.depth[nodeId] = 0;
+    t.seen[nodeId >> 3] |= bit;
+  }
+  // else from before the window started: deliver, nothing to track
+  t.received++;
+  return true;
+}
+
+// At most every reportMs, and only once more have been lost or repeated
+inline bool batchLossReportDue(BatchTracker& t, uint32_t nowMs, uint32_t reportMs = 10000) {
+  if (t.lost + t.duplicates == t.reported || nowMs - t.reportedAtMs < reportMs) return false;
+  t.reported = t.lost + t.duplicates;
+  t.reportedAtMs = nowMs;
+  return true;
+}
+
+#ifdef ESP32
+#include <Arduino.h>
+
+// Gaps in the children's batch sequences (frames lost on the air), and resent batches
+// that had already arrived, on the serial log when batchLossReportDue
+inline void logBatchLoss(BatchTracker& t) {
+  if (!batchLossReportDue(t, millis())) return;
+  Serial.printf("# ESP-NOW: %lu of %lu batches lost, %lu repeats dropped\n", (unsigned long)t.lost,
+                (unsigned long)(t.received + t.lost), (unsigned long)t.duplicates);
+}
+#endif
+
+typedef void (*EspNowReceiveCallback)(const uint8_t* mac, const uint8_t* data, int len);
+
+// A batch frame: check it is well formed (every message a known length, filling the
+// frame exactly), count it, then hand each message to onMessage as if it had come in
+// a frame of its own, unless the batch is a repeat. Returns false if it isn't a batch.
+// The first byte tells a batch from a single message (BATCH_MAGIC, which no single
+// message starts with), not the length: nothing keeps a batch's length from matching
+// some message's.
+bool unpackBatch(const uint8_t* mac, const uint8_t* data, int len, BatchTracker& tracker,
+                 EspNowReceiveCallback onMessage) {
+  if (len < (int)sizeof(BatchHeader) || data[0] != BATCH_MAGIC) return false;
+  BatchHeader header;
+  memcpy(&header, data, sizeof(header));
+  int pos = sizeof(header);
+  for (int i = 0; i < header.count; i++) {
+    if (pos >= len || !batchMessageLength(data[pos]) || pos + 1 + data[pos] > len) return false;
+    pos += 1 + data[pos];
+  }
+  if (pos != len) return false;
+
+  if (!batchTrack(tracker, header.nodeId, header.batchSeq)) return true;
+  pos = sizeof(header);
+  for (int i = 0; i < header.count; i++) {
+    onMessage(mac, data + pos + 1, data[pos]);
+    pos += 1 + data[pos];
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef ESPNOW_RELIABLE_H
+#define ESPNOW_RELIABLE_H
+
+#include <stdint.h>
+#include <string.h>
+#include "espnow_batch.h"
+
+// Reliable batch delivery from a child to its parent
+// Broadcast ESP-NOW frames are never acknowledged or retried, so a frame lost on the
+// air is a lost pass. Once a child knows its parent's MAC (from the probe response)
+// it sends its batches to that MAC instead: unicast frames are acknowledged by the
+// parent's radio and retried by the MAC, and esp_now_send's callback says whether the
+// ACK came. On top of that the ReliableSender resends a frame whose callback failed,
+// up to RELIABLE_MAX_SENDS times RELIABLE_RETRY_US apart (doubling), which carries
+// it over interference longer than the MAC's own retries. At most RELIABLE_WINDOW
+// frames are handed to ESP-NOW at once; the callbacks come back in send order, so
+// each settles the oldest of them.
+// The batch sequence number (BatchHeader) is the per-child sequence number: a
+// resend keeps it, and the receiver's BatchTracker drops the copy when the first
+// one had arrived and only its ACK was lost.
+
+#ifndef ESPNOW_RELIABLE
+#define ESPNOW_RELIABLE 1  // Override via build_flags: -DESPNOW_RELIABLE=0 (broadcast only)
+#endif
+
+const int RELIABLE_QUEUE = 8;              // frames queued or in flight
+const int RELIABLE_WINDOW = 2;             // handed to ESP-NOW, awaiting their callback
+const int RELIABLE_MAX_SENDS = 4;          // esp_now_send calls per frame, each with the MAC's retries
+const uint32_t RELIABLE_RETRY_US = 4000;   // before the first resend, then doubling
+const int RELIABLE_LINK_LOST_FRAMES = 3;   // dropped in a row: the parent is gone
+
+enum ReliableState : uint8_t { RELIABLE_FREE, RELIABLE_WAITING, RELIABLE_IN_FLIGHT };
+
+struct ReliableFrame {
+  uint8_t data[ESPNOW_MAX_PAYLOAD];
+  int length;
+  ReliableState state;
+  uint8_t sends;        // so far
+  uint32_t order;       // queue order; resends go before newer frames
+  uint64_t queuedUs;
+  uint64_t notBeforeUs;
+};
+
+struct ReliableStats {
+  uint32_t queued;       // frames
+  uint32_t delivered;    // acknowledged
+  uint32_t resent;       // frames that needed more than one send
+  uint32_t sends;        // esp_now_send calls
+  uint32_t dropped;      // out of sends, or pushed out of a full queue
+  uint64_t latencyTotalUs;  // queued to acknowledged, over the delivered frames
+  uint32_t latencyMaxUs;
+};
+
+struct ReliableSender {
+  ReliableFrame frames[RELIABLE_QUEUE];
+  int inFlight[RELIABLE_WINDOW];  // slots, oldest first
+  int inFlightCount;
+  uint32_t nextOrder;
+  int maxSends;
+  int droppedInRow;     // frames dropped since the last ACK
+  ReliableStats stats;
+};
+
+void reliableInit(ReliableSender& s, int maxSends = RELIABLE_MAX_SENDS) {
+  memset(&s, 0, sizeof(s));
+  s.maxSends = maxSends;
+}
+
+void reliableDrop(ReliableSender& s, ReliableFrame& f) {
+  f.state = RELIABLE_FREE;
+  s.stats.dropped++;
+  s.droppedInRow++;
+}
+
+// Queue a finished batch. A full queue drops its oldest frame not yet in flight.
+void reliableQueue(ReliableSender& s, const uint8_t* frame, int len, uint64_t nowUs) {
+  int slot = -1, oldest = -1;
+  for (int i = 0; i < RELIABLE_QUEUE; i++) {
+    if (s.frames[i].state == RELIABLE_FREE) {
+      slot = i;
+      break;
+    }
+    if (s.frames[i].state == RELIABLE_WAITING && (oldest < 0 || s.frames[i].order < s.frames[oldest].order)) {
+      oldest = i;
+    }
+  }
+  if (slot < 0) {
+    slot = oldest;
+    reliableDrop(s, s.frames[slot]);
+  }
+  ReliableFrame& f = s.frames[slot];
+  memcpy(f.data, frame, len);
+  f.length = len;
+  f.state = RELIABLE_WAITING;
+  f.sends = 0;
+  f.order = s.nextOrder++;
+  f.queuedUs = nowUs;
+  f.notBeforeUs = nowUs;
+  s.stats.queued++;
+}
+
+// The next frame to hand to esp_now_send, if the window has room: copied to out and
+// counted in flight. Returns its length, 0 if none.
+int reliableNext(ReliableSender& s, uint64_t nowUs, uint8_t* out) {
+  if (s.inFlightCount == RELIABLE_WINDOW) return 0;
+  int next = -1;
+  for (int i = 0; i < RELIABLE_QUEUE; i++) {
+    const ReliableFrame& f = s.frames[i];
+    if (f.state == RELIABLE_WAITING && nowUs >= f.notBeforeUs && (next < 0 || f.order < s.frames[next].order)) {
+      next = i;
+    }
+  }
+  if (next < 0) return 0;
+  ReliableFrame& f = s.frames[next];
+  f.state = RELIABLE_IN_FLIGHT;
+  if (f.sends++ == 1) s.stats.resent++;
+  s.stats.sends++;
+  s.inFlight[s.inFlightCount++] = next;
+  memcpy(out, f.data, f.length);
+  return f.length;
+}
+
+// Not acknowledged: wait and resend, or drop once out of sends
+void reliableRetry(ReliableSender& s, ReliableFrame& f, uint64_t nowUs) {
+  if (f.sends >= s.maxSends) {
+    reliableDrop(s, f);
+    return;
+  }
+  f.state = RELIABLE_WAITING;
+  f.notBeforeUs = nowUs + ((uint64_t)RELIABLE_RETRY_US << (f.sends - 1));
+}
+
+// esp_now_send's callback: settles the oldest frame in flight
+void reliableSent(ReliableSender& s, bool acked, uint64_t nowUs) {
+  if (s.inFlightCount == 0) return;
+  ReliableFrame& f = s.frames[s.inFlight[0]];
+  s.inFlightCount--;
+  memmove(s.inFlight, s.inFlight + 1, s.inFlightCount * sizeof(s.inFlight[0]));
+  if (!acked) {
+    reliableRetry(s, f, nowUs);
+    return;
+  }
+  uint32_t latency = (uint32_t)(nowUs - f.queuedUs);
+  s.stats.delivered++;
+  s.stats.latencyTotalUs += latency;
+  if (latency > s.stats.latencyMaxUs) s.stats.latencyMaxUs = latency;
+  s.droppedInRow = 0;
+  f.state = RELIABLE_FREE;
+}
+
+// esp_now_send refused the frame reliableNext just gave out: no callback will come
+void reliableSendFailed(ReliableSender& s, uint64_t nowUs) {
+  if (s.inFlightCount == 0) return;
+  reliableRetry(s, s.frames[s.inFlight[--s.inFlightCount]], nowUs);
+}
+
+// Give up on everything queued (the parent is gone); frames still in flight settle
+// through their callbacks
+void reliableClear(ReliableSender& s) {
+  for (int i = 0; i < RELIABLE_QUEUE; i++) {
+    if (s.frames[i].state == RELIABLE_WAITING) reliableDrop(s, s.frames[i]);
+  }
+}
+
+inline bool reliableLinkLost(const ReliableSender& s) { return s.droppedInRow >= RELIABLE_LINK_LOST_FRAMES; }
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef OVERLAP_DETECTOR_H
+#define OVERLAP_DETECTOR_H
+
+#include <stdint.h>
+#include "scalextric_protocol.h"
+
+// Two cars over one sensor
+// When a second car arrives within DETECTION_TIMEOUT of the first (bunched cars at a
+// pit entry, side by side in a lane-change zone), the sensor sees two interleaved
+// pulse trains. Consecutive-edge intervals then mix fragments of both periods, so
+// the median lands on one car or on nothing at all and the second car is lost.
+//
+// The differences between all pairs of nearby edges, not just consecutive ones, stay
+// bimodal: each train contributes its own period, the cross terms spread out. So:
+//   1. for each car, the period estimate is the median of the pairwise differences
+//      within its FREQUENCY_TOLERANCE_PCT band (this tracks emitter drift); cars with
+//      too few differences in their band are skipped
+//   2. the longest chain of edges spaced by whole periods (missing edges allowed) is
+//      that car's train; the car whose train covers most edges wins
+//   3. its edges are removed and the rest searched again for a second car
+// Each train carries its own confidence: the share of its periods that have an edge.
+// Reflections and bounce edges rarely line up into a train of their own.
+//
+// Cars whose periods are 2:1 (car 1 / car 5, car 2 / car 6) look like the faster car
+// with every other edge missing, so those pairs are only separated when the faster
+// car's train is the longer one.
+
+const int OVERLAP_WINDOW = 64;                 // most recent raw edges examined
+const unsigned long OVERLAP_MAX_SPAN = 40000;  // ignore edges older than this (micros)
+const int OVERLAP_MIN_TRAIN = 10;              // edges a train needs to count as a car
+const uint32_t OVERLAP_STEP_TOL_US = 20;       // +/- around the period for a chain step (edge jitter)
+const uint32_t OVERLAP_MAX_GAP_US = 2 * MAX_VALID_INTERVAL;  // longest chain step (dropouts), same for every car
+const float OVERLAP_MIN_CONFIDENCE = 0.6;      // both trains need at least this
+
+struct OverlapResult {
+  int count;            // cars found, 0-2
+  int car[2];           // 1-6, longest train first
+  float confidence[2];  // 0..1, share of the train's periods with an edge
+  int edges[2];         // edges in each train
+  uint32_t periodUs[2]; // period each train was chained with
+};
+
+struct OverlapTrain {
+  int car;          // 0 = none
+  int edges;        // edges in the chain
+  int periods;      // periods the chain spans
+  int last;         // index of its last edge (walk back through prev)
+  uint32_t period;
+};
+
+// Histogram of the differences between all pairs of edges in the valid interval
+// range, 1us bins; each car's band of it gives that car's period
+const int OVERLAP_HIST_BINS = MAX_VALID_INTERVAL - MIN_VALID_INTERVAL + 1;
+
+void overlapHistogram(const uint32_t* e, int n, uint8_t* hist) {
+  for (int b = 0; b < OVERLAP_HIST_BINS; b++) hist[b] = 0;
+  for (int i = 1; i < n; i++) {
+    for (int j = i - 1; j >= 0; j--) {
+      uint32_t d = e[i] - e[j];
+      if (d > MAX_VALID_INTERVAL) break;
+      if (d >= MIN_VALID_INTERVAL && hist[d - MIN_VALID_INTERVAL] < 255) hist[d - MIN_VALID_INTERVAL]++;
+    }
+  }
+}
+
+// Median of the histogram within [lo, hi]; 0 if too few differences for a train
+uint32_t overlapPeriod(const uint8_t* hist, uint32_t lo, uint32_t hi) {
+  if (lo < MIN_VALID_INTERVAL) lo = MIN_VALID_INTERVAL;
+  if (hi > MAX_VALID_INTERVAL) hi = MAX_VALID_INTERVAL;
+  int count = 0;
+  for (uint32_t d = lo; d <= hi; d++) count += hist[d - MIN_VALID_INTERVAL];
+  if (count < OVERLAP_MIN_TRAIN - 1) return 0;
+  int seen = 0;
+  for (uint32_t d = lo; d <= hi; d++) {
+    seen += hist[d - MIN_VALID_INTERVAL];
+    if (2 * seen > count) return d;
+  }
+  return hi;
+}
+
+// Distance of a period from car c's nominal period, as a fraction
+inline float periodError(uint32_t period, int c) {
+  float ratio = period * CAR_FREQUENCIES[c] / 1000000.0f;
+  return ratio > 1 ? ratio - 1 : 1 - ratio;
+}
+
+// Longest chain of edges spaced by whole periods, up to OVERLAP_MAX_GAP_US apart.
+// The gap is in time, not periods: the car 5 train through every other car 1 edge
+// must not bridge longer dropouts than car 1's own train. prev[] gets the links.
+OverlapTrain overlapChain(const uint32_t* e, int n, uint32_t period, int* prev) {
+  int len[OVERLAP_WINDOW];
+  int span[OVERLAP_WINDOW];
+  OverlapTrain best = {0, 0, 0, -1, period};
+  uint32_t maxK = OVERLAP_MAX_GAP_US / period;
+  uint32_t reach = maxK * period + OVERLAP_STEP_TOL_US;
+  for (int i = 0; i < n; i++) {
+    len[i] = 1;
+    span[i] = 0;
+    prev[i] = -1;
+    for (int j = i - 1; j >= 0; j--) {
+      uint32_t d = e[i] - e[j];
+      if (d > reach) break;
+      uint32_t k = (d + period / 2) / period;  // periods in this step
+      if (k < 1 || k > maxK) continue;
+      uint32_t expected = k * period;
+      uint32_t error = d > expected ? d - expected : expected - d;
+      if (error > OVERLAP_STEP_TOL_US) continue;
+      // Longest chain, then fewest missing edges
+      if (len[j] + 1 > len[i] || (len[j] + 1 == len[i] && span[j] + (int)k < span[i])) {
+        len[i] = len[j] + 1;
+        span[i] = span[j] + (int)k;
+        prev[i] = j;
+      }
+    }
+    if (len[i] > best.edges || (len[i] == best.edges && span[i] < best.periods)) {
+      best.edges = len[i];
+      best.periods = span[i];
+      best.last = i;
+    }
+  }
+  return best;
+}
+
+// Finds the best train among n edges and removes its edges (order kept).
+// Returns it with car 0 if no car has a long enough train.
+OverlapTrain takeTrain(uint32_t* e, int& n) {
+  OverlapTrain trains[6];
+  OverlapTrain best = {0, 0, 0, -1, 0};
+  int prev[OVERLAP_WINDOW];
+  uint8_t hist[OVERLAP_HIST_BINS];
+  overlapHistogram(e, n, hist);
+  for (int c = 0; c < 6; c++) {
+    uint32_t nominal = 1000000 / CAR_FREQUENCIES[c];
+    uint32_t tol = (uint32_t)(nominal * FREQUENCY_TOLERANCE_PCT);
+    uint32_t period = overlapPeriod(hist, nominal - tol, nominal + tol);
+    OverlapTrain train = {0, 0, 0, -1, period};
+    if (period > 0) {
+      train = overlapChain(e, n, period, prev);
+      train.car = c + 1;
+    }
+    trains[c] = train;
+    // Most edges wins; with equal edges, fewer gaps (car 5 over car 1 at every other
+    // period), then the period nearest nominal (the tolerance bands of cars 4/5 and 5/6 overlap)
+    bool better = train.edges > best.edges ||
+                  (train.edges == best.edges && train.car > 0 &&
+                   (train.periods < best.periods ||
+                    (train.periods == best.periods && periodError(period, c) < periodError(best.period, best.car - 1))));
+    if (better) best = train;
+  }
+
+  // A jittery car 1 (or 2) breaks its own chain more often than the car 5 (or 6) chain
+  // through every other edge of it, which then wins on edges. If a solid train at half
+  // the period covers the same stretch, the faster car is the real one.
+  for (int c = 0; c < 6 && best.car > 0; c++) {
+    const OverlapTrain& t = trains[c];
+    if (t.car == 0 || t.car == best.car) continue;
+    uint32_t twice = 2 * t.period;
+    uint32_t error = twice > best.period ? twice - best.period : best.period - twice;
+    bool solid = t.edges >= (t.periods + 1) * OVERLAP_MIN_CONFIDENCE;
+    if (error <= OVERLAP_STEP_TOL_US && solid && 2 * t.edges >= best.edges) {
+      best = t;
+      break;
+    }
+  }
+  if (best.edges < OVERLAP_MIN_TRAIN) {
+    best.car = 0;
+    return best;
+  }
+
+  overlapChain(e, n, best.period, prev);
+  bool inTrain[OVERLAP_WINDOW] = {};
+  for (int i = best.last; i >= 0; i = prev[i]) inTrain[i] = true;
+  int kept = 0;
+  for (int i = 0; i < n; i++) {
+    if (!inTrain[i]) e[kept++] = e[i];
+  }
+  n = kept;
+  return best;
+}
+
+// Looks for up to two cars among n raw edge times (micros, oldest first)
+void detectOverlap(const uint32_t* history, int n, OverlapResult& out) {
+  out.count = 0;
+  int first = 0;
+  while (first < n - 1 && history[n - 1] - history[first] > OVERLAP_MAX_SPAN) first++;
+  int m = n - first;
+  if (m > OVERLAP_WINDOW) {
+    first += m - OVERLAP_WINDOW;
+    m = OVERLAP_WINDOW;
+  }
+
+  uint32_t edges[OVERLAP_WINDOW];
+  for (int k = 0; k < m; k++) edges[k] = history[first + k];
+
+  for (int t = 0; t < 2 && m >= OVERLAP_MIN_TRAIN; t++) {
+    OverlapTrain train = takeTrain(edges, m);
+    if (train.car == 0) break;
+    float confidence = (float)train.edges / (train.periods + 1);
+    if (confidence < OVERLAP_MIN_CONFIDENCE) break;
+    // Leftovers of the same car: the same car again, or a drifting car 4 read as car 5
+    // (their tolerance bands overlap), which two different emitters never come this close to
+    uint32_t gap = train.period > out.periodUs[0] ? train.period - out.periodUs[0] : out.periodUs[0] - train.period;
+    if (t == 1 && (train.car == out.car[0] || gap * 2 <= out.periodUs[0] * FREQUENCY_TOLERANCE_PCT)) break;
+    out.car[t] = train.car;
+    out.confidence[t] = confidence;
+    out.edges[t] = train.edges;
+    out.periodUs[t] = train.period;
+    out.count++;
+  }
+}
+
+#endif
@@ -0,0 +1,302 @@
+#ifndef RACE_ENGINE_H
+#define RACE_ENGINE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scalextric_protocol.h"
+
+// Incremental race engine (parent node)
+// Turns car events into laps, sector times and running order as they arrive, and
+// reports only what changed, so clients never rebuild standings from the history.
+//
+// Timing lines are (node, sensor) pairs numbered 0..numLines-1 in track order;
+// line 0 is start/finish and sector k runs from line k to line k+1 (the last sector
+// back to line 0). A car's timing starts on its first start/finish crossing.
+//
+// Each car has a progress count (lines crossed since its start). A crossing that
+// skips lines - a missed detection - still advances progress by the lines skipped,
+// so a missed start/finish still counts the lap, just without a lap time. The running
+// order is kept sorted by (progress, time it got there): a crossing only moves that
+// car up past the cars it has just overtaken, so each event costs a few comparisons
+// plus one swap per overtake, with no sort and no history.
+//
+// Times are the parent's clock at detection: when its detector reports a car on its own
+// sensors, and for a child's the detection time the child sent on the parent's clock
+// (clock_sync.h), or ESP-NOW receipt if it isn't in sync. So all lines share one clock.
+
+#ifndef RACE_MIN_LAP_MS
+#define RACE_MIN_LAP_MS 1000  // Override via build_flags: -DRACE_MIN_LAP_MS=2000
+#endif
+
+const int RACE_NUM_CARS = 6;
+const int RACE_MAX_LINES = 4;  // start/finish + 3 sector lines
+
+// ========== UPDATES ==========
+
+enum RaceUpdateType {
+  RACE_SECTOR,    // car finished a sector: sector, timeMs, bestMs
+  RACE_LAP,       // car finished a lap: laps, timeMs (0 = not timed), bestMs, avgMs
+  RACE_POSITION,  // car's position in the running order changed: position
+};
+
+struct RaceUpdate {
+  RaceUpdateType type;
+  uint8_t car;
+  uint8_t position;  // 1-based
+  uint16_t laps;
+  uint8_t sector;
+  uint32_t timeMs;
+  uint32_t bestMs;
+  uint32_t avgMs;
+};
+
+typedef void (*RaceUpdateCallback)(const RaceUpdate& update);
+
+// Text form sent to clients; never starts with a number, so event parsers skip it
+//   R:S:CAR:SECTOR:MS:BEST_MS
+//   R:L:CAR:LAPS:LAST_MS:BEST_MS:AVG_MS
+//   R:P:CAR:POS
+int formatRaceUpdate(char* buf, size_t size, const RaceUpdate& update) {
+  switch (update.type) {
+    case RACE_SECTOR:
+      return snprintf(buf, size, "R:S:%d:%d:%lu:%lu", update.car, update.sector,
+                      (unsigned long)update.timeMs, (unsigned long)update.bestMs);
+    case RACE_LAP:
+      return snprintf(buf, size, "R:L:%d:%d:%lu:%lu:%lu", update.car, update.laps,
+                      (unsigned long)update.timeMs, (unsigned long)update.bestMs,
+                      (unsigned long)update.avgMs);
+    default:
+      return snprintf(buf, size, "R:P:%d:%d", update.car, update.position);
+  }
+}
+
+// ========== ENGINE ==========
+
+struct RaceCar {
+  bool started;
+  uint16_t laps;
+  uint8_t line;            // last line crossed
+  uint32_t lineMs;         // when it crossed it
+  uint32_t progress;       // lines crossed since the start
+  bool lapTimed;           // current lap started on a seen start/finish crossing
+  uint32_t lapStartMs;
+  uint32_t lastLapMs;      // 0 = none yet / not timed
+  uint32_t bestLapMs;
+  uint32_t totalLapMs;     // over timedLaps, for the average
+  uint16_t timedLaps;
+  uint32_t lastSectorMs[RACE_MAX_LINES];
+  uint32_t bestSectorMs[RACE_MAX_LINES];
+  uint8_t position;        // 1-based
+};
+
+struct RaceLine {
+  uint8_t nodeId;
+  uint8_t sensorId;
+};
+
+class RaceEngine {
+ public:
+  RaceEngine() : numLines(0) {
+    setLine(PARENT_NODE_ID, 0, 0);  // start/finish on the parent's first sensor until configured
+    reset();
+  }
+
+  // Clears standings, keeps the timing lines
+  void reset() {
+    memset(cars, 0, sizeof(cars));
+    for (int i = 0; i < RACE_NUM_CARS; i++) {
+      order[i] = i;
+      cars[i].position = i + 1;
+    }
+  }
+
+  int lineCount() const { return numLines; }
+  const RaceLine& line(int index) const { return lines[index]; }
+
+  // Maps (node, sensor) to timing line index; index >= RACE_MAX_LINES removes it.
+  // Indices must be contiguous from 0: returns false if it would leave a gap.
+  bool setLine(uint8_t nodeId, uint8_t sensorId, int index) {
+    int existing = findLine(nodeId, sensorId);
+    if (index >= RACE_MAX_LINES || index < 0) {
+      if (existing < 0) return true;
+      for (int i = existing; i < numLines - 1; i++) lines[i] = lines[i + 1];
+      numLines--;
+      return true;
+    }
+    if (index > numLines || (existing >= 0 && index == numLines)) return false;
+    if (existing >= 0) {
+      RaceLine moved = lines[existing];
+      for (int i = existing; i < numLines - 1; i++) lines[i] = lines[i + 1];
+      for (int i = numLines - 1; i > index; i--) lines[i] = lines[i - 1];
+      lines[index] = moved;
+      return true;
+    }
+    for (int i = numLines; i > index; i--) lines[i] = lines[i - 1];
+    lines[index].nodeId = nodeId;
+    lines[index].sensorId = sensorId;
+    numLines++;
+    return true;
+  }
+
+  // Timing line for (node, sensor), -1 if it isn't one
+  int findLine(uint8_t nodeId, uint8_t sensorId) const {
+    for (int i = 0; i < numLines; i++) {
+      if (lines[i].nodeId == nodeId && lines[i].sensorId == sensorId) return i;
+    }
+    return -1;
+  }
+
+  // Client commands: "LINE:NODE:SENSOR:INDEX" (INDEX -1 removes the line), "RESET"
+  bool handleCommand(const char* cmd) {
+    if (strncmp(cmd, "RESET", 5) == 0) {
+      reset();
+      return true;
+    }
+    int nodeId, sensorId, index;
+    if (sscanf(cmd, "LINE:%d:%d:%d", &nodeId, &sensorId, &index) != 3) return false;
+    if (nodeId < 0 || nodeId > 255 || sensorId < 0 || sensorId > 255) return false;
+    if (!setLine(nodeId, sensorId, index)) return false;
+    reset();  // progress counts lines, so it can't carry over a change of layout
+    return true;
+  }
+
+  // Whole standings as the same updates (for a client that connects mid-race)
+  void snapshot(RaceUpdateCallback onUpdate) const {
+    for (int pos = 1; pos <= RACE_NUM_CARS; pos++) {
+      int index = order[pos - 1];
+      const RaceCar& c = cars[index];
+      if (!c.started) continue;
+      RaceUpdate update;
+      memset(&update, 0, sizeof(update));
+      update.car = index + 1;
+      update.type = RACE_POSITION;
+      update.position = pos;
+      onUpdate(update);
+      update.type = RACE_LAP;
+      update.laps = c.laps;
+      update.timeMs = c.lastLapMs;
+      update.bestMs = c.bestLapMs;
+      update.avgMs = c.timedLaps ? c.totalLapMs / c.timedLaps : 0;
+      onUpdate(update);
+    }
+  }
+
+  const RaceCar& car(int carNumber) const { return cars[carNumber - 1]; }
+  int carAt(int position) const { return order[position - 1] + 1; }
+
+  // One detection; returns true if it changed the standings
+  bool onCrossing(uint8_t nodeId, uint8_t sensorId, int carNumber, uint32_t timeMs,
+                  RaceUpdateCallback onUpdate) {
+    if (carNumber < 1 || carNumber > RACE_NUM_CARS) return false;
+    int lineIndex = findLine(nodeId, sensorId);
+    if (lineIndex < 0) return false;
+    RaceCar& c = cars[carNumber - 1];
+    RaceUpdate update;
+    memset(&update, 0, sizeof(update));
+    update.car = carNumber;
+
+    if (!c.started) {
+      if (lineIndex != 0) return false;
+      c.started = true;
+      c.line = 0;
+      c.lineMs = timeMs;
+      c.lapTimed = true;
+      c.lapStartMs = timeMs;
+      moveUp(carNumber - 1, onUpdate);
+      return true;
+    }
+
+    // Lines advanced since the last crossing; the same line again is a full lap
+    // unless it's too soon (the same car seen twice on one line)
+    int steps = (lineIndex - c.line + numLines) % numLines;
+    if (steps == 0) {
+      if (timeMs - c.lineMs < RACE_MIN_LAP_MS) return false;
+      steps = numLines;
+    }
+
+    if (steps == 1 && numLines > 1) {
+      uint32_t sectorMs = timeMs - c.lineMs;
+      c.lastSectorMs[c.line] = sectorMs;
+      if (c.bestSectorMs[c.line] == 0 || sectorMs < c.bestSectorMs[c.line]) {
+        c.bestSectorMs[c.line] = sectorMs;
+      }
+      update.type = RACE_SECTOR;
+      update.sector = c.line;
+      update.timeMs = sectorMs;
+      update.bestMs = c.bestSectorMs[c.line];
+      if (onUpdate) onUpdate(update);
+    }
+
+    bool lapDone = c.line + steps >= numLines;
+    c.progress += steps;
+    c.line = lineIndex;
+    c.lineMs = timeMs;
+
+    if (lapDone) {
+      c.laps = c.progress / numLines;
+      c.lastLapMs = 0;
+      if (lineIndex == 0 && c.lapTimed) {
+        c.lastLapMs = timeMs - c.lapStartMs;
+        c.totalLapMs += c.lastLapMs;
+        c.timedLaps++;
+        if (c.bestLapMs == 0 || c.lastLapMs < c.bestLapMs) c.bestLapMs = c.lastLapMs;
+      }
+      c.lapTimed = lineIndex == 0;
+      c.lapStartMs = timeMs;
+      update.type = RACE_LAP;
+      update.laps = c.laps;
+      update.timeMs = c.lastLapMs;
+      update.bestMs = c.bestLapMs;
+      update.avgMs = c.timedLaps ? c.totalLapMs / c.timedLaps : 0;
+      if (onUpdate) onUpdate(update);
+    }
+
+    moveUp(carNumber - 1, onUpdate);
+    return true;
+  }
+
+ private:
+  RaceCar cars[RACE_NUM_CARS];
+  int order[RACE_NUM_CARS];  // car index by position - 1
+  RaceLine lines[RACE_MAX_LINES];
+  int numLines;
+
+  // a is ahead of b: further round, or got there first. Not started is last.
+  bool ahead(int a, int b) const {
+    const RaceCar& ca = cars[a];
+    const RaceCar& cb = cars[b];
+    if (ca.started != cb.started) return ca.started;
+    if (!ca.started) return a < b;
+    if (ca.progress != cb.progress) return ca.progress > cb.progress;
+    return (int32_t)(cb.lineMs - ca.lineMs) > 0;
+  }
+
+  void moveUp(int index, RaceUpdateCallback onUpdate) {
+    int pos = cars[index].position - 1;
+    int start = pos;
+    while (pos > 0 && ahead(index, order[pos - 1])) {
+      int passed = order[pos - 1];
+      order[pos] = passed;
+      cars[passed].position = pos + 1;
+      notifyPosition(passed, onUpdate);
+      pos--;
+    }
+    order[pos] = index;
+    cars[index].position = pos + 1;
+    if (pos != start) notifyPosition(index, onUpdate);
+  }
+
+  void notifyPosition(int index, RaceUpdateCallback onUpdate) {
+    if (!onUpdate) return;
+    RaceUpdate update;
+    memset(&update, 0, sizeof(update));
+    update.type = RACE_POSITION;
+    update.car = index + 1;
+    update.position = cars[index].position;
+    onUpdate(update);
+  }
+};
+
+#endif
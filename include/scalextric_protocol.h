@@ -1,7 +1,10 @@
 #ifndef SCALEXTRIC_PROTOCOL_H
 #define SCALEXTRIC_PROTOCOL_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 
 // Scalextric Car Detector - Shared Protocol & Constants
 // Used by both parent and child nodes
@@ -16,27 +19,283 @@ struct __attribute__((packed)) CarEvent {
   uint32_t timestamp;
 };
 
+// Signal quality of one car report, computed by the detector when it reports the car
+// (car_detection.h eventQuality). Every report follows at least one valid interval,
+// so pulses == 0 means "no quality data" (an older child, or EVENT_QUALITY=0).
+struct __attribute__((packed)) EventQuality {
+  uint8_t pulses;           // valid intervals so far, saturates at 255
+  uint8_t validPct;         // valid intervals / raw intervals of the pass so far
+  uint8_t glitches;         // edges dropped by the bounce filter, saturates at 255
+  uint8_t outOfBand;        // intervals outside MIN..MAX_VALID_INTERVAL, saturates at 255
+  uint16_t iqrUs;           // interquartile range of the interval window, 0 = too few
+  uint16_t marginPermille;  // how much nearer the reported car's frequency is than the next car's, 0.1%
+  uint8_t overlapPct;       // confidence of a second car's pulse train, 0 = none seen
+};
+
+// CarEvent with its EventQuality appended; receivers tell them apart by length
+struct __attribute__((packed)) CarEventWithQuality {
+  CarEvent event;
+  EventQuality quality;
+};
+
+// CarEventWithQuality with the time of detection on the parent's clock, from a child in
+// sync with that parent (clock_sync.h). Only ever unicast to that parent: any other
+// receiver is on a clock of its own.
+struct __attribute__((packed)) CarEventTimed {
+  CarEvent event;
+  EventQuality quality;
+  uint64_t detectedUs;  // parent's esp_timer_get_time() when the child reported the car
+  uint8_t syncError;    // the child's bound on detectedUs's error, 4 us steps, saturates at 255
+};
+
+// Sent once per pass, DETECTION_TIMEOUT after the car has gone (after its CarEvent)
+struct __attribute__((packed)) PassEvent {
+  uint8_t magic;         // PASS_EVENT_MAGIC
+  uint8_t nodeId;
+  uint8_t sensorId;
+  uint8_t carNumber;     // 0 = unknown
+  uint64_t firstEdgeUs;  // sending node's micros64() at the first edge (the parent's, PASS_FLAG_PARENT_CLOCK)
+  uint32_t durationUs;   // first to last edge
+  uint16_t speedMmps;    // 0 = no estimate
+  uint8_t flags;         // PASS_FLAG_*
+  uint8_t pulseCount;    // valid intervals, saturates at 255
+};
+
+// Sent every HEALTH_REPORT_MS per sensor, and when a sensor's status changes
+struct __attribute__((packed)) HealthEvent {
+  uint8_t magic;             // HEALTH_EVENT_MAGIC
+  uint8_t nodeId;
+  uint8_t sensorId;
+  uint8_t status;            // HEALTH_*
+  uint16_t edgesPerSec;      // raw edges over the last second, saturates
+  uint16_t glitchesPerSec;   // edges dropped by the bounce filter
+  uint16_t outOfBandPerSec;  // intervals outside MIN..MAX_VALID_INTERVAL
+  uint16_t idleSec;          // since the sensor's last edge, saturates
+  uint8_t throttles;         // interrupt storms since boot, saturates
+};
+
+// Several of the messages above from one child in one ESP-NOW frame (espnow_batch.h):
+// this header, then count x (length byte, message)
+struct __attribute__((packed)) BatchHeader {
+  uint8_t magic;      // BATCH_MAGIC
+  uint8_t nodeId;
+  uint16_t batchSeq;  // per child, one more per frame; receivers count the gaps
+  uint8_t count;      // messages that follow
+};
+
 struct __attribute__((packed)) ProbeMsg {
   uint8_t magic;    // PROBE_REQUEST_MAGIC or PROBE_RESPONSE_MAGIC
   uint8_t nodeId;
   uint8_t channel;  // Parent's WiFi channel (set in response, 0 in request)
 };
 
+// Two-way clock sync (clock_sync.h): a child sends SYNC_REQUEST_MAGIC with its clock,
+// the parent sends it back as SYNC_RESPONSE_MAGIC with its own clock added. Never batched.
+struct __attribute__((packed)) SyncMsg {
+  uint8_t magic;        // SYNC_REQUEST_MAGIC or SYNC_RESPONSE_MAGIC
+  uint8_t nodeId;       // the child's, in both
+  uint16_t seq;         // per child, matches a response to its request
+  uint64_t childTxUs;   // child's esp_timer_get_time() as it sent the request
+  uint64_t parentRxUs;  // parent's as the request arrived (0 in request)
+  uint64_t parentTxUs;  // parent's as it sent the response (0 in request)
+};
+
 // ========== PROTOCOL CONSTANTS ==========
 
 const uint8_t PROBE_REQUEST_MAGIC = 0xAA;
 const uint8_t PROBE_RESPONSE_MAGIC = 0xBB;
+const uint8_t PASS_EVENT_MAGIC = 0xCC;
+const uint8_t HEALTH_EVENT_MAGIC = 0xDD;
+const uint8_t BATCH_MAGIC = 0xEE;
+const uint8_t SYNC_REQUEST_MAGIC = 0x5C;
+const uint8_t SYNC_RESPONSE_MAGIC = 0x5D;
 const uint8_t PARENT_NODE_ID = 255;
+const int ESPNOW_MAX_PAYLOAD = 250;  // ESP_NOW_MAX_DATA_LEN
+
+const uint8_t PASS_FLAG_SPEED_TRAP = 0x01;    // speed from two sensors, not beam crossing time
+const uint8_t PASS_FLAG_PARENT_CLOCK = 0x02;  // firstEdgeUs is on the parent's clock (clock_sync.h)
+
+// EVENT_QUALITY=1: children send CarEventWithQuality instead of CarEvent. Parents
+// accept both, so this only needs to be 0 for children of a parent older than it.
+#ifndef EVENT_QUALITY
+#define EVENT_QUALITY 1  // Override via build_flags: -DEVENT_QUALITY=0
+#endif
+
+// An ESP-NOW car event of any length; quality is zeroed for a plain CarEvent, and
+// detectedUs (if asked for) is 0 unless the event is a CarEventTimed
+inline bool readCarEvent(const uint8_t* data, int len, CarEvent& event, EventQuality& quality,
+                         uint64_t* detectedUs = nullptr) {
+  if (len != sizeof(CarEvent) && len != sizeof(CarEventWithQuality) && len != sizeof(CarEventTimed)) return false;
+  memcpy(&event, data, sizeof(CarEvent));
+  if (len == sizeof(CarEvent)) {
+    memset(&quality, 0, sizeof(quality));
+  } else {
+    memcpy(&quality, data + sizeof(CarEvent), sizeof(EventQuality));
+  }
+  if (detectedUs) {
+    *detectedUs = 0;
+    if (len == sizeof(CarEventTimed)) memcpy(detectedUs, data + offsetof(CarEventTimed, detectedUs), sizeof(uint64_t));
+  }
+  return true;
+}
+
+// Thresholds for a report worth a second look (sensor dirty, misaligned or in
+// sunlight, emitter drifting); clients use the same ones on the :Q: fields
+const uint8_t QUALITY_MIN_VALID_PCT = 50;          // half the intervals rejected
+const uint16_t QUALITY_MIN_MARGIN_PERMILLE = 40;   // within 4% of a toss-up with another car
+const uint16_t QUALITY_MAX_IQR_US = 40;           // intervals all over the place
+
+inline bool eventMarginal(const EventQuality& q) {
+  return q.pulses > 0 && (q.validPct < QUALITY_MIN_VALID_PCT || q.marginPermille < QUALITY_MIN_MARGIN_PERMILLE ||
+                          q.iqrUs > QUALITY_MAX_IQR_US);
+}
+
+// Text form for clients: SEQ:NODE:SENSOR:CAR:FREQ:MILLIS, then
+// :Q:PULSES:VALID%:GLITCHES:OOB:IQR_US:MARGIN:OVERLAP% if the event has quality data.
+// Clients that split on ':' and read the first six fields ignore the tail.
+// MILLIS is timeUs / 1000, given the same timeUs as encodeCarRecord (not the event's
+// timestamp, a child's own clock), so both forms of one event carry one time.
+inline int formatCarEvent(char* buf, size_t size, uint32_t seq, const CarEvent& event, uint64_t timeUs,
+                          const EventQuality& quality) {
+  int n = snprintf(buf, size, "%lu:%d:%d:%d:%d:%lu", (unsigned long)seq, event.nodeId, event.sensorId,
+                   event.carNumber, event.frequency, (unsigned long)(uint32_t)(timeUs / 1000));
+  if (quality.pulses == 0 || n < 0 || (size_t)n >= size) return n;
+  return n + snprintf(buf + n, size - n, ":Q:%u:%u:%u:%u:%u:%u:%u", quality.pulses, quality.validPct,
+                      quality.glitches, quality.outOfBand, quality.iqrUs, quality.marginPermille,
+                      quality.overlapPct);
+}
+
+// Sensor health status, worst first wins (sensor_health.h)
+const uint8_t HEALTH_OK = 0;
+const uint8_t HEALTH_NOISY = 1;      // many glitches / out-of-band intervals: stray IR, flicker
+const uint8_t HEALTH_SILENT = 2;     // no edges while the other sensors saw many passes
+const uint8_t HEALTH_SATURATED = 3;  // input held low without edges: phototransistor in sunlight
+const uint8_t HEALTH_STORM = 4;      // interrupt storm, interrupt detached until it is rearmed
+
+inline const char* healthStatusName(uint8_t status) {
+  static const char* const NAMES[] = {"OK", "NOISY", "SILENT", "SATURATED", "STORM"};
+  return status <= HEALTH_STORM ? NAMES[status] : "?";
+}
+
+// Text form for clients: H:NODE:SENSOR:STATUS:EDGES/S:GLITCHES/S:OOB/S:IDLE_S:THROTTLES
+inline int formatHealthEvent(char* buf, size_t size, const HealthEvent& health) {
+  return snprintf(buf, size, "H:%d:%d:%s:%u:%u:%u:%u:%u", health.nodeId, health.sensorId,
+                  healthStatusName(health.status), health.edgesPerSec, health.glitchesPerSec,
+                  health.outOfBandPerSec, health.idleSec, health.throttles);
+}
+
+// Text form for clients: P:NODE:SENSOR:CAR:FIRST_US:LAST_US:SPEED_MMPS:SOURCE:PULSES, times on the
+// sending node's clock (or the parent's, PASS_FLAG_PARENT_CLOCK); SOURCE is T (speed trap) or B (beam)
+inline int formatPassEvent(char* buf, size_t size, const PassEvent& pass) {
+  return snprintf(buf, size, "P:%d:%d:%d:%llu:%llu:%u:%c:%d", pass.nodeId, pass.sensorId, pass.carNumber,
+                  (unsigned long long)pass.firstEdgeUs, (unsigned long long)(pass.firstEdgeUs + pass.durationUs),
+                  pass.speedMmps, (pass.flags & PASS_FLAG_SPEED_TRAP) ? 'T' : 'B', pass.pulseCount);
+}
+
+// ========== BINARY EVENT RECORDS ==========
+
+// Fixed-layout, little-endian (as the ESP32 is) alternative to the text form of a car
+// event. A client asks for it per connection by sending FORMAT:BIN (FORMAT:TEXT goes
+// back); until then it gets text lines, so older clients keep working. P:, H:, R: and
+// # lines stay text either way. The first byte is never printable ASCII, so a reader
+// of a mixed stream (serial) tells a record from a line by it, and the length byte
+// delimits the record. A plain record is 20 bytes, one notification at the default
+// BLE MTU.
+struct __attribute__((packed)) CarRecord {
+  uint8_t magicVersion;  // RECORD_MAGIC | RECORD_VERSION
+  uint8_t type;          // RECORD_CAR
+  uint8_t length;        // whole record including TLVs
+  uint32_t seq;
+  uint8_t nodeId;
+  uint8_t sensorId;
+  uint8_t carNumber;
+  uint16_t frequency;
+  uint64_t timeUs;       // sending node's clock, the same one SYNC reports in ms
+};
+// then TLV extensions: type, length, value; decoders skip types they don't know
+
+const uint8_t RECORD_MAGIC = 0xA0;        // high nibble
+const uint8_t RECORD_VERSION = 1;         // low nibble; bumped when the fixed part changes
+const uint8_t RECORD_CAR = 1;
+const uint8_t RECORD_TLV_QUALITY = 1;     // EventQuality
+const size_t RECORD_MAX_SIZE = sizeof(CarRecord) + 2 + sizeof(EventQuality);
+
+inline bool isRecordStart(uint8_t b) { return (b & 0xF0) == RECORD_MAGIC; }
+
+// Returns the record's length, or 0 if it doesn't fit. Quality goes in a TLV if the
+// event has quality data.
+inline int encodeCarRecord(uint8_t* buf, size_t size, uint32_t seq, const CarEvent& event, uint64_t timeUs,
+                           const EventQuality& quality) {
+  size_t n = sizeof(CarRecord) + (quality.pulses ? 2 + sizeof(EventQuality) : 0);
+  if (n > size) return 0;
+  CarRecord r;
+  r.magicVersion = RECORD_MAGIC | RECORD_VERSION;
+  r.type = RECORD_CAR;
+  r.length = (uint8_t)n;
+  r.seq = seq;
+  r.nodeId = event.nodeId;
+  r.sensorId = event.sensorId;
+  r.carNumber = event.carNumber;
+  r.frequency = event.frequency;
+  r.timeUs = timeUs;
+  memcpy(buf, &r, sizeof(r));
+  if (quality.pulses) {
+    buf[sizeof(r)] = RECORD_TLV_QUALITY;
+    buf[sizeof(r) + 1] = sizeof(EventQuality);
+    memcpy(buf + sizeof(r) + 2, &quality, sizeof(EventQuality));
+  }
+  return (int)n;
+}
+
+// A car record of a version this build knows; quality is zeroed without its TLV
+inline bool decodeCarRecord(const uint8_t* data, size_t len, CarRecord& record, EventQuality& quality) {
+  if (len < sizeof(CarRecord) || data[0] != (RECORD_MAGIC | RECORD_VERSION) || data[1] != RECORD_CAR) return false;
+  memcpy(&record, data, sizeof(CarRecord));
+  if (record.length < sizeof(CarRecord) || record.length > len) return false;
+  memset(&quality, 0, sizeof(quality));
+  for (size_t i = sizeof(CarRecord); i + 2 <= record.length; i += 2 + data[i + 1]) {
+    if (i + 2 + data[i + 1] > record.length) return false;
+    if (data[i] == RECORD_TLV_QUALITY && data[i + 1] >= sizeof(EventQuality)) {
+      memcpy(&quality, data + i + 2, sizeof(EventQuality));
+    }
+  }
+  return true;
+}
+
+// Client event format, as negotiated with FORMAT:BIN / FORMAT:TEXT; true for binary.
+// Returns false (and leaves binary alone) if the message isn't a FORMAT command.
+inline bool parseFormatCommand(const char* msg, bool& binary) {
+  if (strncmp(msg, "FORMAT:", 7) != 0) return false;
+  if (strncmp(msg + 7, "BIN", 3) == 0) {
+    binary = true;
+  } else if (strncmp(msg + 7, "TEXT", 4) == 0) {
+    binary = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Reply to a FORMAT command: FORMAT:BIN:VERSION or FORMAT:TEXT
+inline int formatFormatReply(char* buf, size_t size, bool binary) {
+  return binary ? snprintf(buf, size, "FORMAT:BIN:%d", RECORD_VERSION) : snprintf(buf, size, "FORMAT:TEXT");
+}
 
 // ========== SENSOR CONFIGURATION ==========
 
-const int SENSOR_PINS[] = {4, 5, 18, 19};
-const int NUM_SENSORS = 4;
+// Pins for this node's sensors. The detector's state array and ISR trampolines are
+// sized from this list at compile time, so each firmware env sets its own count.
+#ifndef SENSOR_PIN_LIST
+#define SENSOR_PIN_LIST 4, 5, 18, 19  // Override via build_flags: -DSENSOR_PIN_LIST=4,5,18,19,23,25
+#endif
+
+constexpr int SENSOR_PINS[] = {SENSOR_PIN_LIST};
+constexpr int NUM_SENSORS = sizeof(SENSOR_PINS) / sizeof(SENSOR_PINS[0]);
 
 // ========== CAR DETECTION PARAMETERS ==========
 
-const int CAR_FREQUENCIES[] = {5500, 4400, 3700, 3100, 2800, 2400};
-const float FREQUENCY_TOLERANCE_PCT = 0.08;  // 8% of target frequency
+constexpr int CAR_FREQUENCIES[] = {5500, 4400, 3700, 3100, 2800, 2400};
+constexpr float FREQUENCY_TOLERANCE_PCT = 0.08;  // 8% of target frequency
 const unsigned long MIN_VALID_INTERVAL = 150;
 const unsigned long MAX_VALID_INTERVAL = 450;
 const int MIN_PULSES_FOR_ID = 6;
@@ -0,0 +1,171 @@
+#ifndef SENSOR_HEALTH_H
+#define SENSOR_HEALTH_H
+
+#include <stdint.h>
+#include "scalextric_protocol.h"
+
+// Per-sensor health over a sliding window
+// Every HEALTH_TICK_MS the detector hands each sensor's running edge, glitch and
+// out-of-band counts to healthTick(), which keeps the last HEALTH_TICKS deltas in a
+// ring so the window sums (one second) slide by one tick at a time. From those and
+// the pin level it derives a status (HEALTH_* in scalextric_protocol.h):
+//   STORM      more than HEALTH_STORM_EDGES_PER_S in one tick; the detector detaches
+//              the interrupt for HEALTH_THROTTLE_MS, doubling (up to
+//              HEALTH_MAX_THROTTLE_MS) while it storms again within
+//              HEALTH_BACKOFF_RESET_MS of being rearmed
+//   SATURATED  pin low for HEALTH_SATURATED_TICKS ticks in a row with no edges: the
+//              phototransistor is held on, so no car can be seen
+//   SILENT     no edges while the node completed HEALTH_SILENT_PASSES passes on its
+//              other sensors: blocked, unplugged or a dead pull-up
+//   NOISY      glitches + out-of-band intervals over HEALTH_NOISY_PER_S
+// Worst first. The thresholds sit well clear of real traffic: one car is 2.4-5.5k
+// edges/s and two side by side about twice that.
+
+#ifndef HEALTH_STORM_EDGES_PER_S
+#define HEALTH_STORM_EDGES_PER_S 20000  // Override via build_flags: -DHEALTH_STORM_EDGES_PER_S=...
+#endif
+
+const uint32_t HEALTH_TICK_MS = 100;
+const int HEALTH_TICKS = 10;                       // window = HEALTH_TICKS x HEALTH_TICK_MS = 1s
+const uint32_t HEALTH_WINDOW_MS = HEALTH_TICKS * HEALTH_TICK_MS;
+const uint32_t HEALTH_NOISY_PER_S = 50;            // a lamp flickering at mains frequency gives 100-120
+const int HEALTH_SATURATED_TICKS = 10;
+const uint32_t HEALTH_SILENT_PASSES = 50;
+const uint32_t HEALTH_THROTTLE_MS = 1000;
+const uint32_t HEALTH_MAX_THROTTLE_MS = 60000;
+const uint32_t HEALTH_BACKOFF_RESET_MS = 30000;
+const uint32_t HEALTH_REPORT_MS = 10000;           // every sensor's status, changed or not
+
+struct SensorHealth {
+  uint32_t tickEdges[HEALTH_TICKS];    // raw edges per tick, including those a full ring dropped
+  uint16_t tickGlitches[HEALTH_TICKS];
+  uint16_t tickOutOfBand[HEALTH_TICKS];
+  int tick;                            // slot of the newest tick
+  uint32_t windowEdges;                // sums over the window
+  uint32_t windowGlitches;
+  uint32_t windowOutOfBand;
+  uint32_t seenEdges;                  // the sensor's running counts at the last tick
+  uint32_t seenGlitches;
+  uint32_t seenOutOfBand;
+  uint32_t lastEdgeMs;                 // tick of the last edge (or boot / rearm)
+  uint32_t passesAtLastEdge;           // node's completed passes at that tick
+  uint8_t lowTicks;                    // ticks in a row with the pin low and no edges
+  uint8_t status;                      // HEALTH_*, as last reported
+  bool throttled;                      // interrupt detached until rearmAtMs
+  uint32_t rearmAtMs;
+  uint32_t rearmedAtMs;
+  uint32_t throttleMs;                 // length of the last throttle (backoff)
+  uint16_t throttles;
+};
+
+// Empty window, counting from the sensor's current counts
+void healthClearWindow(SensorHealth& h, uint32_t edges, uint32_t glitches, uint32_t outOfBand) {
+  for (int i = 0; i < HEALTH_TICKS; i++) {
+    h.tickEdges[i] = 0;
+    h.tickGlitches[i] = 0;
+    h.tickOutOfBand[i] = 0;
+  }
+  h.tick = 0;
+  h.windowEdges = 0;
+  h.windowGlitches = 0;
+  h.windowOutOfBand = 0;
+  h.seenEdges = edges;
+  h.seenGlitches = glitches;
+  h.seenOutOfBand = outOfBand;
+  h.lowTicks = 0;
+}
+
+void healthReset(SensorHealth& h, uint32_t nowMs) {
+  healthClearWindow(h, 0, 0, 0);
+  h.lastEdgeMs = nowMs;
+  h.passesAtLastEdge = 0;
+  h.status = HEALTH_OK;
+  h.throttled = false;
+  h.rearmAtMs = 0;
+  h.rearmedAtMs = 0;
+  h.throttleMs = 0;
+  h.throttles = 0;
+}
+
+inline uint16_t saturate16(uint32_t n) { return n > 0xFFFF ? 0xFFFF : (uint16_t)n; }
+
+// Slide the window on by one tick. Returns the raw edges of this tick.
+uint32_t healthTick(SensorHealth& h, uint32_t edges, uint32_t glitches, uint32_t outOfBand, bool pinLow,
+                    uint32_t passes, uint32_t nowMs) {
+  uint32_t newEdges = edges - h.seenEdges;
+  uint16_t newGlitches = saturate16(glitches - h.seenGlitches);
+  uint16_t newOutOfBand = saturate16(outOfBand - h.seenOutOfBand);
+  h.seenEdges = edges;
+  h.seenGlitches = glitches;
+  h.seenOutOfBand = outOfBand;
+
+  h.tick = (h.tick + 1) % HEALTH_TICKS;
+  h.windowEdges += newEdges - h.tickEdges[h.tick];
+  h.windowGlitches += newGlitches - h.tickGlitches[h.tick];
+  h.windowOutOfBand += newOutOfBand - h.tickOutOfBand[h.tick];
+  h.tickEdges[h.tick] = newEdges;
+  h.tickGlitches[h.tick] = newGlitches;
+  h.tickOutOfBand[h.tick] = newOutOfBand;
+
+  if (newEdges > 0) {
+    h.lastEdgeMs = nowMs;
+    h.passesAtLastEdge = passes;
+    h.lowTicks = 0;
+  } else if (pinLow) {
+    if (h.lowTicks < 255) h.lowTicks++;
+  } else {
+    h.lowTicks = 0;
+  }
+  return newEdges;
+}
+
+// More edges in elapsedMs than any car (or two) can produce
+inline bool healthStorm(uint32_t edges, uint32_t elapsedMs) {
+  return (uint64_t)edges * 1000 > (uint64_t)HEALTH_STORM_EDGES_PER_S * (elapsedMs ? elapsedMs : 1);
+}
+
+// Detach for HEALTH_THROTTLE_MS, or twice the last throttle if it stormed again soon
+// after being rearmed. Returns how long.
+uint32_t healthThrottle(SensorHealth& h, uint32_t nowMs) {
+  bool again = h.throttles > 0 && nowMs - h.rearmedAtMs < HEALTH_BACKOFF_RESET_MS;
+  h.throttleMs = again ? h.throttleMs * 2 : HEALTH_THROTTLE_MS;
+  if (h.throttleMs > HEALTH_MAX_THROTTLE_MS) h.throttleMs = HEALTH_MAX_THROTTLE_MS;
+  h.throttled = true;
+  h.rearmAtMs = nowMs + h.throttleMs;
+  if (h.throttles < 0xFFFF) h.throttles++;
+  return h.throttleMs;
+}
+
+inline bool healthRearmDue(const SensorHealth& h, uint32_t nowMs) {
+  return h.throttled && (int32_t)(nowMs - h.rearmAtMs) >= 0;
+}
+
+// Interrupt attached again: start a fresh window from the sensor's current counts
+void healthRearm(SensorHealth& h, uint32_t edges, uint32_t glitches, uint32_t outOfBand, uint32_t nowMs) {
+  healthClearWindow(h, edges, glitches, outOfBand);
+  h.throttled = false;
+  h.rearmedAtMs = nowMs;
+}
+
+// Status from the current window, worst first
+uint8_t healthStatus(const SensorHealth& h, uint32_t passes) {
+  if (h.throttled) return HEALTH_STORM;
+  if (h.lowTicks >= HEALTH_SATURATED_TICKS) return HEALTH_SATURATED;
+  if (passes - h.passesAtLastEdge >= HEALTH_SILENT_PASSES) return HEALTH_SILENT;
+  if ((uint64_t)(h.windowGlitches + h.windowOutOfBand) * 1000 >= (uint64_t)HEALTH_NOISY_PER_S * HEALTH_WINDOW_MS) {
+    return HEALTH_NOISY;
+  }
+  return HEALTH_OK;
+}
+
+// Per-second rate of a window sum
+inline uint32_t healthRate(uint32_t windowSum) { return (uint32_t)((uint64_t)windowSum * 1000 / HEALTH_WINDOW_MS); }
+
+// Raw edges per second: over the window, or while throttled over the tick that tripped it
+// (the rest of the window is from before the storm)
+inline uint32_t healthEdgeRate(const SensorHealth& h) {
+  if (h.throttled) return (uint32_t)((uint64_t)h.tickEdges[h.tick] * 1000 / HEALTH_TICK_MS);
+  return healthRate(h.windowEdges);
+}
+
+#endif
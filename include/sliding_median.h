@@ -0,0 +1,84 @@
+#ifndef SLIDING_MEDIAN_H
+#define SLIDING_MEDIAN_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Sliding-window median over pulse intervals
+// Keeps the last Capacity intervals in a FIFO plus a Fenwick (binary indexed) tree of
+// counts over the valid interval range [MinValue, MaxValue] in whole micros.
+// push() is O(log range) (~9 steps for 150-450us) and median() is O(1) (cached),
+// so the window can grow to 32-64 entries without growing loop time.
+//
+// Median matches the old sort-based version: the upper median, sorted[count / 2].
+
+template <int Capacity, int MinValue, int MaxValue>
+class SlidingMedian {
+ public:
+  static const int RANGE = MaxValue - MinValue + 1;
+
+  SlidingMedian() { clear(); }
+
+  void clear() {
+    memset(tree, 0, sizeof(tree));
+    head = 0;
+    count = 0;
+    cachedMedian = 0;
+  }
+
+  // Insert an interval, evicting the oldest once the window is full.
+  // Values outside [MinValue, MaxValue] are ignored.
+  void push(uint32_t value) {
+    if (value < (uint32_t)MinValue || value > (uint32_t)MaxValue) return;
+    if (count == Capacity) {
+      add(fifo[head] - MinValue + 1, -1);
+    } else {
+      count++;
+    }
+    fifo[head] = (uint16_t)value;
+    head = (head + 1) % Capacity;
+    add(value - MinValue + 1, 1);
+    cachedMedian = kth(count / 2 + 1);
+  }
+
+  uint32_t median() const { return cachedMedian; }
+
+  // k-th smallest value in the window (1-based, k <= size()), e.g. for quartiles
+  uint32_t kthSmallest(int k) const { return kth(k); }
+  int size() const { return count; }
+
+ private:
+  uint16_t fifo[Capacity];
+  uint8_t tree[RANGE + 1];  // 1-based Fenwick tree of value counts
+  int head;
+  int count;
+  uint32_t cachedMedian;
+
+  void add(int idx, int delta) {
+    for (; idx <= RANGE; idx += idx & -idx) {
+      tree[idx] += delta;
+    }
+  }
+
+  // k-th smallest value (1-based) by binary lifting down the tree
+  uint32_t kth(int k) const {
+    int pos = 0;
+    for (int step = highestBit(RANGE); step > 0; step >>= 1) {
+      if (pos + step <= RANGE && tree[pos + step] < k) {
+        pos += step;
+        k -= tree[pos];
+      }
+    }
+    return pos + MinValue;  // pos + 1 is the 1-based index of the answer
+  }
+
+  static int highestBit(int n) {
+    int bit = 1;
+    while (bit * 2 <= n) bit *= 2;
+    return bit;
+  }
+
+  static_assert(Capacity > 0 && Capacity < 256, "counts are stored in uint8_t");
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef SPRT_CLASSIFIER_H
+#define SPRT_CLASSIFIER_H
+
+#include <stdint.h>
+#include <math.h>
+#include "scalextric_protocol.h"
+
+// Sequential (SPRT-style) car classifier
+// Every valid interval adds its log-likelihood under each hypothesis:
+//   car c    interval ~ Normal(1e6 / f_c, sigma_c) with probability 1 - SPRT_OUTLIER_PROB,
+//            anything in the valid range otherwise (dropout, reflection, second car)
+//   unknown  interval uniform over MIN_VALID_INTERVAL..MAX_VALID_INTERVAL
+// sigma_c covers emitter drift (SPRT_PERIOD_SPREAD of the period) and edge jitter.
+// A car is decided as soon as its total beats every other hypothesis, including
+// unknown, by log((1 - SPRT_ERROR_RATE) / SPRT_ERROR_RATE) - Wald's bound for a
+// wrong decision rate of about SPRT_ERROR_RATE if the model holds. A clean signal
+// decides in 3 intervals; a noisy or in-between one keeps accumulating, and a car
+// that never gets there is reported as unknown at the timeout like the median path.
+//
+// The outlier term caps what one bad interval can do to a car at
+// log(1 / SPRT_OUTLIER_PROB), so a single dropout or glitch can't force a decision.
+
+#ifndef SPRT_ERROR_RATE
+#define SPRT_ERROR_RATE 0.001f  // Override via build_flags: -DSPRT_ERROR_RATE=0.01
+#endif
+
+const float SPRT_PERIOD_SPREAD = 0.03;  // 1 sigma of a car's period, fraction of nominal
+const float SPRT_JITTER_US = 4.0;       // 1 sigma of interval jitter from edge timing
+const float SPRT_OUTLIER_PROB = 0.05;   // share of intervals that match no model
+const int SPRT_NUM_CARS = 6;
+
+const float SPRT_THRESHOLD = logf((1.0f - SPRT_ERROR_RATE) / SPRT_ERROR_RATE);
+
+struct SprtCarModel {
+  float periodUs;
+  float halfInvVariance;  // 1 / (2 sigma^2)
+  float peak;             // log density at the nominal period (inlier part)
+};
+
+// Log density of an interval that matches no car
+const float SPRT_FLAT = -logf((float)(MAX_VALID_INTERVAL - MIN_VALID_INTERVAL + 1));
+const float SPRT_OUTLIER = logf(SPRT_OUTLIER_PROB) + SPRT_FLAT;
+
+SprtCarModel makeSprtModel(int car) {
+  SprtCarModel model;
+  model.periodUs = 1000000.0f / CAR_FREQUENCIES[car];
+  float spread = model.periodUs * SPRT_PERIOD_SPREAD;
+  float variance = spread * spread + SPRT_JITTER_US * SPRT_JITTER_US;
+  model.halfInvVariance = 0.5f / variance;
+  model.peak = logf((1.0f - SPRT_OUTLIER_PROB) / sqrtf(2.0f * (float)M_PI * variance));
+  return model;
+}
+
+const SprtCarModel SPRT_MODEL[SPRT_NUM_CARS] = {
+  makeSprtModel(0), makeSprtModel(1), makeSprtModel(2),
+  makeSprtModel(3), makeSprtModel(4), makeSprtModel(5),
+};
+
+struct SprtState {
+  float logLikelihood[SPRT_NUM_CARS + 1];  // [0] unknown, [1..6] cars
+  int intervals;
+};
+
+void sprtClear(SprtState& state) {
+  for (int h = 0; h <= SPRT_NUM_CARS; h++) state.logLikelihood[h] = 0;
+  state.intervals = 0;
+}
+
+// Add one valid interval (micros)
+void sprtUpdate(SprtState& state, uint32_t intervalUs) {
+  state.logLikelihood[0] += SPRT_FLAT;
+  for (int c = 0; c < SPRT_NUM_CARS; c++) {
+    const SprtCarModel& model = SPRT_MODEL[c];
+    float d = intervalUs - model.periodUs;
+    float inlier = model.peak - d * d * model.halfInvVariance;
+    // max() instead of log-sum-exp: within a fraction of a nat, and no exp/log per interval
+    state.logLikelihood[c + 1] += inlier > SPRT_OUTLIER ? inlier : SPRT_OUTLIER;
+  }
+  state.intervals++;
+}
+
+// Car 1-6 once it leads every other hypothesis by SPRT_THRESHOLD, else 0 (undecided)
+int sprtDecision(const SprtState& state) {
+  int best = 0;
+  float second = -INFINITY;
+  for (int h = 1; h <= SPRT_NUM_CARS; h++) {
+    if (state.logLikelihood[h] > state.logLikelihood[best]) best = h;
+  }
+  for (int h = 0; h <= SPRT_NUM_CARS; h++) {
+    if (h != best && state.logLikelihood[h] > second) second = state.logLikelihood[h];
+  }
+  if (best == 0 || state.logLikelihood[best] - second < SPRT_THRESHOLD) return 0;
+  return best;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef TONE_BANK_H
+#define TONE_BANK_H
+
+#include <stdint.h>
+#include <math.h>
+#include <stdlib.h>
+#include "scalextric_protocol.h"
+
+// Tone-bank car classifier
+// Treats the captured falling edges as impulses and runs one Goertzel-style
+// single-bin DFT per car frequency over them:
+//   S_c = sum_k exp(-j * 2pi * f_c * (t_k - t_0))
+// Edges from car c line up in phase at f_c, so |S_c| / n is close to 1, while
+// reflections, bounce and a second car's edges land at random phases and only
+// dilute the score. Unlike the median interval, a spurious edge that splits a
+// period does not produce a wrong interval - it just adds one noisy term.
+//
+// Each car gets TONE_BINS bins spread across its +/- FREQUENCY_TOLERANCE_PCT band
+// and scores the best of them, so a car running a few percent off nominal stays
+// coherent over the whole window.
+//
+// Edges at f are also coherent at 2f, so car 5 (2800 Hz) scores well on car 1's
+// bins (5500 Hz) and a slow car 6 (2400 Hz) on car 2's (4400 Hz). Edges at 2f are
+// not coherent at f, though, so when both a car and its subharmonic score well the
+// subharmonic wins, and the runner-up used for confidence skips harmonics of the winner.
+//
+// Integer only: the phase of each edge is (dt * f) mod 1e6, looked up in a
+// 64-entry cosine table, so scoring n edges costs 6 * TONE_BINS * n table lookups.
+
+const int TONE_NUM_CARS = 6;
+const int TONE_BINS = 3;
+const int TONE_LUT_SIZE = 64;
+
+// round(127 * cos(2pi * i / 64)); sin(x) = cos(x - pi/2) = TONE_COS[(i + 48) % 64]
+const int8_t TONE_COS[TONE_LUT_SIZE] = {
+   127,  126,  125,  122,  117,  112,  106,   98,   90,   81,   71,   60,   49,   37,   25,   12,
+     0,  -12,  -25,  -37,  -49,  -60,  -71,  -81,  -90,  -98, -106, -112, -117, -122, -125, -126,
+  -127, -126, -125, -122, -117, -112, -106,  -98,  -90,  -81,  -71,  -60,  -49,  -37,  -25,  -12,
+     0,   12,   25,   37,   49,   60,   71,   81,   90,   98,  106,  112,  117,  122,  125,  126,
+};
+
+struct ToneScores {
+  float coherence[TONE_NUM_CARS];  // |S_c| / n, 0 (random) .. 1 (perfectly periodic at f_c)
+  int bestCar;                     // 1-6
+  float confidence;                // 1 - second best / best, 0 (tie) .. 1 (unique)
+};
+
+const float TONE_SUBHARMONIC_RATIO = 0.8;  // subharmonic wins if it scores this close to the best
+
+// True if car b's band overlaps 2x or 3x car a's band (both may be off nominal)
+bool isToneHarmonic(int a, int b) {
+  for (int k = 2; k <= 3; k++) {
+    float diff = abs(CAR_FREQUENCIES[b] - k * CAR_FREQUENCIES[a]);
+    if (diff < CAR_FREQUENCIES[b] * FREQUENCY_TOLERANCE_PCT * 2) return true;
+  }
+  return false;
+}
+
+// Coherence of n edges at a single frequency
+constexpr uint32_t TONE_MAX_PRODUCT_SPAN_US =  // CAR_FREQUENCIES[0] is the highest
+    (uint32_t)(4294967295.0 / (CAR_FREQUENCIES[0] * (1.0 + FREQUENCY_TOLERANCE_PCT / 2)));
+
+float toneCoherence(const uint32_t* edges, int n, uint32_t freq) {
+  int32_t re = 0;
+  int32_t im = 0;
+  for (int k = 0; k < n; k++) {
+    uint32_t phase = ((edges[k] - edges[0]) * freq) % 1000000;
+    int idx = phase * TONE_LUT_SIZE / 1000000;
+    re += TONE_COS[idx];
+    im += TONE_COS[(idx + 48) % TONE_LUT_SIZE];
+  }
+  return sqrtf((float)re * re + (float)im * im) / (127.0f * n);
+}
+
+// Score n edge timestamps (micros, oldest first, n >= 2).
+// dt * f must fit in 32 bits: at the highest bin (5.5 kHz + 4%, ~5.72 kHz) the span from
+// first to last edge must stay below TONE_MAX_PRODUCT_SPAN_US (~0.75 s).
+void scoreToneBank(const uint32_t* edges, int n, ToneScores& out) {
+  out.bestCar = 0;
+  for (int c = 0; c < TONE_NUM_CARS; c++) {
+    out.coherence[c] = 0;
+    for (int b = 0; b < TONE_BINS; b++) {
+      float offset = (2.0f * b / (TONE_BINS - 1) - 1.0f) * FREQUENCY_TOLERANCE_PCT / 2;
+      float coherence = toneCoherence(edges, n, (uint32_t)(CAR_FREQUENCIES[c] * (1.0f + offset)));
+      if (coherence > out.coherence[c]) out.coherence[c] = coherence;
+    }
+    if (out.bestCar == 0 || out.coherence[c] > out.coherence[out.bestCar - 1]) {
+      out.bestCar = c + 1;
+    }
+  }
+
+  for (int c = 0; c < TONE_NUM_CARS; c++) {
+    if (isToneHarmonic(c, out.bestCar - 1) &&
+        out.coherence[c] >= out.coherence[out.bestCar - 1] * TONE_SUBHARMONIC_RATIO) {
+      out.bestCar = c + 1;
+      break;
+    }
+  }
+
+  float best = out.coherence[out.bestCar - 1];
+  float second = 0;
+  for (int c = 0; c < TONE_NUM_CARS; c++) {
+    if (c == out.bestCar - 1 || isToneHarmonic(out.bestCar - 1, c)) continue;
+    if (out.coherence[c] > second) second = out.coherence[c];
+  }
+  out.confidence = best > 0 ? 1.0f - second / best : 0;
+}
+
+#endif
@@ -0,0 +1,26 @@
+# PlatformIO post-build script: run a host program and fail the build if it fails
+#
+# Used by the scalextric_golden_* native envs: the golden corpus suite
+# (src/native/scalextric_golden_suite.cpp) runs right after linking and exits
+# non-zero when accuracy, pulses-to-decision, time-to-decision or cycles per pulse
+# regress past their tolerance, or when accuracy in any scenario is below its
+# absolute floor (golden_corpus.h), so `pio run -e scalextric_golden_sprt` is the check.
+#
+# Enable per env with: extra_scripts = post:scripts/golden_gate.py
+
+Import("env")
+
+import os
+import subprocess
+
+
+def gate(target, source, env):
+    program = target[0].get_abspath()
+    if not os.path.isfile(program):
+        return 1
+    print("# Golden gate %s" % env["PIOENV"])
+    # Non-zero return fails the SCons action, and with it the build
+    return subprocess.call([program])
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}", gate)
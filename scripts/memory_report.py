@@ -0,0 +1,86 @@
+# PlatformIO post-build script: static RAM / IRAM report for detector firmware
+#
+# Prints IRAM and DRAM use of the linked firmware, and how much of each the car
+# detector takes (sensor state arrays + ISR trampolines), so sensor-count
+# configurations (SENSOR_PIN_LIST) can be compared env by env:
+#
+#   # Memory scalextric_child (4 sensors): IRAM 58212 / 131072 (44.4%), DRAM 41872 bytes
+#   #   detector: DRAM 3392 bytes, IRAM 248 bytes
+#
+# Enable per env with: extra_scripts = post:scripts/memory_report.py
+
+Import("env")
+
+import os
+import subprocess
+
+IRAM_TOTAL = 128 * 1024
+IRAM_SECTIONS = (".iram0.vectors", ".iram0.text")
+DRAM_SECTIONS = (".dram0.data", ".dram0.bss", ".noinit")
+
+# Internal instruction RAM (code in DRAM-aliased IRAM), excludes flash-mapped code
+IRAM_START = 0x40070000
+IRAM_END = 0x400C0000
+
+# Symbols owned by car_detection.h
+DETECTOR_SYMBOLS = ("sensors", "sensorEdges", "sensorClocks", "pendingSensors", "detectingSensors",
+                    "sensorCalibration", "sensorCarLut", "sensorHealth", "onPulse", "onCapture", "onMcpwmCapture")
+
+DEFAULT_SENSOR_COUNT = 4
+
+
+def tool(name):
+    # $SIZETOOL is e.g. xtensa-esp32-elf-size; nm lives next to it
+    size_tool = env.subst("$SIZETOOL")
+    return size_tool[: -len("size")] + name if size_tool.endswith("size") else name
+
+
+def sensor_count():
+    for define in env.get("CPPDEFINES", []):
+        if isinstance(define, (tuple, list)) and define[0] == "SENSOR_PIN_LIST":
+            return len(str(define[1]).split(","))
+    return DEFAULT_SENSOR_COUNT
+
+
+def section_sizes(elf):
+    sizes = {}
+    output = subprocess.check_output([tool("size"), "-A", elf]).decode()
+    for line in output.splitlines():
+        parts = line.split()
+        if len(parts) >= 2 and parts[0].startswith(".") and parts[1].isdigit():
+            sizes[parts[0]] = int(parts[1])
+    return sizes
+
+
+def detector_sizes(elf):
+    iram = 0
+    dram = 0
+    output = subprocess.check_output([tool("nm"), "-S", "-C", elf]).decode()
+    for line in output.splitlines():
+        parts = line.split(None, 3)
+        if len(parts) < 4 or not parts[3].startswith(DETECTOR_SYMBOLS):
+            continue
+        address = int(parts[0], 16)
+        size = int(parts[1], 16)
+        if IRAM_START <= address < IRAM_END:
+            iram += size
+        elif parts[2] in "bBdD":
+            dram += size
+    return iram, dram
+
+
+def report(target, source, env):
+    elf = target[0].get_abspath()
+    if not os.path.isfile(elf):
+        return
+    sizes = section_sizes(elf)
+    iram = sum(sizes.get(name, 0) for name in IRAM_SECTIONS)
+    dram = sum(sizes.get(name, 0) for name in DRAM_SECTIONS)
+    detector_iram, detector_dram = detector_sizes(elf)
+
+    print("# Memory %s (%d sensors): IRAM %d / %d (%.1f%%), DRAM %d bytes" % (
+        env["PIOENV"], sensor_count(), iram, IRAM_TOTAL, 100.0 * iram / IRAM_TOTAL, dram))
+    print("#   detector: DRAM %d bytes, IRAM %d bytes" % (detector_dram, detector_iram))
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", report)
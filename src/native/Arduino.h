@@ -0,0 +1,57 @@
+#ifndef NATIVE_ARDUINO_SHIM_H
+#define NATIVE_ARDUINO_SHIM_H
+
+// Minimal Arduino shim for host (native) builds
+// Provides just enough of the Arduino core for car_detection.h to compile on Linux.
+// Time is simulated: the benchmark sets the clock with hostSetMicros() before
+// calling the ISR / processing functions.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmath>
+
+using std::abs;
+
+#define IRAM_ATTR
+#define INPUT_PULLUP 0x05
+#define FALLING 0x02
+#define LOW 0x0
+#define HIGH 0x1
+
+#define digitalPinToInterrupt(p) (p)
+
+// ========== SIMULATED CLOCK ==========
+
+static uint64_t hostMicros = 0;
+
+inline void hostSetMicros(uint64_t us) { hostMicros = us; }
+
+// Truncate to 32 bits like the ESP32 core so wraparound behaves the same
+inline unsigned long micros() { return (uint32_t)hostMicros; }
+inline unsigned long millis() { return (uint32_t)(hostMicros / 1000); }
+inline int64_t esp_timer_get_time() { return (int64_t)hostMicros; }
+
+// ========== SIMULATED PINS ==========
+
+// Tests set input levels with hostPinLow and see which pins have an interrupt attached
+const int HOST_NUM_PINS = 40;
+static bool hostPinLow[HOST_NUM_PINS];
+static bool hostInterruptAttached[HOST_NUM_PINS];
+
+inline int digitalRead(int pin) { return hostPinLow[pin] ? LOW : HIGH; }
+inline void attachInterrupt(int pin, void (*isr)(), int mode) {
+  (void)isr;
+  (void)mode;
+  hostInterruptAttached[pin] = true;
+}
+inline void detachInterrupt(int pin) { hostInterruptAttached[pin] = false; }
+
+// ========== NO-OP HARDWARE ==========
+
+inline void noInterrupts() {}
+inline void interrupts() {}
+inline void pinMode(int pin, int mode) { (void)pin; (void)mode; }
+
+#endif
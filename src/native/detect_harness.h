@@ -0,0 +1,130 @@
+#ifndef DETECT_HARNESS_H
+#define DETECT_HARNESS_H
+
+#include <Arduino.h>
+#include <vector>
+#include "car_detection.h"
+
+// Host harness: replays edge timestamps through the real detector
+// Edges are injected through an EdgeFeed (by default onPulse() with the simulated
+// clock set to the edge time, i.e. CAPTURE_GPIO_ISR with zero interrupt latency),
+// and processDeadlines() + processSensor() are polled at LOOP_PERIOD_US like loop() +
+// delay(1) on the ESP32.
+// Built with -DDETECTION_TASK=1 it models the detection task instead: processSensor()
+// runs right after every edge and processDeadlines() exactly at each sensor deadline
+// (the esp_timer), ignoring the task's wake-up cost.
+
+const uint64_t LOOP_PERIOD_US = 1000;
+
+// Deliver one edge that happened at edgeUs to sensor 0
+typedef void (*EdgeFeed)(uint64_t edgeUs);
+
+void feedGpioEdge(uint64_t edgeUs) {
+  hostSetMicros(edgeUs);
+  onPulse(0);
+}
+
+struct PassResult {
+  bool detected;          // onCarDetected fired at least once
+  int car;                // first reported car (0 = unknown)
+  int edgesToDecision;    // raw edges fed to the ISR before the first report
+  uint64_t usToDecision;  // first edge -> first report
+  int reports;            // total reports during the pass
+  uint64_t latencyUs;     // last edge fed -> first report (ISR-to-callback latency)
+  int passes;             // onPassComplete calls (1 per pass, 0 if it was noise)
+  uint16_t speedMmps;     // estimated speed of the completed pass
+  uint8_t carMask;        // every car reported during the pass, bit car - 1
+  EventQuality quality;   // of the first report
+};
+
+static PassResult* harnessResult = nullptr;
+static uint64_t harnessFirstEdge = 0;
+static int harnessEdgesFed = 0;
+static uint64_t harnessLastEdge = 0;
+
+void harnessOnCarDetected(uint8_t sensorId, int car, float freq) {
+  (void)freq;
+  PassResult& r = *harnessResult;
+  if (r.reports++ == 0) {
+    r.detected = true;
+    r.car = car;
+    r.edgesToDecision = harnessEdgesFed;
+    r.usToDecision = hostMicros - harnessFirstEdge;
+    r.latencyUs = hostMicros - harnessLastEdge;
+    r.quality = lastEventQuality(sensorId);
+  }
+  if (car >= 1 && car <= 8) r.carMask |= 1 << (car - 1);
+}
+
+void harnessOnPassComplete(const PassInfo& pass) {
+  PassResult& r = *harnessResult;
+  r.passes++;
+  r.speedMmps = pass.speedMmps;
+}
+
+// DETECTION_TASK: fire every deadline due before untilUs at its exact time
+void runDeadlinesUntil(uint64_t untilUs) {
+  while (!sensorDeadlines.empty()) {
+    uint64_t at = sensorDeadlines.earliest();
+    if (at >= untilUs) break;
+    if (at < hostMicros) at = hostMicros;
+    hostSetMicros(at);
+    processDeadlines(harnessOnCarDetected, harnessOnPassComplete);
+  }
+}
+
+// Feed one pass worth of edges into sensor 0 and poll until the detector has reset.
+// pollPhaseUs offsets the loop schedule relative to the first edge.
+PassResult runPass(const std::vector<uint64_t>& edges, uint64_t pollPhaseUs,
+                   EdgeFeed feed = feedGpioEdge) {
+  PassResult result = {false, 0, 0, 0, 0, 0, 0, 0, 0, {}};
+  if (edges.empty()) return result;
+
+  harnessResult = &result;
+  harnessFirstEdge = edges.front();
+  harnessEdgesFed = 0;
+
+  SensorState& sensor = sensors[0];
+
+#if DETECTION_TASK
+  (void)pollPhaseUs;
+  for (size_t i = 0; i < edges.size(); i++) {
+    runDeadlinesUntil(edges[i]);
+    feed(edges[i]);
+    harnessEdgesFed++;
+    harnessLastEdge = edges[i];
+    processSensor(sensor, harnessOnCarDetected);
+  }
+
+  // Woken by the deadline timer
+  runDeadlinesUntil(UINT64_MAX);
+#else
+  uint64_t nextPoll = edges.front() + pollPhaseUs % LOOP_PERIOD_US;
+
+  for (size_t i = 0; i < edges.size(); i++) {
+    while (nextPoll <= edges[i]) {
+      hostSetMicros(nextPoll);
+      processDeadlines(harnessOnCarDetected, harnessOnPassComplete);
+      processSensor(sensor, harnessOnCarDetected);
+      nextPoll += LOOP_PERIOD_US;
+    }
+    feed(edges[i]);
+    harnessEdgesFed++;
+    harnessLastEdge = edges[i];
+  }
+
+  // Keep polling until the timeout has reset the sensor
+  uint64_t quietUntil = edges.back() + DETECTION_TIMEOUT + 2 * LOOP_PERIOD_US;
+  while (nextPoll <= quietUntil) {
+    hostSetMicros(nextPoll);
+    processDeadlines(harnessOnCarDetected, harnessOnPassComplete);
+    processSensor(sensor, harnessOnCarDetected);
+    nextPoll += LOOP_PERIOD_US;
+  }
+#endif
+
+  harnessResult = nullptr;
+  return result;
+}
+
+#endif
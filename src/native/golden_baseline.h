@@ -0,0 +1,115 @@
+#ifndef GOLDEN_BASELINE_H
+#define GOLDEN_BASELINE_H
+
+#include "golden_corpus.h"
+
+// Accepted results of scalextric_golden_suite on golden corpus v1
+// Regenerate a config's rows with: scalextric_golden_suite --print-baseline
+// (after an intended change, in the same commit as the change). Cycles are host
+// timings, so take each row's median over a few runs rather than a single run.
+
+const uint32_t GOLDEN_BASELINE_DIGEST = 0x414081ba;
+
+const GoldenMetrics GOLDEN_BASELINE[] = {
+  {"median", "clean", 100.00f, 0.00f, 15.64f, 4278.0f, 168.1f},
+  {"median", "speed-6", 99.17f, 0.00f, 14.42f, 4339.6f, 210.7f},
+  {"median", "speed-10", 79.17f, 0.00f, 9.83f, 4152.1f, 236.2f},
+  {"median", "ambient-ir", 99.58f, 0.42f, 19.48f, 4293.2f, 236.5f},
+  {"median", "overlap", 96.25f, 3.75f, 21.79f, 4559.1f, 264.1f},
+  {"median", "dropouts", 100.00f, 0.00f, 15.25f, 4869.7f, 169.5f},
+  {"median", "jitter", 100.00f, 0.00f, 15.64f, 4278.0f, 204.2f},
+  {"median", "drift", 100.00f, 0.00f, 15.63f, 4294.7f, 169.5f},
+  {"median", "overall", 96.77f, 0.52f, 16.10f, 4388.5f, 208.9f},
+  {"median-task", "clean", 100.00f, 0.00f, 10.83f, 2931.7f, 209.1f},
+  {"median-task", "speed-6", 99.17f, 0.00f, 10.93f, 3003.3f, 229.2f},
+  {"median-task", "speed-10", 79.17f, 0.00f, 9.31f, 2886.7f, 210.4f},
+  {"median-task", "ambient-ir", 99.58f, 0.42f, 13.43f, 2954.2f, 336.4f},
+  {"median-task", "overlap", 96.67f, 3.33f, 15.12f, 3127.7f, 349.7f},
+  {"median-task", "dropouts", 100.00f, 0.00f, 11.43f, 3645.0f, 203.5f},
+  {"median-task", "jitter", 100.00f, 0.00f, 10.84f, 2933.9f, 240.3f},
+  {"median-task", "drift", 100.00f, 0.00f, 10.83f, 2942.1f, 215.9f},
+  {"median-task", "overall", 96.82f, 0.47f, 11.64f, 3057.3f, 260.0f},
+  {"tone", "clean", 100.00f, 0.00f, 8.05f, 2215.5f, 591.3f},
+  {"tone", "speed-6", 100.00f, 0.00f, 8.00f, 2223.8f, 560.8f},
+  {"tone", "speed-10", 80.83f, 0.00f, 7.42f, 2019.9f, 517.3f},
+  {"tone", "ambient-ir", 99.58f, 0.42f, 9.67f, 2147.2f, 601.4f},
+  {"tone", "overlap", 97.92f, 2.08f, 11.53f, 2397.7f, 634.1f},
+  {"tone", "dropouts", 100.00f, 0.00f, 7.49f, 2361.3f, 737.8f},
+  {"tone", "jitter", 100.00f, 0.00f, 7.89f, 2161.3f, 661.6f},
+  {"tone", "drift", 82.50f, 0.00f, 7.57f, 2001.8f, 618.4f},
+  {"tone", "overall", 95.10f, 0.31f, 8.49f, 2199.2f, 619.1f},
+  {"tone-task", "clean", 100.00f, 0.00f, 8.67f, 2298.1f, 1512.9f},
+  {"tone-task", "speed-6", 100.00f, 0.00f, 8.64f, 2315.8f, 1146.2f},
+  {"tone-task", "speed-10", 80.83f, 0.00f, 7.59f, 2377.7f, 740.3f},
+  {"tone-task", "ambient-ir", 100.00f, 0.00f, 10.06f, 2192.7f, 1641.4f},
+  {"tone-task", "overlap", 98.33f, 1.67f, 11.45f, 2337.8f, 1610.7f},
+  {"tone-task", "dropouts", 100.00f, 0.00f, 8.23f, 2513.6f, 1693.9f},
+  {"tone-task", "jitter", 100.00f, 0.00f, 8.58f, 2269.3f, 1927.8f},
+  {"tone-task", "drift", 82.50f, 0.00f, 8.15f, 2072.3f, 1576.7f},
+  {"tone-task", "overall", 95.21f, 0.21f, 8.97f, 2300.2f, 1590.2f},
+  {"sprt", "clean", 100.00f, 0.00f, 5.72f, 1528.0f, 176.2f},
+  {"sprt", "speed-6", 100.00f, 0.00f, 6.04f, 1623.8f, 214.7f},
+  {"sprt", "speed-10", 97.92f, 0.00f, 5.93f, 1601.5f, 246.6f},
+  {"sprt", "ambient-ir", 99.58f, 0.00f, 9.18f, 2081.5f, 238.7f},
+  {"sprt", "overlap", 86.25f, 0.00f, 13.43f, 2849.7f, 308.6f},
+  {"sprt", "dropouts", 100.00f, 0.00f, 6.25f, 1928.0f, 216.8f},
+  {"sprt", "jitter", 100.00f, 0.00f, 7.04f, 1848.8f, 217.0f},
+  {"sprt", "drift", 100.00f, 0.00f, 7.41f, 2078.0f, 186.5f},
+  {"sprt", "overall", 97.97f, 0.00f, 7.53f, 1927.3f, 240.4f},
+  {"sprt-task", "clean", 100.00f, 0.00f, 4.35f, 1022.1f, 180.8f},
+  {"sprt-task", "speed-6", 100.00f, 0.00f, 4.63f, 1112.4f, 189.3f},
+  {"sprt-task", "speed-10", 98.33f, 0.00f, 4.57f, 1088.6f, 174.8f},
+  {"sprt-task", "ambient-ir", 99.58f, 0.00f, 7.05f, 1496.3f, 277.8f},
+  {"sprt-task", "overlap", 87.50f, 0.00f, 10.18f, 2086.0f, 303.1f},
+  {"sprt-task", "dropouts", 100.00f, 0.00f, 5.06f, 1425.2f, 179.0f},
+  {"sprt-task", "jitter", 100.00f, 0.00f, 5.54f, 1318.2f, 213.9f},
+  {"sprt-task", "drift", 100.00f, 0.00f, 6.01f, 1556.5f, 190.2f},
+  {"sprt-task", "overall", 98.18f, 0.00f, 5.86f, 1377.6f, 227.0f},
+  {"median-cal", "clean", 100.00f, 0.00f, 14.00f, 3794.7f, 240.0f},
+  {"median-cal", "speed-6", 100.00f, 0.00f, 13.65f, 3853.0f, 349.1f},
+  {"median-cal", "speed-10", 83.33f, 0.00f, 9.67f, 3753.4f, 427.2f},
+  {"median-cal", "ambient-ir", 99.58f, 0.42f, 17.59f, 3841.3f, 306.1f},
+  {"median-cal", "overlap", 97.08f, 2.92f, 20.17f, 4226.5f, 312.6f},
+  {"median-cal", "dropouts", 100.00f, 0.00f, 13.56f, 4273.8f, 234.6f},
+  {"median-cal", "jitter", 100.00f, 0.00f, 14.03f, 3807.2f, 251.6f},
+  {"median-cal", "drift", 100.00f, 0.00f, 14.04f, 3823.8f, 229.7f},
+  {"median-cal", "overall", 97.50f, 0.42f, 14.67f, 3924.2f, 275.5f},
+  {"median-task-cal", "clean", 100.00f, 0.00f, 9.23f, 2458.2f, 210.3f},
+  {"median-task-cal", "speed-6", 100.00f, 0.00f, 9.39f, 2533.8f, 298.4f},
+  {"median-task-cal", "speed-10", 83.33f, 0.00f, 8.54f, 2454.6f, 334.4f},
+  {"median-task-cal", "ambient-ir", 99.58f, 0.42f, 11.56f, 2508.1f, 300.7f},
+  {"median-task-cal", "overlap", 97.08f, 2.92f, 13.40f, 2770.8f, 313.9f},
+  {"median-task-cal", "dropouts", 100.00f, 0.00f, 9.66f, 3038.0f, 218.8f},
+  {"median-task-cal", "jitter", 100.00f, 0.00f, 9.33f, 2484.1f, 243.2f},
+  {"median-task-cal", "drift", 100.00f, 0.00f, 9.24f, 2467.3f, 208.6f},
+  {"median-task-cal", "overall", 97.50f, 0.42f, 10.06f, 2591.6f, 264.4f},
+  {"median-nooverlap", "clean", 100.00f, 0.00f, 15.64f, 4278.0f, 164.5f},
+  {"median-nooverlap", "speed-6", 99.17f, 0.00f, 14.42f, 4339.6f, 200.8f},
+  {"median-nooverlap", "speed-10", 79.17f, 0.00f, 9.83f, 4152.1f, 239.9f},
+  {"median-nooverlap", "ambient-ir", 99.58f, 0.42f, 19.48f, 4293.2f, 164.1f},
+  {"median-nooverlap", "overlap", 96.25f, 3.75f, 21.79f, 4559.1f, 158.5f},
+  {"median-nooverlap", "dropouts", 100.00f, 0.00f, 15.25f, 4869.7f, 162.5f},
+  {"median-nooverlap", "jitter", 100.00f, 0.00f, 15.64f, 4278.0f, 203.9f},
+  {"median-nooverlap", "drift", 100.00f, 0.00f, 15.63f, 4294.7f, 171.0f},
+  {"median-nooverlap", "overall", 96.77f, 0.52f, 16.10f, 4388.5f, 174.7f},
+  {"tone-nooverlap", "clean", 100.00f, 0.00f, 8.05f, 2215.5f, 548.2f},
+  {"tone-nooverlap", "speed-6", 100.00f, 0.00f, 8.00f, 2223.8f, 516.3f},
+  {"tone-nooverlap", "speed-10", 80.83f, 0.00f, 7.42f, 2019.9f, 456.5f},
+  {"tone-nooverlap", "ambient-ir", 99.58f, 0.42f, 9.67f, 2147.2f, 513.0f},
+  {"tone-nooverlap", "overlap", 97.92f, 2.08f, 11.53f, 2397.7f, 539.1f},
+  {"tone-nooverlap", "dropouts", 100.00f, 0.00f, 7.49f, 2361.3f, 651.1f},
+  {"tone-nooverlap", "jitter", 100.00f, 0.00f, 7.89f, 2161.3f, 562.8f},
+  {"tone-nooverlap", "drift", 82.50f, 0.00f, 7.57f, 2001.8f, 516.0f},
+  {"tone-nooverlap", "overall", 95.10f, 0.31f, 8.49f, 2199.2f, 568.4f},
+  {"sprt-nooverlap", "clean", 100.00f, 0.00f, 5.72f, 1528.0f, 169.5f},
+  {"sprt-nooverlap", "speed-6", 100.00f, 0.00f, 6.04f, 1623.8f, 207.4f},
+  {"sprt-nooverlap", "speed-10", 97.92f, 0.00f, 5.93f, 1601.5f, 255.0f},
+  {"sprt-nooverlap", "ambient-ir", 99.58f, 0.00f, 9.18f, 2081.5f, 182.3f},
+  {"sprt-nooverlap", "overlap", 86.25f, 0.00f, 13.43f, 2849.7f, 166.0f},
+  {"sprt-nooverlap", "dropouts", 100.00f, 0.00f, 6.25f, 1928.0f, 170.4f},
+  {"sprt-nooverlap", "jitter", 100.00f, 0.00f, 7.04f, 1848.8f, 196.3f},
+  {"sprt-nooverlap", "drift", 100.00f, 0.00f, 7.41f, 2078.0f, 172.5f},
+  {"sprt-nooverlap", "overall", 97.97f, 0.00f, 7.53f, 1927.3f, 179.5f},
+};
+
+#endif
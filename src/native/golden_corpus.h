@@ -0,0 +1,109 @@
+#ifndef GOLDEN_CORPUS_H
+#define GOLDEN_CORPUS_H
+
+#include <stdint.h>
+#include <vector>
+#include "edge_trace.h"
+#include "pulse_sim.h"
+
+// Golden corpus for the detector regression suite (host only)
+// A fixed set of labelled edge traces in the edge_trace.h format, so a corpus trace
+// and a field capture from scalextric_trace_logger replay the same way. The traces
+// are generated from PulseSim with fixed seeds rather than stored as binaries; the
+// suite checks their digest against golden_baseline.h, so any change to the
+// simulator or the scenarios shows up as a new corpus, never as a silent shift in
+// the metrics. Changing a scenario means bumping GOLDEN_CORPUS_VERSION and
+// re-baselining (scalextric_golden_suite --print-baseline).
+
+const int GOLDEN_CORPUS_VERSION = 1;
+const int GOLDEN_PASSES_PER_CAR = 40;
+const uint64_t GOLDEN_CORPUS_SEED = 0x5CA1E7E1;
+
+struct GoldenScenario {
+  const char* name;
+  PassConfig cfg;    // car is overridden per pass
+  bool randomDrift;  // +/- freqOffsetPct, random sign per pass
+  float floorPct;    // accuracy every config must reach, whatever its baseline says
+};
+
+// PassConfig: car, speed m/s, view mm, drift, jitter us, dropout, bounce, glitch, other car, other prob
+const GoldenScenario GOLDEN_SCENARIOS[] = {
+  {"clean",      {1,  2.0f, 25.0f, 0.00f, 2.0f, 0.00f, 0.00f, 0.00f, 0, 0.0f}, false, 99.0f},
+  {"speed-6",    {1,  6.0f, 25.0f, 0.00f, 3.0f, 0.02f, 0.00f, 0.01f, 0, 0.0f}, false, 95.0f},
+  {"speed-10",   {1, 10.0f, 25.0f, 0.00f, 3.0f, 0.02f, 0.00f, 0.01f, 0, 0.0f}, false, 75.0f},
+  {"ambient-ir", {1,  2.0f, 25.0f, 0.00f, 4.0f, 0.00f, 0.10f, 0.15f, 0, 0.0f}, false, 95.0f},
+  {"overlap",    {1,  2.0f, 25.0f, 0.00f, 2.0f, 0.00f, 0.00f, 0.00f, 1, 0.3f}, false, 85.0f},
+  {"dropouts",   {1,  2.0f, 25.0f, 0.00f, 2.0f, 0.15f, 0.00f, 0.00f, 0, 0.0f}, false, 95.0f},
+  {"jitter",     {1,  2.0f, 25.0f, 0.00f, 8.0f, 0.00f, 0.00f, 0.00f, 0, 0.0f}, false, 95.0f},
+  {"drift",      {1,  2.0f, 25.0f, 0.04f, 2.0f, 0.00f, 0.00f, 0.00f, 0, 0.0f}, true,  80.0f},
+};
+const float GOLDEN_OVERALL_FLOOR_PCT = 90.0f;
+const int GOLDEN_NUM_SCENARIOS = sizeof(GOLDEN_SCENARIOS) / sizeof(GOLDEN_SCENARIOS[0]);
+
+struct GoldenPass {
+  int car;           // what the detector should report
+  uint64_t startUs;  // edges of this pass lie in [startUs, endUs]
+  uint64_t endUs;
+};
+
+struct GoldenTrace {
+  const char* name;
+  std::vector<uint8_t> bytes;  // edge_trace.h frames, sensor 0
+  std::vector<GoldenPass> passes;
+};
+
+GoldenTrace buildGoldenTrace(int scenario) {
+  const GoldenScenario& s = GOLDEN_SCENARIOS[scenario];
+  PulseSim sim(GOLDEN_CORPUS_SEED + scenario);
+  static TraceWriter writer;  // 16 KB buffer, drained after every pass
+  writer.reset();
+  GoldenTrace trace;
+  trace.name = s.name;
+  uint64_t t = 1000000;
+
+  for (int car = 1; car <= 6; car++) {
+    for (int p = 0; p < GOLDEN_PASSES_PER_CAR; p++) {
+      PassConfig cfg = s.cfg;
+      cfg.car = car;
+      if (s.randomDrift && sim.uniform() < 0.5) cfg.freqOffsetPct = -cfg.freqOffsetPct;
+      if (cfg.otherCar > 0) cfg.otherCar = 1 + (car + (int)(sim.uniform() * 5)) % 6;
+
+      std::vector<uint64_t> edges;
+      uint64_t end = sim.generatePass(cfg, t, edges);
+      for (size_t i = 0; i < edges.size(); i++) writer.edge(0, edges[i]);
+      writer.flush();
+      GoldenPass pass = {car, t, edges.empty() ? end : edges.back()};
+      trace.passes.push_back(pass);
+
+      uint8_t chunk[256];
+      int n;
+      while ((n = writer.buffer.pop(chunk, sizeof(chunk))) > 0) {
+        trace.bytes.insert(trace.bytes.end(), chunk, chunk + n);
+      }
+      t = end + DETECTION_TIMEOUT + 100000;  // idle track between passes
+    }
+  }
+  return trace;
+}
+
+// One row of the regression table (golden_baseline.h holds the accepted values)
+struct GoldenMetrics {
+  const char* config;      // classifier[-task], see scalextric_golden_suite
+  const char* scenario;    // GoldenScenario name or "overall"
+  float accuracyPct;       // reported the right car
+  float wrongPct;          // reported a different car
+  float pulses;            // edges to the first report, avg over correct passes
+  float usToDecision;      // first edge to first report, avg over correct passes
+  float cyclesPerPulse;    // host CPU cycles in the detector per edge
+};
+
+// FNV-1a over every trace, in order
+uint32_t goldenCorpusDigest(const std::vector<GoldenTrace>& corpus) {
+  uint32_t h = 2166136261u;
+  for (size_t t = 0; t < corpus.size(); t++) {
+    for (size_t i = 0; i < corpus[t].bytes.size(); i++) h = (h ^ corpus[t].bytes[i]) * 16777619u;
+  }
+  return h;
+}
+
+#endif
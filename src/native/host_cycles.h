@@ -0,0 +1,23 @@
+#ifndef HOST_CYCLES_H
+#define HOST_CYCLES_H
+
+#include <stdint.h>
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// CPU cycle counter for host benchmarks (the ESP32 side would read CCOUNT).
+// Falls back to nanoseconds where there is no cycle counter; still comparable run to
+// run on one machine.
+inline uint64_t readCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef PULSE_SIM_H
+#define PULSE_SIM_H
+
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "scalextric_protocol.h"
+
+// Synthetic IR pulse-train simulator (host only)
+// Emits falling-edge timestamps (micros) for one car passing over one sensor.
+// Deterministic for a given seed so benchmark runs are repeatable.
+
+struct PassConfig {
+  int car;               // 1-6
+  float speedMps;        // car speed over the sensor
+  float viewWidthMm;     // length of track over which the sensor sees the car's IR LED
+  float freqOffsetPct;   // emitter frequency error, e.g. 0.03 = 3% fast
+  float jitterUs;        // gaussian edge jitter (1 sigma)
+  float dropoutProb;     // probability a real edge is missed
+  float bounceProb;      // probability of a bounce edge 5-35us after a real edge
+  float glitchProb;      // probability of a spurious edge (reflection) somewhere in each period
+  int otherCar;          // second car in view at the same time (0 = none)
+  float otherProb;       // fraction of the second car's edges the sensor sees
+};
+
+const PassConfig DEFAULT_PASS = {1, 2.0f, 25.0f, 0.0f, 2.0f, 0.0f, 0.0f, 0.0f, 0, 0.0f};
+
+class PulseSim {
+ public:
+  explicit PulseSim(uint64_t seed) : state(seed ? seed : 0x9E3779B97F4A7C15ULL) {}
+
+  // xorshift64* - small, fast and good enough for test vectors
+  uint64_t next() {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+  }
+
+  double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+
+  double gaussian() {
+    double u1 = uniform();
+    double u2 = uniform();
+    if (u1 < 1e-12) u1 = 1e-12;
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+  }
+
+  // Pass duration in micros for a given speed and sensor view width
+  static uint64_t passDurationUs(const PassConfig& cfg) {
+    return (uint64_t)(cfg.viewWidthMm / cfg.speedMps * 1000.0);
+  }
+
+  // Append the edges of one pass starting at startUs (sorted), returns pass end time
+  uint64_t generatePass(const PassConfig& cfg, uint64_t startUs, std::vector<uint64_t>& edges) {
+    double freq = CAR_FREQUENCIES[cfg.car - 1] * (1.0 + cfg.freqOffsetPct);
+    double periodUs = 1000000.0 / freq;
+    uint64_t endUs = startUs + passDurationUs(cfg);
+    size_t first = edges.size();
+
+    // Car arrives at a random phase of its emitter cycle
+    for (double t = startUs + uniform() * periodUs; t < endUs; t += periodUs) {
+      if (uniform() >= cfg.dropoutProb) {
+        double jittered = t + gaussian() * cfg.jitterUs;
+        edges.push_back((uint64_t)(jittered < startUs ? startUs : jittered));
+      }
+      if (uniform() < cfg.bounceProb) {
+        edges.push_back((uint64_t)(t + 5 + uniform() * 30));
+      }
+      if (uniform() < cfg.glitchProb) {
+        edges.push_back((uint64_t)(t + uniform() * periodUs));
+      }
+    }
+
+    // Weaker second car (e.g. adjacent lane, reflection off another car)
+    if (cfg.otherCar > 0) {
+      double otherPeriodUs = 1000000.0 / CAR_FREQUENCIES[cfg.otherCar - 1];
+      for (double t = startUs + uniform() * otherPeriodUs; t < endUs; t += otherPeriodUs) {
+        if (uniform() < cfg.otherProb) {
+          edges.push_back((uint64_t)(t + gaussian() * cfg.jitterUs));
+        }
+      }
+    }
+
+    std::sort(edges.begin() + first, edges.end());
+    return endUs;
+  }
+
+ private:
+  uint64_t state;
+};
+
+#endif
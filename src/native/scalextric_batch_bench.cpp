@@ -0,0 +1,174 @@
+#include <Arduino.h>
+#include <vector>
+#include <algorithm>
+#include "car_detection.h"
+#include "pulse_sim.h"
+#include "host_cycles.h"
+
+// Batched Sensor Processing Benchmark (host)
+// Compares the cost of one loop() pass with the per-sensor loop
+//   for (i) processSensor(sensors[i], cb)
+// against the batched processAllSensors(cb), on identical edge streams, and checks
+// that both report the same cars at the same times. Cycles cover processDeadlines +
+// sensor processing only, not the simulated ISRs. Built once per sensor count:
+//   scalextric_batch_bench_4, _8, _16 (SENSOR_PIN_LIST)
+//
+// Usage: scalextric_batch_bench [seed]
+// Exits non-zero if the two paths disagree.
+
+const uint64_t LOOP_PERIOD_US = 1000;
+const int TIMING_RUNS = 5;  // cycles are the fastest run
+
+struct TimedEdge {
+  uint64_t timeUs;
+  int sensor;
+};
+
+bool byTime(const TimedEdge& a, const TimedEdge& b) {
+  return a.timeUs != b.timeUs ? a.timeUs < b.timeUs : a.sensor < b.sensor;
+}
+
+struct Workload {
+  const char* name;
+  std::vector<TimedEdge> edges;
+  uint64_t endUs;  // poll until here
+};
+
+void addPass(PulseSim& sim, Workload& w, int sensor, int car, uint64_t startUs) {
+  PassConfig cfg = DEFAULT_PASS;
+  cfg.car = car;
+  cfg.jitterUs = 3.0f;
+  cfg.glitchProb = 0.02f;
+  std::vector<uint64_t> edges;
+  uint64_t end = sim.generatePass(cfg, startUs, edges);
+  for (size_t i = 0; i < edges.size(); i++) {
+    TimedEdge e = {edges[i], sensor};
+    w.edges.push_back(e);
+  }
+  if (end + DETECTION_TIMEOUT + 10 * LOOP_PERIOD_US > w.endUs) {
+    w.endUs = end + DETECTION_TIMEOUT + 10 * LOOP_PERIOD_US;
+  }
+}
+
+std::vector<Workload> buildWorkloads(uint64_t seed) {
+  std::vector<Workload> workloads;
+  PulseSim sim(seed);
+
+  // Empty track for 2 seconds: what most loop() passes look like
+  Workload idle = {"idle", std::vector<TimedEdge>(), 2000000};
+  workloads.push_back(idle);
+
+  // One car at a time going round, crossing the sensors one after another
+  Workload single = {"one car", std::vector<TimedEdge>(), 0};
+  for (int lap = 0; lap < 4; lap++) {
+    for (int i = 0; i < NUM_SENSORS; i++) {
+      addPass(sim, single, i, 1 + (lap + i) % 6, 1000000 + (uint64_t)(lap * NUM_SENSORS + i) * 150000);
+    }
+  }
+  workloads.push_back(single);
+
+  // Every sensor with a car over it at once (a multi-lane start line)
+  Workload busy = {"all busy", std::vector<TimedEdge>(), 0};
+  for (int rep = 0; rep < 8; rep++) {
+    for (int i = 0; i < NUM_SENSORS; i++) {
+      addPass(sim, busy, i, 1 + i % 6, 1000000 + rep * 300000 + (uint64_t)(sim.uniform() * 2000));
+    }
+  }
+  workloads.push_back(busy);
+
+  for (size_t i = 0; i < workloads.size(); i++) {
+    std::sort(workloads[i].edges.begin(), workloads[i].edges.end(), byTime);
+  }
+  return workloads;
+}
+
+// ========== RUN ==========
+
+uint32_t detectionDigest;
+int detections;
+
+void onBenchDetection(uint8_t sensorId, int car, float freq) {
+  (void)freq;
+  uint64_t words[3] = {sensorId, (uint64_t)car, hostMicros};
+  for (int w = 0; w < 3; w++) {
+    for (int b = 0; b < 8; b++) detectionDigest = (detectionDigest ^ (uint8_t)(words[w] >> (8 * b))) * 16777619u;
+  }
+  detections++;
+}
+
+struct RunResult {
+  uint64_t cycles;
+  int polls;
+  uint32_t digest;
+  int detections;
+};
+
+RunResult runWorkload(const Workload& w, bool batched) {
+  initSensors();
+  detectionDigest = 2166136261u;
+  detections = 0;
+  RunResult r = {0, 0, 0, 0};
+
+  size_t next = 0;
+  for (uint64_t t = 1000000; t <= w.endUs; t += LOOP_PERIOD_US) {
+    while (next < w.edges.size() && w.edges[next].timeUs < t) {
+      hostSetMicros(w.edges[next].timeUs);
+      onPulse(w.edges[next].sensor);
+      next++;
+    }
+    hostSetMicros(t);
+    uint64_t start = readCycles();
+    processDeadlines(onBenchDetection);
+    if (batched) {
+      processAllSensors(onBenchDetection);
+    } else {
+      for (int i = 0; i < NUM_SENSORS; i++) processSensor(sensors[i], onBenchDetection);
+    }
+    r.cycles += readCycles() - start;
+    r.polls++;
+  }
+  r.digest = detectionDigest;
+  r.detections = detections;
+  return r;
+}
+
+RunResult bestOf(const Workload& w, bool batched) {
+  RunResult best = runWorkload(w, batched);
+  for (int run = 1; run < TIMING_RUNS; run++) {
+    RunResult r = runWorkload(w, batched);
+    if (r.cycles < best.cycles) best.cycles = r.cycles;
+  }
+  return best;
+}
+
+int main(int argc, char** argv) {
+  uint64_t seed = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1;
+
+  printf("# Batched sensor processing: %d sensors, classifier %d, seed %llu\n", NUM_SENSORS,
+         CAR_CLASSIFIER, (unsigned long long)seed);
+  printf("# Per sensor: loop state %u bytes, ISR state %u bytes (ring %u + clock %u)\n",
+         (unsigned)sizeof(SensorState), (unsigned)(sizeof(SensorEdgeRing) + sizeof(CaptureClock)),
+         (unsigned)sizeof(SensorEdgeRing), (unsigned)sizeof(CaptureClock));
+
+  std::vector<Workload> workloads = buildWorkloads(seed);
+  bool ok = true;
+
+  printf("\nworkload   polls   edges   cars  per-sensor cyc/pass  batched cyc/pass  speedup  result\n");
+  for (size_t i = 0; i < workloads.size(); i++) {
+    const Workload& w = workloads[i];
+    RunResult loopResult = bestOf(w, false);
+    RunResult batchResult = bestOf(w, true);
+    bool same = loopResult.digest == batchResult.digest &&
+                loopResult.detections == batchResult.detections;
+    ok = ok && same;
+    double perSensor = (double)loopResult.cycles / loopResult.polls;
+    double batched = (double)batchResult.cycles / batchResult.polls;
+    printf("%-10s %-7d %-7u %-5d %-20.1f %-17.1f %-8.2f %s\n", w.name, loopResult.polls,
+           (unsigned)w.edges.size(), loopResult.detections, perSensor, batched,
+           batched > 0 ? perSensor / batched : 0.0, same ? "ok" : "MISMATCH");
+  }
+
+  printf("\n%s\n", ok ? "PASS: batched and per-sensor processing agree"
+                      : "FAIL: batched processing reported different cars");
+  return ok ? 0 : 1;
+}
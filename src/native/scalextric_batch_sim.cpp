@@ -0,0 +1,451 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "espnow_batch.h"
+#include "sensor_health.h"
+#include "pulse_sim.h"
+
+// ESP-NOW Batching Simulation (host)
+// Ten children with four sensors each, all seeing cars at once (the field crossing a
+// line of sensors): every ROUND_US each sensor reports a car (CarEventWithQuality)
+// within BURST_US of the others and its PassEvent PASS_DELAY_US later, and every
+// HEALTH_REPORT_MS each child reports its four sensors. The frames go through a model
+// of the 802.11 broadcast channel ESP-NOW uses:
+//   1 Mbps DSSS, 192us long preamble, 43 bytes of MAC header, action frame and vendor
+//   element around the payload, DIFS 50us, 20us slots, backoff 0..CW_MIN frozen while
+//   the channel is busy. Stations whose backoff ends in the same slot collide, and
+//   broadcasts aren't acknowledged, so nobody retries.
+// once with one frame per message (ESPNOW_BATCH_US=0) and then per batch window, with
+// the firmware's batcher (EspNowBatch, flushed from a 1 ms loop as the child does) and
+// receive path (unpackBatch / BatchTracker). The same traffic spread over the round
+// shows what batching costs when the channel is quiet.
+// Prints airtime, frames, delivery ratio and car event latency (detection to the end
+// of the frame carrying it).
+//
+// Usage: scalextric_batch_sim [seconds] [seed]
+// Exits non-zero if a batch is malformed, a delivered message differs from the one
+// sent, the tracker's loss count disagrees with the channel, or batching a burst
+// doesn't deliver more in less airtime.
+
+const int CHILDREN = 10;
+const int SENSORS = 4;
+const uint64_t ROUND_US = 200000;
+const uint64_t BURST_US = 1000;
+const uint64_t PASS_DELAY_US = 50000;  // PassEvent after the CarEvent, +0..2ms
+const uint64_t LOOP_US = 1000;         // child loop(): delay(1)
+
+// 802.11b DCF, as ESP-NOW broadcasts at its default 1 Mbps
+const int PREAMBLE_US = 192;
+const int FRAME_OVERHEAD_BYTES = 24 + 4 + 15;  // MAC header, FCS, action frame + vendor element
+const int US_PER_BYTE = 8;
+const int DIFS_US = 50;
+const int SLOT_US = 20;
+const int CW_MIN = 31;
+
+inline uint32_t airtimeUs(int payload) { return PREAMBLE_US + (FRAME_OVERHEAD_BYTES + payload) * US_PER_BYTE; }
+
+struct Message {
+  int child;
+  uint64_t timeUs;
+  int len;
+  uint8_t bytes[sizeof(PassEvent)];
+  bool car;
+};
+
+struct Frame {
+  int child;
+  uint64_t readyUs;
+  std::vector<uint8_t> data;
+  std::vector<uint32_t> messages;
+  bool delivered;
+  uint64_t endUs;
+};
+
+// ========== TRAFFIC ==========
+
+// Ids ride in a field of each message so the receiver can check it against the original
+void addCar(std::vector<Message>& msgs, int child, int sensor, uint64_t t) {
+  int car = 1 + (child * SENSORS + sensor) % 6;
+  CarEventWithQuality m = {{(uint8_t)child, (uint8_t)sensor, (uint8_t)car, (uint16_t)CAR_FREQUENCIES[car - 1],
+                            (uint32_t)msgs.size()},
+                           {20, 95, 0, 0, 5, 120, 0}};
+  Message msg = {child, t, (int)sizeof(m), {0}, true};
+  memcpy(msg.bytes, &m, sizeof(m));
+  msgs.push_back(msg);
+}
+
+void addPass(std::vector<Message>& msgs, int child, int sensor, uint64_t t) {
+  PassEvent p = {PASS_EVENT_MAGIC, (uint8_t)child, (uint8_t)sensor, 1, msgs.size(), 12000, 2000, 0, 30};
+  Message msg = {child, t, (int)sizeof(p), {0}, false};
+  memcpy(msg.bytes, &p, sizeof(p));
+  msgs.push_back(msg);
+}
+
+void addHealth(std::vector<Message>& msgs, int child, int sensor, uint64_t t) {
+  uint32_t id = msgs.size();
+  HealthEvent h = {HEALTH_EVENT_MAGIC, (uint8_t)child, (uint8_t)sensor, HEALTH_OK, (uint16_t)id, 0,
+                   (uint16_t)(id >> 16), 0, 0};
+  Message msg = {child, t, (int)sizeof(h), {0}, false};
+  memcpy(msg.bytes, &h, sizeof(h));
+  msgs.push_back(msg);
+}
+
+uint32_t messageId(const uint8_t* data, int len) {
+  if (len == sizeof(CarEventWithQuality)) {
+    CarEvent e;
+    memcpy(&e, data, sizeof(e));
+    return e.timestamp;
+  }
+  if (len == sizeof(PassEvent)) {
+    PassEvent p;
+    memcpy(&p, data, sizeof(p));
+    return (uint32_t)p.firstEdgeUs;
+  }
+  HealthEvent h;
+  memcpy(&h, data, sizeof(h));
+  return h.edgesPerSec | (uint32_t)h.outOfBandPerSec << 16;
+}
+
+// burst: every sensor within BURST_US of the round start; otherwise anywhere in it
+std::vector<Message> makeTraffic(uint64_t durationUs, bool burst, PulseSim& rng) {
+  std::vector<Message> msgs;
+  for (uint64_t round = 0; round + ROUND_US <= durationUs; round += ROUND_US) {
+    for (int c = 0; c < CHILDREN; c++) {
+      for (int s = 0; s < SENSORS; s++) {
+        uint64_t t = round + (uint64_t)(rng.uniform() * (burst ? BURST_US : ROUND_US - BURST_US));
+        addCar(msgs, c, s, t);
+        addPass(msgs, c, s, t + PASS_DELAY_US + (uint64_t)(rng.uniform() * 2000));
+      }
+    }
+  }
+  for (int c = 0; c < CHILDREN; c++) {
+    for (uint64_t t = (uint64_t)(rng.uniform() * HEALTH_REPORT_MS * 1000); t < durationUs;
+         t += HEALTH_REPORT_MS * 1000) {
+      for (int s = 0; s < SENSORS; s++) addHealth(msgs, c, s, t);
+    }
+  }
+  return msgs;
+}
+
+// ========== CHILDREN ==========
+
+// One child's messages as frames: each on its own, or through EspNowBatch with the
+// window flushed from loop ticks
+void childFrames(const std::vector<Message>& msgs, int child, uint32_t windowUs, PulseSim& rng,
+                 std::vector<Frame>& frames) {
+  std::vector<uint32_t> order;
+  for (uint32_t i = 0; i < msgs.size(); i++) {
+    if (msgs[i].child == child) order.push_back(i);
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&](uint32_t a, uint32_t b) { return msgs[a].timeUs < msgs[b].timeUs; });
+
+  EspNowBatch batch;
+  batchInit(batch, (uint8_t)child);
+  std::vector<uint32_t> batched;
+  uint64_t tick = (uint64_t)(rng.uniform() * LOOP_US);
+  auto take = [&](uint64_t at) {
+    uint8_t out[ESPNOW_MAX_PAYLOAD];
+    int n = batchTake(batch, out);
+    Frame f = {child, at, std::vector<uint8_t>(out, out + n), batched, false, 0};
+    frames.push_back(f);
+    batched.clear();
+  };
+
+  for (size_t i = 0; i < order.size(); i++) {
+    const Message& m = msgs[order[i]];
+    if (windowUs == 0) {
+      Frame f = {child, m.timeUs, std::vector<uint8_t>(m.bytes, m.bytes + m.len),
+                 std::vector<uint32_t>(1, order[i]), false, 0};
+      frames.push_back(f);
+      continue;
+    }
+    for (; tick <= m.timeUs; tick += LOOP_US) {
+      if (batchDue(batch, tick)) take(tick);
+    }
+    if (!batchFits(batch, m.len)) take(m.timeUs);
+    batchAdd(batch, m.bytes, m.len, m.timeUs, windowUs);
+    batched.push_back(order[i]);
+  }
+  for (; batch.length > 0; tick += LOOP_US) {
+    if (batchDue(batch, tick)) take(tick);
+  }
+}
+
+// ========== CHANNEL ==========
+
+struct ChannelStats {
+  uint64_t busyUs;
+  size_t collided;
+};
+
+// DCF over all children's frames, in each child's order. Sets delivered / endUs.
+ChannelStats runChannel(std::vector<Frame>& frames, PulseSim& rng) {
+  std::vector<std::vector<size_t> > queues(CHILDREN);
+  for (size_t i = 0; i < frames.size(); i++) queues[frames[i].child].push_back(i);
+  std::vector<size_t> head(CHILDREN, 0);
+  std::vector<int> backoff(CHILDREN, -1);
+  std::vector<uint64_t> txSlot(CHILDREN), startSlot(CHILDREN);
+  ChannelStats st = {0, 0};
+  uint64_t freeAt = 0;
+
+  while (true) {
+    uint64_t base = freeAt + DIFS_US;
+    uint64_t first = UINT64_MAX;
+    for (int c = 0; c < CHILDREN; c++) {
+      if (head[c] == queues[c].size()) continue;
+      uint64_t ready = frames[queues[c][head[c]]].readyUs;
+      if (backoff[c] < 0) backoff[c] = (int)(rng.uniform() * (CW_MIN + 1));
+      startSlot[c] = ready <= base ? 0 : (ready - base + SLOT_US - 1) / SLOT_US;
+      txSlot[c] = startSlot[c] + backoff[c];
+      if (txSlot[c] < first) first = txSlot[c];
+    }
+    if (first == UINT64_MAX) break;
+
+    std::vector<int> senders;
+    uint32_t duration = 0;
+    for (int c = 0; c < CHILDREN; c++) {
+      if (head[c] == queues[c].size() || startSlot[c] > first) continue;
+      if (txSlot[c] == first) {
+        senders.push_back(c);
+        duration = std::max(duration, airtimeUs((int)frames[queues[c][head[c]]].data.size()));
+      } else {
+        backoff[c] = (int)(txSlot[c] - first);  // counted down until the channel went busy
+      }
+    }
+    freeAt = base + first * SLOT_US + duration;
+    st.busyUs += duration;
+    for (size_t i = 0; i < senders.size(); i++) {
+      int c = senders[i];
+      Frame& f = frames[queues[c][head[c]++]];
+      f.delivered = senders.size() == 1;
+      f.endUs = freeAt;
+      if (!f.delivered) st.collided++;
+      backoff[c] = -1;
+    }
+  }
+  return st;
+}
+
+// ========== RECEIVER ==========
+
+const std::vector<Message>* rxMessages;
+std::vector<uint64_t> rxDeliveredUs;  // per message, 0 = never
+uint64_t rxNowUs;
+bool rxContentOk;
+
+// The receivers' onDataReceived, for the messages it would queue
+void onMessage(const uint8_t*, const uint8_t* data, int len) {
+  uint32_t id = messageId(data, len);
+  if (id >= rxMessages->size() || (*rxMessages)[id].len != len || memcmp((*rxMessages)[id].bytes, data, len) != 0 ||
+      rxDeliveredUs[id] != 0) {
+    rxContentOk = false;
+    return;
+  }
+  rxDeliveredUs[id] = rxNowUs;
+}
+
+struct Result {
+  size_t frames;
+  double airtimePct;
+  size_t collided;
+  double delivered;     // fraction of messages
+  double carDelivered;  // fraction of car events
+  double latencyMeanUs;
+  double latencyP99Us;
+  uint32_t trackerLost;
+  uint32_t truthLost;   // lost frames some later frame of the same child revealed
+  bool contentOk;
+};
+
+Result simulate(const std::vector<Message>& msgs, uint64_t durationUs, uint32_t windowUs, uint64_t seed) {
+  PulseSim rng(seed);
+  std::vector<Frame> frames;
+  for (int c = 0; c < CHILDREN; c++) childFrames(msgs, c, windowUs, rng, frames);
+  ChannelStats channel = runChannel(frames, rng);
+
+  std::vector<size_t> order;
+  for (size_t i = 0; i < frames.size(); i++) order.push_back(i);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return frames[a].endUs < frames[b].endUs; });
+
+  static BatchTracker tracker;
+  memset(&tracker, 0, sizeof(tracker));
+  rxMessages = &msgs;
+  rxDeliveredUs.assign(msgs.size(), 0);
+  rxContentOk = true;
+  uint8_t mac[6] = {0x24, 0x6F, 0x28, 0, 0, 0};
+  for (size_t i = 0; i < order.size(); i++) {
+    const Frame& f = frames[order[i]];
+    if (!f.delivered) continue;
+    mac[5] = (uint8_t)f.child;
+    rxNowUs = f.endUs;
+    if (!unpackBatch(mac, f.data.data(), (int)f.data.size(), tracker, onMessage)) {
+      onMessage(mac, f.data.data(), (int)f.data.size());
+    }
+  }
+
+  // Every frame from a child is one batch; a lost one shows once a later one arrives,
+  // and only after the receiver has heard from the child at all
+  Result r = {frames.size(), 100.0 * channel.busyUs / durationUs, channel.collided, 0, 0, 0, 0,
+              tracker.lost, 0, rxContentOk};
+  if (windowUs > 0) {
+    std::vector<int> lostSince(CHILDREN, -1);
+    for (size_t i = 0; i < frames.size(); i++) {
+      if (!frames[i].delivered) {
+        if (lostSince[frames[i].child] >= 0) lostSince[frames[i].child]++;
+      } else {
+        if (lostSince[frames[i].child] < 0) lostSince[frames[i].child] = 0;
+        r.truthLost += lostSince[frames[i].child];
+        lostSince[frames[i].child] = 0;
+      }
+    }
+  }
+
+  size_t delivered = 0, cars = 0, carsDelivered = 0;
+  std::vector<double> latency;
+  for (size_t i = 0; i < msgs.size(); i++) {
+    if (rxDeliveredUs[i]) delivered++;
+    if (!msgs[i].car) continue;
+    cars++;
+    if (rxDeliveredUs[i]) {
+      carsDelivered++;
+      latency.push_back((double)(rxDeliveredUs[i] - msgs[i].timeUs));
+    }
+  }
+  r.delivered = (double)delivered / msgs.size();
+  r.carDelivered = (double)carsDelivered / cars;
+  std::sort(latency.begin(), latency.end());
+  for (size_t i = 0; i < latency.size(); i++) r.latencyMeanUs += latency[i] / latency.size();
+  r.latencyP99Us = latency.empty() ? 0 : latency[latency.size() * 99 / 100];
+  return r;
+}
+
+// ========== FORMAT CHECKS ==========
+
+std::vector<std::vector<uint8_t> > unpacked;
+
+void collect(const uint8_t*, const uint8_t* data, int len) { unpacked.push_back(std::vector<uint8_t>(data, data + len)); }
+
+bool testFormat() {
+  BatchTracker tracker;
+  memset(&tracker, 0, sizeof(tracker));
+  uint8_t mac[6] = {0};
+  uint8_t frame[ESPNOW_MAX_PAYLOAD];
+
+  // As many car events as fit, then the next one needs a new frame
+  EspNowBatch b;
+  batchInit(b, 7);
+  CarEventWithQuality car = {{7, 1, 3, 3096, 1234}, {14, 93, 2, 1, 6, 97, 0}};
+  int fitted = 0;
+  while (batchFits(b, sizeof(car))) {
+    batchAdd(b, &car, sizeof(car), 100, 3000);
+    fitted++;
+  }
+  bool ok = sizeof(BatchHeader) == 5 && fitted == (ESPNOW_MAX_PAYLOAD - 5) / 19 && !batchDue(b, 3099) &&
+            batchDue(b, 3100);
+  int n = batchTake(b, frame);
+  unpacked.clear();
+  ok = ok && n == 5 + fitted * 19 && b.length == 0 && b.nextSeq == 1 && !batchDue(b, 1000000);
+  ok = ok && unpackBatch(mac, frame, n, tracker, collect) && (int)unpacked.size() == fitted &&
+       memcmp(unpacked[0].data(), &car, sizeof(car)) == 0 && tracker.received == 1;
+
+  // Mixed messages come out in order, each at its own length
+  PassEvent pass = {PASS_EVENT_MAGIC, 7, 1, 3, 99, 12000, 2000, 0, 30};
+  HealthEvent health = {HEALTH_EVENT_MAGIC, 7, 2, HEALTH_NOISY, 10, 60, 0, 0, 0};
+  CarEvent plain = {7, 2, 5, 4286, 5678};
+  batchAdd(b, &plain, sizeof(plain), 0, 3000);
+  batchAdd(b, &pass, sizeof(pass), 0, 3000);
+  batchAdd(b, &health, sizeof(health), 0, 3000);
+  n = batchTake(b, frame);
+  unpacked.clear();
+  ok = ok && unpackBatch(mac, frame, n, tracker, collect) && unpacked.size() == 3 &&
+       unpacked[0].size() == sizeof(plain) && unpacked[1].size() == sizeof(pass) &&
+       unpacked[2].size() == sizeof(health) && memcmp(unpacked[1].data(), &pass, sizeof(pass)) == 0;
+  BatchHeader header;
+  memcpy(&header, frame, sizeof(header));
+  ok = ok && header.magic == BATCH_MAGIC && header.nodeId == 7 && header.batchSeq == 1 && header.count == 3;
+
+  // Malformed: truncated, trailing byte, unknown length, count past the end
+  unpacked.clear();
+  ok = ok && !unpackBatch(mac, frame, n - 1, tracker, collect);
+  frame[n] = 0;
+  ok = ok && !unpackBatch(mac, frame, n + 1, tracker, collect);
+  uint8_t saved = frame[5];
+  frame[5] = 10;
+  ok = ok && !unpackBatch(mac, frame, n, tracker, collect);
+  frame[5] = saved;
+  frame[4] = 4;
+  ok = ok && !unpackBatch(mac, frame, n, tracker, collect) && unpacked.empty() && tracker.received == 2;
+
+  // A single message whose first byte happens to be the magic (node 0xEE) isn't a batch
+  CarEvent node238 = {BATCH_MAGIC, 0, 1, 5000, 0};
+  CarEventWithQuality node238q = {node238, {1, 0, 0, 0, 0, 0, 0}};
+  ok = ok && !unpackBatch(mac, (const uint8_t*)&node238, sizeof(node238), tracker, collect) &&
+       !unpackBatch(mac, (const uint8_t*)&node238q, sizeof(node238q), tracker, collect);
+
+  // Sequence gaps, late fills, repeats, a reboot, wrap
+  memset(&tracker, 0, sizeof(tracker));
+  const uint16_t seqs[] = {0, 1, 3, 3, 2, 1, 200, 150, 100, 101};
+  const bool fresh[] = {true, true, true, false, true, false, true, true, true, true};
+  for (size_t i = 0; i < sizeof(seqs) / sizeof(seqs[0]); i++) ok = ok && batchTrack(tracker, 4, seqs[i]) == fresh[i];
+  ok = ok && tracker.lost == 195 && tracker.duplicates == 2;
+  ok = ok && batchTrack(tracker, 5, 65535) && batchTrack(tracker, 5, 0) && batchTrack(tracker, 5, 2);
+  ok = ok && tracker.lost == 196 && tracker.received == 11;
+  ok = ok && batchLossReportDue(tracker, 20000) && !batchLossReportDue(tracker, 20001);
+  tracker.lost++;
+  ok = ok && !batchLossReportDue(tracker, 25000) && batchLossReportDue(tracker, 30000);
+
+  printf("format: %d car events per frame, mixed batch, malformed rejected, gaps and repeats %s\n", fitted,
+         ok ? "ok" : "MISMATCH");
+  return ok;
+}
+
+void printResult(uint32_t windowUs, const Result& r, double seconds) {
+  char name[16];
+  if (windowUs) {
+    snprintf(name, sizeof(name), "%.0f ms", windowUs / 1000.0);
+  } else {
+    snprintf(name, sizeof(name), "none");
+  }
+  printf("%-7s %-9.0f %-9.1f %-10u %-9.2f %-9.2f %-9.2f %-9.2f %u/%u\n", name, r.frames / seconds, r.airtimePct,
+         (unsigned)r.collided, 100.0 * r.delivered, 100.0 * r.carDelivered, r.latencyMeanUs / 1000,
+         r.latencyP99Us / 1000, r.trackerLost, r.truthLost);
+}
+
+int main(int argc, char** argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 60;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+  uint64_t durationUs = (uint64_t)(seconds * 1e6);
+  const uint32_t windows[] = {0, 2000, 3000, 5000};
+  const int WINDOW_COUNT = sizeof(windows) / sizeof(windows[0]);
+
+  printf("# ESP-NOW batching: %d children x %d sensors, a car on every sensor every %llu ms, %.0f s, seed %llu\n",
+         CHILDREN, SENSORS, (unsigned long long)(ROUND_US / 1000), seconds, (unsigned long long)seed);
+  printf("# one frame: %u us on air for a car event alone, %u us for a full batch\n\n",
+         airtimeUs(sizeof(CarEventWithQuality)), airtimeUs(ESPNOW_MAX_PAYLOAD));
+  bool ok = testFormat();
+
+  for (int burst = 1; burst >= 0; burst--) {
+    PulseSim trafficRng(seed);
+    std::vector<Message> msgs = makeTraffic(durationUs, burst, trafficRng);
+    printf("\n%s: %u messages\n", burst ? "burst (every sensor within 1 ms)" : "spread (anywhere in the round)",
+           (unsigned)msgs.size());
+    printf("window  frames/s  airtime%%  collided   deliv%%    cars%%     lat ms    p99 ms    lost seen/actual\n");
+    Result results[WINDOW_COUNT];
+    for (int w = 0; w < WINDOW_COUNT; w++) {
+      results[w] = simulate(msgs, durationUs, windows[w], seed + 1);
+      printResult(windows[w], results[w], seconds);
+      ok = ok && results[w].contentOk && results[w].trackerLost == results[w].truthLost;
+      ok = ok && results[w].latencyP99Us < windows[w] + LOOP_US + ROUND_US / 2;
+      if (burst && w > 0) {
+        ok = ok && results[w].airtimePct < results[0].airtimePct && results[w].frames < results[0].frames &&
+             results[w].carDelivered > results[0].carDelivered;
+      }
+    }
+  }
+
+  printf("\n%s\n", ok ? "# PASS" : "# FAIL");
+  return ok ? 0 : 1;
+}
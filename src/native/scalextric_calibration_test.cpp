@@ -0,0 +1,161 @@
+#include <Arduino.h>
+#include <string.h>
+#include <vector>
+#include "car_detection.h"
+#include "pulse_sim.h"
+#include "detect_harness.h"
+
+// Car Calibration Test (host, CAR_CALIBRATION=1)
+// A session of cars whose emitters sit 4-6% off nominal and sag a further
+// SESSION_DRIFT over the session, as batteries run down, crossing sensor 0 in random
+// order at 1.5-4 m/s; half of them end up past FREQUENCY_TOLERANCE_PCT. Runs it three ways:
+//   nominal    calibrationLearning off: the compile-time bands
+//   learning   bands learned from the session's own passes
+//   restored   the learned tables exported, the node reset (initSensors) and the
+//              tables imported again, as loadCalibration does at boot; then the
+//              first passes after boot against a fresh nominal boot
+// and checks that a damaged or mismatched NVS blob is rejected.
+//
+// Usage: scalextric_calibration_test [passes per car] [seed]
+// Exits non-zero if learning doesn't cut unknowns and pulses without adding wrong cars.
+
+#if !CAR_CALIBRATION
+#error "build with -DCAR_CALIBRATION=1 (env:scalextric_calibration_test)"
+#endif
+
+const float CAR_OFFSETS[6] = {0.05f, -0.055f, 0.04f, 0.05f, -0.05f, -0.06f};
+const float SESSION_DRIFT = -0.03f;  // all cars, linearly over the session
+const int BOOT_PASSES = 5;            // per car, right after boot
+
+struct Session {
+  std::vector<PassConfig> passes;
+};
+
+Session buildSession(int passesPerCar, uint64_t seed, float driftFrom, float driftTo) {
+  PulseSim sim(seed);
+  Session s;
+  int total = passesPerCar * 6;
+  for (int p = 0; p < total; p++) {
+    PassConfig cfg = DEFAULT_PASS;
+    cfg.car = 1 + (int)(sim.uniform() * 6);
+    cfg.speedMps = 1.5f + (float)sim.uniform() * 2.5f;
+    cfg.jitterUs = 3.0f;
+    cfg.dropoutProb = 0.02f;
+    cfg.glitchProb = 0.01f;
+    cfg.freqOffsetPct = CAR_OFFSETS[cfg.car - 1] + driftFrom + (driftTo - driftFrom) * p / total;
+    s.passes.push_back(cfg);
+  }
+  return s;
+}
+
+struct SessionStats {
+  int passes, correct, wrong, unknown, missed;
+  long pulses;  // edges to the first report, over correct passes
+  long micros;
+};
+
+SessionStats runSession(const Session& s, uint64_t seed) {
+  SessionStats st = {0, 0, 0, 0, 0, 0, 0};
+  PulseSim sim(seed);
+  uint64_t t = 1000000;
+  for (size_t p = 0; p < s.passes.size(); p++) {
+    std::vector<uint64_t> edges;
+    t = sim.generatePass(s.passes[p], t, edges);
+    PassResult r = runPass(edges, (uint64_t)(sim.uniform() * LOOP_PERIOD_US));
+    t += DETECTION_TIMEOUT + 100000;
+    st.passes++;
+    if (!r.detected) {
+      st.missed++;
+    } else if (r.car == s.passes[p].car) {
+      st.correct++;
+      st.pulses += r.edgesToDecision;
+      st.micros += (long)r.usToDecision;
+    } else if (r.car == 0) {
+      st.unknown++;
+    } else {
+      st.wrong++;
+    }
+  }
+  return st;
+}
+
+void printStats(const char* name, const SessionStats& s) {
+  printf("%-10s %-7d %-6.1f %-7.2f %-6.1f %-6.1f %-7.1f %.0f\n", name, s.passes, 100.0 * s.correct / s.passes,
+         100.0 * s.wrong / s.passes, 100.0 * s.unknown / s.passes, 100.0 * s.missed / s.passes,
+         s.correct ? (double)s.pulses / s.correct : 0.0, s.correct ? (double)s.micros / s.correct : 0.0);
+}
+
+double pct(int n, int of) { return of ? 100.0 * n / of : 0; }
+double avg(long sum, int n) { return n ? (double)sum / n : 0; }
+
+void printTable(const CarCalibration& cal) {
+  printf("\ncar  nominal us  learned us  offset%%  inner band%%  passes\n");
+  for (int c = 0; c < 6; c++) {
+    float nominal = nominalIntervalUs(c);
+    printf("%-4d %-11.1f %-11.1f %-8.2f %-12.2f %u\n", c + 1, nominal, cal.centerUs[c],
+           100.0f * (cal.centerUs[c] / nominal - 1), 100.0f * innerToleranceUs(cal, c) / cal.centerUs[c],
+           (unsigned)cal.samples[c]);
+  }
+}
+
+int main(int argc, char** argv) {
+  int passesPerCar = argc > 1 ? atoi(argv[1]) : 150;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+
+  printf("# Car calibration: %d passes per car, seed %llu, drift %+.1f%% over the session\n", passesPerCar,
+         (unsigned long long)seed, 100 * SESSION_DRIFT);
+  printf("# Emitter offsets:");
+  for (int c = 0; c < 6; c++) printf(" %+.1f%%", 100 * CAR_OFFSETS[c]);
+  printf("\n\nrun        passes  ok%%    wrong%%  unk%%   miss%%  pulses  us\n");
+
+  Session session = buildSession(passesPerCar, seed, 0, SESSION_DRIFT);
+
+  initSensors();
+  calibrationLearning = false;
+  SessionStats nominal = runSession(session, seed + 1);
+  printStats("nominal", nominal);
+
+  initSensors();
+  calibrationLearning = true;
+  SessionStats learning = runSession(session, seed + 1);
+  printStats("learning", learning);
+  printTable(sensorCalibration[0]);
+
+  // ========== BOOT ==========
+
+  CalibrationBlob blob;
+  exportCalibration(blob);
+  Session boot = buildSession(BOOT_PASSES, seed + 2, SESSION_DRIFT, SESSION_DRIFT);
+
+  initSensors();
+  SessionStats fresh = runSession(boot, seed + 3);
+  initSensors();
+  bool imported = importCalibration(blob);
+  SessionStats restored = runSession(boot, seed + 3);
+
+  printf("\n## first %d passes after boot\n", BOOT_PASSES * 6);
+  printf("run        passes  ok%%    wrong%%  unk%%   miss%%  pulses  us\n");
+  printStats("nominal", fresh);
+  printStats("restored", restored);
+
+  // ========== NVS BLOB ==========
+
+  CalibrationBlob damaged = blob;
+  ((uint8_t*)&damaged.table[0])[5] ^= 0x10;
+  CalibrationBlob oldVersion = blob;
+  oldVersion.version = CALIBRATION_VERSION + 1;
+  oldVersion.crc = calibrationCrc(oldVersion);
+  CalibrationBlob empty;
+  memset(&empty, 0xFF, sizeof(empty));  // erased flash
+  bool rejects = !importCalibration(damaged) && !importCalibration(oldVersion) && !importCalibration(empty);
+  printf("\nblob %u bytes: import %s, damaged/other version/erased %s\n", (unsigned)sizeof(blob),
+         imported ? "ok" : "FAILED", rejects ? "rejected" : "ACCEPTED");
+
+  bool ok = imported && rejects;
+  ok = ok && learning.unknown < nominal.unknown;
+  ok = ok && pct(learning.wrong, learning.passes) <= pct(nominal.wrong, nominal.passes) + 0.5;
+  ok = ok && avg(learning.pulses, learning.correct) < avg(nominal.pulses, nominal.correct);
+  ok = ok && restored.correct >= fresh.correct && restored.wrong <= fresh.wrong;
+  printf("\n%s\n", ok ? "# PASS" : "# FAIL");
+  return ok ? 0 : 1;
+}
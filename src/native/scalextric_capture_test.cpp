@@ -0,0 +1,211 @@
+#include <Arduino.h>
+#include <vector>
+#include "car_detection.h"
+#include "pulse_sim.h"
+#include "detect_harness.h"
+
+// Edge Capture Test (host)
+// Stands in for the capture hardware with a fake source and drives both backends'
+// entry points (onPulse for CAPTURE_GPIO_ISR, onCapture for CAPTURE_MCPWM):
+//
+// 1. Clock: feeds latched APB ticks (sub-microsecond edge times, tick counter
+//    starting near its 32-bit wrap, long idle gaps) through CaptureClock and checks
+//    every interval comes out within 1us of the true interval. Also lone edges a
+//    whole number of tick wraps (+ a little) after the last one, with no pass end in
+//    between to re-anchor: each must still come out at its true time.
+// 2. Detection: runs every car through the real detector with interrupt latency
+//    added to each edge. The GPIO backend timestamps when its ISR runs, so latency
+//    becomes interval error; the MCPWM backend timestamps in hardware.
+//
+// Usage: scalextric_capture_test [passes] [seed]
+// Exits non-zero if any converted interval is off by more than 1us, or a lone edge by
+// more than its interrupt latency.
+
+const uint32_t TICKS_PER_US = CAPTURE_TICKS_PER_US;
+
+// Interrupt latency: usually a few micros, sometimes held off by the radio stacks
+struct LatencyModel {
+  float stallProb;
+  float stallMaxUs;
+};
+
+const LatencyModel LATENCY = {0.2f, 40.0f};
+
+PulseSim* latencySim = nullptr;
+uint32_t tickOffset = 0;
+
+uint64_t isrLatency() {
+  uint64_t latency = 2 + (uint64_t)(latencySim->uniform() * 3);
+  if (latencySim->uniform() < LATENCY.stallProb) {
+    latency += (uint64_t)(latencySim->uniform() * LATENCY.stallMaxUs);
+  }
+  return latency;
+}
+
+// Fake capture unit: the counter latches at the true (sub-microsecond) edge time
+uint32_t latchTicks(uint64_t edgeUs, uint32_t fracTicks) {
+  return tickOffset + (uint32_t)(edgeUs * TICKS_PER_US) + fracTicks;
+}
+
+void feedGpioLate(uint64_t edgeUs) {
+  hostSetMicros(edgeUs + isrLatency());
+  onPulse(0);
+}
+
+void feedCapture(uint64_t edgeUs) {
+  uint32_t ticks = latchTicks(edgeUs, (uint32_t)(latencySim->uniform() * TICKS_PER_US));
+  hostSetMicros(edgeUs + isrLatency());
+  onCapture(0, ticks);
+}
+
+// ========== 1. CLOCK CONVERSION ==========
+
+bool testClock(PulseSim& sim) {
+  const uint32_t offsets[] = {0, 0xFFFFFFFFu - 2000 * TICKS_PER_US, (uint32_t)sim.next()};
+  const uint64_t gapsUs[] = {DETECTION_TIMEOUT + 1000, 5000000, 60000000};  // incl. > tick wrap (53.7s)
+  int intervals = 0;
+  int64_t worst = 0;
+
+  for (size_t o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+    tickOffset = offsets[o];
+    CaptureClock clock;
+    clock.reset();
+    uint64_t t = 1000000;
+
+    for (int pass = 0; pass < 30; pass++) {
+      PassConfig cfg = DEFAULT_PASS;
+      cfg.car = 1 + pass % 6;
+      std::vector<uint64_t> edges;
+      t = sim.generatePass(cfg, t, edges);
+
+      double lastTrue = 0;
+      uint32_t lastMicros = 0;
+      for (size_t i = 0; i < edges.size(); i++) {
+        uint32_t frac = (uint32_t)(sim.uniform() * TICKS_PER_US);
+        hostSetMicros(edges[i] + isrLatency());
+        uint32_t us = clock.toMicros(latchTicks(edges[i], frac));
+        double trueUs = edges[i] + (double)frac / TICKS_PER_US;
+        if (i > 0) {
+          int64_t err = (int64_t)(uint32_t)(us - lastMicros) - (int64_t)llround(trueUs - lastTrue);
+          if (err < 0) err = -err;
+          if (err > worst) worst = err;
+          intervals++;
+        }
+        lastTrue = trueUs;
+        lastMicros = us;
+      }
+
+      clock.requestAnchor();  // what resetSensor does at the end of a pass
+      t += gapsUs[pass % 3];
+    }
+  }
+
+  bool ok = worst <= 1;
+  printf("## clock\n%d intervals, worst error %lldus: %s\n", intervals, (long long)worst,
+         ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// Stray edges, one at a time: no pass, so nothing calls requestAnchor. A gap of
+// N x wrap + a few hundred us gives a tick delta of those few hundred us.
+bool testIdleWrap(PulseSim& sim) {
+  const uint64_t maxLatencyUs = 5 + (uint64_t)LATENCY.stallMaxUs;
+  tickOffset = (uint32_t)sim.next();
+  CaptureClock clock;
+  clock.reset();
+  uint64_t t = 1000000;
+  int64_t worstAnchor = 0, worstInterval = 0;
+  int gaps = 0;
+
+  for (int n = 1; n <= 8; n++) {
+    uint64_t epsUs = 100 + (uint64_t)(sim.uniform() * 900);
+    t += ((uint64_t)n << 32) / TICKS_PER_US + epsUs;
+
+    // The lone edge, then one 300us later (a pass starting with it)
+    hostSetMicros(t + isrLatency());
+    uint32_t us = clock.toMicros(latchTicks(t, 0));
+    hostSetMicros(t + 300 + isrLatency());
+    uint32_t next = clock.toMicros(latchTicks(t + 300, 0));
+
+    int64_t anchorErr = llabs((int64_t)(int32_t)(us - (uint32_t)t));  // late by its ISR latency
+    int64_t intervalErr = (int64_t)(uint32_t)(next - us) - 300;
+    if (intervalErr < 0) intervalErr = -intervalErr;
+    if (anchorErr > worstAnchor) worstAnchor = anchorErr;
+    if (intervalErr > worstInterval) worstInterval = intervalErr;
+    gaps++;
+    t += 300;
+  }
+
+  bool ok = worstAnchor <= (int64_t)maxLatencyUs && worstInterval <= 1;
+  printf("\n## idle wrap\n%d gaps of N x %.1fs + <1ms, worst edge error %lldus, interval %lldus: %s\n",
+         gaps, 4294967296.0 / TICKS_PER_US / 1e6, (long long)worstAnchor, (long long)worstInterval,
+         ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// ========== 2. DETECTION THROUGH EACH BACKEND ==========
+
+struct Backend {
+  const char* name;
+  EdgeFeed feed;
+};
+
+void testDetection(int passes, uint64_t seed) {
+  const Backend backends[] = {
+    {"gpio-isr (no latency)", feedGpioEdge},
+    {"gpio-isr (latency)", feedGpioLate},
+    {"mcpwm-capture (latency)", feedCapture},
+  };
+
+  printf("\n## detection, jitter 2us, ISR latency 2-5us + %.0f%% stalls up to %.0fus\n",
+         LATENCY.stallProb * 100, LATENCY.stallMaxUs);
+  printf("backend                   ok%%    wrong%%  unk%%   miss%%  pulses(avg)\n");
+
+  for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+    PulseSim sim(seed);
+    initSensors();
+    tickOffset = (uint32_t)sim.next();
+    int total = 0, correct = 0, wrong = 0, unknown = 0, missed = 0;
+    long pulses = 0;
+    uint64_t t = 1000000;
+
+    for (int car = 1; car <= 6; car++) {
+      for (int p = 0; p < passes; p++) {
+        PassConfig cfg = DEFAULT_PASS;
+        cfg.car = car;
+        std::vector<uint64_t> edges;
+        t = sim.generatePass(cfg, t, edges);
+        PassResult r = runPass(edges, (uint64_t)(sim.uniform() * LOOP_PERIOD_US), backends[b].feed);
+        t += DETECTION_TIMEOUT + 100000;
+
+        total++;
+        if (!r.detected) missed++;
+        else if (r.car == car) { correct++; pulses += r.edgesToDecision; }
+        else if (r.car == 0) unknown++;
+        else wrong++;
+      }
+    }
+
+    printf("%-25s %-6.1f %-7.1f %-6.1f %-6.1f %.1f\n", backends[b].name,
+           100.0 * correct / total, 100.0 * wrong / total, 100.0 * unknown / total,
+           100.0 * missed / total, correct ? (double)pulses / correct : 0.0);
+  }
+}
+
+int main(int argc, char** argv) {
+  int passes = argc > 1 ? atoi(argv[1]) : 200;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+
+  printf("# Edge capture test: %d passes/car, seed %llu\n", passes, (unsigned long long)seed);
+
+  PulseSim latency(seed ^ 0x5A5A5A5AULL);
+  latencySim = &latency;
+
+  PulseSim sim(seed);
+  bool ok = testClock(sim);
+  ok = testIdleWrap(sim) && ok;
+  testDetection(passes, seed);
+
+  printf("\n# %s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
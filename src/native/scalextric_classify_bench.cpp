@@ -0,0 +1,103 @@
+#include <Arduino.h>
+#include <vector>
+#include <chrono>
+#include "car_detection.h"
+#include "pulse_sim.h"
+
+// Classification Micro-Benchmark (host)
+// Compares the float path the median classifier used to run every loop pass
+// (1e6 / median, then identifyCar) against the compile-time interval -> car table
+// (identifyCarByInterval), and checks they agree on every interval in
+// MIN_VALID_INTERVAL..MAX_VALID_INTERVAL.
+//
+// Usage: scalextric_classify_bench [medians] [seed]
+// Exits non-zero if the table disagrees with the float path anywhere.
+
+int floatPath(uint32_t medianUs) {
+  float freq = medianUs ? 1000000.0 / medianUs : 0;
+  return identifyCar(freq);
+}
+
+// Prints the interval band each car occupies in the table
+bool checkEquivalence() {
+  int mismatches = 0;
+  int bandStart = MIN_VALID_INTERVAL;
+  int bandCar = identifyCarByInterval(MIN_VALID_INTERVAL);
+
+  printf("## equivalence\ncar  interval (us)  frequency (Hz)\n");
+  for (uint32_t us = MIN_VALID_INTERVAL; us <= MAX_VALID_INTERVAL + 1; us++) {
+    int car = us <= MAX_VALID_INTERVAL ? identifyCarByInterval(us) : -1;
+    if (us <= MAX_VALID_INTERVAL && car != floatPath(us)) {
+      printf("MISMATCH at %uus: table %d, float %d\n", us, car, floatPath(us));
+      mismatches++;
+    }
+    if (car != bandCar) {
+      if (bandCar > 0) {
+        printf("%-4d %3d - %-8u %4.0f - %4.0f\n", bandCar, bandStart, us - 1,
+               1000000.0 / (us - 1), 1000000.0 / bandStart);
+      }
+      bandStart = us;
+      bandCar = car;
+    }
+  }
+  // Out of range must never match
+  if (identifyCarByInterval(0) != 0 || identifyCarByInterval(MIN_VALID_INTERVAL - 1) != 0 ||
+      identifyCarByInterval(MAX_VALID_INTERVAL + 1) != 0) {
+    printf("MISMATCH: out-of-range interval classified\n");
+    mismatches++;
+  }
+  printf("%d intervals, %d mismatches\n", CAR_LUT_SIZE, mismatches);
+  return mismatches == 0;
+}
+
+// Medians as processSensor sees them: sliding median over simulated passes
+std::vector<uint32_t> makeMedians(size_t count, uint64_t seed) {
+  PulseSim sim(seed);
+  IntervalWindow window;
+  std::vector<uint32_t> medians;
+  uint64_t t = 0;
+  while (medians.size() < count) {
+    PassConfig cfg = DEFAULT_PASS;
+    cfg.car = 1 + (int)(sim.uniform() * 6);
+    cfg.jitterUs = 8.0f;
+    cfg.freqOffsetPct = (float)(sim.uniform() * 0.1 - 0.05);
+    std::vector<uint64_t> edges;
+    t = sim.generatePass(cfg, t, edges) + 100000;
+    window.clear();
+    for (size_t i = 1; i < edges.size() && medians.size() < count; i++) {
+      window.push((uint32_t)(edges[i] - edges[i - 1]));
+      medians.push_back(medianInterval(window));
+    }
+  }
+  return medians;
+}
+
+int main(int argc, char** argv) {
+  size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+  typedef std::chrono::steady_clock Clock;
+
+  printf("# Classification benchmark: table %d bytes, seed %llu\n",
+         (int)sizeof(IntervalCarTable::car), (unsigned long long)seed);
+  bool ok = checkEquivalence();
+
+  std::vector<uint32_t> medians = makeMedians(count, seed);
+  unsigned long checksum[2] = {0, 0};
+
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < medians.size(); i++) checksum[0] += floatPath(medians[i]);
+  double floatNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+  start = Clock::now();
+  for (size_t i = 0; i < medians.size(); i++) checksum[1] += identifyCarByInterval(medians[i]);
+  double tableNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+  printf("\n## speed (%u medians)\npath             ns/op  checksum\n", (unsigned)medians.size());
+  printf("float divide     %-6.2f %lu\n", floatNs / medians.size(), checksum[0]);
+  printf("interval table   %-6.2f %lu\n", tableNs / medians.size(), checksum[1]);
+  printf("speedup          %.1fx\n", floatNs / tableNs);
+
+  ok = ok && checksum[0] == checksum[1];
+  printf("\n# %s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,240 @@
+#include <Arduino.h>
+#include <vector>
+#include "car_detection.h"
+#include "pulse_sim.h"
+
+// Deadline Scheduler Test (host)
+// 1. Heap: random arm / cancel / popExpired against a brute-force scan.
+// 2. Reset timing: how long after (last edge + DETECTION_TIMEOUT) a sensor resets.
+// 3. Back-to-back: car B arrives shortly after car A's timeout on the same sensor;
+//    counts how often the detector resets in between (two passes) instead of
+//    merging B into A's pass.
+//
+// Each detection check runs three schedules over the same traces:
+//   legacy scan     loop() every 1ms, timeout measured from when the loop saw the
+//                   last pulse and checked after consuming new edges (the old code)
+//   loop+deadlines  loop() every 1ms, processDeadlines() then processSensor()
+//   deadline timer  DETECTION_TASK: processSensor() per edge, expiry at the deadline
+//
+// Usage: scalextric_deadline_test [passes] [seed]
+// Exits non-zero if the heap disagrees with the reference, or a deadline schedule
+// fails to separate cars arriving after the timeout.
+
+const uint64_t LOOP_PERIOD_US = 1000;
+
+// ========== 1. HEAP ==========
+
+const int HEAP_IDS = 16;
+
+bool testHeap(PulseSim& sim, int ops) {
+  DeadlineHeap<HEAP_IDS> heap;
+  bool armed[HEAP_IDS] = {false};
+  uint64_t at[HEAP_IDS];
+  uint64_t now = 1000000;
+  int errors = 0;
+  int expired = 0;
+
+  for (int op = 0; op < ops; op++) {
+    int id = (int)(sim.uniform() * HEAP_IDS);
+    double action = sim.uniform();
+    if (action < 0.6) {
+      at[id] = now + (uint64_t)(sim.uniform() * DETECTION_TIMEOUT);
+      armed[id] = true;
+      heap.arm(id, at[id]);
+    } else if (action < 0.7) {
+      armed[id] = false;
+      heap.cancel(id);
+    } else {
+      now += (uint64_t)(sim.uniform() * DETECTION_TIMEOUT / 4);
+      int popped;
+      while (heap.popExpired(now, popped)) {
+        // Must be armed, due, and no earlier than any other armed deadline
+        if (!armed[popped] || now < at[popped]) errors++;
+        for (int i = 0; i < HEAP_IDS; i++) {
+          if (armed[i] && i != popped && at[i] < at[popped]) errors++;
+        }
+        armed[popped] = false;
+        expired++;
+      }
+      for (int i = 0; i < HEAP_IDS; i++) {
+        if (armed[i] && now >= at[i]) errors++;  // due but not popped
+      }
+    }
+
+    int count = 0;
+    for (int i = 0; i < HEAP_IDS; i++) {
+      if (armed[i] != heap.armed(i)) errors++;
+      count += armed[i];
+    }
+    if (count != heap.size()) errors++;
+  }
+
+  printf("## heap\n%d ops, %d expiries, %d errors: %s\n", ops, expired, errors, errors ? "FAIL" : "ok");
+  return errors == 0;
+}
+
+// ========== DETECTION SCHEDULES ==========
+
+enum Schedule { LEGACY_SCAN, LOOP_DEADLINES, DEADLINE_TIMER, NUM_SCHEDULES };
+const char* SCHEDULE_NAMES[] = {"legacy scan", "loop+deadlines", "deadline timer"};
+
+void ignoreCar(uint8_t sensorId, int car, float freq) {
+  (void)sensorId;
+  (void)car;
+  (void)freq;
+}
+
+struct TraceResult {
+  std::vector<uint64_t> resets;  // when sensor 0 went back to idle
+};
+
+// Runs one edge trace through sensor 0 and records every reset
+TraceResult runTrace(const std::vector<uint64_t>& edges, Schedule schedule, uint64_t pollPhaseUs) {
+  TraceResult result;
+  SensorState& sensor = sensors[0];
+  uint64_t quietUntil = edges.back() + DETECTION_TIMEOUT + 3 * LOOP_PERIOD_US;
+  uint32_t noticedAt = 0;  // LEGACY_SCAN: micros() when the loop last saw new pulse data
+
+  if (schedule == DEADLINE_TIMER) {
+    size_t next = 0;
+    for (;;) {
+      // Next event: an edge, or the deadline if it comes first
+      uint64_t edgeAt = next < edges.size() ? edges[next] : UINT64_MAX;
+      if (!sensorDeadlines.empty()) {
+        uint64_t deadlineAt = sensorDeadlines.earliest();
+        if (deadlineAt < hostMicros) deadlineAt = hostMicros;
+        if (deadlineAt < edgeAt) {
+          hostSetMicros(deadlineAt);
+          bool wasDetecting = sensor.detecting;
+          processDeadlines(ignoreCar);  // a timeout, or with DETECTION_TASK a confirm deadline
+          if (wasDetecting && !sensor.detecting) result.resets.push_back(hostMicros);
+          continue;
+        }
+      }
+      if (next == edges.size()) break;
+      hostSetMicros(edges[next++]);
+      onPulse(0);
+      processSensor(sensor, ignoreCar);
+    }
+    return result;
+  }
+
+  size_t next = 0;
+  for (uint64_t poll = edges.front() + pollPhaseUs % LOOP_PERIOD_US; poll <= quietUntil;
+       poll += LOOP_PERIOD_US) {
+    while (next < edges.size() && edges[next] < poll) {
+      hostSetMicros(edges[next++]);
+      onPulse(0);
+    }
+    hostSetMicros(poll);
+    bool wasDetecting = sensor.detecting;
+
+    if (schedule == LOOP_DEADLINES) {
+      processDeadlines(ignoreCar);
+      if (wasDetecting && !sensor.detecting) result.resets.push_back(poll);
+      processSensor(sensor, ignoreCar);
+    } else {
+      int pulses = sensor.pulseCount;
+      processSensor(sensor, ignoreCar);
+      if (sensor.pulseCount != pulses) noticedAt = micros();
+      if (sensor.detecting && micros() - noticedAt > DETECTION_TIMEOUT) {
+        expireSensor(sensor, ignoreCar);
+        result.resets.push_back(poll);
+      }
+    }
+  }
+  return result;
+}
+
+PassConfig passFor(int car) {
+  PassConfig cfg = DEFAULT_PASS;
+  cfg.car = car;
+  return cfg;
+}
+
+// ========== 2. RESET TIMING ==========
+
+void testResetTiming(int passes, uint64_t seed) {
+  printf("\n## reset timing: reset time - (last edge + %luus)\n", DETECTION_TIMEOUT);
+  printf("schedule         late(avg)  late(max)\n");
+
+  for (int s = 0; s < NUM_SCHEDULES; s++) {
+    PulseSim sim(seed);
+    initSensors();
+    uint64_t t = 1000000;
+    double total = 0;
+    uint64_t worst = 0;
+    int count = 0;
+
+    for (int p = 0; p < passes; p++) {
+      std::vector<uint64_t> edges;
+      t = sim.generatePass(passFor(1 + p % 6), t, edges);
+      TraceResult r = runTrace(edges, (Schedule)s, (uint64_t)(sim.uniform() * LOOP_PERIOD_US));
+      t += DETECTION_TIMEOUT + 100000;
+      if (r.resets.size() != 1) continue;
+      uint64_t late = r.resets[0] - (edges.back() + DETECTION_TIMEOUT);
+      total += late;
+      if (late > worst) worst = late;
+      count++;
+    }
+    printf("%-16s %-10.0f %llu\n", SCHEDULE_NAMES[s], count ? total / count : 0.0,
+           (unsigned long long)worst);
+  }
+}
+
+// ========== 3. BACK-TO-BACK CARS ==========
+
+bool testBackToBack(int passes, uint64_t seed) {
+  const uint64_t gapsUs[] = {100, 250, 500, 1000, 1500, 2500};  // after DETECTION_TIMEOUT
+  bool ok = true;
+
+  printf("\n## back-to-back: car B starts DETECTION_TIMEOUT + gap after car A's last edge\n");
+  printf("gap      ");
+  for (int s = 0; s < NUM_SCHEDULES; s++) printf("%-16s", SCHEDULE_NAMES[s]);
+  printf("(%% separated)\n");
+
+  for (size_t g = 0; g < sizeof(gapsUs) / sizeof(gapsUs[0]); g++) {
+    printf("+%-7llu ", (unsigned long long)gapsUs[g]);
+    for (int s = 0; s < NUM_SCHEDULES; s++) {
+      PulseSim sim(seed + g);
+      initSensors();
+      uint64_t t = 1000000;
+      int separated = 0;
+
+      for (int p = 0; p < passes; p++) {
+        std::vector<uint64_t> edges;
+        sim.generatePass(passFor(1 + p % 6), t, edges);
+        uint64_t bStart = edges.back() + DETECTION_TIMEOUT + gapsUs[g];
+        std::vector<uint64_t> second;
+        t = sim.generatePass(passFor(1 + (p + 3) % 6), bStart, second);
+        // generatePass starts at a random phase; shift B so its first edge is at bStart
+        for (size_t i = 0; i < second.size(); i++) edges.push_back(second[i] - second[0] + bStart);
+        t += DETECTION_TIMEOUT + 100000;
+
+        TraceResult r = runTrace(edges, (Schedule)s, (uint64_t)(sim.uniform() * LOOP_PERIOD_US));
+        if (r.resets.size() == 2) separated++;
+      }
+
+      double pct = 100.0 * separated / passes;
+      if (s != LEGACY_SCAN && separated != passes) ok = false;
+      printf("%-16.1f", pct);
+    }
+    printf("\n");
+  }
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  int passes = argc > 1 ? atoi(argv[1]) : 600;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+
+  printf("# Deadline scheduler test: %d passes, seed %llu\n", passes, (unsigned long long)seed);
+
+  PulseSim sim(seed);
+  bool ok = testHeap(sim, 1000000);
+  testResetTiming(passes, seed);
+  ok = testBackToBack(passes, seed) && ok;
+
+  printf("\n# %s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
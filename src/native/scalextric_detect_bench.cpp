@@ -0,0 +1,143 @@
+#include <Arduino.h>
+#include <vector>
+#include <algorithm>
+#include "car_detection.h"
+#include "pulse_sim.h"
+#include "detect_harness.h"
+
+// Scalextric Detection Benchmark (host)
+// Runs simulated car passes through processSensor/onPulse and reports, per car:
+//   pulses-to-decision, time-to-decision, edge-to-callback latency,
+//   misclassification and miss rates
+//
+// Usage: scalextric_detect_bench [passes] [seed]
+// Build with -DCAR_CLASSIFIER=... (see car_detection.h) to benchmark another classifier,
+// or -DDETECTION_TASK=1 to model the event-driven detection task instead of loop() polling;
+// the same seed produces the same traces, so runs are directly comparable.
+// Tune MIN_PULSES_FOR_ID, CONFIRM_COUNT and FREQUENCY_TOLERANCE_PCT against these numbers.
+
+struct Scenario {
+  const char* name;
+  PassConfig cfg;
+  bool randomDrift;  // apply +/- freqOffsetPct with random sign per pass
+};
+
+// PassConfig: car, speed m/s, view mm, drift, jitter us, dropout, bounce, glitch, other car, other prob
+const Scenario SCENARIOS[] = {
+  {"clean",       {1, 2.0f, 25.0f, 0.00f, 2.0f, 0.00f, 0.00f, 0.00f, 0, 0.0f}, false},
+  {"jitter",      {1, 2.0f, 25.0f, 0.00f, 8.0f, 0.00f, 0.00f, 0.00f, 0, 0.0f}, false},
+  {"dropouts",    {1, 2.0f, 25.0f, 0.00f, 2.0f, 0.10f, 0.00f, 0.00f, 0, 0.0f}, false},
+  {"glitches",    {1, 2.0f, 25.0f, 0.00f, 2.0f, 0.00f, 0.10f, 0.05f, 0, 0.0f}, false},
+  {"drift",       {1, 2.0f, 25.0f, 0.05f, 2.0f, 0.00f, 0.00f, 0.00f, 0, 0.0f}, true},
+  {"fast",        {1, 8.0f, 25.0f, 0.00f, 2.0f, 0.00f, 0.00f, 0.00f, 0, 0.0f}, false},
+  {"reflections", {1, 2.0f, 25.0f, 0.00f, 2.0f, 0.00f, 0.00f, 0.30f, 0, 0.0f}, false},
+  {"second-car",  {1, 2.0f, 25.0f, 0.00f, 2.0f, 0.00f, 0.00f, 0.00f, 1, 0.3f}, false},
+};
+const int NUM_SCENARIOS = sizeof(SCENARIOS) / sizeof(SCENARIOS[0]);
+const int NUM_CARS = 6;
+
+struct CarStats {
+  int passes;
+  int correct;
+  int wrong;     // reported as a different car
+  int unknown;   // reported as car 0
+  int missed;    // no report at all
+  std::vector<int> pulses;
+  std::vector<uint64_t> micros;
+  std::vector<uint64_t> latency;
+};
+
+template <typename T>
+T percentile(std::vector<T> values, int pct) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  size_t idx = (values.size() - 1) * pct / 100;
+  return values[idx];
+}
+
+template <typename T>
+double mean(const std::vector<T>& values) {
+  if (values.empty()) return 0;
+  double sum = 0;
+  for (size_t i = 0; i < values.size(); i++) sum += values[i];
+  return sum / values.size();
+}
+
+int main(int argc, char** argv) {
+  int passes = argc > 1 ? atoi(argv[1]) : 200;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+
+  printf("# Scalextric detection benchmark: %d passes/car/scenario, seed %llu\n",
+         passes, (unsigned long long)seed);
+  printf("# Classifier: %s, %s\n", CAR_CLASSIFIER == CLASSIFIER_TONE_BANK ? "tone-bank" : "median",
+         DETECTION_TASK ? "detection task" : "loop() polling");
+  printf("# MIN_PULSES_FOR_ID=%d CONFIRM_COUNT=%d FREQUENCY_TOLERANCE_PCT=%.3f HISTORY_SIZE=%d\n",
+         MIN_PULSES_FOR_ID, CONFIRM_COUNT, FREQUENCY_TOLERANCE_PCT, HISTORY_SIZE);
+
+  initSensors();
+
+  int totalPasses = 0;
+  int totalWrong = 0;
+  int totalMissed = 0;
+  std::vector<uint64_t> allLatency;
+
+  for (int s = 0; s < NUM_SCENARIOS; s++) {
+    const Scenario& scenario = SCENARIOS[s];
+    PulseSim sim(seed * 1000 + s);
+
+    printf("\n## %s\n", scenario.name);
+    printf("car  passes  ok%%    wrong%%  unk%%   miss%%  pulses(avg/p95)  us(avg/p95)      lat(avg/p95)\n");
+
+    for (int car = 1; car <= NUM_CARS; car++) {
+      CarStats stats = {0, 0, 0, 0, 0, std::vector<int>(), std::vector<uint64_t>(),
+                        std::vector<uint64_t>()};
+      uint64_t t = 1000000;
+
+      for (int p = 0; p < passes; p++) {
+        PassConfig cfg = scenario.cfg;
+        cfg.car = car;
+        if (scenario.randomDrift && sim.uniform() < 0.5) cfg.freqOffsetPct = -cfg.freqOffsetPct;
+        if (cfg.otherCar > 0) cfg.otherCar = 1 + (car + (int)(sim.uniform() * 5)) % NUM_CARS;
+
+        std::vector<uint64_t> edges;
+        t = sim.generatePass(cfg, t, edges);
+        PassResult r = runPass(edges, (uint64_t)(sim.uniform() * LOOP_PERIOD_US));
+        t += DETECTION_TIMEOUT + 100000;  // idle track between passes
+
+        stats.passes++;
+        if (!r.detected) {
+          stats.missed++;
+        } else if (r.car == car) {
+          stats.correct++;
+          stats.pulses.push_back(r.edgesToDecision);
+          stats.micros.push_back(r.usToDecision);
+          stats.latency.push_back(r.latencyUs);
+        } else if (r.car == 0) {
+          stats.unknown++;
+        } else {
+          stats.wrong++;
+        }
+      }
+
+      printf("%-4d %-7d %-6.1f %-7.1f %-6.1f %-6.1f %5.1f / %-8d %6.0f / %-8llu %5.0f / %-5llu\n",
+             car, stats.passes,
+             100.0 * stats.correct / stats.passes,
+             100.0 * stats.wrong / stats.passes,
+             100.0 * stats.unknown / stats.passes,
+             100.0 * stats.missed / stats.passes,
+             mean(stats.pulses), percentile(stats.pulses, 95),
+             mean(stats.micros), (unsigned long long)percentile(stats.micros, 95),
+             mean(stats.latency), (unsigned long long)percentile(stats.latency, 95));
+      allLatency.insert(allLatency.end(), stats.latency.begin(), stats.latency.end());
+
+      totalPasses += stats.passes;
+      totalWrong += stats.wrong;
+      totalMissed += stats.missed;
+    }
+  }
+
+  printf("\n# Overall: %d passes, misclassified %.2f%%, missed %.2f%%, latency avg %.0fus p95 %lluus\n",
+         totalPasses, 100.0 * totalWrong / totalPasses, 100.0 * totalMissed / totalPasses,
+         mean(allLatency), (unsigned long long)percentile(allLatency, 95));
+  return 0;
+}
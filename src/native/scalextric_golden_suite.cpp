@@ -0,0 +1,306 @@
+#include <Arduino.h>
+#include <vector>
+#include "car_detection.h"
+#include "pulse_sim.h"
+#include "detect_harness.h"
+#include "host_cycles.h"
+#include "golden_corpus.h"
+#include "golden_baseline.h"
+
+// Golden Corpus Regression Suite (host)
+// Replays the golden corpus (golden_corpus.h) through the detector as built and
+// prints, per scenario and overall: accuracy, wrong/unknown/missed rates,
+// pulses-to-decision, microseconds-to-decision and host CPU cycles per pulse.
+// The results are compared with the accepted rows for this configuration in
+// golden_baseline.h, and the program exits non-zero when any metric is worse by
+// more than its tolerance. The scalextric_golden_* envs run it after every build
+// (scripts/golden_gate.py), one env per classifier / polling mode, so a detector
+// change that regresses any of them fails the build. Each scenario also has an
+// absolute accuracy floor (golden_corpus.h) that every config must reach, so a
+// config that is already broken can't be baselined as it is: --print-baseline
+// fails too when a floor is missed.
+//
+// Usage: scalextric_golden_suite                  run and check
+//        scalextric_golden_suite --print-baseline run and print rows for golden_baseline.h
+
+#ifndef GOLDEN_ACCURACY_DROP
+#define GOLDEN_ACCURACY_DROP 0.5  // Override via build_flags: -DGOLDEN_ACCURACY_DROP=... (points)
+#endif
+
+#ifndef GOLDEN_WRONG_RISE
+#define GOLDEN_WRONG_RISE 0.25  // Override via build_flags: -DGOLDEN_WRONG_RISE=... (points)
+#endif
+
+#ifndef GOLDEN_PULSES_RISE_PCT
+#define GOLDEN_PULSES_RISE_PCT 5  // Override via build_flags: -DGOLDEN_PULSES_RISE_PCT=...
+#endif
+
+#ifndef GOLDEN_US_RISE_PCT
+#define GOLDEN_US_RISE_PCT 5  // Override via build_flags: -DGOLDEN_US_RISE_PCT=...
+#endif
+
+// Cycles depend on the host CPU and its load, so the margin is wide: it catches an
+// accidental O(n^2), not a few percent. -DGOLDEN_CHECK_CYCLES=0 on a slow CI box.
+#ifndef GOLDEN_CYCLES_RISE_PCT
+#define GOLDEN_CYCLES_RISE_PCT 100  // Override via build_flags: -DGOLDEN_CYCLES_RISE_PCT=...
+#endif
+
+#ifndef GOLDEN_CHECK_CYCLES
+#define GOLDEN_CHECK_CYCLES 1  // Override via build_flags: -DGOLDEN_CHECK_CYCLES=0
+#endif
+
+const int TIMING_RUNS = 3;  // cycles are the fastest of these; results must agree
+
+#if CAR_CLASSIFIER == CLASSIFIER_SPRT
+#define GOLDEN_CLASSIFIER "sprt"
+#elif CAR_CLASSIFIER == CLASSIFIER_TONE_BANK
+#define GOLDEN_CLASSIFIER "tone"
+#else
+#define GOLDEN_CLASSIFIER "median"
+#endif
+
+#if DETECTION_TASK
+#define GOLDEN_MODE "-task"
+#else
+#define GOLDEN_MODE ""
+#endif
+
+#if CAR_CALIBRATION
+#define GOLDEN_CALIBRATION "-cal"
+#else
+#define GOLDEN_CALIBRATION ""
+#endif
+
+#if OVERLAP_DETECTION
+#define GOLDEN_OVERLAP ""
+#else
+#define GOLDEN_OVERLAP "-nooverlap"
+#endif
+
+#define GOLDEN_CONFIG GOLDEN_CLASSIFIER GOLDEN_MODE GOLDEN_CALIBRATION GOLDEN_OVERLAP
+
+// ========== REPLAY ==========
+
+std::vector<uint64_t> traceEdges;
+
+void collectEdge(const TraceRecord& record) {
+  if (record.type == TRACE_EDGE) traceEdges.push_back(record.timeUs);
+}
+
+struct ScenarioStats {
+  int passes;
+  int correct;
+  int wrong;
+  int unknown;
+  int missed;
+  uint64_t pulses;    // sums over correct passes
+  uint64_t micros;
+  uint64_t edges;     // all edges fed
+  uint64_t cycles;    // spent in runPass
+};
+
+// From a freshly initialised detector, so nothing it learns (CAR_CALIBRATION) carries
+// over from another scenario or an earlier replay of this one
+ScenarioStats runScenario(const GoldenTrace& trace) {
+  ScenarioStats stats = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+  initSensors();
+  traceEdges.clear();
+  decodeTrace(trace.bytes.data(), trace.bytes.size(), collectEdge);
+
+  size_t next = 0;
+  std::vector<uint64_t> edges;
+  for (size_t p = 0; p < trace.passes.size(); p++) {
+    const GoldenPass& pass = trace.passes[p];
+    edges.clear();
+    while (next < traceEdges.size() && traceEdges[next] <= pass.endUs) {
+      if (traceEdges[next] >= pass.startUs) edges.push_back(traceEdges[next]);
+      next++;
+    }
+
+    // Fixed, well-spread loop phase per pass so every run sees the same schedule
+    uint64_t phase = (p * 379) % LOOP_PERIOD_US;
+    uint64_t start = readCycles();
+    PassResult r = runPass(edges, phase);
+    stats.cycles += readCycles() - start;
+    stats.edges += edges.size();
+
+    stats.passes++;
+    if (!r.detected) {
+      stats.missed++;
+    } else if (r.car == pass.car) {
+      stats.correct++;
+      stats.pulses += r.edgesToDecision;
+      stats.micros += r.usToDecision;
+    } else if (r.car == 0) {
+      stats.unknown++;
+    } else {
+      stats.wrong++;
+    }
+  }
+  return stats;
+}
+
+GoldenMetrics toMetrics(const char* scenario, const ScenarioStats& s) {
+  GoldenMetrics m = {GOLDEN_CONFIG, scenario, 0, 0, 0, 0, 0};
+  if (s.passes > 0) {
+    m.accuracyPct = 100.0f * s.correct / s.passes;
+    m.wrongPct = 100.0f * s.wrong / s.passes;
+  }
+  if (s.correct > 0) {
+    m.pulses = (float)s.pulses / s.correct;
+    m.usToDecision = (float)s.micros / s.correct;
+  }
+  if (s.edges > 0) m.cyclesPerPulse = (float)s.cycles / s.edges;
+  return m;
+}
+
+void addStats(ScenarioStats& total, const ScenarioStats& s) {
+  total.passes += s.passes;
+  total.correct += s.correct;
+  total.wrong += s.wrong;
+  total.unknown += s.unknown;
+  total.missed += s.missed;
+  total.pulses += s.pulses;
+  total.micros += s.micros;
+  total.edges += s.edges;
+  total.cycles += s.cycles;
+}
+
+// ========== BASELINE CHECK ==========
+
+const GoldenMetrics* findBaseline(const char* scenario) {
+  for (size_t i = 0; i < sizeof(GOLDEN_BASELINE) / sizeof(GOLDEN_BASELINE[0]); i++) {
+    const GoldenMetrics& b = GOLDEN_BASELINE[i];
+    if (strcmp(b.config, GOLDEN_CONFIG) == 0 && strcmp(b.scenario, scenario) == 0) return &b;
+  }
+  return nullptr;
+}
+
+int regressions = 0;
+
+// Lower is better for everything but accuracy, which fails below its limit
+void checkMetric(const char* scenario, const char* metric, float value, float limit,
+                 float baseline, bool higherIsBetter = false) {
+  if (higherIsBetter ? value >= limit : value <= limit) return;
+  printf("REGRESSION %s/%s %s: %.2f, baseline %.2f, limit %.2f\n", GOLDEN_CONFIG, scenario, metric,
+         value, baseline, limit);
+  regressions++;
+}
+
+void checkBaseline(const GoldenMetrics& m) {
+  const GoldenMetrics* b = findBaseline(m.scenario);
+  if (!b) {
+    printf("REGRESSION %s/%s: no baseline row (run with --print-baseline)\n", GOLDEN_CONFIG,
+           m.scenario);
+    regressions++;
+    return;
+  }
+  checkMetric(m.scenario, "accuracy%", m.accuracyPct, b->accuracyPct - GOLDEN_ACCURACY_DROP,
+              b->accuracyPct, true);
+  checkMetric(m.scenario, "wrong%", m.wrongPct, b->wrongPct + GOLDEN_WRONG_RISE, b->wrongPct);
+  checkMetric(m.scenario, "pulses", m.pulses, b->pulses * (1 + GOLDEN_PULSES_RISE_PCT / 100.0f),
+              b->pulses);
+  checkMetric(m.scenario, "us", m.usToDecision,
+              b->usToDecision * (1 + GOLDEN_US_RISE_PCT / 100.0f), b->usToDecision);
+#if GOLDEN_CHECK_CYCLES
+  checkMetric(m.scenario, "cycles/pulse", m.cyclesPerPulse,
+              b->cyclesPerPulse * (1 + GOLDEN_CYCLES_RISE_PCT / 100.0f), b->cyclesPerPulse);
+#endif
+}
+
+// The absolute floor, independent of golden_baseline.h
+void checkFloor(const GoldenMetrics& m, float floorPct) {
+  if (m.accuracyPct >= floorPct) return;
+  printf("BELOW FLOOR %s/%s accuracy%%: %.2f, floor %.2f\n", GOLDEN_CONFIG, m.scenario,
+         m.accuracyPct, floorPct);
+  regressions++;
+}
+
+bool sameResults(const ScenarioStats& a, const ScenarioStats& b) {
+  return a.passes == b.passes && a.correct == b.correct && a.wrong == b.wrong &&
+         a.unknown == b.unknown && a.missed == b.missed && a.pulses == b.pulses &&
+         a.micros == b.micros && a.edges == b.edges;
+}
+
+int main(int argc, char** argv) {
+  bool printBaseline = argc > 1 && strcmp(argv[1], "--print-baseline") == 0;
+
+  std::vector<GoldenTrace> corpus;
+  for (int s = 0; s < GOLDEN_NUM_SCENARIOS; s++) corpus.push_back(buildGoldenTrace(s));
+  uint32_t digest = goldenCorpusDigest(corpus);
+
+  printf("# Scalextric golden corpus v%d: %d scenarios x %d passes/car, digest %08x\n",
+         GOLDEN_CORPUS_VERSION, GOLDEN_NUM_SCENARIOS, GOLDEN_PASSES_PER_CAR, (unsigned)digest);
+  printf("# Config %s: MIN_PULSES_FOR_ID=%d CONFIRM_COUNT=%d FREQUENCY_TOLERANCE_PCT=%.3f\n",
+         GOLDEN_CONFIG, MIN_PULSES_FOR_ID, CONFIRM_COUNT, FREQUENCY_TOLERANCE_PCT);
+
+  std::vector<ScenarioStats> results(GOLDEN_NUM_SCENARIOS);
+  bool deterministic = true;
+  for (int s = 0; s < GOLDEN_NUM_SCENARIOS; s++) {
+    for (int run = 0; run < TIMING_RUNS; run++) {
+      ScenarioStats stats = runScenario(corpus[s]);
+      if (run == 0) {
+        results[s] = stats;
+      } else {
+        if (!sameResults(stats, results[s])) deterministic = false;
+        if (stats.cycles < results[s].cycles) results[s].cycles = stats.cycles;
+      }
+    }
+  }
+
+  printf("\nscenario     passes  ok%%    wrong%%  unk%%   miss%%  pulses  us      cycles/pulse\n");
+  ScenarioStats total = {0, 0, 0, 0, 0, 0, 0, 0, 0};
+  std::vector<GoldenMetrics> metrics;
+  for (int s = 0; s <= GOLDEN_NUM_SCENARIOS; s++) {
+    bool overall = s == GOLDEN_NUM_SCENARIOS;
+    if (!overall) addStats(total, results[s]);
+    const ScenarioStats& st = overall ? total : results[s];
+    GoldenMetrics m = toMetrics(overall ? "overall" : corpus[s].name, st);
+    metrics.push_back(m);
+    printf("%-12s %-7d %-6.1f %-7.1f %-6.1f %-6.1f %-7.1f %-7.0f %.0f\n", m.scenario, st.passes,
+           m.accuracyPct, m.wrongPct, 100.0 * st.unknown / st.passes,
+           100.0 * st.missed / st.passes, m.pulses, m.usToDecision, m.cyclesPerPulse);
+  }
+
+  if (!deterministic) {
+    printf("\nFAIL: replays of the same corpus gave different results\n");
+    return 1;
+  }
+
+  printf("\n");
+  for (int s = 0; s <= GOLDEN_NUM_SCENARIOS; s++) {
+    checkFloor(metrics[s],
+               s < GOLDEN_NUM_SCENARIOS ? GOLDEN_SCENARIOS[s].floorPct : GOLDEN_OVERALL_FLOOR_PCT);
+  }
+  if (regressions > 0) {
+    printf("FAIL: %d scenario(s) below their accuracy floor%s\n", regressions,
+           printBaseline ? "; fix the detector before baselining it" : "");
+    return 1;
+  }
+
+  if (printBaseline) {
+    printf("// golden_baseline.h rows for %s (corpus digest 0x%08x)\n", GOLDEN_CONFIG,
+           (unsigned)digest);
+    for (size_t i = 0; i < metrics.size(); i++) {
+      const GoldenMetrics& m = metrics[i];
+      printf("  {\"%s\", \"%s\", %.2ff, %.2ff, %.2ff, %.1ff, %.1ff},\n", m.config, m.scenario,
+             m.accuracyPct, m.wrongPct, m.pulses, m.usToDecision, m.cyclesPerPulse);
+    }
+    return 0;
+  }
+
+  if (digest != GOLDEN_BASELINE_DIGEST) {
+    printf("\nFAIL: corpus digest %08x, baseline was taken on %08x; re-baseline with "
+           "--print-baseline if the corpus change is intended\n",
+           (unsigned)digest, (unsigned)GOLDEN_BASELINE_DIGEST);
+    return 1;
+  }
+
+  for (size_t i = 0; i < metrics.size(); i++) checkBaseline(metrics[i]);
+  if (regressions > 0) {
+    printf("FAIL: %d regression(s) against golden_baseline.h\n", regressions);
+    return 1;
+  }
+  printf("PASS: %s within tolerance of golden_baseline.h\n", GOLDEN_CONFIG);
+  return 0;
+}
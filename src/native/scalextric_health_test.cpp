@@ -0,0 +1,226 @@
+#include <Arduino.h>
+#include <string.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "car_detection.h"
+#include "pulse_sim.h"
+
+// Sensor Health Test (host)
+// Runs four sensors through one timeline, polled like loop() with delay(1), with
+// processAllSensors and monitorSensorHealth. An edge only reaches onPulse while its
+// pin has an interrupt attached, so a throttled sensor really costs no ISR calls.
+//   sensor 0  a car every 300ms throughout
+//   sensor 1  interrupt storm (60k random edges/s) 5-15s, then a car every 300ms
+//   sensor 2  pin held low without edges (sunlight) 10-20s, then a car every 300ms
+//   sensor 3  nothing until 30s, then 120 Hz lamp flicker with bounce until 40s
+// Checks that the storm is throttled within a few ticks with doubling backoff and the
+// sensor comes back afterwards, that sensor 0 keeps detecting through it, that each
+// fault gets its status (STORM, SATURATED, SILENT, NOISY) and clears again, and that
+// every sensor is reported every HEALTH_REPORT_MS. Also checks the H: text form.
+//
+// Usage: scalextric_health_test [seed]
+// Exits non-zero if any of those fail.
+
+const uint64_t SIM_US = 45000000;
+const uint64_t POLL_US = 1000;
+const uint64_t STORM_FROM = 5000000, STORM_TO = 15000000;
+const uint64_t LOW_FROM = 10000000, LOW_TO = 20000000;
+const uint64_t FLICKER_FROM = 30000000, FLICKER_TO = 40000000;
+
+struct ScheduledPass {
+  int sensor;
+  int car;
+  uint64_t startUs, endUs;
+};
+
+struct Report {
+  uint64_t atUs;
+  HealthInfo info;
+};
+
+std::vector<std::pair<uint64_t, int> > edges;  // (time, sensor)
+std::vector<ScheduledPass> passes;
+std::vector<Report> reports;
+std::vector<std::pair<uint64_t, int> > detections[NUM_SENSORS];  // (time, car)
+
+void onCarDetected(uint8_t sensorId, int car, float freq) {
+  (void)freq;
+  detections[sensorId].push_back(std::make_pair(hostMicros, car));
+}
+
+void onHealthReport(const HealthInfo& health) { reports.push_back({hostMicros, health}); }
+
+void addPasses(PulseSim& sim, int sensor, uint64_t fromUs, uint64_t toUs) {
+  for (uint64_t t = fromUs; t + 300000 <= toUs; t += 300000) {
+    PassConfig cfg = DEFAULT_PASS;
+    cfg.car = 1 + (int)(sim.uniform() * 6);
+    cfg.speedMps = 1.5f + (float)sim.uniform() * 2.5f;
+    std::vector<uint64_t> pass;
+    uint64_t end = sim.generatePass(cfg, t, pass);
+    for (size_t i = 0; i < pass.size(); i++) edges.push_back(std::make_pair(pass[i], sensor));
+    passes.push_back({sensor, cfg.car, t, end});
+  }
+}
+
+void buildTimeline(uint64_t seed) {
+  PulseSim sim(seed);
+  addPasses(sim, 0, 1000000, SIM_US);
+  for (double t = STORM_FROM; t < STORM_TO; t += 1 + sim.uniform() * 32) {
+    edges.push_back(std::make_pair((uint64_t)t, 1));
+  }
+  addPasses(sim, 1, STORM_TO + 6000000, SIM_US);
+  addPasses(sim, 2, LOW_TO + 1000000, SIM_US);
+  for (uint64_t t = FLICKER_FROM; t < FLICKER_TO; t += 1000000 / 120) {
+    edges.push_back(std::make_pair(t, 3));
+    if (sim.uniform() < 0.5) edges.push_back(std::make_pair(t + 5 + (uint64_t)(sim.uniform() * 30), 3));
+  }
+  std::sort(edges.begin(), edges.end());
+}
+
+// First report of this sensor with this status at or after fromUs, 0 if none
+uint64_t firstStatus(int sensor, uint8_t status, uint64_t fromUs) {
+  for (size_t i = 0; i < reports.size(); i++) {
+    const Report& r = reports[i];
+    if (r.info.sensorId == sensor && r.info.status == status && r.atUs >= fromUs) return r.atUs;
+  }
+  return 0;
+}
+
+uint8_t lastStatus(int sensor) {
+  uint8_t status = HEALTH_OK;
+  for (size_t i = 0; i < reports.size(); i++) {
+    if (reports[i].info.sensorId == sensor) status = reports[i].info.status;
+  }
+  return status;
+}
+
+// Passes of a sensor whose first report (if any) was their car
+void passAccuracy(int sensor, uint64_t fromUs, uint64_t toUs, int& total, int& correct) {
+  total = correct = 0;
+  for (size_t p = 0; p < passes.size(); p++) {
+    const ScheduledPass& pass = passes[p];
+    if (pass.sensor != sensor || pass.startUs < fromUs || pass.startUs >= toUs) continue;
+    total++;
+    for (size_t d = 0; d < detections[sensor].size(); d++) {
+      uint64_t at = detections[sensor][d].first;
+      if (at < pass.startUs || at > pass.endUs + DETECTION_TIMEOUT + 2 * POLL_US) continue;
+      if (detections[sensor][d].second == pass.car) correct++;
+      break;
+    }
+  }
+}
+
+bool testText() {
+  HealthEvent health = {HEALTH_EVENT_MAGIC, 3, 1, HEALTH_STORM, 65535, 12, 340, 7, 2};
+  char text[64];
+  formatHealthEvent(text, sizeof(text), health);
+  bool ok = strcmp(text, "H:3:1:STORM:65535:12:340:7:2") == 0;
+  // Receivers tell ESP-NOW messages apart by length and first byte
+  ok = ok && sizeof(HealthEvent) != sizeof(CarEvent) && sizeof(HealthEvent) != sizeof(CarEventWithQuality) &&
+       sizeof(HealthEvent) != sizeof(PassEvent) && sizeof(HealthEvent) != sizeof(ProbeMsg);
+  printf("\ntext: %s (HealthEvent %u bytes)%s\n", text, (unsigned)sizeof(HealthEvent), ok ? "" : "  MISMATCH");
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  uint64_t seed = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1;
+  printf("# Sensor health: %d sensors, %.0fs, seed %llu\n", NUM_SENSORS, SIM_US / 1e6, (unsigned long long)seed);
+  static_assert(NUM_SENSORS >= 4, "needs 4 sensors");
+
+  buildTimeline(seed);
+  hostSetMicros(0);
+  initSensors();
+
+  long isrCalls[NUM_SENSORS] = {0}, generated[NUM_SENSORS] = {0};
+  size_t next = 0;
+  for (uint64_t now = POLL_US; now <= SIM_US; now += POLL_US) {
+    while (next < edges.size() && edges[next].first <= now) {
+      int s = edges[next].second;
+      generated[s]++;
+      if (hostInterruptAttached[SENSOR_PINS[s]]) {
+        hostSetMicros(edges[next].first);
+        onPulse(s);
+        isrCalls[s]++;
+      }
+      next++;
+    }
+    hostPinLow[SENSOR_PINS[2]] = now >= LOW_FROM && now < LOW_TO;
+    hostSetMicros(now);
+    processDeadlines(onCarDetected);
+    processAllSensors(onCarDetected);
+    monitorSensorHealth(onHealthReport);
+  }
+
+  printf("\nstatus changes:\n");
+  uint8_t shown[NUM_SENSORS] = {0};
+  for (size_t i = 0; i < reports.size(); i++) {
+    const Report& r = reports[i];
+    if (r.info.status == shown[r.info.sensorId]) continue;
+    shown[r.info.sensorId] = r.info.status;
+    printf("  %6.2fs  S%d %-9s %6lu edges/s %4lu glitch/s %4lu oob/s  idle %5.1fs  throttles %u\n", r.atUs / 1e6,
+           r.info.sensorId, healthStatusName(r.info.status), (unsigned long)r.info.edgesPerSec,
+           (unsigned long)r.info.glitchesPerSec, (unsigned long)r.info.outOfBandPerSec, r.info.idleMs / 1e3,
+           r.info.throttles);
+  }
+
+  bool ok = testText();
+
+  // Storm: throttled within a few ticks, backing off 1, 2, 4, 8s, and back after it stops
+  std::vector<uint64_t> throttles;
+  for (uint64_t t = firstStatus(1, HEALTH_STORM, 0); t != 0; t = firstStatus(1, HEALTH_STORM, t + 1)) {
+    uint64_t cleared = 0;
+    for (size_t i = 0; i < reports.size(); i++) {
+      if (reports[i].atUs > t && reports[i].info.sensorId == 1 && reports[i].info.status != HEALTH_STORM) {
+        cleared = reports[i].atUs;
+        break;
+      }
+    }
+    throttles.push_back(t);
+    if (cleared == 0) break;
+    t = cleared;
+  }
+  printf("\nstorm: %.0f%% of %ld edges reached the ISR, throttled at", 100.0 * isrCalls[1] / generated[1],
+         generated[1]);
+  for (size_t i = 0; i < throttles.size(); i++) printf(" %.2fs", throttles[i] / 1e6);
+  printf("\n");
+  ok = ok && !throttles.empty() && throttles[0] - STORM_FROM <= 3 * HEALTH_TICK_MS * 1000;
+  ok = ok && throttles.size() >= 3;
+  for (size_t i = 2; i < throttles.size(); i++) {
+    uint64_t gap = throttles[i] - throttles[i - 1], before = throttles[i - 1] - throttles[i - 2];
+    ok = ok && gap > before + 500000;  // doubling
+  }
+  ok = ok && isrCalls[1] * 5 < generated[1];
+  ok = ok && hostInterruptAttached[SENSOR_PINS[1]] && lastStatus(1) == HEALTH_OK;
+
+  // Sensor 0 straight through the storm, sensor 1 once it's over
+  int total0, correct0, total1, correct1, total2, correct2;
+  passAccuracy(0, 0, SIM_US, total0, correct0);
+  passAccuracy(1, STORM_TO, SIM_US, total1, correct1);
+  passAccuracy(2, LOW_TO, SIM_US, total2, correct2);
+  printf("detected: S0 %d/%d, S1 after the storm %d/%d, S2 after the sunlight %d/%d\n", correct0, total0, correct1,
+         total1, correct2, total2);
+  ok = ok && correct0 * 100 >= total0 * 95 && correct1 * 100 >= total1 * 95 && correct2 * 100 >= total2 * 95;
+
+  // Saturated while the pin is held low, OK once cars are seen again
+  uint64_t saturated = firstStatus(2, HEALTH_SATURATED, 0);
+  printf("saturated: S2 at %.2fs, ok again at %.2fs\n", saturated / 1e6, firstStatus(2, HEALTH_OK, LOW_TO) / 1e6);
+  ok = ok && saturated >= LOW_FROM && saturated <= LOW_FROM + (HEALTH_SATURATED_TICKS + 2) * HEALTH_TICK_MS * 1000;
+  ok = ok && firstStatus(2, HEALTH_OK, LOW_TO) != 0 && lastStatus(2) == HEALTH_OK;
+
+  // Silent until the flicker starts, noisy (but not throttled) during it
+  uint64_t silent = firstStatus(3, HEALTH_SILENT, 0), noisy = firstStatus(3, HEALTH_NOISY, FLICKER_FROM);
+  printf("silent: S3 at %.2fs; noisy at %.2fs\n", silent / 1e6, noisy / 1e6);
+  ok = ok && silent != 0 && silent < FLICKER_FROM;
+  ok = ok && noisy != 0 && noisy <= FLICKER_FROM + HEALTH_WINDOW_MS * 1000;
+  ok = ok && firstStatus(3, HEALTH_STORM, 0) == 0 && firstStatus(3, HEALTH_OK, FLICKER_TO) != 0;
+  ok = ok && firstStatus(0, HEALTH_NOISY, 0) == 0 && firstStatus(0, HEALTH_STORM, 0) == 0;
+
+  // Periodic reports
+  int perSensor[NUM_SENSORS] = {0};
+  for (size_t i = 0; i < reports.size(); i++) perSensor[reports[i].info.sensorId]++;
+  for (int s = 0; s < NUM_SENSORS; s++) ok = ok && perSensor[s] >= (int)(SIM_US / 1000 / HEALTH_REPORT_MS);
+
+  printf("\n%s\n", ok ? "# PASS" : "# FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+#include <Arduino.h>
+#include <vector>
+#include <chrono>
+#include "scalextric_protocol.h"
+#include "sliding_median.h"
+#include "pulse_sim.h"
+
+// Median Micro-Benchmark (host)
+// Compares the old copy + bubble-sort median against SlidingMedian on identical
+// interval streams, for several window sizes. Each step inserts one interval and
+// asks for the median, which is what processSensor does per new pulse.
+// Also checks both paths return the same median at every step.
+//
+// Usage: scalextric_median_bench [intervals] [seed]
+
+// The pre-SlidingMedian implementation, kept verbatim apart from the window size
+template <int N>
+struct LegacyMedian {
+  volatile unsigned long history[N];
+  int index;
+
+  LegacyMedian() : index(0) {
+    for (int i = 0; i < N; i++) history[i] = 0;
+  }
+
+  void push(unsigned long value) {
+    history[index] = value;
+    index = (index + 1) % N;
+  }
+
+  unsigned long median() {
+    unsigned long temp[N];
+    int validSamples = 0;
+    noInterrupts();
+    for (int i = 0; i < N; i++) {
+      if (history[i] > 0) {
+        temp[validSamples++] = history[i];
+      }
+    }
+    interrupts();
+    if (validSamples < 3) return 0;
+    for (int i = 0; i < validSamples - 1; i++) {
+      for (int j = 0; j < validSamples - i - 1; j++) {
+        if (temp[j] > temp[j + 1]) {
+          unsigned long swap = temp[j];
+          temp[j] = temp[j + 1];
+          temp[j + 1] = swap;
+        }
+      }
+    }
+    return temp[validSamples / 2];
+  }
+};
+
+// Valid intervals from simulated passes of all six cars with jitter and glitches
+std::vector<uint32_t> makeIntervals(size_t count, uint64_t seed) {
+  PulseSim sim(seed);
+  std::vector<uint32_t> intervals;
+  uint64_t t = 0;
+  while (intervals.size() < count) {
+    PassConfig cfg = DEFAULT_PASS;
+    cfg.car = 1 + (int)(sim.uniform() * 6);
+    cfg.jitterUs = 8.0f;
+    cfg.glitchProb = 0.05f;
+    std::vector<uint64_t> edges;
+    t = sim.generatePass(cfg, t, edges) + 100000;
+    for (size_t i = 1; i < edges.size() && intervals.size() < count; i++) {
+      uint64_t delta = edges[i] - edges[i - 1];
+      if (delta >= MIN_VALID_INTERVAL && delta <= MAX_VALID_INTERVAL) {
+        intervals.push_back((uint32_t)delta);
+      }
+    }
+  }
+  return intervals;
+}
+
+template <int N>
+void runSize(const std::vector<uint32_t>& intervals) {
+  typedef std::chrono::steady_clock Clock;
+  unsigned long checksum = 0;
+  int mismatches = 0;
+
+  // Correctness: both paths must agree once the windows hold 3+ samples
+  {
+    LegacyMedian<N> legacy;
+    SlidingMedian<N, MIN_VALID_INTERVAL, MAX_VALID_INTERVAL> sliding;
+    for (size_t i = 0; i < intervals.size(); i++) {
+      legacy.push(intervals[i]);
+      sliding.push(intervals[i]);
+      unsigned long expected = legacy.median();
+      unsigned long actual = sliding.size() < 3 ? 0 : sliding.median();
+      if (expected != actual) mismatches++;
+    }
+  }
+
+  LegacyMedian<N> legacy;
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < intervals.size(); i++) {
+    legacy.push(intervals[i]);
+    checksum += legacy.median();
+  }
+  double legacyNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+  SlidingMedian<N, MIN_VALID_INTERVAL, MAX_VALID_INTERVAL> sliding;
+  start = Clock::now();
+  for (size_t i = 0; i < intervals.size(); i++) {
+    sliding.push(intervals[i]);
+    checksum += sliding.median();
+  }
+  double slidingNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+
+  printf("%-6d %-14.1f %-14.1f %6.1fx   %-10d (checksum %lu)\n", N,
+         legacyNs / intervals.size(), slidingNs / intervals.size(),
+         legacyNs / slidingNs, mismatches, checksum);
+}
+
+int main(int argc, char** argv) {
+  size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+
+  std::vector<uint32_t> intervals = makeIntervals(count, seed);
+  printf("# Median benchmark: %u intervals, seed %llu\n",
+         (unsigned)intervals.size(), (unsigned long long)seed);
+  printf("window legacy ns/op   sliding ns/op  speedup   mismatches\n");
+
+  runSize<10>(intervals);
+  runSize<16>(intervals);
+  runSize<32>(intervals);
+  runSize<64>(intervals);
+  return 0;
+}
@@ -0,0 +1,202 @@
+#include <Arduino.h>
+#include <vector>
+#include <algorithm>
+#include "car_detection.h"
+#include "overlap_detector.h"
+#include "pulse_sim.h"
+#include "detect_harness.h"
+
+// Dual-Car Overlap Test (host)
+// Interleaves the simulated pulse trains of two cars on one sensor and checks that
+// both are reported:
+//   separation  detectOverlap on a window of mixed edges: both cars found, confidences
+//   detector    whole passes through the detector (runPass): side by side, a car
+//               arriving halfway through another's pass, and a car bunched up behind
+//               another within DETECTION_TIMEOUT
+//   single      one car with noise, drift and reflections must not produce a second car
+//
+// Usage: scalextric_overlap_test [passes] [seed]
+// Build with -DOVERLAP_DETECTION=0 for the numbers without overlap detection, or
+// -DCAR_CLASSIFIER=... / -DDETECTION_TASK=1 for another detector configuration.
+// Exits non-zero if overlap detection is on and the rates fall below MIN_*_PCT.
+
+const float MIN_SEPARATION_PCT = 90;   // both cars found by detectOverlap
+const float MIN_BOTH_REPORTED_PCT = 85;  // both cars reported by the detector
+const float MAX_FALSE_SECOND_PCT = 1;  // single-car passes with a second report
+
+PassConfig noisyPass(PulseSim& sim, int car) {
+  PassConfig cfg = DEFAULT_PASS;
+  cfg.car = car;
+  cfg.jitterUs = 4.0f;
+  cfg.dropoutProb = 0.05f;
+  cfg.bounceProb = 0.05f;
+  cfg.glitchProb = 0.05f;
+  cfg.freqOffsetPct = (float)((sim.uniform() - 0.5) * 0.08);  // +/- 4%
+  return cfg;
+}
+
+void addCar(std::vector<uint64_t>& edges, PulseSim& sim, const PassConfig& cfg, uint64_t startUs) {
+  std::vector<uint64_t> own;
+  sim.generatePass(cfg, startUs, own);
+  edges.insert(edges.end(), own.begin(), own.end());
+  std::sort(edges.begin(), edges.end());
+}
+
+// ========== SEPARATION ==========
+
+bool testSeparation(int passes, uint64_t seed) {
+  printf("## separation (detectOverlap, last %d edges, both cars in view)\n", OVERLAP_WINDOW);
+  printf("first\\second  1      2      3      4      5      6\n");
+  PulseSim sim(seed);
+  int total = 0, found = 0;
+  double confidence = 0;
+  for (int a = 1; a <= 6; a++) {
+    printf("%-13d", a);
+    for (int b = 1; b <= 6; b++) {
+      if (a == b) {
+        printf("-      ");
+        continue;
+      }
+      int ok = 0;
+      for (int p = 0; p < passes; p++) {
+        std::vector<uint64_t> edges;
+        addCar(edges, sim, noisyPass(sim, a), 1000000);
+        addCar(edges, sim, noisyPass(sim, b), 1000000 + (uint64_t)(sim.uniform() * 3000));
+        std::vector<uint32_t> window;
+        size_t from = edges.size() > (size_t)OVERLAP_WINDOW ? edges.size() - OVERLAP_WINDOW : 0;
+        for (size_t i = from; i < edges.size(); i++) window.push_back((uint32_t)edges[i]);
+
+        OverlapResult r;
+        detectOverlap(window.data(), window.size(), r);
+        bool both = r.count == 2 && ((r.car[0] == a && r.car[1] == b) || (r.car[0] == b && r.car[1] == a));
+        if (both) {
+          ok++;
+          confidence += r.confidence[0] + r.confidence[1];
+        }
+      }
+      printf("%-6.0f ", 100.0 * ok / passes);
+      total += passes;
+      found += ok;
+    }
+    printf("\n");
+  }
+  double pct = 100.0 * found / total;
+  printf("both found %.1f%%, mean confidence %.2f\n", pct, found ? confidence / (2 * found) : 0);
+  return pct >= MIN_SEPARATION_PCT;
+}
+
+// ========== DETECTOR ==========
+
+struct Layout {
+  const char* name;
+  float secondStart;  // start of the second car, in units of the first car's pass
+};
+
+const Layout LAYOUTS[] = {
+  {"side by side", 0.0f},
+  {"halfway", 0.5f},
+  {"bunched", 1.4f},  // ~5ms after the first car has gone, well inside DETECTION_TIMEOUT
+};
+const int NUM_LAYOUTS = sizeof(LAYOUTS) / sizeof(LAYOUTS[0]);
+
+bool testDetector(int passes, uint64_t seed) {
+  printf("\n## detector (runPass)\n");
+  printf("layout        passes  both%%   first-ok%%  wrong%%\n");
+  bool ok = true;
+  initSensors();
+  for (int l = 0; l < NUM_LAYOUTS; l++) {
+    PulseSim sim(seed * 100 + l);
+    int total = 0, both = 0, firstOk = 0, wrong = 0;
+    uint64_t t = 1000000;
+    for (int a = 1; a <= 6; a++) {
+      for (int b = 1; b <= 6; b++) {
+        if (a == b) continue;
+        for (int p = 0; p < passes; p++) {
+          PassConfig first = noisyPass(sim, a);
+          PassConfig second = noisyPass(sim, b);
+          uint64_t duration = PulseSim::passDurationUs(first);
+          std::vector<uint64_t> edges;
+          addCar(edges, sim, first, t);
+          addCar(edges, sim, second, t + (uint64_t)(LAYOUTS[l].secondStart * duration));
+          PassResult r = runPass(edges, (uint64_t)(sim.uniform() * LOOP_PERIOD_US));
+          t = edges.back() + DETECTION_TIMEOUT + 100000;
+
+          total++;
+          uint8_t pair = (1 << (a - 1)) | (1 << (b - 1));
+          if ((r.carMask & pair) == pair) both++;
+          if (r.car == a || (LAYOUTS[l].secondStart == 0 && r.car == b)) firstOk++;
+          if (r.carMask & ~pair) wrong++;
+        }
+      }
+    }
+    double pct = 100.0 * both / total;
+    printf("%-13s %-7d %-7.1f %-10.1f %.1f\n", LAYOUTS[l].name, total, pct, 100.0 * firstOk / total,
+           100.0 * wrong / total);
+    ok = ok && pct >= MIN_BOTH_REPORTED_PCT;
+  }
+  return ok;
+}
+
+// ========== SINGLE CAR ==========
+
+bool testSingle(int passes, uint64_t seed) {
+  printf("\n## single car (must report one car)\n");
+  printf("noise         passes  ok%%    second%%\n");
+  // PassConfig: car, speed m/s, view mm, drift, jitter us, dropout, bounce, glitch, other car, other prob
+  const PassConfig noises[] = {
+    {1, 2.0f, 25.0f, 0.00f, 2.0f, 0.00f, 0.00f, 0.00f, 0, 0.0f},
+    {1, 2.0f, 25.0f, 0.00f, 4.0f, 0.00f, 0.10f, 0.15f, 0, 0.0f},
+    {1, 2.0f, 25.0f, 0.04f, 8.0f, 0.15f, 0.00f, 0.00f, 0, 0.0f},
+    {1, 6.0f, 25.0f, 0.00f, 3.0f, 0.02f, 0.00f, 0.01f, 0, 0.0f},
+  };
+  const char* names[] = {"clean", "ambient-ir", "drift+jitter", "fast"};
+  bool ok = true;
+  initSensors();
+  for (int n = 0; n < 4; n++) {
+    PulseSim sim(seed * 1000 + n);
+    int total = 0, correct = 0, second = 0;
+    uint64_t t = 1000000;
+    for (int car = 1; car <= 6; car++) {
+      for (int p = 0; p < passes * 5; p++) {
+        PassConfig cfg = noises[n];
+        cfg.car = car;
+        if (sim.uniform() < 0.5) cfg.freqOffsetPct = -cfg.freqOffsetPct;
+        std::vector<uint64_t> edges;
+        t = sim.generatePass(cfg, t, edges);
+        PassResult r = runPass(edges, (uint64_t)(sim.uniform() * LOOP_PERIOD_US));
+        t += DETECTION_TIMEOUT + 100000;
+        total++;
+        if (r.car == car) correct++;
+        if (r.carMask & (r.carMask - 1)) second++;  // more than one car
+      }
+    }
+    double pct = 100.0 * second / total;
+    printf("%-13s %-7d %-6.1f %.2f\n", names[n], total, 100.0 * correct / total, pct);
+    ok = ok && pct <= MAX_FALSE_SECOND_PCT;
+  }
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  int passes = argc > 1 ? atoi(argv[1]) : 40;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+
+  printf("# Dual-car overlap test: %d passes per pair, seed %llu, OVERLAP_DETECTION=%d\n\n", passes,
+         (unsigned long long)seed, OVERLAP_DETECTION);
+
+  bool separation = testSeparation(passes, seed);
+  bool detector = testDetector(passes, seed);
+  bool single = testSingle(passes, seed);
+
+#if OVERLAP_DETECTION
+  bool ok = separation && detector && single;
+  printf("\n%s\n", ok ? "# PASS" : "# FAIL");
+  return ok ? 0 : 1;
+#else
+  (void)separation;
+  (void)detector;
+  (void)single;
+  printf("\n# OVERLAP_DETECTION=0: reference numbers only\n");
+  return 0;
+#endif
+}
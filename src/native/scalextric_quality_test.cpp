@@ -0,0 +1,211 @@
+#include <Arduino.h>
+#include <string.h>
+#include <vector>
+#include "car_detection.h"
+#include "pulse_sim.h"
+#include "detect_harness.h"
+
+// Event Quality Test (host)
+// Runs single-car passes under each kind of trouble through the detector and prints
+// the mean EventQuality of the first report per scenario. It checks that each metric
+// picks out its own problem against the clean passes:
+//   ambient-ir  glitches and out-of-band intervals up, valid% down
+//   jitter      interval IQR up
+//   drift       margin to the nearest other car down
+//   dropouts    out-of-band intervals up, valid% down
+//   two cars    overlap confidence on the second car's report
+// and that eventMarginal() flags wrong cars far more often than correct ones, and that
+// an unknown-car report carries its own quality. Also checks the ESP-NOW and text
+// forms (readCarEvent, formatCarEvent).
+//
+// Usage: scalextric_quality_test [passes per car] [seed]
+// Exits non-zero if a metric doesn't separate its scenario from clean passes.
+
+struct Scenario {
+  const char* name;
+  PassConfig cfg;  // car is overridden per pass; drift is applied with a random sign
+};
+
+// PassConfig: car, speed m/s, view mm, drift, jitter us, dropout, bounce, glitch, other car, other prob
+const Scenario SCENARIOS[] = {
+  {"clean",      {1, 2.0f, 25.0f, 0.00f, 2.0f, 0.00f, 0.00f, 0.00f, 0, 0.0f}},
+  {"ambient-ir", {1, 2.0f, 25.0f, 0.00f, 2.0f, 0.00f, 0.10f, 0.15f, 0, 0.0f}},
+  {"jitter",     {1, 2.0f, 25.0f, 0.00f, 10.0f, 0.00f, 0.00f, 0.00f, 0, 0.0f}},
+  {"drift",      {1, 2.0f, 25.0f, 0.065f, 2.0f, 0.00f, 0.00f, 0.00f, 0, 0.0f}},
+  {"dropouts",   {1, 2.0f, 25.0f, 0.00f, 2.0f, 0.20f, 0.00f, 0.00f, 0, 0.0f}},
+};
+const int NUM_SCENARIOS = sizeof(SCENARIOS) / sizeof(SCENARIOS[0]);
+
+struct QualityStats {
+  int passes, reported, correct, wrong, marginal, marginalWrong;
+  double pulses, validPct, glitches, outOfBand, iqrUs, marginPermille, overlapPct;
+};
+
+void addQuality(QualityStats& st, const EventQuality& q) {
+  st.pulses += q.pulses;
+  st.validPct += q.validPct;
+  st.glitches += q.glitches;
+  st.outOfBand += q.outOfBand;
+  st.iqrUs += q.iqrUs;
+  st.marginPermille += q.marginPermille;
+  st.overlapPct += q.overlapPct;
+}
+
+void printStats(const char* name, QualityStats st) {
+  double n = st.reported ? st.reported : 1;
+  printf("%-12s %-7d %-6.1f %-7.1f %-7.1f %-7.1f %-7.2f %-7.2f %-7.1f %-7.1f %-8.1f %.1f\n", name, st.passes,
+         100.0 * st.correct / st.passes, 100.0 * st.wrong / st.passes, st.pulses / n, st.validPct / n,
+         st.glitches / n, st.outOfBand / n, st.iqrUs / n, st.marginPermille / n, st.overlapPct / n,
+         100.0 * st.marginal / n);
+}
+
+QualityStats runScenario(const Scenario& s, int passesPerCar, uint64_t seed) {
+  QualityStats st = {};
+  PulseSim sim(seed);
+  uint64_t t = 1000000;
+  for (int car = 1; car <= 6; car++) {
+    for (int p = 0; p < passesPerCar; p++) {
+      PassConfig cfg = s.cfg;
+      cfg.car = car;
+      if (sim.uniform() < 0.5) cfg.freqOffsetPct = -cfg.freqOffsetPct;
+      std::vector<uint64_t> edges;
+      t = sim.generatePass(cfg, t, edges);
+      PassResult r = runPass(edges, (uint64_t)(sim.uniform() * LOOP_PERIOD_US));
+      t += DETECTION_TIMEOUT + 100000;
+      st.passes++;
+      if (!r.detected) continue;
+      st.reported++;
+      bool marginal = eventMarginal(r.quality);
+      if (r.car == car) {
+        st.correct++;
+      } else {
+        st.wrong++;
+        if (marginal) st.marginalWrong++;
+      }
+      if (marginal) st.marginal++;
+      addQuality(st, r.quality);
+    }
+  }
+  return st;
+}
+
+// Second car's report when two cars share the sensor (side by side)
+QualityStats runTwoCars(int passesPerCar, uint64_t seed) {
+  QualityStats st = {};
+  PulseSim sim(seed);
+  uint64_t t = 1000000;
+  for (int a = 1; a <= 6; a++) {
+    for (int b = 1; b <= 6; b++) {
+      if (a == b) continue;
+      for (int p = 0; p < passesPerCar / 5 + 1; p++) {
+        PassConfig first = SCENARIOS[0].cfg;
+        first.car = a;
+        PassConfig second = first;
+        second.car = b;
+        std::vector<uint64_t> edges;
+        sim.generatePass(first, t, edges);
+        sim.generatePass(second, t + (uint64_t)(sim.uniform() * 2000), edges);
+        std::sort(edges.begin(), edges.end());
+        // The quality callback sees each report; keep the last one (the second car)
+        PassResult r = runPass(edges, (uint64_t)(sim.uniform() * LOOP_PERIOD_US));
+        t = edges.back() + DETECTION_TIMEOUT + 100000;
+        st.passes++;
+        if (r.reports < 2) continue;
+        st.reported++;
+        st.correct += (r.carMask & (1 << (b - 1))) && (r.carMask & (1 << (a - 1)));
+        addQuality(st, sensors[0].quality);
+        if (eventMarginal(sensors[0].quality)) st.marginal++;
+      }
+    }
+  }
+  return st;
+}
+
+// An unknown-car report (pass between every band) right after a clean car 1: its
+// quality must be its own, not the car 1 report's
+bool testUnknownQuality(uint64_t seed) {
+  PulseSim sim(seed);
+  uint64_t t = 1000000;
+  std::vector<uint64_t> edges;
+  sim.generatePass(SCENARIOS[0].cfg, t, edges);
+  PassResult known = runPass(edges, 0);
+  PassConfig between = SCENARIOS[0].cfg;
+  between.freqOffsetPct = -0.11f;  // 4.9 kHz: above car 2's band, below car 1's
+  t = edges.back() + DETECTION_TIMEOUT + 100000;
+  edges.clear();
+  sim.generatePass(between, t, edges);
+  PassResult unknown = runPass(edges, 0);
+  bool ok = known.car == 1 && unknown.detected && unknown.car == 0 && unknown.quality.pulses > 0 &&
+            unknown.quality.marginPermille == 0 && eventMarginal(unknown.quality);
+  printf("\nunknown after car 1: car %d, margin %u (car 1 had %u)%s\n", unknown.car,
+         unknown.quality.marginPermille, known.quality.marginPermille, ok ? "" : "  STALE");
+  return ok;
+}
+
+// ========== WIRE FORMAT ==========
+
+bool testWire() {
+  CarEvent event = {3, 1, 4, 3096, 123456};
+  EventQuality quality = {14, 93, 2, 1, 6, 97, 0};
+  CarEventWithQuality framed = {event, quality};
+
+  CarEvent e;
+  EventQuality q;
+  bool ok = readCarEvent((const uint8_t*)&framed, sizeof(framed), e, q) && q.pulses == 14 && q.marginPermille == 97 &&
+            e.carNumber == 4 && e.timestamp == 123456;
+  ok = ok && readCarEvent((const uint8_t*)&event, sizeof(event), e, q) && q.pulses == 0 && e.frequency == 3096;
+  ok = ok && !readCarEvent((const uint8_t*)&framed, sizeof(event) + 1, e, q);
+
+  char plain[96], extended[96];
+  formatCarEvent(plain, sizeof(plain), 42, event, 123456000ULL, EventQuality());
+  formatCarEvent(extended, sizeof(extended), 42, event, 123456789ULL, quality);
+  ok = ok && strcmp(plain, "42:3:1:4:3096:123456") == 0;
+  ok = ok && strcmp(extended, "42:3:1:4:3096:123456:Q:14:93:2:1:6:97:0") == 0;
+  printf("\nwire: CarEvent %u bytes, with quality %u bytes\n  %s\n  %s\n%s\n", (unsigned)sizeof(CarEvent),
+         (unsigned)sizeof(CarEventWithQuality), plain, extended, ok ? "  round trip ok" : "  MISMATCH");
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  int passesPerCar = argc > 1 ? atoi(argv[1]) : 40;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+
+  printf("# Event quality: %d passes per car, seed %llu\n\n", passesPerCar, (unsigned long long)seed);
+  printf("scenario     passes  ok%%    wrong%%  pulses  valid%%  glitch  oob     iqr us  margin  overlap%% marginal%%\n");
+
+  initSensors();
+  QualityStats stats[NUM_SCENARIOS];
+  int wrong = 0, marginalWrong = 0, correct = 0, marginalCorrect = 0;
+  for (int i = 0; i < NUM_SCENARIOS; i++) {
+    stats[i] = runScenario(SCENARIOS[i], passesPerCar, seed * 100 + i);
+    printStats(SCENARIOS[i].name, stats[i]);
+    wrong += stats[i].wrong;
+    marginalWrong += stats[i].marginalWrong;
+    correct += stats[i].correct;
+    marginalCorrect += stats[i].marginal - stats[i].marginalWrong;
+  }
+  QualityStats two = runTwoCars(passesPerCar, seed * 100 + NUM_SCENARIOS);
+  printStats("two cars", two);
+
+  printf("\nmarginal: %d/%d wrong reports, %d/%d correct reports\n", marginalWrong, wrong, marginalCorrect,
+         correct);
+
+  const QualityStats& clean = stats[0];
+  double n0 = clean.reported;
+  bool ok = testWire();
+  ok = testUnknownQuality(seed * 100 + NUM_SCENARIOS + 1) && ok;
+  ok = ok && stats[1].glitches / stats[1].reported > clean.glitches / n0 + 1;
+  ok = ok && stats[1].validPct / stats[1].reported < clean.validPct / n0 - 10;
+  ok = ok && stats[2].iqrUs / stats[2].reported > 2 * clean.iqrUs / n0;
+  ok = ok && stats[3].marginPermille / stats[3].reported < clean.marginPermille / n0 - 30;
+  ok = ok && stats[4].outOfBand / stats[4].reported > clean.outOfBand / n0 + 0.5;
+  ok = ok && stats[4].validPct / stats[4].reported < clean.validPct / n0 - 10;
+#if OVERLAP_DETECTION
+  ok = ok && two.reported > 0 && two.overlapPct / two.reported > 50;
+#endif
+  ok = ok && clean.marginal == 0;
+  ok = ok && (wrong == 0 || marginalWrong * 2 >= wrong);
+  ok = ok && marginalCorrect * 10 <= correct;
+  printf("\n%s\n", ok ? "# PASS" : "# FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,425 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "race_engine.h"
+#include "pulse_sim.h"
+
+// Race Engine Test (host)
+// Replays a race log through RaceEngine one event at a time, as the parent does, and
+// after every event checks:
+//   reference  standings recomputed from scratch over the whole event history
+//   client     a table built only from the R: updates sent so far
+//   snapshot   a fresh client fed RaceEngine::snapshot() at the end
+// The built-in race is simulated: 6 cars, 3 timing lines, 30 laps, with missed,
+// duplicated and unidentified detections plus events from a sensor that isn't a
+// timing line. A clean run of the same race is also checked against the true lap
+// times and lap counts.
+//
+// Usage: scalextric_race_test [seed] [race.log]
+// race.log: lines as sent by the parents (SEQ:NODE:SENSOR:CAR:FREQ:MILLIS), plus
+// LINE:NODE:SENSOR:INDEX lines to set up the timing lines. Anything else is skipped.
+// Exits non-zero on any mismatch.
+
+const int RACE_LAPS = 30;
+const uint32_t MAX_LATENCY_MS = 15;  // detection + ESP-NOW delay in the simulation
+
+struct LogEvent {
+  uint8_t nodeId;
+  uint8_t sensorId;
+  int car;
+  uint32_t ms;
+};
+
+// ========== RECORDED RACE ==========
+
+struct SimRace {
+  std::vector<std::string> log;
+  int trueLaps[RACE_NUM_CARS];
+  std::vector<uint32_t> trueLapMs[RACE_NUM_CARS];
+};
+
+struct Crossing {
+  uint32_t ms;
+  int car;
+  int line;
+};
+
+bool byTime(const Crossing& a, const Crossing& b) { return a.ms < b.ms; }
+
+SimRace simulateRace(uint64_t seed, bool faults) {
+  const RaceLine LINES[] = {{PARENT_NODE_ID, 0}, {0, 0}, {1, 1}};
+  const float SECTOR_SHARE[] = {0.35f, 0.30f, 0.35f};
+  PulseSim sim(seed);
+  SimRace race;
+  std::vector<Crossing> crossings;
+
+  for (int car = 1; car <= RACE_NUM_CARS; car++) {
+    double t = 2000 + car * 150;  // grid: staggered over the start line
+    double pace = 6500 + sim.uniform() * 1500;
+    race.trueLaps[car - 1] = RACE_LAPS;
+    for (int lap = 0; lap < RACE_LAPS; lap++) {
+      double lapMs = pace + sim.gaussian() * 250 + (sim.uniform() < 0.05 ? 3000 : 0);  // off
+      race.trueLapMs[car - 1].push_back(0);
+      double start = t;
+      for (int line = 0; line < 3; line++) {
+        Crossing c = {(uint32_t)t, car, line};
+        crossings.push_back(c);
+        t += lapMs * SECTOR_SHARE[line];
+      }
+      race.trueLapMs[car - 1][lap] = (uint32_t)t - (uint32_t)start;
+    }
+    Crossing finish = {(uint32_t)t, car, 0};
+    crossings.push_back(finish);
+  }
+  std::sort(crossings.begin(), crossings.end(), byTime);
+
+  // Parent's view: receive time = crossing + latency, with detection faults
+  std::vector<Crossing> received;
+  for (size_t i = 0; i < crossings.size(); i++) {
+    Crossing c = crossings[i];
+    c.ms += (uint32_t)(sim.uniform() * MAX_LATENCY_MS);
+    if (faults) {
+      double r = sim.uniform();
+      if (r < 0.03) continue;                  // missed
+      if (r < 0.04) c.car = 0;                 // seen but not identified
+      if (r >= 0.04 && r < 0.07) {             // reported twice (two sensors / re-trigger)
+        Crossing again = c;
+        again.ms += 5 + (uint32_t)(sim.uniform() * 200);
+        received.push_back(again);
+      }
+      if (sim.uniform() < 0.02) {              // another car on a sensor that isn't a line
+        Crossing other = c;
+        other.line = -1;
+        received.push_back(other);
+      }
+    }
+    received.push_back(c);
+  }
+  std::stable_sort(received.begin(), received.end(), byTime);
+
+  char buf[64];
+  for (int i = 0; i < 3; i++) {
+    snprintf(buf, sizeof(buf), "LINE:%d:%d:%d", LINES[i].nodeId, LINES[i].sensorId, i);
+    race.log.push_back(buf);
+  }
+  for (size_t i = 0; i < received.size(); i++) {
+    const Crossing& c = received[i];
+    RaceLine where = c.line >= 0 ? LINES[c.line] : RaceLine{2, 0};
+    snprintf(buf, sizeof(buf), "%d:%d:%d:%d:%d:%lu", (int)i, where.nodeId, where.sensorId,
+             c.car, c.car ? CAR_FREQUENCIES[c.car - 1] : 0, (unsigned long)c.ms);
+    race.log.push_back(buf);
+  }
+  return race;
+}
+
+// ========== REFERENCE (FULL HISTORY) ==========
+
+struct Standing {
+  bool started;
+  int laps;
+  uint32_t lastLapMs, bestLapMs, avgMs;
+  uint32_t bestSectorMs[RACE_MAX_LINES];
+  int position;
+};
+
+// Every car's standing from the complete list of events on timing lines
+void referenceStandings(const std::vector<LogEvent>& history, const RaceEngine& engine,
+                        Standing out[RACE_NUM_CARS]) {
+  int numLines = engine.lineCount();
+  long progress[RACE_NUM_CARS];
+  size_t reachedAt[RACE_NUM_CARS];  // index of the event that set progress
+
+  for (int car = 1; car <= RACE_NUM_CARS; car++) {
+    Standing& s = out[car - 1];
+    memset(&s, 0, sizeof(s));
+    int line = 0;
+    uint32_t lineMs = 0, lapStart = 0, total = 0;
+    int timed = 0;
+    bool lapTimed = false;
+    long prog = 0;
+    size_t at = 0;
+
+    for (size_t i = 0; i < history.size(); i++) {
+      const LogEvent& e = history[i];
+      int l = engine.findLine(e.nodeId, e.sensorId);
+      if (e.car != car || l < 0) continue;
+      if (!s.started) {
+        if (l != 0) continue;
+        s.started = true;
+        line = 0;
+        lineMs = lapStart = e.ms;
+        lapTimed = true;
+        at = i;
+        continue;
+      }
+      int steps = ((l - line) % numLines + numLines) % numLines;
+      if (steps == 0) {
+        if (e.ms - lineMs < RACE_MIN_LAP_MS) continue;
+        steps = numLines;
+      }
+      if (steps == 1 && numLines > 1) {
+        uint32_t sector = e.ms - lineMs;
+        if (s.bestSectorMs[line] == 0 || sector < s.bestSectorMs[line]) s.bestSectorMs[line] = sector;
+      }
+      if (line + steps >= numLines) {
+        s.lastLapMs = 0;
+        if (l == 0 && lapTimed) {
+          s.lastLapMs = e.ms - lapStart;
+          total += s.lastLapMs;
+          timed++;
+          if (s.bestLapMs == 0 || s.lastLapMs < s.bestLapMs) s.bestLapMs = s.lastLapMs;
+        }
+        lapTimed = l == 0;
+        lapStart = e.ms;
+      }
+      prog += steps;
+      line = l;
+      lineMs = e.ms;
+      at = i;
+    }
+    s.laps = (int)(prog / numLines);
+    s.avgMs = timed ? total / timed : 0;
+    progress[car - 1] = s.started ? prog : -1;
+    reachedAt[car - 1] = at;
+  }
+
+  // Position: sort by progress, then by who got there first
+  int order[RACE_NUM_CARS];
+  for (int i = 0; i < RACE_NUM_CARS; i++) order[i] = i;
+  for (int i = 0; i < RACE_NUM_CARS; i++) {
+    for (int j = i + 1; j < RACE_NUM_CARS; j++) {
+      int a = order[i], b = order[j];
+      bool bFirst = progress[b] > progress[a] ||
+                    (progress[b] == progress[a] && progress[a] >= 0 && reachedAt[b] < reachedAt[a]);
+      if (bFirst) {
+        order[i] = b;
+        order[j] = a;
+      }
+    }
+  }
+  for (int p = 0; p < RACE_NUM_CARS; p++) out[order[p]].position = p + 1;
+}
+
+// ========== CLIENT (UPDATES ONLY) ==========
+
+struct ClientTable {
+  Standing cars[RACE_NUM_CARS];
+  long updates;
+  long bytes;
+};
+
+ClientTable client;
+
+void resetClient(ClientTable& table) {
+  memset(&table, 0, sizeof(table));
+  for (int i = 0; i < RACE_NUM_CARS; i++) table.cars[i].position = i + 1;
+}
+
+void applyUpdate(ClientTable& table, const RaceUpdate& update) {
+  Standing& s = table.cars[update.car - 1];
+  s.started = true;
+  switch (update.type) {
+    case RACE_SECTOR:
+      s.bestSectorMs[update.sector] = update.bestMs;
+      break;
+    case RACE_LAP:
+      s.laps = update.laps;
+      s.lastLapMs = update.timeMs;
+      s.bestLapMs = update.bestMs;
+      s.avgMs = update.avgMs;
+      break;
+    case RACE_POSITION:
+      s.position = update.position;
+      break;
+  }
+  char buf[64];
+  table.updates++;
+  table.bytes += formatRaceUpdate(buf, sizeof(buf), update) + 1;
+}
+
+void onClientUpdate(const RaceUpdate& update) { applyUpdate(client, update); }
+
+ClientTable snapshotClient;
+
+void onSnapshotUpdate(const RaceUpdate& update) { applyUpdate(snapshotClient, update); }
+
+// Fields a client sees; the reference marks a car started at its first line-0
+// crossing, the client when it first hears about it (also a line-0 crossing)
+bool sameStanding(const Standing& a, const Standing& b, int numLines, bool sectors) {
+  if (a.laps != b.laps || a.lastLapMs != b.lastLapMs || a.bestLapMs != b.bestLapMs ||
+      a.avgMs != b.avgMs || a.position != b.position) {
+    return false;
+  }
+  for (int l = 0; sectors && l < numLines; l++) {
+    if (a.bestSectorMs[l] != b.bestSectorMs[l]) return false;
+  }
+  return true;
+}
+
+// ========== REPLAY ==========
+
+struct ReplayResult {
+  int events;
+  int mismatches;
+  long fullStandingsBytes;  // what resending the whole table every event would cost
+};
+
+ReplayResult replay(const std::vector<std::string>& log, RaceEngine& engine, bool verbose) {
+  ReplayResult result = {0, 0, 0};
+  std::vector<LogEvent> history;
+  engine.reset();
+  resetClient(client);
+
+  for (size_t i = 0; i < log.size(); i++) {
+    const char* line = log[i].c_str();
+    if (strncmp(line, "LINE:", 5) == 0) {
+      if (!engine.handleCommand(line)) printf("bad line config: %s\n", line);
+      history.clear();
+      resetClient(client);
+      continue;
+    }
+    unsigned long seq, ms;
+    int node, sensor, car, freq;
+    if (sscanf(line, "%lu:%d:%d:%d:%d:%lu", &seq, &node, &sensor, &car, &freq, &ms) != 6) continue;
+
+    LogEvent e = {(uint8_t)node, (uint8_t)sensor, car, (uint32_t)ms};
+    history.push_back(e);
+    engine.onCrossing(e.nodeId, e.sensorId, e.car, e.ms, onClientUpdate);
+    result.events++;
+
+    Standing reference[RACE_NUM_CARS];
+    referenceStandings(history, engine, reference);
+    for (int c = 0; c < RACE_NUM_CARS; c++) {
+      const RaceCar& rc = engine.car(c + 1);
+      Standing fromEngine;
+      memset(&fromEngine, 0, sizeof(fromEngine));
+      fromEngine.laps = rc.laps;
+      fromEngine.lastLapMs = rc.lastLapMs;
+      fromEngine.bestLapMs = rc.bestLapMs;
+      fromEngine.avgMs = rc.timedLaps ? rc.totalLapMs / rc.timedLaps : 0;
+      fromEngine.position = rc.position;
+      memcpy(fromEngine.bestSectorMs, rc.bestSectorMs, sizeof(fromEngine.bestSectorMs));
+
+      bool engineOk = sameStanding(reference[c], fromEngine, engine.lineCount(), true);
+      bool clientOk = sameStanding(reference[c], client.cars[c], engine.lineCount(), true);
+      if (!engineOk || !clientOk) {
+        if (result.mismatches++ < 5) {
+          printf("MISMATCH after \"%s\": car %d %s (laps %d/%d pos %d/%d best %lu/%lu)\n", line,
+                 c + 1, engineOk ? "client" : "engine", reference[c].laps,
+                 engineOk ? client.cars[c].laps : fromEngine.laps, reference[c].position,
+                 engineOk ? client.cars[c].position : fromEngine.position,
+                 (unsigned long)reference[c].bestLapMs,
+                 (unsigned long)(engineOk ? client.cars[c].bestLapMs : fromEngine.bestLapMs));
+        }
+      }
+    }
+    // One R:L line per started car is the minimum a full resend would cost
+    char buf[64];
+    for (int c = 1; c <= RACE_NUM_CARS; c++) {
+      const RaceCar& rc = engine.car(c);
+      if (!rc.started) continue;
+      RaceUpdate full = {RACE_LAP, (uint8_t)c, rc.position, rc.laps, 0, rc.lastLapMs, rc.bestLapMs, 0};
+      result.fullStandingsBytes += formatRaceUpdate(buf, sizeof(buf), full) + 1;
+      full.type = RACE_POSITION;
+      result.fullStandingsBytes += formatRaceUpdate(buf, sizeof(buf), full) + 1;
+    }
+  }
+
+  if (verbose) {
+    printf("pos car laps  last(ms)  best(ms)  avg(ms)  best sectors(ms)\n");
+    for (int p = 1; p <= RACE_NUM_CARS; p++) {
+      int c = engine.carAt(p);
+      const RaceCar& rc = engine.car(c);
+      if (!rc.started) continue;
+      printf("%-3d %-3d %-5d %-9lu %-9lu %-8lu", p, c, rc.laps, (unsigned long)rc.lastLapMs,
+             (unsigned long)rc.bestLapMs,
+             (unsigned long)(rc.timedLaps ? rc.totalLapMs / rc.timedLaps : 0));
+      for (int l = 0; l < engine.lineCount(); l++) printf(" %lu", (unsigned long)rc.bestSectorMs[l]);
+      printf("\n");
+    }
+  }
+  return result;
+}
+
+bool checkSnapshot(const RaceEngine& engine) {
+  resetClient(snapshotClient);
+  engine.snapshot(onSnapshotUpdate);
+  int errors = 0;
+  for (int c = 0; c < RACE_NUM_CARS; c++) {
+    if (!engine.car(c + 1).started) continue;
+    if (!sameStanding(client.cars[c], snapshotClient.cars[c], engine.lineCount(), false)) errors++;
+  }
+  printf("snapshot: %ld updates, %d mismatches: %s\n", snapshotClient.updates, errors,
+         errors ? "FAIL" : "ok");
+  return errors == 0;
+}
+
+// Clean race: every lap counted and timed to within the detection latency
+bool checkTruth(const SimRace& race, const RaceEngine& engine) {
+  int errors = 0;
+  uint32_t worst = 0;
+  for (int c = 1; c <= RACE_NUM_CARS; c++) {
+    const RaceCar& rc = engine.car(c);
+    const std::vector<uint32_t>& laps = race.trueLapMs[c - 1];
+    if (rc.laps != race.trueLaps[c - 1] || rc.timedLaps != race.trueLaps[c - 1]) errors++;
+    uint32_t best = *std::min_element(laps.begin(), laps.end());
+    uint32_t err = rc.bestLapMs > best ? rc.bestLapMs - best : best - rc.bestLapMs;
+    if (err > worst) worst = err;
+    if (err > MAX_LATENCY_MS) errors++;
+  }
+  printf("truth: laps and lap times for %d cars, best lap off by <= %lums, %d errors: %s\n",
+         RACE_NUM_CARS, (unsigned long)worst, errors, errors ? "FAIL" : "ok");
+  return errors == 0;
+}
+
+int main(int argc, char** argv) {
+  uint64_t seed = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1;
+  RaceEngine engine;
+  bool ok = true;
+
+  if (argc > 2) {
+    std::vector<std::string> log;
+    FILE* f = fopen(argv[2], "r");
+    if (!f) {
+      printf("can't open %s\n", argv[2]);
+      return 1;
+    }
+    char buf[256];
+    while (fgets(buf, sizeof(buf), f)) {
+      buf[strcspn(buf, "\r\n")] = 0;
+      log.push_back(buf);
+    }
+    fclose(f);
+    printf("# Race replay: %s\n\n", argv[2]);
+    ReplayResult r = replay(log, engine, true);
+    printf("\n%d events, %d mismatches\n", r.events, r.mismatches);
+    ok = r.mismatches == 0 && checkSnapshot(engine);
+    printf("\n# %s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+  }
+
+  printf("# Race engine test: seed %llu, %d laps, 6 cars, 3 timing lines\n",
+         (unsigned long long)seed, RACE_LAPS);
+
+  printf("\n## clean race\n");
+  SimRace clean = simulateRace(seed, false);
+  ReplayResult r = replay(clean.log, engine, false);
+  printf("%d events, %d mismatches: %s\n", r.events, r.mismatches, r.mismatches ? "FAIL" : "ok");
+  ok = r.mismatches == 0 && ok;
+  ok = checkTruth(clean, engine) && ok;
+
+  printf("\n## race with missed, duplicate and unidentified detections\n");
+  SimRace faulty = simulateRace(seed, true);
+  r = replay(faulty.log, engine, true);
+  printf("\n%d events, %d mismatches: %s\n", r.events, r.mismatches, r.mismatches ? "FAIL" : "ok");
+  printf("updates: %ld (%.2f per event), %ld bytes vs %ld resending the table each event\n",
+         client.updates, (double)client.updates / r.events, client.bytes, r.fullStandingsBytes);
+  ok = r.mismatches == 0 && ok;
+  ok = checkSnapshot(engine) && ok;
+
+  printf("\n# %s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
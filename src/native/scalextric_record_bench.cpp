@@ -0,0 +1,239 @@
+#include <Arduino.h>
+#include <string.h>
+#include <vector>
+#include "scalextric_protocol.h"
+#include "pulse_sim.h"
+#include "host_cycles.h"
+
+// Binary Event Record Benchmark (host)
+// Encodes the same stream of car events (six cars on four sensors, half of them with
+// EventQuality, sequence and clock counting up as on a long session) both ways:
+//   text    formatCarEvent, what clients get by default
+//   binary  encodeCarRecord, what they get after FORMAT:BIN
+// and prints the cycles per event and the bytes each transport carries: the payload
+// plus a WebSocket server frame header, a newline on serial, and how many events
+// fit one notification at the default BLE MTU (20 bytes of payload).
+// Also checks every record decodes back to the event, that its text line carries the
+// same time (both parents format both from one time, whatever the event's own
+// timestamp), that unknown TLVs are skipped, that other versions are rejected and that
+// FORMAT commands parse.
+//
+// Usage: scalextric_record_bench [events] [seed]
+// Exits non-zero if a record doesn't round-trip or binary isn't smaller and cheaper.
+
+const size_t BLE_DEFAULT_PAYLOAD = 20;  // ATT MTU 23 less the notification header
+const int ROUNDS = 5;                   // best of, against scheduler noise
+
+volatile unsigned long encodeSink;
+
+struct Input {
+  uint32_t seq;
+  CarEvent event;
+  uint64_t timeUs;
+  EventQuality quality;
+};
+
+std::vector<Input> makeEvents(size_t count, uint64_t seed) {
+  PulseSim sim(seed);
+  std::vector<Input> events;
+  uint64_t t = 3600000000ULL;  // an hour in
+  for (size_t i = 0; i < count; i++) {
+    Input in;
+    int car = 1 + (int)(sim.uniform() * 6);
+    t += 50000 + (uint64_t)(sim.uniform() * 400000);
+    in.seq = 10000 + (uint32_t)i;
+    in.event.nodeId = sim.uniform() < 0.5 ? PARENT_NODE_ID : (uint8_t)(sim.uniform() * 4);
+    in.event.sensorId = (uint8_t)(sim.uniform() * 4);
+    in.event.carNumber = car;
+    in.event.frequency = (uint16_t)(CAR_FREQUENCIES[car - 1] * (0.97 + sim.uniform() * 0.06));
+    in.event.timestamp = (uint32_t)(t / 1000);
+    in.timeUs = t;
+    memset(&in.quality, 0, sizeof(in.quality));
+    if (sim.uniform() < 0.5) {
+      in.quality.pulses = 6 + (uint8_t)(sim.uniform() * 40);
+      in.quality.validPct = 70 + (uint8_t)(sim.uniform() * 30);
+      in.quality.glitches = (uint8_t)(sim.uniform() * 4);
+      in.quality.outOfBand = (uint8_t)(sim.uniform() * 3);
+      in.quality.iqrUs = 2 + (uint16_t)(sim.uniform() * 20);
+      in.quality.marginPermille = 40 + (uint16_t)(sim.uniform() * 200);
+      in.quality.overlapPct = sim.uniform() < 0.1 ? (uint8_t)(sim.uniform() * 100) : 0;
+    }
+    events.push_back(in);
+  }
+  return events;
+}
+
+struct PathStats {
+  double cyclesPerEvent;
+  double payloadBytes;  // mean
+  size_t maxBytes;
+  double bleFit;        // fraction within one default-MTU notification
+};
+
+// Cycles per event of one encoder, best of ROUNDS; bytes from the last round
+template <typename Encode>
+PathStats measure(const std::vector<Input>& events, Encode encode) {
+  PathStats st = {1e30, 0, 0, 0};
+  uint8_t buf[128];
+  unsigned long checksum = 0;
+  for (int round = 0; round < ROUNDS; round++) {
+    size_t bytes = 0, fit = 0, maxBytes = 0;
+    uint64_t start = readCycles();
+    for (size_t i = 0; i < events.size(); i++) {
+      size_t n = (size_t)encode(buf, sizeof(buf), events[i]);
+      checksum += buf[n - 1];
+      bytes += n;
+      if (n <= BLE_DEFAULT_PAYLOAD) fit++;
+      if (n > maxBytes) maxBytes = n;
+    }
+    double cycles = (double)(readCycles() - start) / events.size();
+    if (cycles < st.cyclesPerEvent) st.cyclesPerEvent = cycles;
+    st.payloadBytes = (double)bytes / events.size();
+    st.maxBytes = maxBytes;
+    st.bleFit = (double)fit / events.size();
+  }
+  encodeSink = checksum;  // keep the encodes
+  return st;
+}
+
+int encodeText(uint8_t* buf, size_t size, const Input& in) {
+  return formatCarEvent((char*)buf, size, in.seq, in.event, in.timeUs, in.quality);
+}
+
+int encodeBinary(uint8_t* buf, size_t size, const Input& in) {
+  return encodeCarRecord(buf, size, in.seq, in.event, in.timeUs, in.quality);
+}
+
+// Every record decodes back to its event, plain and with quality
+int roundTripErrors(const std::vector<Input>& events) {
+  int errors = 0;
+  for (size_t i = 0; i < events.size(); i++) {
+    const Input& in = events[i];
+    uint8_t buf[RECORD_MAX_SIZE];
+    int n = encodeCarRecord(buf, sizeof(buf), in.seq, in.event, in.timeUs, in.quality);
+    CarRecord r;
+    EventQuality q;
+    bool ok = n > 0 && isRecordStart(buf[0]) && decodeCarRecord(buf, n, r, q) && r.length == n;
+    ok = ok && r.seq == in.seq && r.nodeId == in.event.nodeId && r.sensorId == in.event.sensorId &&
+         r.carNumber == in.event.carNumber && r.frequency == in.event.frequency && r.timeUs == in.timeUs;
+    ok = ok && memcmp(&q, &in.quality, sizeof(q)) == 0;
+    ok = ok && !decodeCarRecord(buf, n - 1, r, q);  // truncated
+    if (!ok) errors++;
+  }
+  return errors;
+}
+
+// The text line and the record of one event carry one time: MILLIS is the record's
+// timeUs / 1000, not the event's timestamp (set apart here, as a child's clock is)
+int sameTimeErrors(const std::vector<Input>& events) {
+  int errors = 0;
+  for (size_t i = 0; i < events.size(); i++) {
+    Input in = events[i];
+    in.event.timestamp = (uint32_t)(in.timeUs / 1000) - 54321;
+    char line[96];
+    uint8_t buf[RECORD_MAX_SIZE];
+    formatCarEvent(line, sizeof(line), in.seq, in.event, in.timeUs, in.quality);
+    int n = encodeCarRecord(buf, sizeof(buf), in.seq, in.event, in.timeUs, in.quality);
+    CarRecord r;
+    EventQuality q;
+    unsigned long seq = 0, ms = 0;
+    bool ok = sscanf(line, "%lu:%*d:%*d:%*d:%*d:%lu", &seq, &ms) == 2 && decodeCarRecord(buf, n, r, q);
+    ok = ok && seq == r.seq && ms == (uint32_t)(r.timeUs / 1000);
+    if (!ok) errors++;
+  }
+  return errors;
+}
+
+bool testFormat() {
+  CarEvent event = {3, 1, 4, 3096, 123456};
+  EventQuality quality = {14, 93, 2, 1, 6, 97, 0};
+  uint8_t buf[64];
+  int n = encodeCarRecord(buf, sizeof(buf), 42, event, 123456789ULL, quality);
+
+  // Fixed layout, little-endian
+  const uint8_t head[] = {0xA1, RECORD_CAR, (uint8_t)n, 42, 0, 0, 0, 3, 1, 4, 0x18, 0x0C};
+  bool ok = sizeof(CarRecord) == 20 && n == 31 && memcmp(buf, head, sizeof(head)) == 0;
+  ok = ok && buf[20] == RECORD_TLV_QUALITY && buf[21] == sizeof(EventQuality);
+
+  // An unknown TLV before the quality one is skipped
+  uint8_t ext[64];
+  memcpy(ext, buf, sizeof(CarRecord));
+  const uint8_t unknown[] = {0x7F, 3, 1, 2, 3};
+  memcpy(ext + sizeof(CarRecord), unknown, sizeof(unknown));
+  memcpy(ext + sizeof(CarRecord) + sizeof(unknown), buf + sizeof(CarRecord), n - sizeof(CarRecord));
+  ext[2] = (uint8_t)(n + sizeof(unknown));
+  CarRecord r;
+  EventQuality q;
+  ok = ok && decodeCarRecord(ext, ext[2], r, q) && q.pulses == 14 && q.marginPermille == 97;
+
+  // A TLV running past the record, a newer version, too small a buffer
+  ext[sizeof(CarRecord) + 1] = 200;
+  ok = ok && !decodeCarRecord(ext, ext[2], r, q);
+  buf[0] = RECORD_MAGIC | (RECORD_VERSION + 1);
+  ok = ok && isRecordStart(buf[0]) && !decodeCarRecord(buf, n, r, q);
+  ok = ok && encodeCarRecord(buf, sizeof(CarRecord), 42, event, 0, quality) == 0;
+  ok = ok && encodeCarRecord(buf, sizeof(CarRecord), 42, event, 0, EventQuality()) == (int)sizeof(CarRecord);
+
+  // Text lines never start with a record byte
+  ok = ok && !isRecordStart('0') && !isRecordStart('9') && !isRecordStart('#') && !isRecordStart('H') &&
+       !isRecordStart('P') && !isRecordStart('R') && !isRecordStart('S');
+
+  bool binary = false;
+  char reply[24];
+  ok = ok && parseFormatCommand("FORMAT:BIN", binary) && binary;
+  formatFormatReply(reply, sizeof(reply), binary);
+  ok = ok && strcmp(reply, "FORMAT:BIN:1") == 0;
+  ok = ok && parseFormatCommand("FORMAT:TEXT", binary) && !binary;
+  ok = ok && !parseFormatCommand("FORMAT:XML", binary) && !parseFormatCommand("SYNC", binary) && !binary;
+  printf("format: CarRecord %u bytes, with quality %d; layout, TLV skip, version check %s\n",
+         (unsigned)sizeof(CarRecord), n, ok ? "ok" : "MISMATCH");
+  return ok;
+}
+
+void printPath(const char* name, const PathStats& st, double frameBytes, double lineBytes) {
+  printf("%-7s %-10.1f %-9.1f %-5u %-12.1f %-12.1f %.0f%%\n", name, st.cyclesPerEvent, st.payloadBytes,
+         (unsigned)st.maxBytes, st.payloadBytes + frameBytes, st.payloadBytes + lineBytes, 100.0 * st.bleFit);
+}
+
+int main(int argc, char** argv) {
+  size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+
+  std::vector<Input> events = makeEvents(count, seed);
+  printf("# Event record benchmark: %u events, seed %llu\n\n", (unsigned)events.size(),
+         (unsigned long long)seed);
+
+  std::vector<Input> plain = events, extended = events;
+  for (size_t i = 0; i < events.size(); i++) memset(&plain[i].quality, 0, sizeof(EventQuality));
+  for (size_t i = 0; i < events.size(); i++) {
+    if (extended[i].quality.pulses == 0) extended[i].quality = events[(i + 1) % events.size()].quality;
+    if (extended[i].quality.pulses == 0) extended[i].quality.pulses = 1;
+  }
+
+  struct Mix {
+    const char* name;
+    const std::vector<Input>* events;
+  } mixes[] = {{"no quality", &plain}, {"half with quality", &events}, {"all with quality", &extended}};
+
+  bool ok = testFormat();
+  ok = ok && roundTripErrors(events) == 0 && roundTripErrors(plain) == 0;
+  int timeErrors = sameTimeErrors(events);
+  printf("text/record time: %d of %u events differ\n", timeErrors, (unsigned)events.size());
+  ok = ok && timeErrors == 0;
+
+  for (size_t m = 0; m < sizeof(mixes) / sizeof(mixes[0]); m++) {
+    PathStats text = measure(*mixes[m].events, encodeText);
+    PathStats binary = measure(*mixes[m].events, encodeBinary);
+    printf("\n%s\n", mixes[m].name);
+    printf("path    cycles/ev  bytes     max   ws frame     serial       ble 1 notif\n");
+    printPath("text", text, 2, 2);     // WebSocket frame header; println's \r\n
+    printPath("binary", binary, 2, 0);  // records are self-delimiting
+    printf("binary: %.1fx fewer cycles, %.0f%% of the bytes\n", text.cyclesPerEvent / binary.cyclesPerEvent,
+           100.0 * binary.payloadBytes / text.payloadBytes);
+    ok = ok && binary.cyclesPerEvent < text.cyclesPerEvent && binary.payloadBytes < text.payloadBytes;
+    if (mixes[m].events == &plain) ok = ok && binary.bleFit == 1.0;
+  }
+
+  printf("\n%s\n", ok ? "# PASS" : "# FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,412 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include "espnow_reliable.h"
+#include "pulse_sim.h"
+
+// Reliable ESP-NOW Delivery Simulation (host)
+// Four children, four sensors each, a car over each sensor every 100-400 ms (a
+// CarEventWithQuality, then its PassEvent 50 ms later), batched as the child does,
+// sent to the parent through a radio that loses frames:
+//   broadcast   one transmission, no ACK (ESPNOW_RELIABLE=0)
+//   mac only    unicast: the MAC retries until ACKed, up to MAC_ATTEMPTS, and the
+//               send callback reports the result; no resends (RELIABLE_MAX_SENDS=1)
+//   reliable    unicast plus ReliableSender's resends (espnow_reliable.h)
+// Each transmission and each ACK is lost with the scenario's probability, and always
+// during an outage (interference, coexistence). Losing only the ACK makes the child
+// resend a batch the parent already has. The parent's receive path is the firmware's
+// (unpackBatch / BatchTracker).
+// Prints messages delivered, repeats dropped, the parent's loss count against the
+// truth, sends per batch and car event latency (detection to first arrival).
+//
+// Usage: scalextric_reliable_sim [seconds] [seed]
+// Exits non-zero if the application sees a message twice or changed, the parent's
+// loss count is wrong, the sender's counts don't add up, or resending doesn't beat
+// the MAC alone.
+
+const int CHILDREN = 4;
+const int SENSORS = 4;
+const uint64_t LOOP_US = 1000;
+
+// 802.11b at 1 Mbps, as ESP-NOW sends
+const int PREAMBLE_US = 192;
+const int FRAME_OVERHEAD_BYTES = 24 + 4 + 15;  // MAC header, FCS, action frame + vendor element
+const int ACK_US = 10 + PREAMBLE_US + 14 * 8;  // SIFS, then a 14-byte ACK
+const int DIFS_US = 50;
+const int SLOT_US = 20;
+const int CW_MIN = 31;
+const int CW_MAX = 1023;
+const int MAC_ATTEMPTS = 7;  // assumed; the ESP32's retry limit for ESP-NOW isn't documented
+
+inline uint32_t airtimeUs(int payload) { return PREAMBLE_US + (FRAME_OVERHEAD_BYTES + payload) * 8; }
+
+enum Mode { BROADCAST_ONLY, MAC_ONLY, RELIABLE };
+const char* const MODE_NAMES[] = {"broadcast", "mac only", "reliable"};
+
+struct Scenario {
+  const char* name;
+  double loss;          // per transmission / ACK
+  uint32_t outageUs;    // each outage, 0 = none
+  uint32_t outageGapUs; // mean time between outages
+};
+
+struct Message {
+  uint64_t timeUs;
+  int child;
+  int len;
+  uint8_t bytes[sizeof(PassEvent)];
+  bool car;
+};
+
+struct Reception {
+  uint64_t timeUs;
+  int child;
+  std::vector<uint8_t> frame;
+};
+
+struct Callback {
+  uint64_t timeUs;
+  bool acked;
+};
+
+// ========== TRAFFIC ==========
+
+std::vector<Message> makeTraffic(uint64_t durationUs, PulseSim& rng) {
+  std::vector<Message> msgs;
+  for (int c = 0; c < CHILDREN; c++) {
+    for (int s = 0; s < SENSORS; s++) {
+      for (uint64_t t = (uint64_t)(rng.uniform() * 400000); t < durationUs;
+           t += 100000 + (uint64_t)(rng.uniform() * 300000)) {
+        int car = 1 + (int)(rng.uniform() * 6);
+        CarEventWithQuality event = {{(uint8_t)c, (uint8_t)s, (uint8_t)car, (uint16_t)CAR_FREQUENCIES[car - 1], 0},
+                                     {20, 95, 0, 0, 5, 120, 0}};
+        Message m = {t, c, (int)sizeof(event), {0}, true};
+        memcpy(m.bytes, &event, sizeof(event));
+        msgs.push_back(m);
+
+        PassEvent pass = {PASS_EVENT_MAGIC, (uint8_t)c, (uint8_t)s, (uint8_t)car, 0, 12000, 2000, 0, 30};
+        Message p = {t + 50000, c, (int)sizeof(pass), {0}, false};
+        memcpy(p.bytes, &pass, sizeof(pass));
+        msgs.push_back(p);
+      }
+    }
+  }
+  std::stable_sort(msgs.begin(), msgs.end(), [](const Message& a, const Message& b) { return a.timeUs < b.timeUs; });
+
+  // Each message carries its index, so the parent can check it against the original
+  for (uint32_t i = 0; i < msgs.size(); i++) {
+    if (msgs[i].car) {
+      memcpy(msgs[i].bytes + offsetof(CarEvent, timestamp), &i, sizeof(i));
+    } else {
+      uint64_t id = i;
+      memcpy(msgs[i].bytes + offsetof(PassEvent, firstEdgeUs), &id, sizeof(id));
+    }
+  }
+  return msgs;
+}
+
+uint32_t messageId(const uint8_t* data, int len) {
+  if (len == sizeof(CarEventWithQuality)) {
+    CarEvent e;
+    memcpy(&e, data, sizeof(e));
+    return e.timestamp;
+  }
+  PassEvent p;
+  memcpy(&p, data, sizeof(p));
+  return (uint32_t)p.firstEdgeUs;
+}
+
+// ========== RADIO ==========
+
+struct Radio {
+  Scenario scenario;
+  std::vector<uint64_t> outageStarts;
+  PulseSim rng;
+  std::vector<Reception> receptions;
+  uint64_t transmissions;
+
+  Radio(const Scenario& s, uint64_t durationUs, uint64_t seed) : scenario(s), rng(seed), transmissions(0) {
+    if (s.outageUs == 0) return;
+    for (uint64_t t = (uint64_t)(rng.uniform() * s.outageGapUs * 2); t < durationUs + 1000000;
+         t += s.outageUs + (uint64_t)(rng.uniform() * s.outageGapUs * 2)) {
+      outageStarts.push_back(t);
+    }
+  }
+
+  bool lost(uint64_t t) {
+    std::vector<uint64_t>::iterator it = std::upper_bound(outageStarts.begin(), outageStarts.end(), t);
+    if (it != outageStarts.begin() && t < *(it - 1) + scenario.outageUs) return true;
+    return rng.uniform() < scenario.loss;
+  }
+
+  // One esp_now_send from a child whose radio is free from busyUntil: the MAC's
+  // attempts, each with its backoff, and the send callback at the end. The parent's
+  // MAC passes only the first copy up (802.11 drops retries it already has).
+  Callback send(int child, const uint8_t* frame, int len, uint64_t nowUs, bool unicast, uint64_t& busyUntil) {
+    uint64_t t = std::max(nowUs, busyUntil);
+    bool acked = false, passedUp = false;
+    for (int attempt = 0; attempt < (unicast ? MAC_ATTEMPTS : 1); attempt++) {
+      int cw = std::min((CW_MIN + 1) << attempt, CW_MAX + 1);
+      t += DIFS_US + (uint64_t)(rng.uniform() * cw) * SLOT_US;
+      bool arrived = !lost(t);
+      t += airtimeUs(len);
+      transmissions++;
+      if (arrived && !passedUp) {
+        passedUp = true;
+        Reception r = {t, child, std::vector<uint8_t>(frame, frame + len)};
+        receptions.push_back(r);
+      }
+      if (!unicast) break;
+      t += ACK_US;
+      if (arrived && !lost(t)) {
+        acked = true;
+        break;
+      }
+    }
+    busyUntil = t;
+    Callback cb = {t, unicast ? acked : true};
+    return cb;
+  }
+};
+
+// ========== CHILDREN ==========
+
+struct Child {
+  EspNowBatch batch;
+  ReliableSender sender;
+  std::deque<Callback> callbacks;  // in send order, as ESP-NOW reports them
+  uint64_t busyUntil;
+  int linkLostTrips;
+};
+
+struct Result {
+  double delivered;       // fraction of messages
+  double carLatencyMeanUs;
+  double carLatencyP99Us;
+  uint32_t duplicates;    // dropped by the parent
+  uint32_t trackerLost;
+  uint32_t truthLost;
+  double sendsPerBatch;   // esp_now_send calls
+  double transmissionsPerBatch;
+  int linkLostTrips;
+  bool ok;                // messages intact and once each, sender counts add up
+};
+
+const std::vector<Message>* rxMessages;
+std::vector<uint64_t> rxDeliveredUs;
+uint64_t rxNowUs;
+bool rxOk;
+
+void onMessage(const uint8_t*, const uint8_t* data, int len) {
+  uint32_t id = messageId(data, len);
+  if (id >= rxMessages->size() || (*rxMessages)[id].len != len || memcmp((*rxMessages)[id].bytes, data, len) != 0 ||
+      rxDeliveredUs[id] != 0) {
+    rxOk = false;
+    return;
+  }
+  rxDeliveredUs[id] = rxNowUs;
+}
+
+Result simulate(const std::vector<Message>& msgs, uint64_t durationUs, const Scenario& scenario, Mode mode,
+                uint64_t seed) {
+  Radio radio(scenario, durationUs, seed);
+  PulseSim rng(seed + 1);
+  std::vector<Child> children(CHILDREN);
+  std::vector<uint16_t> firstSeq(CHILDREN);
+  for (int c = 0; c < CHILDREN; c++) {
+    firstSeq[c] = (uint16_t)rng.next();  // as the firmware's esp_random(), so some wrap
+    batchInit(children[c].batch, (uint8_t)c, firstSeq[c]);
+    reliableInit(children[c].sender, mode == RELIABLE ? RELIABLE_MAX_SENDS : 1);
+    children[c].busyUntil = 0;
+    children[c].linkLostTrips = 0;
+  }
+  uint64_t batches = 0, sends = 0;
+
+  // A finished batch, as the child's sendBatch
+  auto sendBatch = [&](int c, const uint8_t* frame, int len, uint64_t nowUs) {
+    batches++;
+    if (mode == BROADCAST_ONLY) {
+      sends++;
+      radio.send(c, frame, len, nowUs, false, children[c].busyUntil);
+    } else {
+      reliableQueue(children[c].sender, frame, len, nowUs);
+    }
+  };
+
+  size_t next = 0;
+  for (uint64_t tick = 0; tick < durationUs + 1000000; tick += LOOP_US) {
+    for (; next < msgs.size() && msgs[next].timeUs <= tick; next++) {
+      const Message& m = msgs[next];
+      Child& child = children[m.child];
+      if (!batchFits(child.batch, m.len)) {
+        uint8_t frame[ESPNOW_MAX_PAYLOAD];
+        int n = batchTake(child.batch, frame);
+        sendBatch(m.child, frame, n, m.timeUs);
+      }
+      batchAdd(child.batch, m.bytes, m.len, m.timeUs, ESPNOW_BATCH_US);
+    }
+    for (int c = 0; c < CHILDREN; c++) {
+      Child& child = children[c];
+      while (!child.callbacks.empty() && child.callbacks.front().timeUs <= tick) {
+        reliableSent(child.sender, child.callbacks.front().acked, child.callbacks.front().timeUs);
+        child.callbacks.pop_front();
+      }
+      if (batchDue(child.batch, tick)) {
+        uint8_t frame[ESPNOW_MAX_PAYLOAD];
+        int n = batchTake(child.batch, frame);
+        sendBatch(c, frame, n, tick);
+      }
+      if (mode == BROADCAST_ONLY) continue;
+      uint8_t frame[ESPNOW_MAX_PAYLOAD];
+      int n;
+      while ((n = reliableNext(child.sender, tick, frame)) > 0) {
+        sends++;
+        child.callbacks.push_back(radio.send(c, frame, n, tick, true, child.busyUntil));
+      }
+      if (reliableLinkLost(child.sender)) {
+        child.linkLostTrips++;  // the firmware would rescan here; the sim keeps going
+        child.sender.droppedInRow = 0;
+      }
+    }
+  }
+
+  // The parent, in arrival order
+  std::stable_sort(radio.receptions.begin(), radio.receptions.end(),
+                   [](const Reception& a, const Reception& b) { return a.timeUs < b.timeUs; });
+  static BatchTracker tracker;
+  memset(&tracker, 0, sizeof(tracker));
+  rxMessages = &msgs;
+  rxDeliveredUs.assign(msgs.size(), 0);
+  rxOk = true;
+  std::vector<std::vector<bool> > arrived(CHILDREN);
+  uint8_t mac[6] = {0x24, 0x6F, 0x28, 0, 0, 0};
+  for (size_t i = 0; i < radio.receptions.size(); i++) {
+    const Reception& r = radio.receptions[i];
+    mac[5] = (uint8_t)r.child;
+    rxNowUs = r.timeUs;
+    rxOk = rxOk && unpackBatch(mac, r.frame.data(), (int)r.frame.size(), tracker, onMessage);
+    BatchHeader header;
+    memcpy(&header, r.frame.data(), sizeof(header));
+    size_t index = (uint16_t)(header.batchSeq - firstSeq[r.child]);
+    if (arrived[r.child].size() <= index) arrived[r.child].resize(index + 1, false);
+    arrived[r.child][index] = true;
+  }
+
+  Result res = {0, 0, 0, tracker.duplicates, tracker.lost, 0, (double)sends / batches,
+                (double)radio.transmissions / batches, 0, rxOk};
+  // Truth: batches never received between a child's first and last received
+  for (int c = 0; c < CHILDREN; c++) {
+    size_t first = 0;
+    while (first < arrived[c].size() && !arrived[c][first]) first++;
+    for (size_t i = first; i < arrived[c].size(); i++) res.truthLost += !arrived[c][i];
+    res.linkLostTrips += children[c].linkLostTrips;
+
+    const ReliableStats& st = children[c].sender.stats;
+    uint32_t left = 0;
+    for (int i = 0; i < RELIABLE_QUEUE; i++) left += children[c].sender.frames[i].state != RELIABLE_FREE;
+    if (mode != BROADCAST_ONLY) res.ok = res.ok && st.delivered + st.dropped + left == st.queued;
+  }
+
+  size_t delivered = 0;
+  std::vector<double> latency;
+  for (size_t i = 0; i < msgs.size(); i++) {
+    if (!rxDeliveredUs[i]) continue;
+    delivered++;
+    if (msgs[i].car) latency.push_back((double)(rxDeliveredUs[i] - msgs[i].timeUs));
+  }
+  res.delivered = (double)delivered / msgs.size();
+  std::sort(latency.begin(), latency.end());
+  for (size_t i = 0; i < latency.size(); i++) res.carLatencyMeanUs += latency[i] / latency.size();
+  res.carLatencyP99Us = latency.empty() ? 0 : latency[latency.size() * 99 / 100];
+  return res;
+}
+
+// ========== SENDER CHECKS ==========
+
+bool testSender() {
+  ReliableSender s;
+  reliableInit(s);
+  uint8_t a[] = {1, 2, 3}, b[] = {4, 5}, c[] = {7, 8, 9, 10}, out[ESPNOW_MAX_PAYLOAD];
+  reliableQueue(s, a, sizeof(a), 0);
+  reliableQueue(s, b, sizeof(b), 0);
+  reliableQueue(s, c, sizeof(c), 0);
+
+  // Two in flight at most, oldest first
+  bool ok = reliableNext(s, 0, out) == 3 && reliableNext(s, 0, out) == 2 && reliableNext(s, 0, out) == 0;
+  // a fails: c goes while a waits RELIABLE_RETRY_US
+  reliableSent(s, false, 1000);
+  ok = ok && reliableNext(s, 1000, out) == 4 && reliableNext(s, 1000, out) == 0;
+  reliableSent(s, true, 2000);  // b
+  ok = ok && reliableNext(s, 1000 + RELIABLE_RETRY_US - 1, out) == 0;
+  ok = ok && reliableNext(s, 1000 + RELIABLE_RETRY_US, out) == 3 && out[0] == 1;
+  ok = ok && s.stats.resent == 1 && s.stats.delivered == 1 && s.stats.latencyMaxUs == 2000;
+
+  // Out of sends: dropped; the retry waits double each time
+  reliableSent(s, true, 6000);   // c
+  reliableSent(s, false, 6000);  // a, second send
+  uint64_t t = 6000 + 2 * RELIABLE_RETRY_US;
+  ok = ok && reliableNext(s, t - 1, out) == 0 && reliableNext(s, t, out) == 3;
+  reliableSent(s, false, t);
+  t += 4 * RELIABLE_RETRY_US;
+  ok = ok && reliableNext(s, t, out) == 3;
+  reliableSent(s, false, t);
+  ok = ok && reliableNext(s, t + 100000, out) == 0 && s.stats.dropped == 1 && s.stats.sends == 6;
+
+  // Refused by esp_now_send: the newest in flight goes back; a full queue drops its oldest
+  reliableQueue(s, a, sizeof(a), t);
+  reliableQueue(s, b, sizeof(b), t);
+  ok = ok && reliableNext(s, t, out) == 3 && reliableNext(s, t, out) == 2 && out[0] == 4;
+  reliableSendFailed(s, t);
+  ok = ok && s.inFlightCount == 1;
+  for (int i = 0; i < RELIABLE_QUEUE; i++) reliableQueue(s, a, sizeof(a), t);
+  ok = ok && s.stats.dropped == 3 && s.stats.queued == 5 + RELIABLE_QUEUE;
+  reliableClear(s);
+  ok = ok && s.stats.dropped == 2 + RELIABLE_QUEUE && s.inFlightCount == 1;
+  reliableSent(s, true, t + 500);
+  ok = ok && s.stats.delivered == 3 && s.stats.delivered + s.stats.dropped == s.stats.queued && !reliableLinkLost(s);
+
+  printf("sender: window, resend order and backoff, drops, refusals %s\n", ok ? "ok" : "MISMATCH");
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 60;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+  uint64_t durationUs = (uint64_t)(seconds * 1e6);
+  const Scenario scenarios[] = {
+      {"clean", 0, 0, 0},
+      {"10% loss", 0.10, 0, 0},
+      {"30% loss", 0.30, 0, 0},
+      {"2% + 20 ms outages every ~0.5 s", 0.02, 20000, 500000},
+      {"5% + 60 ms outages every ~2 s", 0.05, 60000, 2000000},
+  };
+
+  PulseSim trafficRng(seed);
+  std::vector<Message> msgs = makeTraffic(durationUs, trafficRng);
+  printf("# Reliable ESP-NOW: %d children x %d sensors, %u messages over %.0f s, %d MAC attempts, seed %llu\n\n",
+         CHILDREN, SENSORS, (unsigned)msgs.size(), seconds, MAC_ATTEMPTS, (unsigned long long)seed);
+  bool ok = testSender();
+
+  for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++) {
+    printf("\n%s\n", scenarios[s].name);
+    printf("mode        deliv%%    repeats  lost seen/actual  sends/batch  tx/batch  lat ms    p99 ms    link lost\n");
+    Result results[3];
+    for (int m = 0; m < 3; m++) {
+      Result& r = results[m];
+      r = simulate(msgs, durationUs, scenarios[s], (Mode)m, seed + 1);
+      printf("%-11s %-9.3f %-8u %6u/%-9u %-12.2f %-9.2f %-9.2f %-9.2f %d\n", MODE_NAMES[m], 100.0 * r.delivered,
+             r.duplicates, r.trackerLost, r.truthLost, r.sendsPerBatch, r.transmissionsPerBatch,
+             r.carLatencyMeanUs / 1000, r.carLatencyP99Us / 1000, r.linkLostTrips);
+      ok = ok && r.ok && r.trackerLost == r.truthLost;
+    }
+    ok = ok && results[RELIABLE].delivered >= results[MAC_ONLY].delivered &&
+         results[MAC_ONLY].delivered >= results[BROADCAST_ONLY].delivered;
+    if (scenarios[s].outageUs == 0) ok = ok && results[RELIABLE].delivered == 1.0;
+  }
+
+  printf("\n%s\n", ok ? "# PASS" : "# FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+#include <Arduino.h>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include "car_detection.h"
+
+// Edge Ring Stress Test (host)
+// One producer thread per sensor stands in for onPulse, pushing sequence numbers
+// into the same SensorEdgeRing the firmware uses, while one consumer thread polls
+// all four rings like loop(). Every popped value must be exactly the next one
+// expected, less any edges the producer counted as overflows - anything else is
+// a lost, duplicated or torn edge.
+//
+//   paced:    4 x 5.5 kHz, consumer polls every 1ms      -> must see zero overflows
+//   stall:    4 x 5.5 kHz, consumer stalls 2x ring depth -> overflows counted, none unaccounted
+//   flat-out: producers push as fast as they can         -> exercises the acquire/release pairs
+//
+// Usage: scalextric_ring_stress [seconds per phase]
+// Exits non-zero if any phase fails.
+
+typedef std::chrono::steady_clock Clock;
+
+const uint32_t EDGE_RATE_HZ = 5500;     // car 1, the fastest emitter
+const uint32_t LOOP_PERIOD_US = 1000;   // loop() + delay(1)
+
+struct Phase {
+  const char* name;
+  bool paced;           // producers run at EDGE_RATE_HZ, otherwise flat out
+  uint32_t stallUs;     // consumer sleeps this long once, mid-phase
+  bool expectOverflow;  // overflows are expected (and must be accounted for)
+};
+
+struct SensorCheck {
+  uint32_t received;
+  uint32_t expected;  // next value the consumer should see (or later, after an overflow)
+  uint32_t skipped;   // values missing from the stream
+  uint32_t errors;    // duplicated or out-of-order values
+};
+
+std::atomic<bool> running;
+
+void producer(int sensor, bool paced, uint32_t& produced) {
+  SensorEdgeRing& ring = sensorEdges[sensor];
+  Clock::duration period = std::chrono::nanoseconds(1000000000ULL / EDGE_RATE_HZ);
+  Clock::time_point next = Clock::now();
+  uint32_t value = 0;
+  while (running.load(std::memory_order_relaxed)) {
+    if (paced) {
+      next += period;
+      std::this_thread::sleep_until(next);
+    }
+    ring.push(value++);
+  }
+  produced = value;
+}
+
+void consume(int sensor, SensorCheck& check) {
+  uint32_t value;
+  while (sensorEdges[sensor].pop(value)) {
+    check.received++;
+    if (value < check.expected) {
+      check.errors++;
+    } else {
+      check.skipped += value - check.expected;
+      check.expected = value + 1;
+    }
+  }
+}
+
+bool runPhase(const Phase& phase, double seconds) {
+  initSensors();
+  SensorCheck checks[NUM_SENSORS] = {};
+  uint32_t produced[NUM_SENSORS] = {};
+
+  running.store(true);
+  std::thread producers[NUM_SENSORS];
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    producers[i] = std::thread(producer, i, phase.paced, std::ref(produced[i]));
+  }
+
+  Clock::time_point start = Clock::now();
+  Clock::time_point end = start + std::chrono::microseconds((uint64_t)(seconds * 1e6));
+  Clock::time_point stallAt = start + (end - start) / 2;
+  bool stalled = phase.stallUs == 0;
+  while (Clock::now() < end) {
+    for (int i = 0; i < NUM_SENSORS; i++) consume(i, checks[i]);
+    if (!stalled && Clock::now() >= stallAt) {
+      std::this_thread::sleep_for(std::chrono::microseconds(phase.stallUs));
+      stalled = true;
+    }
+    if (phase.paced) std::this_thread::sleep_for(std::chrono::microseconds(LOOP_PERIOD_US));
+  }
+
+  running.store(false);
+  for (int i = 0; i < NUM_SENSORS; i++) producers[i].join();
+  for (int i = 0; i < NUM_SENSORS; i++) consume(i, checks[i]);
+
+  bool ok = true;
+  printf("\n## %s\n", phase.name);
+  printf("sensor produced   received   overflows  skipped    errors  result\n");
+  for (int i = 0; i < NUM_SENSORS; i++) {
+    SensorCheck& c = checks[i];
+    uint32_t overflows = sensorEdges[i].overflowCount();
+    // Trailing overflows after the last received value show up as produced - expected
+    uint32_t missing = c.skipped + (produced[i] - c.expected);
+    bool pass = c.errors == 0 && missing == overflows &&
+                c.received + overflows == produced[i] &&
+                (phase.expectOverflow || overflows == 0);
+    ok = ok && pass;
+    printf("%-6d %-10u %-10u %-10u %-10u %-7u %s\n", i, produced[i], c.received,
+           overflows, c.skipped, c.errors, pass ? "ok" : "FAIL");
+  }
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 2.0;
+
+  // Long enough to fill the ring twice over at EDGE_RATE_HZ
+  uint32_t stallUs = 2 * EDGE_RING_SIZE * (1000000 / EDGE_RATE_HZ);
+  const Phase phases[] = {
+    {"paced 4 x 5.5 kHz, 1ms loop", true, 0, false},
+    {"paced 4 x 5.5 kHz, one loop stall", true, stallUs, true},
+    {"flat-out producers", false, 0, true},
+  };
+
+  printf("# Edge ring stress test: EDGE_RING_SIZE=%d, %.1fs per phase, stall %uus\n",
+         EDGE_RING_SIZE, seconds, stallUs);
+
+  bool ok = true;
+  for (size_t p = 0; p < sizeof(phases) / sizeof(phases[0]); p++) {
+    ok = runPhase(phases[p], seconds) && ok;
+  }
+
+  printf("\n# %s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
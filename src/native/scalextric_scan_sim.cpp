@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "channel_scan.h"
+#include "pulse_sim.h"
+
+// Channel Scan Simulation (host)
+// How long a child is blind before it can send its parent a car event: from the start
+// of its scan (at boot, or when the link is lost) until it has the parent's channel.
+// The setup steps before the scan (OLED, WiFi and ESP-NOW init) are the same before
+// and after, and not modelled. Each trial draws the parent's channel and the radio:
+//   a probe answer leaves the parent 1-3 ms after the probe (its stack and the air);
+//     a BLE parent's radio is on BLE 30% of the time, which adds 5-55 ms
+//   each frame is lost with the scenario's probability
+//   a unicast probe is ACKed by the parent's radio within 1 ms, after the MAC's 7
+//     attempts if frames are lost; a BLE wait longer than 20 ms outlasts the attempts
+//   parent beacons every PROBE_BEACON_MS at a random phase, delayed like answers
+//   an OLED redraw costs 25 ms (1 KB over 400 kHz I2C); the child has one
+// Channels next to the parent's, which may hear a probe, count as silent.
+//   old       1-13 in order, 3 rounds, 150 ms each, a redraw per channel; retry every 30 s
+//   no beacon the cached channel first (no redraw), then scanStep's rounds, a redraw
+//             per round; parents don't beacon (PROBE_BEACON_MS=0)
+//   new       the same with parent beacons; between scans it waits on the cached channel
+//
+// Usage: scalextric_scan_sim [trials] [seed]
+// Exits non-zero if scanStep's order or dwells are wrong, if the new scan misses a
+// parent the old one finds, or if its p99 is worse than the old one's in any scenario,
+// or over 150 ms when the parent is where the child left it.
+
+const double OLED_REDRAW_MS = 25;
+const double OLD_DWELL_MS = 150;
+const int OLD_ROUNDS = 3;
+const double RETRY_MS = 30000;  // SCAN_RETRY_INTERVAL
+const double GIVE_UP_MS = 120000;
+const double MAC_ATTEMPTS = 7;
+const double MAC_RETRY_MS = 20;  // the MAC's attempts span about this long
+
+enum ChannelSet { CH_COMMON, CH_ANY, CH_ONE };
+enum CacheState { CACHE_NONE, CACHE_HIT, CACHE_MOVED };
+
+struct Scenario {
+  const char* name;
+  ChannelSet channels;
+  bool ble;          // the parent shares its radio with BLE
+  CacheState cache;  // what the child remembers
+  double loss;       // per frame
+  double upMs;       // the parent comes up this long after the scan starts
+};
+
+enum Mode { OLD, NO_BEACON, NEW };
+
+struct Trial {
+  int parentChannel;
+  double beaconPhaseMs;
+  LinkCache cache;
+  bool cacheIsParent;  // the cached MAC is this parent's
+};
+
+struct Times {
+  std::vector<double> ms;
+  int missed = 0;
+  double pct(double p) {
+    if (ms.empty()) return 0;
+    std::sort(ms.begin(), ms.end());
+    return ms[std::min(ms.size() - 1, (size_t)(p / 100 * ms.size()))];
+  }
+};
+
+class ScanSim {
+ public:
+  ScanSim(const Scenario& sc, const Trial& trial, Mode mode, PulseSim& rng)
+      : sc(sc), trial(trial), mode(mode), rng(rng) {}
+
+  // When the child has its parent, ms from the start of the scan; < 0 if not by GIVE_UP_MS
+  double run() {
+    double t = 0;
+    int waitOn = 1;
+    while (t < GIVE_UP_MS) {
+      double end;
+      double found = mode == OLD ? scanOld(t, end) : scanNew(t, end, waitOn);
+      if (found >= 0) return found;
+      double next = std::max(t + RETRY_MS, end);
+      if (mode == NEW) {
+        double heard = beacon(waitOn, end, next);
+        if (heard >= 0) return heard;
+      }
+      t = next;
+    }
+    return -1;
+  }
+
+ private:
+  const Scenario& sc;
+  const Trial& trial;
+  Mode mode;
+  PulseSim& rng;
+
+  bool lost() { return rng.uniform() < sc.loss; }
+
+  // From the parent's stack to the air: 1-3 ms, plus BLE's turn on the radio
+  double parentDelayMs() {
+    double ms = 1 + rng.uniform() * 2;
+    if (sc.ble && rng.uniform() < 0.3) ms += 5 + rng.uniform() * 50;
+    return ms;
+  }
+
+  bool parentUp(int channel, double t) { return channel == trial.parentChannel && t >= sc.upMs; }
+
+  // A broadcast probe at t, listening until end: the answer's arrival, or -1
+  double probe(int channel, double t, double end) {
+    if (!parentUp(channel, t) || lost()) return -1;
+    double arrival = t + parentDelayMs();
+    return !lost() && arrival < end ? arrival : -1;
+  }
+
+  // A unicast probe to the cached MAC at t: its ACK, or -1
+  double unicastProbe(int channel, double t, double end) {
+    if (!trial.cacheIsParent || !parentUp(channel, t)) return -1;
+    double wait = sc.ble && rng.uniform() < 0.3 ? 5 + rng.uniform() * 50 : 0;
+    if (wait > MAC_RETRY_MS) return -1;
+    double attemptLost = 1 - (1 - sc.loss) * (1 - sc.loss);  // the frame or its ACK
+    if (rng.uniform() < pow(attemptLost, MAC_ATTEMPTS)) return -1;
+    double ack = t + wait + 1;
+    return ack < end ? ack : -1;
+  }
+
+  // The first beacon heard on channel between from and to, or -1
+  double beacon(int channel, double from, double to) {
+    if (channel != trial.parentChannel || PROBE_BEACON_MS == 0) return -1;
+    double start = std::max(from - 60, sc.upMs);
+    double k = ceil((start - trial.beaconPhaseMs) / PROBE_BEACON_MS);
+    for (double sent = trial.beaconPhaseMs + k * PROBE_BEACON_MS; sent < to; sent += PROBE_BEACON_MS) {
+      double arrival = sent + parentDelayMs();
+      if (arrival >= from && arrival < to && !lost()) return arrival;
+    }
+    return -1;
+  }
+
+  double scanOld(double t, double& end) {
+    for (int round = 0; round < OLD_ROUNDS; round++) {
+      for (int ch = 1; ch <= SCAN_CHANNEL_COUNT; ch++) {
+        t += OLED_REDRAW_MS;
+        double found = probe(ch, t, t + OLD_DWELL_MS);
+        if (found >= 0) return found;
+        t += OLD_DWELL_MS;
+      }
+    }
+    end = t;
+    return -1;
+  }
+
+  double scanNew(double t, double& end, int& waitOn) {
+    ScanStep step;
+    int drawnRound = -1;
+    for (int i = 0; scanStep(trial.cache, i, step); i++) {
+      if (step.round >= 0 && step.round != drawnRound) {
+        drawnRound = step.round;
+        t += OLED_REDRAW_MS;
+      }
+      double stepEnd = t + step.dwellMs;
+      double found = -1;
+      if (step.round < 0) found = unicastProbe(step.channel, t, stepEnd);
+      double answer = probe(step.channel, t, stepEnd);
+      if (answer >= 0 && (found < 0 || answer < found)) found = answer;
+      if (mode == NEW) {
+        double heard = beacon(step.channel, t, found >= 0 ? found : stepEnd);
+        if (heard >= 0) found = heard;
+      }
+      if (found >= 0) return found;
+      t = stepEnd;
+    }
+    end = t;
+    waitOn = linkCacheValid(trial.cache) ? trial.cache.channel : 1;
+    return -1;
+  }
+};
+
+// ========== SCAN ORDER ==========
+
+bool testScanSteps() {
+  bool ok = true;
+  LinkCache none = {};
+  LinkCache cached = {};
+  cached.channel = 6;
+  ScanStep step;
+
+  // No cache: every channel once per round, common ones first (and at least
+  // SCAN_COMMON_DWELL_MS), dwell doubling to the cap
+  int steps = 0;
+  int seen[SCAN_ROUNDS][SCAN_CHANNEL_COUNT + 1] = {};
+  double totalMs = 0;
+  for (; scanStep(none, steps, step); steps++) {
+    ok = ok && step.round >= 0 && step.round < SCAN_ROUNDS && step.channel >= 1 && step.channel <= SCAN_CHANNEL_COUNT;
+    if (!ok) break;
+    seen[step.round][step.channel]++;
+    uint32_t dwell = std::min((uint32_t)SCAN_DWELL_MS << step.round, (uint32_t)SCAN_MAX_DWELL_MS);
+    bool common = step.channel == 1 || step.channel == 6 || step.channel == 11;
+    if (common) dwell = std::max(dwell, (uint32_t)SCAN_COMMON_DWELL_MS);
+    ok = ok && step.dwellMs == dwell;
+    totalMs += step.dwellMs;
+  }
+  ok = ok && steps == SCAN_ROUNDS * SCAN_CHANNEL_COUNT;
+  for (int r = 0; r < SCAN_ROUNDS; r++) {
+    for (int ch = 1; ch <= SCAN_CHANNEL_COUNT; ch++) ok = ok && seen[r][ch] == 1;
+  }
+  ok = ok && scanStep(none, 0, step) && step.channel == 1 && scanStep(none, 1, step) && step.channel == 6 &&
+       scanStep(none, 2, step) && step.channel == 11;
+  ok = ok && SCAN_MAX_DWELL_MS > PROBE_BEACON_MS;
+
+  // Cached: its channel first and not again in the first round
+  int cachedSteps = 0;
+  int sixes = 0;
+  for (; scanStep(cached, cachedSteps, step); cachedSteps++) {
+    if (step.channel == 6) sixes++;
+    ok = ok && (cachedSteps == 0) == (step.round < 0);
+    if (step.round == 0) ok = ok && step.channel != 6;
+  }
+  ok = ok && cachedSteps == steps && sixes == SCAN_ROUNDS && scanStep(cached, 0, step) && step.channel == 6 &&
+       step.dwellMs == SCAN_CACHED_DWELL_MS && step.dwellMs > PROBE_BEACON_MS;
+
+  // An out-of-range cache is no cache
+  LinkCache bad = {};
+  bad.channel = 14;
+  ok = ok && !linkCacheValid(bad) && scanStep(bad, 0, step) && step.channel == 1 && step.round == 0;
+
+  printf("scan order: %d steps, %.0f ms of dwell without a parent (old: %.0f ms); %s\n", steps, totalMs,
+         OLD_ROUNDS * SCAN_CHANNEL_COUNT * OLD_DWELL_MS, ok ? "ok" : "MISMATCH");
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  int trials = argc > 1 ? atoi(argv[1]) : 2000;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+  const Scenario scenarios[] = {
+      {"first boot, WiFi parent on 1/6/11", CH_COMMON, false, CACHE_NONE, 0, 0},
+      {"first boot, WiFi parent on any channel", CH_ANY, false, CACHE_NONE, 0, 0},
+      {"first boot, BLE parent", CH_ONE, true, CACHE_NONE, 0, 0},
+      {"reboot, WiFi parent", CH_ANY, false, CACHE_HIT, 0, 0},
+      {"reboot, BLE parent", CH_ONE, true, CACHE_HIT, 0, 0},
+      {"reboot, 30% frame loss", CH_ANY, false, CACHE_HIT, 0.30, 0},
+      {"reboot, router moved the parent", CH_ANY, false, CACHE_MOVED, 0, 0},
+      {"link lost, parent back after 5 s", CH_ANY, false, CACHE_HIT, 0, 5000},
+  };
+
+  printf("# Channel scan: %d trials per scenario, beacon every %d ms, seed %llu\n\n", trials, PROBE_BEACON_MS,
+         (unsigned long long)seed);
+  bool ok = testScanSteps();
+
+  printf("\nms from the start of the scan (or from the parent coming back) to the parent's channel, p50 / p99 / max\n");
+  printf("scenario                                 old                    no beacon              new\n");
+  PulseSim rng(seed);
+  for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+    const Scenario& sc = scenarios[i];
+    Times times[3];
+    for (int n = 0; n < trials; n++) {
+      Trial trial;
+      static const int common[] = {1, 6, 11};
+      trial.parentChannel = sc.channels == CH_ONE      ? 1
+                            : sc.channels == CH_COMMON ? common[(int)(rng.uniform() * 3)]
+                                                       : 1 + (int)(rng.uniform() * SCAN_CHANNEL_COUNT);
+      trial.beaconPhaseMs = rng.uniform() * PROBE_BEACON_MS;
+      memset(&trial.cache, 0, sizeof(trial.cache));
+      trial.cacheIsParent = sc.cache != CACHE_NONE;
+      if (sc.cache == CACHE_HIT) trial.cache.channel = trial.parentChannel;
+      if (sc.cache == CACHE_MOVED) {
+        trial.cache.channel = 1 + (trial.parentChannel + (int)(rng.uniform() * 12)) % SCAN_CHANNEL_COUNT;
+      }
+      for (int m = OLD; m <= NEW; m++) {
+        // Each mode sees the same draws
+        PulseSim draws(seed * 1000003 + i * 7919 + n);
+        double found = ScanSim(sc, trial, (Mode)m, draws).run();
+        if (found < 0) {
+          times[m].missed++;
+        } else {
+          times[m].ms.push_back(found - sc.upMs);
+        }
+      }
+    }
+    printf("%-40s", sc.name);
+    for (int m = OLD; m <= NEW; m++) {
+      char cell[32];
+      snprintf(cell, sizeof(cell), "%.0f / %.0f / %.0f", times[m].pct(50), times[m].pct(99), times[m].pct(100));
+      printf(" %-22s", cell);
+    }
+    printf("%s\n", times[NEW].missed ? "  MISSED" : "");
+    ok = ok && times[NEW].missed <= times[OLD].missed && times[NEW].pct(99) <= times[OLD].pct(99);
+    if (sc.cache == CACHE_HIT && sc.upMs == 0) ok = ok && times[NEW].pct(99) <= 150;
+  }
+
+  printf("\n%s\n", ok ? "# PASS" : "# FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+#include <Arduino.h>
+#include <vector>
+#include <algorithm>
+
+#ifndef SPEED_TRAP_MM
+#define SPEED_TRAP_MM 100  // sensor 1 is 100mm after sensor 0 for the speed-trap section
+#endif
+
+#include "car_detection.h"
+#include "pulse_sim.h"
+#include "detect_harness.h"
+
+// Speed Sweep Benchmark (host)
+// Runs every car over the sensor at increasing speed, so the car is in view for fewer
+// and fewer edges, and reports how many passes each classifier still identifies and
+// how many edges it needs. Build once per classifier (-DCAR_CLASSIFIER=...) and compare:
+// the fixed MIN_PULSES_FOR_ID + CONFIRM_COUNT rule of the median classifier starts
+// missing cars once a pass is shorter than its minimum, while the sequential test
+// (CLASSIFIER_SPRT) decides as soon as the intervals it has are conclusive.
+//
+// Also checks the speed reported with each completed pass (PassInfo):
+//   beam  one sensor, SENSOR_VIEW_MM / beam-crossing time
+//   trap  sensors 0 and 1 SPEED_TRAP_MM apart, time between their first edges
+//
+// Usage: scalextric_speed_bench [passes] [seed]
+
+const float SPEEDS_MPS[] = {2, 4, 6, 8, 10, 12, 14, 16, 20};
+const int NUM_SPEEDS = sizeof(SPEEDS_MPS) / sizeof(SPEEDS_MPS[0]);
+
+PassConfig sweepPass(int car, float speedMps) {
+  PassConfig cfg = DEFAULT_PASS;
+  cfg.car = car;
+  cfg.speedMps = speedMps;
+  cfg.jitterUs = 4.0f;
+  cfg.dropoutProb = 0.02f;
+  cfg.glitchProb = 0.02f;
+  return cfg;
+}
+
+// |estimate - true| as a percentage of true
+double speedErrorPct(uint16_t mmps, float speedMps) {
+  return fabs(mmps / 1000.0 - speedMps) / speedMps * 100.0;
+}
+
+template <typename T>
+T percentile(std::vector<T> values, int pct) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  return values[(values.size() - 1) * pct / 100];
+}
+
+double mean(const std::vector<double>& values) {
+  double sum = 0;
+  for (size_t i = 0; i < values.size(); i++) sum += values[i];
+  return values.empty() ? 0 : sum / values.size();
+}
+
+// ========== CLASSIFICATION + BEAM SPEED ==========
+
+void sweepSingleSensor(int passes, uint64_t seed) {
+  printf("m/s   view(ms)  ok%%    wrong%%  unk%%   miss%%  pulses(avg)  beam err%%(avg/p95)\n");
+
+  initSensors();
+  for (int s = 0; s < NUM_SPEEDS; s++) {
+    PulseSim sim(seed * 1000 + s);
+    int total = 0, correct = 0, wrong = 0, unknown = 0, missed = 0;
+    long pulses = 0;
+    std::vector<double> speedErr;
+    uint64_t t = 1000000;
+
+    for (int car = 1; car <= 6; car++) {
+      for (int p = 0; p < passes; p++) {
+        std::vector<uint64_t> edges;
+        t = sim.generatePass(sweepPass(car, SPEEDS_MPS[s]), t, edges);
+        PassResult r = runPass(edges, (uint64_t)(sim.uniform() * LOOP_PERIOD_US));
+        t += DETECTION_TIMEOUT + 100000;
+
+        total++;
+        if (!r.detected) missed++;
+        else if (r.car == car) { correct++; pulses += r.edgesToDecision; }
+        else if (r.car == 0) unknown++;
+        else wrong++;
+        if (r.passes > 0) speedErr.push_back(speedErrorPct(r.speedMmps, SPEEDS_MPS[s]));
+      }
+    }
+
+    PassConfig view = DEFAULT_PASS;
+    view.speedMps = SPEEDS_MPS[s];
+    printf("%-5.0f %-9.2f %-6.1f %-7.1f %-6.1f %-6.1f %-12.1f %.1f / %.1f\n", SPEEDS_MPS[s],
+           PulseSim::passDurationUs(view) / 1000.0, 100.0 * correct / total,
+           100.0 * wrong / total, 100.0 * unknown / total, 100.0 * missed / total,
+           correct ? (double)pulses / correct : 0.0, mean(speedErr), percentile(speedErr, 95));
+  }
+}
+
+// ========== TWO-SENSOR SPEED TRAP ==========
+
+PassInfo trapPass;
+int trapPasses = 0;
+
+void ignoreCar(uint8_t sensorId, int car, float freq) {
+  (void)sensorId;
+  (void)car;
+  (void)freq;
+}
+
+void onTrapPass(const PassInfo& pass) {
+  if (pass.sensorId != 1) return;
+  trapPass = pass;
+  trapPasses++;
+}
+
+void sweepSpeedTrap(int passes, uint64_t seed) {
+  printf("\n## speed trap: sensor 1 %dmm after sensor 0\n", SPEED_TRAP_MM);
+  printf("m/s   paired%%  trap err%%(avg/p95)\n");
+
+  for (int s = 0; s < NUM_SPEEDS; s++) {
+    PulseSim sim(seed * 2000 + s);
+    initSensors();
+    std::vector<double> trapErr;
+    int paired = 0, total = 0;
+    uint64_t t = 1000000;
+
+    for (int p = 0; p < passes * 6; p++) {
+      PassConfig cfg = sweepPass(1 + p % 6, SPEEDS_MPS[s]);
+      uint64_t travelUs = (uint64_t)(SPEED_TRAP_MM / SPEEDS_MPS[s] * 1000.0);
+      std::vector<uint64_t> edges[2];
+      sim.generatePass(cfg, t, edges[0]);
+      uint64_t end = sim.generatePass(cfg, t + travelUs, edges[1]);
+
+      // loop(): both sensors, polled every 1ms
+      trapPasses = 0;
+      size_t next[2] = {0, 0};
+      for (uint64_t poll = t + (uint64_t)(sim.uniform() * LOOP_PERIOD_US);
+           poll < end + DETECTION_TIMEOUT + 2 * LOOP_PERIOD_US; poll += LOOP_PERIOD_US) {
+        for (int i = 0; i < 2; i++) {
+          while (next[i] < edges[i].size() && edges[i][next[i]] < poll) {
+            hostSetMicros(edges[i][next[i]++]);
+            onPulse(i);
+          }
+        }
+        hostSetMicros(poll);
+        processDeadlines(ignoreCar, onTrapPass);
+        processSensor(sensors[0], ignoreCar);
+        processSensor(sensors[1], ignoreCar);
+      }
+      t = end + DETECTION_TIMEOUT + 100000;
+
+      total++;
+      if (trapPasses > 0 && trapPass.speedFromTrap) {
+        paired++;
+        trapErr.push_back(speedErrorPct(trapPass.speedMmps, SPEEDS_MPS[s]));
+      }
+    }
+
+    printf("%-5.0f %-8.1f %.2f / %.2f\n", SPEEDS_MPS[s], 100.0 * paired / total, mean(trapErr),
+           percentile(trapErr, 95));
+  }
+}
+
+int main(int argc, char** argv) {
+  int passes = argc > 1 ? atoi(argv[1]) : 200;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+
+  const char* classifier = CAR_CLASSIFIER == CLASSIFIER_SPRT ? "sprt"
+                         : CAR_CLASSIFIER == CLASSIFIER_TONE_BANK ? "tone-bank" : "median";
+  printf("# Speed sweep: %d passes/car/speed, seed %llu, classifier %s\n", passes,
+         (unsigned long long)seed, classifier);
+  printf("# %dmm view, jitter 4us, 2%% dropouts, 2%% glitches, car 1-6 mixed\n\n",
+         SENSOR_VIEW_MM);
+
+  sweepSingleSensor(passes, seed);
+  sweepSpeedTrap(passes, seed);
+  return 0;
+}
@@ -0,0 +1,376 @@
+#include <Arduino.h>
+#include <vector>
+#include <algorithm>
+#include "car_detection.h"
+#include "pulse_sim.h"
+
+// Edge Trace Replayer (host)
+// Feeds a binary edge trace (include/edge_trace.h, captured with
+// scalextric_trace_logger) back through the detector, with loop() polled every 1ms
+// on a fixed schedule, so the same trace always gives the same result. Compares the
+// detections with the ones the detector made on the track, and prints a digest of
+// the replayed detections. Build with -DCAR_CLASSIFIER=... to see what another
+// classifier makes of the same real-world edges.
+//
+// Usage: scalextric_trace_replay <trace.sxt> [-v]
+//        scalextric_trace_replay --selftest [passes] [seed]
+// The self-test records simulated passes through the EDGE_TRACE hooks, with text
+// and a corrupted frame in the stream, and checks the decoded edges, detections and
+// replay against what was recorded. Exits non-zero on any mismatch.
+
+#if !EDGE_TRACE
+#error "scalextric_trace_replay needs -DEDGE_TRACE=1 (the self-test records through the detector)"
+#endif
+
+const uint64_t LOOP_PERIOD_US = 1000;
+
+struct Detection {
+  uint8_t sensor;
+  int car;
+  uint64_t timeUs;
+};
+
+// ========== DECODE ==========
+
+std::vector<TraceRecord> decoded;
+
+void collectRecord(const TraceRecord& record) { decoded.push_back(record); }
+
+bool byTime(const TraceRecord& a, const TraceRecord& b) { return a.timeUs < b.timeUs; }
+
+bool byTimeThenSensor(const TraceRecord& a, const TraceRecord& b) {
+  return a.timeUs != b.timeUs ? a.timeUs < b.timeUs : a.sensor < b.sensor;
+}
+
+// ========== REPLAY ==========
+
+std::vector<Detection> replayed;
+
+void onReplayDetection(uint8_t sensorId, int car, float freq) {
+  (void)freq;
+  Detection d = {sensorId, car, hostMicros};
+  replayed.push_back(d);
+}
+
+void pollOnce(uint64_t at, CarDetectedCallback onCarDetected) {
+  hostSetMicros(at);
+  processDeadlines(onCarDetected);
+  processAllSensors(onCarDetected);
+}
+
+// Runs time-ordered edges through the detector. Polls land on multiples of
+// LOOP_PERIOD_US; stallFromUs..stallToUs is a loop() stall (no polls).
+void runEdges(const std::vector<TraceRecord>& edges, CarDetectedCallback onCarDetected,
+              uint64_t stallFromUs = 0, uint64_t stallToUs = 0) {
+  if (edges.empty()) return;
+  uint64_t nextPoll = (edges.front().timeUs / LOOP_PERIOD_US + 1) * LOOP_PERIOD_US;
+  for (size_t i = 0; i < edges.size(); i++) {
+    while (nextPoll <= edges[i].timeUs) {
+      if (nextPoll < stallFromUs || nextPoll >= stallToUs) pollOnce(nextPoll, onCarDetected);
+      nextPoll += LOOP_PERIOD_US;
+    }
+    hostSetMicros(edges[i].timeUs);
+    onPulse(edges[i].sensor);
+  }
+  uint64_t quietUntil = edges.back().timeUs + DETECTION_TIMEOUT + 2 * LOOP_PERIOD_US;
+  for (; nextPoll <= quietUntil; nextPoll += LOOP_PERIOD_US) pollOnce(nextPoll, onCarDetected);
+}
+
+// Edges of the decoded trace in time order, skipping sensors this build doesn't have
+std::vector<TraceRecord> traceEdges(const std::vector<TraceRecord>& records, int& skipped) {
+  std::vector<TraceRecord> edges;
+  skipped = 0;
+  for (size_t i = 0; i < records.size(); i++) {
+    if (records[i].type != TRACE_EDGE) continue;
+    if (records[i].sensor >= NUM_SENSORS) {
+      skipped++;
+      continue;
+    }
+    edges.push_back(records[i]);
+  }
+  std::stable_sort(edges.begin(), edges.end(), byTime);
+  return edges;
+}
+
+std::vector<Detection> replay(const std::vector<TraceRecord>& edges) {
+  initSensors();
+  replayed.clear();
+  runEdges(edges, onReplayDetection);
+  return replayed;
+}
+
+uint32_t digest(const std::vector<Detection>& detections) {
+  uint32_t h = 2166136261u;  // FNV-1a
+  for (size_t i = 0; i < detections.size(); i++) {
+    uint8_t bytes[10] = {detections[i].sensor, (uint8_t)detections[i].car};
+    for (int b = 0; b < 8; b++) bytes[2 + b] = (uint8_t)(detections[i].timeUs >> (8 * b));
+    for (int b = 0; b < 10; b++) h = (h ^ bytes[b]) * 16777619u;
+  }
+  return h;
+}
+
+struct Comparison {
+  int agree, changed, missing, extra;
+};
+
+// Pairs each recorded detection with a replayed one on the same sensor in the same pass
+Comparison compare(const std::vector<Detection>& recorded, const std::vector<Detection>& again,
+                   bool verbose) {
+  Comparison c = {0, 0, 0, 0};
+  std::vector<bool> used(again.size(), false);
+  for (size_t i = 0; i < recorded.size(); i++) {
+    const Detection& r = recorded[i];
+    int match = -1;
+    for (size_t j = 0; j < again.size() && match < 0; j++) {
+      uint64_t gap = r.timeUs > again[j].timeUs ? r.timeUs - again[j].timeUs : again[j].timeUs - r.timeUs;
+      if (!used[j] && again[j].sensor == r.sensor && gap < DETECTION_TIMEOUT) match = j;
+    }
+    if (match < 0) {
+      c.missing++;
+      if (verbose) printf("%12.6f  S%d  car %d  ->  (none)\n", r.timeUs / 1e6, r.sensor, r.car);
+      continue;
+    }
+    used[match] = true;
+    if (again[match].car == r.car) {
+      c.agree++;
+    } else {
+      c.changed++;
+      if (verbose) {
+        printf("%12.6f  S%d  car %d  ->  car %d\n", r.timeUs / 1e6, r.sensor, r.car, again[match].car);
+      }
+    }
+  }
+  for (size_t j = 0; j < again.size(); j++) {
+    if (used[j]) continue;
+    c.extra++;
+    if (verbose) printf("%12.6f  S%d  (none) ->  car %d\n", again[j].timeUs / 1e6, again[j].sensor, again[j].car);
+  }
+  return c;
+}
+
+std::vector<Detection> recordedDetections(const std::vector<TraceRecord>& records) {
+  std::vector<Detection> out;
+  for (size_t i = 0; i < records.size(); i++) {
+    if (records[i].type != TRACE_DETECTION) continue;
+    Detection d = {records[i].sensor, (int)records[i].value, records[i].timeUs};
+    out.push_back(d);
+  }
+  return out;
+}
+
+const char* classifierName() {
+  return CAR_CLASSIFIER == CLASSIFIER_SPRT ? "sprt"
+       : CAR_CLASSIFIER == CLASSIFIER_TONE_BANK ? "tone-bank" : "median";
+}
+
+// ========== FILE MODE ==========
+
+int replayFile(const char* path, bool verbose) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    printf("can't open %s\n", path);
+    return 1;
+  }
+  std::vector<uint8_t> bytes;
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) bytes.insert(bytes.end(), buf, buf + n);
+  fclose(f);
+
+  decoded.clear();
+  TraceStats stats = decodeTrace(bytes.data(), bytes.size(), collectRecord);
+  int skipped;
+  std::vector<TraceRecord> edges = traceEdges(decoded, skipped);
+  std::vector<Detection> recorded = recordedDetections(decoded);
+
+  long perSensor[TRACE_MAX_SENSORS] = {0};
+  uint32_t lost = 0;
+  for (size_t i = 0; i < decoded.size(); i++) {
+    if (decoded[i].type == TRACE_EDGE) perSensor[decoded[i].sensor]++;
+    if (decoded[i].type == TRACE_LOST) lost += decoded[i].value;
+  }
+
+  printf("# Trace replay: %s, classifier %s\n", path, classifierName());
+  printf("%lu bytes: %lu frames, %lu bad, %lu bytes skipped\n", (unsigned long)bytes.size(),
+         (unsigned long)stats.frames, (unsigned long)stats.badFrames, (unsigned long)stats.skippedBytes);
+  printf("edges:");
+  for (int s = 0; s < TRACE_MAX_SENSORS; s++) {
+    if (perSensor[s]) printf(" S%d=%ld", s, perSensor[s]);
+  }
+  printf(", lost on the device %lu", (unsigned long)lost);
+  if (skipped) printf(", %d on sensors >= %d skipped", skipped, NUM_SENSORS);
+  printf("\nrecorded detections: %d\n\n", (int)recorded.size());
+
+  std::vector<Detection> again = replay(edges);
+  if (verbose) printf("time(s)       sensor  recorded -> replayed\n");
+  Comparison c = compare(recorded, again, verbose);
+  printf("%sreplayed %d detections: %d agree, %d changed car, %d missing, %d extra\n",
+         verbose ? "\n" : "", (int)again.size(), c.agree, c.changed, c.missing, c.extra);
+  printf("digest %08x\n", digest(again));
+  return 0;
+}
+
+// ========== SELF-TEST ==========
+
+std::vector<Detection> live;
+
+void onLiveDetection(uint8_t sensorId, int car, float freq) {
+  (void)freq;
+  Detection d = {sensorId, car, hostMicros};
+  live.push_back(d);
+}
+
+void drainTrace(std::vector<uint8_t>& stream) {
+  uint8_t chunk[256];
+  int n;
+  while ((n = edgeTrace.buffer.pop(chunk, sizeof(chunk))) > 0) stream.insert(stream.end(), chunk, chunk + n);
+}
+
+bool sameDetections(const std::vector<Detection>& a, const std::vector<Detection>& b, bool checkTime) {
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i].sensor != b[i].sensor || a[i].car != b[i].car) return false;
+    if (checkTime && a[i].timeUs != b[i].timeUs) return false;
+  }
+  return true;
+}
+
+int selfTest(int passes, uint64_t seed) {
+  printf("# Trace self-test: %d passes/car, seed %llu, classifier %s\n", passes,
+         (unsigned long long)seed, classifierName());
+  PulseSim sim(seed);
+  std::vector<TraceRecord> fed;
+  std::vector<uint8_t> stream;
+  const char* bootText = "ets Jun  8 2016 00:22:57\r\n# Scalextric Edge Trace Logger\r\n";
+  stream.insert(stream.end(), bootText, bootText + strlen(bootText));
+
+  // Record: passes on every sensor, two lanes at once on every third pass
+  initSensors();
+  live.clear();
+  uint64_t t = 5000000;
+  for (int p = 0; p < passes * 6; p++) {
+    PassConfig cfg = DEFAULT_PASS;
+    cfg.car = 1 + p % 6;
+    cfg.jitterUs = 4.0f;
+    cfg.dropoutProb = 0.02f;
+    cfg.bounceProb = 0.02f;
+    cfg.glitchProb = 0.02f;
+    std::vector<uint64_t> times[2];
+    int sensor = p % NUM_SENSORS;
+    uint64_t end = sim.generatePass(cfg, t, times[0]);
+    if (p % 3 == 0) {
+      cfg.car = 1 + (p + 2) % 6;
+      end = std::max(end, sim.generatePass(cfg, t + (uint64_t)(sim.uniform() * 5000), times[1]));
+    }
+    std::vector<TraceRecord> pass;
+    for (int lane = 0; lane < 2; lane++) {
+      for (size_t i = 0; i < times[lane].size(); i++) {
+        TraceRecord r = {TRACE_EDGE, (uint8_t)((sensor + lane) % NUM_SENSORS), times[lane][i], 0};
+        pass.push_back(r);
+      }
+    }
+    std::stable_sort(pass.begin(), pass.end(), byTime);
+    runEdges(pass, onLiveDetection);
+    fed.insert(fed.end(), pass.begin(), pass.end());
+    drainTrace(stream);
+    if (p % 10 == 9) {
+      const char* status = "\n# cars 10, dropped frames 0\n";
+      stream.insert(stream.end(), status, status + strlen(status));
+    }
+    t = end + DETECTION_TIMEOUT + 200000 + (uint64_t)(sim.uniform() * 1000000);
+  }
+  edgeTrace.flush();
+  drainTrace(stream);
+  bool ok = true;
+
+  // 1. Decode: exactly the edges and detections that went in
+  decoded.clear();
+  TraceStats stats = decodeTrace(stream.data(), stream.size(), collectRecord);
+  int skipped;
+  std::vector<TraceRecord> edges = traceEdges(decoded, skipped);
+  std::vector<Detection> recorded = recordedDetections(decoded);
+  // Same instant on two sensors may come out in either order
+  std::vector<TraceRecord> fedSorted = fed;
+  std::vector<TraceRecord> edgesSorted = edges;
+  std::sort(fedSorted.begin(), fedSorted.end(), byTimeThenSensor);
+  std::sort(edgesSorted.begin(), edgesSorted.end(), byTimeThenSensor);
+  int edgeErrors = edges.size() == fedSorted.size() ? 0 : 1;
+  for (size_t i = 0; !edgeErrors && i < edges.size(); i++) {
+    if (edgesSorted[i].sensor != fedSorted[i].sensor || edgesSorted[i].timeUs != fedSorted[i].timeUs) {
+      edgeErrors++;
+    }
+  }
+  bool detectionsOk = sameDetections(recorded, live, false);
+  printf("\n## round trip\n%lu edges, %lu detections in %lu bytes (%.2f bytes/edge), %lu frames\n",
+         (unsigned long)fed.size(), (unsigned long)live.size(), (unsigned long)stream.size(),
+         (double)stream.size() / fed.size(), (unsigned long)stats.frames);
+  printf("edges %s, detections %s\n", edgeErrors ? "FAIL" : "ok", detectionsOk ? "ok" : "FAIL");
+  ok = ok && !edgeErrors && detectionsOk;
+
+  // 2. Replay: same detections at the same times, and the same digest every run
+  std::vector<Detection> first = replay(edges);
+  std::vector<Detection> second = replay(edges);
+  bool replayOk = sameDetections(first, live, true) && digest(first) == digest(second);
+  printf("\n## replay\n%lu detections, digest %08x / %08x: %s\n", (unsigned long)first.size(),
+         digest(first), digest(second), replayOk ? "ok" : "FAIL");
+  ok = ok && replayOk;
+
+  // 3. Corruption: one flipped byte costs that frame only
+  std::vector<uint8_t> damaged = stream;
+  size_t at = damaged.size() / 2;
+  while (!(damaged[at] == TRACE_MAGIC_0 && damaged[at + 1] == TRACE_MAGIC_1)) at++;
+  int frameLen = damaged[at + 2];
+  damaged[at + 3 + frameLen / 2] ^= 0x5A;
+  size_t cleanRecords = decoded.size();
+  decoded.clear();
+  TraceStats damagedStats = decodeTrace(damaged.data(), damaged.size(), collectRecord);
+  bool corruptOk = damagedStats.frames == stats.frames - 1 && decoded.size() < cleanRecords &&
+                   decoded.size() + frameLen / 2 + 1 >= cleanRecords;
+  printf("\n## corrupted frame\nframes %lu -> %lu, records %lu -> %lu: %s\n",
+         (unsigned long)stats.frames, (unsigned long)damagedStats.frames,
+         (unsigned long)cleanRecords, (unsigned long)decoded.size(), corruptOk ? "ok" : "FAIL");
+  ok = ok && corruptOk;
+
+  // 4. Ring overflow: a 60ms loop stall mid-pass shows up as lost edges
+  initSensors();
+  live.clear();
+  PassConfig slow = DEFAULT_PASS;
+  slow.speedMps = 0.25f;  // 100ms in view
+  std::vector<uint64_t> times;
+  sim.generatePass(slow, t, times);
+  std::vector<TraceRecord> pass;
+  for (size_t i = 0; i < times.size(); i++) {
+    TraceRecord r = {TRACE_EDGE, 0, times[i], 0};
+    pass.push_back(r);
+  }
+  runEdges(pass, onLiveDetection, t + 20000, t + 80000);
+  edgeTrace.flush();
+  stream.clear();
+  drainTrace(stream);
+  decoded.clear();
+  decodeTrace(stream.data(), stream.size(), collectRecord);
+  uint32_t lost = 0;
+  for (size_t i = 0; i < decoded.size(); i++) {
+    if (decoded[i].type == TRACE_LOST) lost += decoded[i].value;
+  }
+  bool lostOk = lost > 0 && lost == sensorEdges[0].overflowCount();
+  printf("\n## ring overflow\nring dropped %lu, trace says %lu: %s\n",
+         (unsigned long)sensorEdges[0].overflowCount(), (unsigned long)lost, lostOk ? "ok" : "FAIL");
+  ok = ok && lostOk;
+
+  printf("\n# %s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "--selftest") == 0) {
+    int passes = argc > 2 ? atoi(argv[2]) : 50;
+    uint64_t seed = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1;
+    return selfTest(passes, seed);
+  }
+  if (argc < 2) {
+    printf("usage: scalextric_trace_replay <trace.sxt> [-v] | --selftest [passes] [seed]\n");
+    return 1;
+  }
+  return replayFile(argv[1], argc > 2 && strcmp(argv[2], "-v") == 0);
+}
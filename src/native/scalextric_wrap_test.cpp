@@ -0,0 +1,123 @@
+#include <Arduino.h>
+#include <vector>
+#include "car_detection.h"
+#include "pulse_sim.h"
+#include "detect_harness.h"
+
+// micros() Wraparound Test (host)
+// The ISRs timestamp edges with 32-bit micros(), which wraps every 2^32us (~71.6
+// minutes); the detector widens them to 64-bit micros64() time.
+//
+// 1. extendEdgeTime: random 64-bit clocks (including either side of each 32-bit
+//    wrap) and edges up to 30 minutes old or slightly newer than the clock.
+// 2. Mid-pass wrap: every car, with the wrap placed at each edge of the pass in
+//    turn (so one edge lands on micros() == 0), must give exactly the same result
+//    as the same pass away from the wrap.
+// 3. Stale edge: an edge exactly one wrap plus 250us before a new pass has the same
+//    32-bit timestamp as a valid interval; it must not be paired with the new edge.
+//
+// Usage: scalextric_wrap_test [passes] [seed]
+// Exits non-zero on any mismatch.
+
+const uint64_t WRAP = 1ULL << 32;
+
+bool testExtend(PulseSim& sim) {
+  int errors = 0;
+  const int trials = 1000000;
+  for (int i = 0; i < trials; i++) {
+    uint64_t now = (sim.next() % 8) * WRAP + sim.next() % WRAP;
+    if (now < WRAP) now += WRAP;
+    int64_t age = (int64_t)(sim.uniform() * 1800e6) - 1000000;  // -1s .. 30 min
+    uint64_t edge = now - age;
+    if (extendEdgeTime((uint32_t)edge, now) != edge) errors++;
+  }
+  printf("## extendEdgeTime\n%d trials, %d errors: %s\n", trials, errors, errors ? "FAIL" : "ok");
+  return errors == 0;
+}
+
+bool samePass(const PassResult& a, const PassResult& b) {
+  return a.detected == b.detected && a.car == b.car && a.edgesToDecision == b.edgesToDecision &&
+         a.usToDecision == b.usToDecision && a.reports == b.reports && a.latencyUs == b.latencyUs &&
+         a.passes == b.passes && a.speedMmps == b.speedMmps;
+}
+
+// Same pass, shifted so it starts at startUs
+PassResult runAt(const std::vector<uint64_t>& edges, uint64_t startUs, uint64_t pollPhaseUs) {
+  std::vector<uint64_t> shifted(edges.size());
+  for (size_t i = 0; i < edges.size(); i++) shifted[i] = edges[i] - edges[0] + startUs;
+  initSensors();
+  hostSetMicros(startUs > LOOP_PERIOD_US ? startUs - LOOP_PERIOD_US : 0);
+  return runPass(shifted, pollPhaseUs);
+}
+
+bool testMidPassWrap(int passes, PulseSim& sim) {
+  const uint64_t REFERENCE_START = 10000000;
+  int runs = 0;
+  int mismatches = 0;
+
+  for (int car = 1; car <= 6; car++) {
+    for (int p = 0; p < passes; p++) {
+      PassConfig cfg = DEFAULT_PASS;
+      cfg.car = car;
+      cfg.jitterUs = 4.0f;
+      cfg.glitchProb = 0.02f;
+      std::vector<uint64_t> edges;
+      sim.generatePass(cfg, 0, edges);
+      uint64_t phase = (uint64_t)(sim.uniform() * LOOP_PERIOD_US);
+      PassResult reference = runAt(edges, REFERENCE_START, phase);
+
+      // Wrap exactly at each edge (and one more wrap later), then at the deadline
+      for (size_t j = 0; j <= edges.size(); j++) {
+        uint64_t offset = j < edges.size() ? edges[j] - edges[0]
+                                           : edges.back() - edges[0] + DETECTION_TIMEOUT;
+        uint64_t wraps = 1 + j % 3;
+        PassResult wrapped = runAt(edges, wraps * WRAP - offset, phase);
+        runs++;
+        if (!samePass(reference, wrapped)) {
+          if (mismatches++ < 5) {
+            printf("MISMATCH car %d, wrap at edge %d: car %d/%d, edges %d/%d, reports %d/%d\n",
+                   car, (int)j, reference.car, wrapped.car, reference.edgesToDecision,
+                   wrapped.edgesToDecision, reference.reports, wrapped.reports);
+          }
+        }
+      }
+    }
+  }
+  printf("\n## mid-pass wrap\n%d passes, %d mismatches: %s\n", runs, mismatches,
+         mismatches ? "FAIL" : "ok");
+  return mismatches == 0;
+}
+
+bool testStaleEdge() {
+  initSensors();
+  SensorState& sensor = sensors[0];
+  uint64_t stale = 5 * WRAP + 123456;
+
+  // One stray edge, then nothing until exactly one wrap later
+  hostSetMicros(stale);
+  onPulse(0);
+  processSensor(sensor, harnessOnCarDetected);
+
+  hostSetMicros(stale + WRAP + 250);  // micros() - stale == 250, a valid interval
+  onPulse(0);
+  processSensor(sensor, harnessOnCarDetected);
+
+  bool ok = sensor.pulseCount == 0 && !sensor.detecting;
+  printf("\n## stale edge one wrap ago\npulseCount %d: %s\n", sensor.pulseCount, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  int passes = argc > 1 ? atoi(argv[1]) : 20;
+  uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1;
+
+  printf("# micros() wrap test: %d passes/car, seed %llu\n", passes, (unsigned long long)seed);
+
+  PulseSim sim(seed);
+  bool ok = testExtend(sim);
+  ok = testMidPassWrap(passes, sim) && ok;
+  ok = testStaleEdge() && ok;
+
+  printf("\n# %s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -5,6 +5,7 @@
 #include <BLE2902.h>
 #include <esp_bt_main.h>
 #include <esp_gap_ble_api.h>
+#include "scalextric_protocol.h"
 
 // Scalextric BLE Bridge (ESP32-B of split relay)
 // Reads event lines from Serial2 (sent by ESP32-A running scalextric_espnow_receiver)
@@ -13,8 +14,10 @@
 // NO WiFi on this board — dedicated BLE radio, no coexistence delay
 // Wiring: GPIO26 (RX2) ← ESP32-A GPIO25 (TX2), plus shared GND
 //
-// Input format:  NODE:SENSOR:CAR:FREQ\n
-// Output format: SEQ:NODE:SENSOR:CAR:FREQ:RECV_MILLIS
+// Input format:  NODE:SENSOR:CAR:FREQ\n, and P: / H: lines
+// Output format: SEQ:NODE:SENSOR:CAR:FREQ:RECV_MILLIS; P: and H: lines go out as they came
+// A client that writes FORMAT:BIN to the sync characteristic gets binary CarRecords
+// (encodeCarRecord) instead; FORMAT:TEXT, or reconnecting, goes back to text.
 //
 // SYNC handled entirely by this board using its own millis() — consistent with event timestamps
 
@@ -28,19 +31,22 @@ bool clientConnected = false;
 
 // Parsed event queue
 const int EVENT_QUEUE_SIZE = 8;
-struct ParsedEvent {
-  int nodeId;
-  int sensorId;
-  int carNumber;
-  int frequency;
-};
-ParsedEvent eventQueue[EVENT_QUEUE_SIZE];
-uint32_t eventReceiveMs[EVENT_QUEUE_SIZE];  // millis() when Serial2 line arrived
+CarEvent eventQueue[EVENT_QUEUE_SIZE];
+uint64_t eventReceiveUs[EVENT_QUEUE_SIZE];  // micros when Serial2 line arrived
 volatile int eventQueueCount = 0;
 
+// P: and H: lines from ESP32-A, passed on unchanged
+const int LINE_QUEUE_SIZE = 8;
+char lineQueue[LINE_QUEUE_SIZE][96];
+int lineQueueCount = 0;
+
 // Pending SYNC response
 volatile bool syncPending = false;
 
+// Event format (FORMAT:BIN / FORMAT:TEXT), text for each new connection
+volatile bool binaryFormat = false;
+volatile bool formatReplyPending = false;
+
 // Sequence number for drop detection
 uint32_t seqNumber = 0;
 
@@ -70,6 +76,7 @@ class ServerCallbacks : public BLEServerCallbacks {
   }
   void onDisconnect(BLEServer* server) override {
     clientConnected = false;
+    binaryFormat = false;
     server->getAdvertising()->start();
     Serial.println("Client disconnected, re-advertising");
   }
@@ -78,17 +85,21 @@ class ServerCallbacks : public BLEServerCallbacks {
 class SyncCallbacks : public BLECharacteristicCallbacks {
   void onWrite(BLECharacteristic* characteristic) override {
     std::string value = characteristic->getValue();
-    if (value.find("SYNC") != std::string::npos) {
+    bool binary;
+    if (parseFormatCommand(value.c_str(), binary)) {
+      binaryFormat = binary;
+      formatReplyPending = true;
+    } else if (value.find("SYNC") != std::string::npos) {
       syncPending = true;
     }
   }
 };
 
 // Serial2 line buffer
-char lineBuf[64];
+char lineBuf[96];
 int linePos = 0;
 
-bool parseLine(const char* line, ParsedEvent& out) {
+bool parseLine(const char* line, CarEvent& out) {
   // Format: NODE:SENSOR:CAR:FREQ
   int node, sensor, car, freq;
   if (sscanf(line, "%d:%d:%d:%d", &node, &sensor, &car, &freq) == 4) {
@@ -96,6 +107,7 @@ bool parseLine(const char* line, ParsedEvent& out) {
     out.sensorId = sensor;
     out.carNumber = car;
     out.frequency = freq;
+    out.timestamp = 0;
     return true;
   }
   return false;
@@ -159,10 +171,15 @@ void loop() {
     if (c == '\n' || c == '\r') {
       if (linePos > 0) {
         lineBuf[linePos] = '\0';
-        ParsedEvent parsed;
-        if (parseLine(lineBuf, parsed) && eventQueueCount < EVENT_QUEUE_SIZE) {
+        CarEvent parsed;
+        if ((lineBuf[0] == 'P' || lineBuf[0] == 'H') && lineBuf[1] == ':') {
+          if (lineQueueCount < LINE_QUEUE_SIZE) {
+            memcpy(lineQueue[lineQueueCount], lineBuf, linePos + 1);
+            lineQueueCount++;
+          }
+        } else if (parseLine(lineBuf, parsed) && eventQueueCount < EVENT_QUEUE_SIZE) {
           eventQueue[eventQueueCount] = parsed;
-          eventReceiveMs[eventQueueCount] = millis();
+          eventReceiveUs[eventQueueCount] = esp_timer_get_time();
           eventQueueCount++;
         }
         linePos = 0;
@@ -175,16 +192,27 @@ void loop() {
   // Flush queued events via BLE notification
   if (clientConnected && eventQueueCount > 0) {
     for (int i = 0; i < eventQueueCount; i++) {
-      ParsedEvent& event = eventQueue[i];
-      char msg[64];
-      snprintf(msg, sizeof(msg), "%lu:%d:%d:%d:%d:%lu",
-               seqNumber++, event.nodeId, event.sensorId, event.carNumber,
-               event.frequency, (unsigned long)eventReceiveMs[i]);
-      eventCharacteristic->setValue(msg);
+      CarEvent& event = eventQueue[i];
+      if (binaryFormat) {
+        uint8_t record[RECORD_MAX_SIZE];
+        int n = encodeCarRecord(record, sizeof(record), seqNumber++, event, eventReceiveUs[i], EventQuality());
+        eventCharacteristic->setValue(record, n);
+      } else {
+        char msg[64];
+        formatCarEvent(msg, sizeof(msg), seqNumber++, event, eventReceiveUs[i], EventQuality());
+        eventCharacteristic->setValue(msg);
+      }
       eventCharacteristic->notify();
     }
   }
   eventQueueCount = 0;
+  if (clientConnected) {
+    for (int i = 0; i < lineQueueCount; i++) {
+      eventCharacteristic->setValue(lineQueue[i]);
+      eventCharacteristic->notify();
+    }
+  }
+  lineQueueCount = 0;
 
   // Send keepalive ping to maintain short connection interval
   if (keepalivePending) {
@@ -204,5 +232,13 @@ void loop() {
     syncCharacteristic->notify();
   }
 
+  if (formatReplyPending) {
+    formatReplyPending = false;
+    char reply[24];
+    formatFormatReply(reply, sizeof(reply), binaryFormat);
+    syncCharacteristic->setValue(reply);
+    syncCharacteristic->notify();
+  }
+
   delay(1);  // Give BLE stack time to process
 }
@@ -16,7 +16,10 @@
 // For use without child nodes — ~3ms latency
 // Includes a 1s keepalive to prevent Windows BLE CI drift
 //
-// Output format: SEQ:NODE:SENSOR:CAR:FREQ:RECV_MILLIS
+// Output format: SEQ:NODE:SENSOR:CAR:FREQ:RECV_MILLIS[:Q:...] (see formatCarEvent)
+// A client that writes FORMAT:BIN to the sync characteristic gets binary CarRecords
+// (encodeCarRecord) instead; FORMAT:TEXT, or reconnecting, goes back to text.
+// Sensor health as H: lines, every 10s per sensor and on a change (see formatHealthEvent)
 
 #define SERVICE_UUID        "a1b2c3d4-e5f6-7890-abcd-ef1234567890"
 #define EVENT_CHAR_UUID     "a1b2c3d4-e5f6-7890-abcd-ef1234567891"
@@ -45,12 +48,28 @@ int totalDetections = 0;
 // Event queue
 const int EVENT_QUEUE_SIZE = 8;
 CarEvent eventQueue[EVENT_QUEUE_SIZE];
-uint32_t eventReceiveMs[EVENT_QUEUE_SIZE];
+EventQuality eventQualities[EVENT_QUEUE_SIZE];  // zero for events without quality data
+uint64_t eventReceiveUs[EVENT_QUEUE_SIZE];
 volatile int eventQueueCount = 0;
+portMUX_TYPE eventQueueMux = portMUX_INITIALIZER_UNLOCKED;  // detection task vs loop()
+
+// Completed passes (speed / duration), same lock as the event queue
+const int PASS_QUEUE_SIZE = 4;
+PassEvent passQueue[PASS_QUEUE_SIZE];
+volatile int passQueueCount = 0;
+
+// Sensor health reports (local and children), same lock as the event queue
+const int HEALTH_QUEUE_SIZE = 16;
+HealthEvent healthQueue[HEALTH_QUEUE_SIZE];
+volatile int healthQueueCount = 0;
 
 // Pending SYNC response
 volatile bool syncPending = false;
 
+// Event format (FORMAT:BIN / FORMAT:TEXT), text for each new connection
+volatile bool binaryFormat = false;
+volatile bool formatReplyPending = false;
+
 // Sequence number for drop detection
 uint32_t seqNumber = 0;
 
@@ -79,6 +98,7 @@ class ServerCallbacks : public BLEServerCallbacks {
   }
   void onDisconnect(BLEServer* server) override {
     clientConnected = false;
+    binaryFormat = false;
     server->getAdvertising()->start();
     Serial.println("Client disconnected, re-advertising");
   }
@@ -87,12 +107,53 @@ class ServerCallbacks : public BLEServerCallbacks {
 class SyncCallbacks : public BLECharacteristicCallbacks {
   void onWrite(BLECharacteristic* characteristic) override {
     std::string value = characteristic->getValue();
-    if (value.find("SYNC") != std::string::npos) {
+    bool binary;
+    if (parseFormatCommand(value.c_str(), binary)) {
+      binaryFormat = binary;
+      formatReplyPending = true;
+    } else if (value.find("SYNC") != std::string::npos) {
       syncPending = true;
     }
   }
 };
 
+void queuePass(const PassEvent& pass) {
+  portENTER_CRITICAL(&eventQueueMux);
+  if (passQueueCount < PASS_QUEUE_SIZE) {
+    passQueue[passQueueCount] = pass;
+    passQueueCount++;
+  }
+  portEXIT_CRITICAL(&eventQueueMux);
+}
+
+void onLocalPassComplete(const PassInfo& pass) {
+  queuePass(toPassEvent(PARENT_NODE_ID, pass));
+}
+
+void queueHealth(const HealthEvent& health) {
+  portENTER_CRITICAL(&eventQueueMux);
+  if (healthQueueCount < HEALTH_QUEUE_SIZE) {
+    healthQueue[healthQueueCount] = health;
+    healthQueueCount++;
+  }
+  portEXIT_CRITICAL(&eventQueueMux);
+}
+
+void onLocalHealthReport(const HealthInfo& health) {
+  queueHealth(toHealthEvent(PARENT_NODE_ID, health));
+}
+
+void queueEvent(const CarEvent& event, const EventQuality& quality) {
+  portENTER_CRITICAL(&eventQueueMux);
+  if (eventQueueCount < EVENT_QUEUE_SIZE) {
+    eventQueue[eventQueueCount] = event;
+    eventReceiveUs[eventQueueCount] = esp_timer_get_time();
+    eventQualities[eventQueueCount] = quality;
+    eventQueueCount++;
+  }
+  portEXIT_CRITICAL(&eventQueueMux);
+}
+
 void onLocalCarDetected(uint8_t sensorId, int car, float freq) {
   CarEvent event;
   event.nodeId = PARENT_NODE_ID;
@@ -108,11 +169,7 @@ void onLocalCarDetected(uint8_t sensorId, int car, float freq) {
   totalDetections++;
   displayNeedsUpdate = true;
 
-  if (eventQueueCount < EVENT_QUEUE_SIZE) {
-    eventQueue[eventQueueCount] = event;
-    eventReceiveMs[eventQueueCount] = millis();
-    eventQueueCount++;
-  }
+  queueEvent(event, lastEventQuality(sensorId));
 }
 
 void updateDisplay() {
@@ -173,10 +230,18 @@ void setup() {
   }
 
   // Setup local sensors
+  Serial.printf("# Local sensors: %d (%u bytes detector state)\n", NUM_SENSORS, (unsigned)sizeof(sensors));
   initSensors();
   for (int i = 0; i < NUM_SENSORS; i++) {
     Serial.printf("# S%d - GPIO %d\n", i, SENSOR_PINS[i]);
   }
+#if CAR_CALIBRATION
+  Serial.printf("# Car calibration: %s\n", loadCalibration() ? "loaded from NVS" : "nominal bands");
+#endif
+#if DETECTION_TASK
+  startDetectionTask(onLocalCarDetected, onLocalPassComplete, onLocalHealthReport);
+  Serial.printf("# Detection task: core %d\n", DETECTION_TASK_CORE);
+#endif
 
   // Init BLE
   BLEDevice::init("Scalextric-Local");
@@ -227,27 +292,70 @@ void setup() {
     Serial.println("# OLED: running on core 0");
   }
 
-  Serial.println("# Format: SEQ:NODE:SENSOR:CAR:FREQ:RECV_MILLIS");
+  Serial.println("# Format: SEQ:NODE:SENSOR:CAR:FREQ:RECV_MILLIS[:Q:PULSES:VALID%:GLITCHES:OOB:IQR_US:MARGIN:OVERLAP%]");
+  Serial.println("# Passes: P:NODE:SENSOR:CAR:FIRST_US:LAST_US:SPEED_MMPS:B|T:PULSES");
+  Serial.println("# Health: H:NODE:SENSOR:STATUS:EDGES/S:GLITCHES/S:OOB/S:IDLE_S:THROTTLES");
   Serial.println("# Listening...\n");
 }
 
 void loop() {
-  for (int i = 0; i < NUM_SENSORS; i++) {
-    processSensor(sensors[i], onLocalCarDetected);
-  }
+#if !DETECTION_TASK
+  processDeadlines(onLocalCarDetected, onLocalPassComplete);
+  processAllSensors(onLocalCarDetected);
+#if SENSOR_HEALTH
+  monitorSensorHealth(onLocalHealthReport);
+#endif
+#endif
+#if CAR_CALIBRATION
+  saveCalibrationIfDue();
+#endif
+
+  CarEvent pending[EVENT_QUEUE_SIZE];
+  uint64_t pendingUs[EVENT_QUEUE_SIZE];
+  EventQuality pendingQualities[EVENT_QUEUE_SIZE];
+  portENTER_CRITICAL(&eventQueueMux);
+  int pendingCount = eventQueueCount;
+  memcpy(pending, eventQueue, pendingCount * sizeof(CarEvent));
+  memcpy(pendingUs, eventReceiveUs, pendingCount * sizeof(uint64_t));
+  memcpy(pendingQualities, eventQualities, pendingCount * sizeof(EventQuality));
+  eventQueueCount = 0;
+  PassEvent pendingPasses[PASS_QUEUE_SIZE];
+  int pendingPassCount = passQueueCount;
+  memcpy(pendingPasses, passQueue, pendingPassCount * sizeof(PassEvent));
+  passQueueCount = 0;
+  HealthEvent pendingHealth[HEALTH_QUEUE_SIZE];
+  int pendingHealthCount = healthQueueCount;
+  memcpy(pendingHealth, healthQueue, pendingHealthCount * sizeof(HealthEvent));
+  healthQueueCount = 0;
+  portEXIT_CRITICAL(&eventQueueMux);
 
-  if (clientConnected && eventQueueCount > 0) {
-    for (int i = 0; i < eventQueueCount; i++) {
-      CarEvent& event = eventQueue[i];
+  if (clientConnected) {
+    for (int i = 0; i < pendingCount; i++) {
+      CarEvent& event = pending[i];
+      if (binaryFormat) {
+        uint8_t record[RECORD_MAX_SIZE];
+        int n = encodeCarRecord(record, sizeof(record), seqNumber++, event, pendingUs[i], pendingQualities[i]);
+        eventCharacteristic->setValue(record, n);
+      } else {
+        char msg[96];
+        formatCarEvent(msg, sizeof(msg), seqNumber++, event, pendingUs[i], pendingQualities[i]);
+        eventCharacteristic->setValue(msg);
+      }
+      eventCharacteristic->notify();
+    }
+    for (int i = 0; i < pendingPassCount; i++) {
+      char msg[96];
+      formatPassEvent(msg, sizeof(msg), pendingPasses[i]);
+      eventCharacteristic->setValue(msg);
+      eventCharacteristic->notify();
+    }
+    for (int i = 0; i < pendingHealthCount; i++) {
       char msg[64];
-      snprintf(msg, sizeof(msg), "%lu:%d:%d:%d:%d:%lu",
-               seqNumber++, event.nodeId, event.sensorId, event.carNumber,
-               event.frequency, (unsigned long)eventReceiveMs[i]);
+      formatHealthEvent(msg, sizeof(msg), pendingHealth[i]);
       eventCharacteristic->setValue(msg);
       eventCharacteristic->notify();
     }
   }
-  eventQueueCount = 0;
 
   // Send keepalive ping to maintain short connection interval
   if (keepalivePending) {
@@ -266,5 +374,13 @@ void loop() {
     syncCharacteristic->notify();
   }
 
+  if (formatReplyPending) {
+    formatReplyPending = false;
+    char reply[24];
+    formatFormatReply(reply, sizeof(reply), binaryFormat);
+    syncCharacteristic->setValue(reply);
+    syncCharacteristic->notify();
+  }
+
   delay(1);
 }
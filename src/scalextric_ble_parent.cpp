@@ -10,6 +10,10 @@
 #include <esp_gap_ble_api.h>
 #include "scalextric_protocol.h"
 #include "car_detection.h"
+#include "race_engine.h"
+#include "espnow_batch.h"
+#include "clock_sync.h"
+#include "channel_scan.h"
 
 // Scalextric BLE Parent Node
 // Detects cars locally AND receives events from child nodes via ESP-NOW
@@ -20,7 +24,13 @@
 // Set ESPNOW_ENABLED=1 for ESP-NOW + BLE (~55ms coexistence delay, supports children)
 // Set TEST_TIMER=1 to generate fake events every 1s (for latency testing without sensors)
 //
-// Output format: SEQ:NODE:SENSOR:CAR:FREQ:RECV_MILLIS
+// Output format: SEQ:NODE:SENSOR:CAR:FREQ:RECV_MILLIS[:Q:...] (see formatCarEvent)
+// A client that writes FORMAT:BIN to the sync characteristic gets binary CarRecords
+// (encodeCarRecord) instead; FORMAT:TEXT, or reconnecting, goes back to text.
+// Sensor health as H: lines, every 10s per sensor and on a change - see formatHealthEvent.
+// Race updates (laps, sectors, positions) as R: lines - see race_engine.h.
+// Write LINE:NODE:SENSOR:INDEX or RESET to the sync characteristic to set up the
+// race; the full standings are sent on connect and on RACE.
 
 #ifndef ESPNOW_ENABLED
 #define ESPNOW_ENABLED 1  // Override via build_flags: -DESPNOW_ENABLED=0
@@ -76,12 +86,35 @@ int carCounts[NUM_CARS] = {0};
 // Event queue - decouple detection from BLE sends
 const int EVENT_QUEUE_SIZE = 8;
 CarEvent eventQueue[EVENT_QUEUE_SIZE];
-uint32_t eventReceiveMs[EVENT_QUEUE_SIZE];  // millis() when event was received/detected
+EventQuality eventQualities[EVENT_QUEUE_SIZE];  // zero for events without quality data
+uint64_t eventReceiveUs[EVENT_QUEUE_SIZE];  // micros when event was detected here, by a synced child, or received
 volatile int eventQueueCount = 0;
+portMUX_TYPE eventQueueMux = portMUX_INITIALIZER_UNLOCKED;  // detection task / ESP-NOW vs loop()
+BatchTracker espNowBatches;  // children's batch frames (espnow_batch.h)
+
+// Completed passes (speed / duration), same lock as the event queue
+const int PASS_QUEUE_SIZE = 4;
+PassEvent passQueue[PASS_QUEUE_SIZE];
+volatile int passQueueCount = 0;
+
+// Sensor health reports (local and children), same lock as the event queue
+const int HEALTH_QUEUE_SIZE = 16;
+HealthEvent healthQueue[HEALTH_QUEUE_SIZE];
+volatile int healthQueueCount = 0;
 
 // Pending SYNC response
 volatile bool syncPending = false;
 
+// Event format (FORMAT:BIN / FORMAT:TEXT), text for each new connection
+volatile bool binaryFormat = false;
+volatile bool formatReplyPending = false;
+
+// Race engine runs in loop(); commands from the BLE task wait here
+RaceEngine race;
+char raceCommand[32];
+volatile bool raceCommandPending = false;
+volatile bool raceSnapshotPending = false;
+
 // Sequence number for drop detection
 uint32_t seqNumber = 0;
 
@@ -103,7 +136,11 @@ int testEventCount = 0;
 
 void IRAM_ATTR onTestTimer() {
   if (!clientConnected) return;
-  if (eventQueueCount >= EVENT_QUEUE_SIZE) return;
+  portENTER_CRITICAL_ISR(&eventQueueMux);
+  if (eventQueueCount >= EVENT_QUEUE_SIZE) {
+    portEXIT_CRITICAL_ISR(&eventQueueMux);
+    return;
+  }
 
   int idx = eventQueueCount;
   int car = (testEventCount % 6) + 1;
@@ -112,8 +149,10 @@ void IRAM_ATTR onTestTimer() {
   eventQueue[idx].carNumber = car;
   eventQueue[idx].frequency = (uint16_t[]){5500, 4400, 3700, 3100, 2800, 2400}[car - 1];
   eventQueue[idx].timestamp = millis();
-  eventReceiveMs[idx] = millis();
+  eventReceiveUs[idx] = esp_timer_get_time();
+  eventQualities[idx] = EventQuality();
   eventQueueCount++;
+  portEXIT_CRITICAL_ISR(&eventQueueMux);
   testEventCount++;
 }
 #endif
@@ -121,6 +160,7 @@ void IRAM_ATTR onTestTimer() {
 class ServerCallbacks : public BLEServerCallbacks {
   void onConnect(BLEServer* server, esp_ble_gatts_cb_param_t* param) override {
     clientConnected = true;
+    raceSnapshotPending = true;
     // Request fast connection interval: 7.5ms min, 15ms max
     esp_ble_conn_update_params_t connParams = {};
     memcpy(connParams.bda, param->connect.remote_bda, sizeof(esp_bd_addr_t));
@@ -132,6 +172,7 @@ class ServerCallbacks : public BLEServerCallbacks {
   }
   void onDisconnect(BLEServer* server) override {
     clientConnected = false;
+    binaryFormat = false;
     server->getAdvertising()->start();
   }
 };
@@ -139,8 +180,17 @@ class ServerCallbacks : public BLEServerCallbacks {
 class SyncCallbacks : public BLECharacteristicCallbacks {
   void onWrite(BLECharacteristic* characteristic) override {
     std::string value = characteristic->getValue();
-    if (value.find("SYNC") != std::string::npos) {
+    bool binary;
+    if (parseFormatCommand(value.c_str(), binary)) {
+      binaryFormat = binary;
+      formatReplyPending = true;
+    } else if (value.find("SYNC") != std::string::npos) {
       syncPending = true;
+    } else if (value.find("RACE") != std::string::npos) {
+      raceSnapshotPending = true;
+    } else if (!raceCommandPending && value.size() < sizeof(raceCommand)) {
+      memcpy(raceCommand, value.c_str(), value.size() + 1);
+      raceCommandPending = true;
     }
   }
 };
@@ -160,6 +210,52 @@ void logEvent(CarEvent& event) {
   displayNeedsUpdate = true;
 }
 
+void notifyRaceUpdate(const RaceUpdate& update) {
+  if (!clientConnected) return;
+  char msg[64];
+  formatRaceUpdate(msg, sizeof(msg), update);
+  eventCharacteristic->setValue(msg);
+  eventCharacteristic->notify();
+}
+
+void queuePass(const PassEvent& pass) {
+  portENTER_CRITICAL(&eventQueueMux);
+  if (passQueueCount < PASS_QUEUE_SIZE) {
+    passQueue[passQueueCount] = pass;
+    passQueueCount++;
+  }
+  portEXIT_CRITICAL(&eventQueueMux);
+}
+
+void onLocalPassComplete(const PassInfo& pass) {
+  queuePass(toPassEvent(PARENT_NODE_ID, pass));
+}
+
+void queueHealth(const HealthEvent& health) {
+  portENTER_CRITICAL(&eventQueueMux);
+  if (healthQueueCount < HEALTH_QUEUE_SIZE) {
+    healthQueue[healthQueueCount] = health;
+    healthQueueCount++;
+  }
+  portEXIT_CRITICAL(&eventQueueMux);
+}
+
+void onLocalHealthReport(const HealthInfo& health) {
+  queueHealth(toHealthEvent(PARENT_NODE_ID, health));
+}
+
+// detectedUs: a child's detection time on our clock (CarEventTimed), 0 = now
+void queueEvent(const CarEvent& event, const EventQuality& quality, uint64_t detectedUs = 0) {
+  portENTER_CRITICAL(&eventQueueMux);
+  if (eventQueueCount < EVENT_QUEUE_SIZE) {
+    eventQueue[eventQueueCount] = event;
+    eventReceiveUs[eventQueueCount] = eventTimeUs(detectedUs, esp_timer_get_time());
+    eventQualities[eventQueueCount] = quality;
+    eventQueueCount++;
+  }
+  portEXIT_CRITICAL(&eventQueueMux);
+}
+
 void onLocalCarDetected(uint8_t sensorId, int car, float freq) {
   CarEvent event;
   event.nodeId = PARENT_NODE_ID;
@@ -170,11 +266,7 @@ void onLocalCarDetected(uint8_t sensorId, int car, float freq) {
 
   logEvent(event);
 
-  if (eventQueueCount < EVENT_QUEUE_SIZE) {
-    eventQueue[eventQueueCount] = event;
-    eventReceiveMs[eventQueueCount] = millis();
-    eventQueueCount++;
-  }
+  queueEvent(event, lastEventQuality(sensorId));
 }
 
 #if ESPNOW_ENABLED
@@ -196,19 +288,35 @@ void onDataReceived(const uint8_t* mac, const uint8_t* data, int len) {
     return;
   }
 
-  espNowRecvCount++;
-  if (len != sizeof(CarEvent)) return;
+#if CLOCK_SYNC
+  // Clock sync from a child (clock_sync.h): its request back, with our clock added
+  if (replyClockSync(mac, data, len)) return;
+#endif
+
+  // A child's batch: each message as if it had come on its own
+  if (unpackBatch(mac, data, len, espNowBatches, onDataReceived)) return;
 
+  espNowRecvCount++;
+  if (len == sizeof(PassEvent) && data[0] == PASS_EVENT_MAGIC) {
+    PassEvent pass;
+    memcpy(&pass, data, sizeof(pass));
+    queuePass(pass);
+    return;
+  }
+  if (len == sizeof(HealthEvent) && data[0] == HEALTH_EVENT_MAGIC) {
+    HealthEvent health;
+    memcpy(&health, data, sizeof(health));
+    queueHealth(health);
+    return;
+  }
   CarEvent event;
-  memcpy(&event, data, sizeof(event));
+  EventQuality quality;
+  uint64_t detectedUs;
+  if (!readCarEvent(data, len, event, quality, &detectedUs)) return;
 
   logEvent(event);
 
-  if (eventQueueCount < EVENT_QUEUE_SIZE) {
-    eventQueue[eventQueueCount] = event;
-    eventReceiveMs[eventQueueCount] = millis();
-    eventQueueCount++;
-  }
+  queueEvent(event, quality, detectedUs);
 
   // Check if this is a new child
   bool known = false;
@@ -262,6 +370,20 @@ void updateDisplay() {
   display.display();
 }
 
+// Edge -> callback latency, printed every 10s (compare builds with/without DETECTION_TASK)
+const unsigned long LATENCY_REPORT_INTERVAL = 10000;
+unsigned long lastLatencyReport = 0;
+
+void reportLatency() {
+  if (millis() - lastLatencyReport < LATENCY_REPORT_INTERVAL) return;
+  lastLatencyReport = millis();
+  LatencyStats stats = detectionLatency;
+  if (stats.count == 0) return;
+  detectionLatency = {0, 0, 0};
+  Serial.printf("# LATENCY: n=%lu avg=%luus max=%luus\n", (unsigned long)stats.count,
+                (unsigned long)(stats.totalUs / stats.count), (unsigned long)stats.maxUs);
+}
+
 void displayTask(void* param) {
   for (;;) {
     if (displayNeedsUpdate) {
@@ -303,6 +425,7 @@ void setup() {
   // Init ESP-NOW
   if (esp_now_init() == ESP_OK) {
     esp_now_register_recv_cb(onDataReceived);
+    startProbeBeacon();
     Serial.println("# ESP-NOW: OK");
   } else {
     Serial.println("# ESP-NOW: FAILED");
@@ -312,11 +435,18 @@ void setup() {
 #endif
 
   // Setup local sensors
-  Serial.println("# Local sensors:");
+  Serial.printf("# Local sensors: %d (%u bytes detector state)\n", NUM_SENSORS, (unsigned)sizeof(sensors));
   initSensors();
   for (int i = 0; i < NUM_SENSORS; i++) {
     Serial.printf("#   S%d - GPIO %d\n", i, SENSOR_PINS[i]);
   }
+#if CAR_CALIBRATION
+  Serial.printf("# Car calibration: %s\n", loadCalibration() ? "loaded from NVS" : "nominal bands");
+#endif
+#if DETECTION_TASK
+  startDetectionTask(onLocalCarDetected, onLocalPassComplete, onLocalHealthReport);
+  Serial.printf("# Detection task: core %d\n", DETECTION_TASK_CORE);
+#endif
 
   // Init BLE
   BLEDevice::init("Scalextric-Parent");
@@ -384,30 +514,90 @@ void setup() {
   Serial.println("# KEEPALIVE: 1s interval");
 
   Serial.println("#");
-  Serial.println("# Format: SEQ:NODE:SENSOR:CAR:FREQ:RECV_MILLIS");
+  Serial.println("# Format: SEQ:NODE:SENSOR:CAR:FREQ:RECV_MILLIS[:Q:PULSES:VALID%:GLITCHES:OOB:IQR_US:MARGIN:OVERLAP%]");
+  Serial.println("# Passes: P:NODE:SENSOR:CAR:FIRST_US:LAST_US:SPEED_MMPS:B|T:PULSES");
+  Serial.println("# Health: H:NODE:SENSOR:STATUS:EDGES/S:GLITCHES/S:OOB/S:IDLE_S:THROTTLES");
   Serial.println("# Parent node = 255, Children = 0,1,2...");
   Serial.println("# Listening for cars...\n");
 }
 
 void loop() {
+#if !DETECTION_TASK
   // Process sensors FIRST - detection is time-critical
-  for (int i = 0; i < NUM_SENSORS; i++) {
-    processSensor(sensors[i], onLocalCarDetected);
-  }
+  processDeadlines(onLocalCarDetected, onLocalPassComplete);
+  processAllSensors(onLocalCarDetected);
+#if SENSOR_HEALTH
+  monitorSensorHealth(onLocalHealthReport);
+#endif
+#endif
+#if CAR_CALIBRATION
+  saveCalibrationIfDue();
+#endif
 
-  // Flush queued events via BLE notification
-  if (clientConnected && eventQueueCount > 0) {
-    for (int i = 0; i < eventQueueCount; i++) {
-      CarEvent& event = eventQueue[i];
+  // Take the queued events, then flush them via BLE notification outside the lock
+  CarEvent pending[EVENT_QUEUE_SIZE];
+  uint64_t pendingUs[EVENT_QUEUE_SIZE];
+  EventQuality pendingQualities[EVENT_QUEUE_SIZE];
+  portENTER_CRITICAL(&eventQueueMux);
+  int pendingCount = eventQueueCount;
+  memcpy(pending, eventQueue, pendingCount * sizeof(CarEvent));
+  memcpy(pendingUs, eventReceiveUs, pendingCount * sizeof(uint64_t));
+  memcpy(pendingQualities, eventQualities, pendingCount * sizeof(EventQuality));
+  eventQueueCount = 0;
+  PassEvent pendingPasses[PASS_QUEUE_SIZE];
+  int pendingPassCount = passQueueCount;
+  memcpy(pendingPasses, passQueue, pendingPassCount * sizeof(PassEvent));
+  passQueueCount = 0;
+  HealthEvent pendingHealth[HEALTH_QUEUE_SIZE];
+  int pendingHealthCount = healthQueueCount;
+  memcpy(pendingHealth, healthQueue, pendingHealthCount * sizeof(HealthEvent));
+  healthQueueCount = 0;
+  portEXIT_CRITICAL(&eventQueueMux);
+
+  if (clientConnected) {
+    for (int i = 0; i < pendingCount; i++) {
+      CarEvent& event = pending[i];
+      if (binaryFormat) {
+        uint8_t record[RECORD_MAX_SIZE];
+        int n = encodeCarRecord(record, sizeof(record), seqNumber++, event, pendingUs[i], pendingQualities[i]);
+        eventCharacteristic->setValue(record, n);
+      } else {
+        char msg[96];
+        formatCarEvent(msg, sizeof(msg), seqNumber++, event, pendingUs[i], pendingQualities[i]);
+        eventCharacteristic->setValue(msg);
+      }
+      eventCharacteristic->notify();
+    }
+    for (int i = 0; i < pendingPassCount; i++) {
+      char msg[96];
+      formatPassEvent(msg, sizeof(msg), pendingPasses[i]);
+      eventCharacteristic->setValue(msg);
+      eventCharacteristic->notify();
+    }
+    for (int i = 0; i < pendingHealthCount; i++) {
       char msg[64];
-      snprintf(msg, sizeof(msg), "%lu:%d:%d:%d:%d:%lu",
-               seqNumber++, event.nodeId, event.sensorId, event.carNumber,
-               event.frequency, (unsigned long)eventReceiveMs[i]);
+      formatHealthEvent(msg, sizeof(msg), pendingHealth[i]);
       eventCharacteristic->setValue(msg);
       eventCharacteristic->notify();
     }
   }
-  eventQueueCount = 0;
+
+  // Standings keep running while no client is connected; it gets a snapshot on connect
+  if (raceCommandPending) {
+    race.handleCommand(raceCommand);
+    raceCommandPending = false;
+    raceSnapshotPending = true;
+  }
+  for (int i = 0; i < pendingCount; i++) {
+    race.onCrossing(pending[i].nodeId, pending[i].sensorId, pending[i].carNumber, (uint32_t)(pendingUs[i] / 1000),
+                    notifyRaceUpdate);
+  }
+  if (raceSnapshotPending && clientConnected) {
+    raceSnapshotPending = false;
+    race.snapshot(notifyRaceUpdate);
+  }
+
+  reportLatency();
 
   // Send keepalive ping to maintain short connection interval
   if (keepalivePending) {
@@ -427,5 +617,21 @@ void loop() {
     syncCharacteristic->notify();
   }
 
+  if (formatReplyPending) {
+    formatReplyPending = false;
+    char reply[24];
+    formatFormatReply(reply, sizeof(reply), binaryFormat);
+    syncCharacteristic->setValue(reply);
+    syncCharacteristic->notify();
+  }
+
+#if ESPNOW_ENABLED
+  // Our probe answer to any child waiting on our channel (channel_scan.h)
+  sendProbeBeacon(PARENT_NODE_ID, ESPNOW_CHANNEL);
+#endif
+
+  // Children's batches lost on the air or resent (espnow_batch.h)
+  logBatchLoss(espNowBatches);
+
   delay(1);  // Give BLE stack time to process
 }
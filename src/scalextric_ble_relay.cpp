@@ -9,6 +9,9 @@
 #include <esp_bt_main.h>
 #include <esp_gap_ble_api.h>
 #include "scalextric_protocol.h"
+#include "espnow_batch.h"
+#include "clock_sync.h"
+#include "channel_scan.h"
 
 // Scalextric ESP-NOW → BLE Relay
 // Receives car events from sensor nodes via ESP-NOW and notifies via BLE
@@ -16,7 +19,9 @@
 // No local sensors, no OLED - pure relay
 //
 // BLE Service: one event characteristic (notify) + one sync characteristic (write+notify)
-// Output format: SEQ:NODE:SENSOR:CAR:FREQ:RECV_MILLIS
+// Output format: SEQ:NODE:SENSOR:CAR:FREQ:RECV_MILLIS[:Q:...] (see formatCarEvent)
+// A client that writes FORMAT:BIN to the sync characteristic gets binary CarRecords
+// (encodeCarRecord) instead; FORMAT:TEXT, or reconnecting, goes back to text.
 
 #define SERVICE_UUID        "a1b2c3d4-e5f6-7890-abcd-ef1234567890"
 #define EVENT_CHAR_UUID     "a1b2c3d4-e5f6-7890-abcd-ef1234567891"
@@ -31,12 +36,26 @@ bool clientConnected = false;
 // Event queue - decouple ESP-NOW callback from BLE notifications
 const int EVENT_QUEUE_SIZE = 8;
 CarEvent eventQueue[EVENT_QUEUE_SIZE];
-uint32_t eventReceiveMs[EVENT_QUEUE_SIZE];  // millis() when ESP-NOW received
+EventQuality eventQualities[EVENT_QUEUE_SIZE];  // zero for events without quality data
+uint64_t eventReceiveUs[EVENT_QUEUE_SIZE];  // micros when ESP-NOW received, or a synced child detected it
 volatile int eventQueueCount = 0;
+BatchTracker espNowBatches;  // children's batch frames (espnow_batch.h)
+
+// Children's completed passes and sensor health reports, passed on as P: and H: lines
+const int PASS_QUEUE_SIZE = 4;
+PassEvent passQueue[PASS_QUEUE_SIZE];
+volatile int passQueueCount = 0;
+const int HEALTH_QUEUE_SIZE = 16;
+HealthEvent healthQueue[HEALTH_QUEUE_SIZE];
+volatile int healthQueueCount = 0;
 
 // Pending SYNC response
 volatile bool syncPending = false;
 
+// Event format (FORMAT:BIN / FORMAT:TEXT), text for each new connection
+volatile bool binaryFormat = false;
+volatile bool formatReplyPending = false;
+
 // Sequence number for drop detection
 uint32_t seqNumber = 0;
 
@@ -66,6 +85,7 @@ class ServerCallbacks : public BLEServerCallbacks {
   }
   void onDisconnect(BLEServer* server) override {
     clientConnected = false;
+    binaryFormat = false;
     // Restart advertising so client can reconnect
     server->getAdvertising()->start();
   }
@@ -74,7 +94,11 @@ class ServerCallbacks : public BLEServerCallbacks {
 class SyncCallbacks : public BLECharacteristicCallbacks {
   void onWrite(BLECharacteristic* characteristic) override {
     std::string value = characteristic->getValue();
-    if (value.find("SYNC") != std::string::npos) {
+    bool binary;
+    if (parseFormatCommand(value.c_str(), binary)) {
+      binaryFormat = binary;
+      formatReplyPending = true;
+    } else if (value.find("SYNC") != std::string::npos) {
       syncPending = true;
     }
   }
@@ -98,15 +122,39 @@ void onDataReceived(const uint8_t* mac, const uint8_t* data, int len) {
     return;
   }
 
-  if (len != sizeof(CarEvent)) return;
+#if CLOCK_SYNC
+  // Clock sync from a child (clock_sync.h): its request back, with our clock added
+  if (replyClockSync(mac, data, len)) return;
+#endif
+
+  // A child's batch: each message as if it had come on its own
+  if (unpackBatch(mac, data, len, espNowBatches, onDataReceived)) return;
+
+  if (len == sizeof(PassEvent) && data[0] == PASS_EVENT_MAGIC) {
+    if (passQueueCount < PASS_QUEUE_SIZE) {
+      memcpy(&passQueue[passQueueCount], data, sizeof(PassEvent));
+      passQueueCount++;
+    }
+    return;
+  }
+  if (len == sizeof(HealthEvent) && data[0] == HEALTH_EVENT_MAGIC) {
+    if (healthQueueCount < HEALTH_QUEUE_SIZE) {
+      memcpy(&healthQueue[healthQueueCount], data, sizeof(HealthEvent));
+      healthQueueCount++;
+    }
+    return;
+  }
 
   CarEvent event;
-  memcpy(&event, data, sizeof(event));
+  EventQuality quality;
+  uint64_t detectedUs;
+  if (!readCarEvent(data, len, event, quality, &detectedUs)) return;
 
   // Queue for BLE notification (don't do BLE in callback)
   if (eventQueueCount < EVENT_QUEUE_SIZE) {
     eventQueue[eventQueueCount] = event;
-    eventReceiveMs[eventQueueCount] = millis();
+    eventQualities[eventQueueCount] = quality;
+    eventReceiveUs[eventQueueCount] = eventTimeUs(detectedUs, esp_timer_get_time());
     eventQueueCount++;
   }
 }
@@ -125,6 +173,7 @@ void setup() {
   // Init ESP-NOW
   if (esp_now_init() == ESP_OK) {
     esp_now_register_recv_cb(onDataReceived);
+    startProbeBeacon();
     Serial.println("# ESP-NOW: OK");
   } else {
     Serial.println("# ESP-NOW: FAILED");
@@ -170,7 +219,7 @@ void setup() {
   Serial.println("# KEEPALIVE: 1s interval");
 
   Serial.println("#");
-  Serial.println("# Format: SEQ:NODE:SENSOR:CAR:FREQ:RECV_MILLIS");
+  Serial.println("# Format: SEQ:NODE:SENSOR:CAR:FREQ:RECV_MILLIS[:Q:PULSES:VALID%:GLITCHES:OOB:IQR_US:MARGIN:OVERLAP%]");
   Serial.println("# Waiting for sensor nodes...\n");
 }
 
@@ -179,15 +228,35 @@ void loop() {
   if (clientConnected && eventQueueCount > 0) {
     for (int i = 0; i < eventQueueCount; i++) {
       CarEvent& event = eventQueue[i];
+      if (binaryFormat) {
+        uint8_t record[RECORD_MAX_SIZE];
+        int n = encodeCarRecord(record, sizeof(record), seqNumber++, event, eventReceiveUs[i], eventQualities[i]);
+        eventCharacteristic->setValue(record, n);
+      } else {
+        char msg[96];
+        formatCarEvent(msg, sizeof(msg), seqNumber++, event, eventReceiveUs[i], eventQualities[i]);
+        eventCharacteristic->setValue(msg);
+      }
+      eventCharacteristic->notify();
+    }
+  }
+  eventQueueCount = 0;
+  if (clientConnected) {
+    for (int i = 0; i < passQueueCount; i++) {
+      char msg[96];
+      formatPassEvent(msg, sizeof(msg), passQueue[i]);
+      eventCharacteristic->setValue(msg);
+      eventCharacteristic->notify();
+    }
+    for (int i = 0; i < healthQueueCount; i++) {
       char msg[64];
-      snprintf(msg, sizeof(msg), "%lu:%d:%d:%d:%d:%lu",
-               seqNumber++, event.nodeId, event.sensorId, event.carNumber,
-               event.frequency, (unsigned long)eventReceiveMs[i]);
+      formatHealthEvent(msg, sizeof(msg), healthQueue[i]);
       eventCharacteristic->setValue(msg);
       eventCharacteristic->notify();
     }
   }
-  eventQueueCount = 0;
+  passQueueCount = 0;
+  healthQueueCount = 0;
 
   // Send keepalive ping to maintain short connection interval
   if (keepalivePending) {
@@ -207,5 +276,19 @@ void loop() {
     syncCharacteristic->notify();
   }
 
+  if (formatReplyPending) {
+    formatReplyPending = false;
+    char reply[24];
+    formatFormatReply(reply, sizeof(reply), binaryFormat);
+    syncCharacteristic->setValue(reply);
+    syncCharacteristic->notify();
+  }
+
+  // Our probe answer to any child waiting on our channel (channel_scan.h)
+  sendProbeBeacon(PARENT_NODE_ID, ESPNOW_CHANNEL);
+
+  // Children's batches lost on the air or resent (espnow_batch.h)
+  logBatchLoss(espNowBatches);
+
   delay(1);  // Give BLE stack time to process
 }
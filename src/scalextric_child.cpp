@@ -7,6 +7,10 @@
 #include <Adafruit_SSD1306.h>
 #include "scalextric_protocol.h"
 #include "car_detection.h"
+#include "espnow_batch.h"
+#include "espnow_reliable.h"
+#include "clock_sync.h"
+#include "channel_scan.h"
 
 // Scalextric Car Detector - ESP-NOW Child Node
 // Detects cars and broadcasts events via ESP-NOW (zero-config)
@@ -14,6 +18,11 @@
 //
 // Output format: NODE:SENSOR:CAR:FREQ:TIME
 // e.g., 0:2:3:3704:12345 = Node 0, Sensor 2, Car 3, 3704 Hz, timestamp
+// Sensor health (HealthEvent) every 10s per sensor and when a sensor's status changes
+// Messages to the parent are batched, one frame per ESPNOW_BATCH_US (espnow_batch.h),
+// and sent to its MAC with ACKs and resends once it has answered a probe (espnow_reliable.h)
+// Car events carry their time on the parent's clock once in sync with it (clock_sync.h)
+// Finds the parent's channel from the last one it was on, then a scan (channel_scan.h)
 //
 // Only config needed: set NODE_ID (0, 1, 2, etc.) for each child
 
@@ -49,17 +58,240 @@ int logCount = 0;
 
 // Display runs on core 0 via FreeRTOS task to avoid blocking sensor processing
 
-volatile bool probeResponseReceived = false;
-uint8_t foundChannel = 0;
+volatile bool probeResponseReceived = false;  // foundChannel / parentMac set, not acted on yet
+uint8_t foundChannel = 0;  // 0 = looking for a parent
+uint8_t parentMac[6];      // whoever answered the probe
+bool parentKnown = false;  // batches go to parentMac, else broadcast
+
+// The last parent found, from NVS (channel_scan.h): its channel is tried first, and
+// its MAC gets a unicast probe whose ACK settles it
+LinkCache linkCache;
+volatile bool probeInFlight = false;  // that probe sent, its send callback not back yet
+volatile bool probeAcked = false;
 
 esp_now_peer_info_t peerInfo;
 bool espNowAvailable = false;
 
-// Parent discovery retry
+// Parent discovery retry; in between, beacons on the channel we wait on find it
 unsigned long lastScanAttempt = 0;
 const unsigned long SCAN_RETRY_INTERVAL = 30000;  // 30 seconds
 
+// Messages for the parent collect here (espnow_batch.h), and finished batches for a
+// known parent wait in reliableSender (espnow_reliable.h). The detection task,
+// loop() and the send callback all reach them, so only under batchLock; frames are
+// sent outside it.
+EspNowBatch espNowBatch;
+ReliableSender reliableSender;
+portMUX_TYPE batchLock = portMUX_INITIALIZER_UNLOCKED;
+unsigned long lastLinkReport = 0;
+uint32_t reportedQueued = 0;
+
+// Parent time only goes in batches unicast to the parent it came from
+#define PARENT_CLOCK (CLOCK_SYNC && ESPNOW_RELIABLE && ESPNOW_BATCH_US)
+
+// Clock sync with the parent (clock_sync.h): loop() runs the exchanges and hands the
+// mapping to the detection task through parentClock, under syncLock
+ClockSync clockSync;
+ClockMap parentClock;
+portMUX_TYPE syncLock = portMUX_INITIALIZER_UNLOCKED;
+uint16_t syncSeq = 0;
+volatile bool syncInFlight = false;    // request sent, its send callback not back yet
+volatile bool syncReplyReady = false;  // syncReply / syncReplyUs for loop()
+SyncMsg syncReply;
+uint64_t syncReplyUs = 0;
+unsigned long lastSyncRequest = 0;
+unsigned long lastSyncReport = 0;
+
+// Counted sent / failed in onDataSent; here only if ESP-NOW refuses the frame
+esp_err_t sendFrame(const uint8_t* dest, const uint8_t* data, int len) {
+  esp_err_t result = esp_now_send(dest, data, len);
+  if (result != ESP_OK) sendFailCount++;
+  return result;
+}
+
+// A finished batch: queued for the parent, or broadcast while there is none
+void sendBatch(const uint8_t* frame, int len) {
+#if ESPNOW_RELIABLE
+  if (parentKnown) {
+    portENTER_CRITICAL(&batchLock);
+    reliableQueue(reliableSender, frame, len, esp_timer_get_time());
+    portEXIT_CRITICAL(&batchLock);
+    return;
+  }
+#endif
+  sendFrame(BROADCAST, frame, len);
+}
+
+// Hand queued batches to ESP-NOW as the window allows. Only loop() sends them, so
+// they reach the radio, and their callbacks come back, in window order. None goes
+// while a sync request or probe is in flight, so its callback isn't taken for a batch's.
+void pumpReliable() {
+  uint8_t frame[ESPNOW_MAX_PAYLOAD];
+  while (parentKnown && !syncInFlight && !probeInFlight) {
+    portENTER_CRITICAL(&batchLock);
+    int len = reliableNext(reliableSender, esp_timer_get_time(), frame);
+    portEXIT_CRITICAL(&batchLock);
+    if (len == 0) return;
+    if (sendFrame(parentMac, frame, len) != ESP_OK) {
+      portENTER_CRITICAL(&batchLock);
+      reliableSendFailed(reliableSender, esp_timer_get_time());
+      portEXIT_CRITICAL(&batchLock);
+      return;
+    }
+  }
+}
+
+// Start over with a new parent, or none: events go without parent time until the
+// exchanges are back in sync
+void resetClockSync() {
+  clockSyncInit(clockSync);
+  portENTER_CRITICAL(&syncLock);
+  parentClock = clockSync.map;
+  portEXIT_CRITICAL(&syncLock);
+}
+
+bool addPeer(const uint8_t* mac) {
+  if (esp_now_is_peer_exist(mac)) return true;
+  esp_now_peer_info_t peer = {};
+  memcpy(peer.peer_addr, mac, 6);
+  peer.channel = 0;
+  peer.encrypt = false;
+  return esp_now_add_peer(&peer) == ESP_OK;
+}
+
+// Unicast to the parent that answered the probe, so its radio ACKs our frames
+void addParentPeer() {
+  resetClockSync();
+  if (!addPeer(parentMac)) return;
+  parentKnown = true;
+  Serial.printf("Parent %02X:%02X:%02X:%02X:%02X:%02X\n", parentMac[0], parentMac[1], parentMac[2], parentMac[3],
+                parentMac[4], parentMac[5]);
+}
+
+// Several batches in a row went unacknowledged: drop the queue, go back to broadcast
+// and look for the parent again
+void checkParentLink() {
+  portENTER_CRITICAL(&batchLock);
+  bool lost = parentKnown && reliableLinkLost(reliableSender);
+  if (lost) {
+    reliableClear(reliableSender);
+    reliableSender.droppedInRow = 0;
+  }
+  portEXIT_CRITICAL(&batchLock);
+  if (!lost) return;
+  parentKnown = false;
+  resetClockSync();
+  probeResponseReceived = false;
+  foundChannel = 0;
+  lastScanAttempt = millis() - SCAN_RETRY_INTERVAL - 1;
+  Serial.println("Parent not acknowledging, rescanning");
+}
+
+// Delivery to the parent every 10s while there is traffic
+void reportParentLink() {
+  if (millis() - lastLinkReport < 10000) return;
+  lastLinkReport = millis();
+  portENTER_CRITICAL(&batchLock);
+  ReliableStats stats = reliableSender.stats;
+  portEXIT_CRITICAL(&batchLock);
+  if (stats.queued == reportedQueued) return;
+  reportedQueued = stats.queued;
+  Serial.printf("# LINK: %lu/%lu batches acked (%lu resent, %lu dropped), ack avg=%luus max=%luus\n",
+                (unsigned long)stats.delivered, (unsigned long)stats.queued, (unsigned long)stats.resent,
+                (unsigned long)stats.dropped,
+                (unsigned long)(stats.delivered ? stats.latencyTotalUs / stats.delivered : 0),
+                (unsigned long)stats.latencyMaxUs);
+}
+
+// A sync request every CLOCK_SYNC_INTERVAL_MS, sent while no batch is in flight
+void requestClockSync() {
+  if (!parentKnown || syncInFlight || millis() - lastSyncRequest < clockSyncIntervalMs(clockSync)) return;
+  portENTER_CRITICAL(&batchLock);
+  bool idle = reliableSender.inFlightCount == 0;
+  portEXIT_CRITICAL(&batchLock);
+  if (!idle) return;
+  lastSyncRequest = millis();
+  SyncMsg request = {SYNC_REQUEST_MAGIC, NODE_ID, ++syncSeq, 0, 0, 0};
+  syncInFlight = true;
+  request.childTxUs = esp_timer_get_time();
+  if (sendFrame(parentMac, (const uint8_t*)&request, sizeof(request)) != ESP_OK) syncInFlight = false;
+}
+
+// Take in the parent's reply; the fit runs here, not in the receive callback
+void updateClockSync() {
+  if (!syncReplyReady) return;
+  clockSyncAdd(clockSync, syncReply.childTxUs, syncReply.parentRxUs, syncReply.parentTxUs, syncReplyUs);
+  syncReplyReady = false;
+  portENTER_CRITICAL(&syncLock);
+  parentClock = clockSync.map;
+  portEXIT_CRITICAL(&syncLock);
+}
+
+// The mapping to the parent's clock, if in sync with it
+bool getParentClock(ClockMap& clock) {
+  portENTER_CRITICAL(&syncLock);
+  clock = parentClock;
+  portEXIT_CRITICAL(&syncLock);
+  return parentKnown && clockMapFresh(clock, esp_timer_get_time());
+}
+
+// Offset, drift and error bound every 10s while exchanging
+void reportClockSync() {
+  if (millis() - lastSyncReport < 10000 || clockSync.exchanges == 0) return;
+  lastSyncReport = millis();
+  const ClockMap& m = clockSync.map;
+  Serial.printf("# CLOCK: offset %lldus drift %+.2fppm +/-%luus (%lu exchanges, %lu rejected, %lu restarts)\n",
+                (long long)m.offsetUs, m.drift * 1e6, (unsigned long)m.errorUs, (unsigned long)clockSync.exchanges,
+                (unsigned long)clockSync.rejected, (unsigned long)clockSync.restarts);
+}
+
+// Queue a message for the parent (sending the batch first if it is full), or with
+// ESPNOW_BATCH_US=0 send it on its own
+esp_err_t sendEspNow(const void* msg, int len) {
+#if ESPNOW_BATCH_US
+  uint8_t full[ESPNOW_MAX_PAYLOAD];
+  int fullLen = 0;
+  portENTER_CRITICAL(&batchLock);
+  if (!batchFits(espNowBatch, len)) fullLen = batchTake(espNowBatch, full);
+  batchAdd(espNowBatch, msg, len, esp_timer_get_time(), ESPNOW_BATCH_US);
+  portEXIT_CRITICAL(&batchLock);
+  if (fullLen) sendBatch(full, fullLen);
+  return ESP_OK;
+#else
+  return sendFrame(BROADCAST, (const uint8_t*)msg, len);
+#endif
+}
+
+// Send the batch once its window is up
+void flushEspNowBatch() {
+  uint8_t frame[ESPNOW_MAX_PAYLOAD];
+  int len = 0;
+  portENTER_CRITICAL(&batchLock);
+  if (batchDue(espNowBatch, esp_timer_get_time())) len = batchTake(espNowBatch, frame);
+  portEXIT_CRITICAL(&batchLock);
+  if (len) sendBatch(frame, len);
+}
+
+// Parents tell the forms apart by length: CarEventTimed once in sync with the parent,
+// else as EVENT_QUALITY says
+esp_err_t sendCarFrame(const CarEvent& event, const EventQuality& quality, uint64_t detectedUs) {
+#if PARENT_CLOCK
+  ClockMap clock;
+  if (getParentClock(clock)) {
+    CarEventTimed timed = {event, quality, clockToParent(clock, detectedUs), syncErrorCode(clock.errorUs)};
+    return sendEspNow(&timed, sizeof(timed));
+  }
+#endif
+#if EVENT_QUALITY
+  CarEventWithQuality frame = {event, quality};
+#else
+  CarEvent frame = event;
+#endif
+  return sendEspNow(&frame, sizeof(frame));
+}
+
 void sendCarEvent(uint8_t sensorId, int car, float freq) {
+  uint64_t detectedUs = esp_timer_get_time();
   CarEvent event;
   event.nodeId = NODE_ID;
   event.sensorId = sensorId;
@@ -68,12 +300,10 @@ void sendCarEvent(uint8_t sensorId, int car, float freq) {
   event.timestamp = millis();
 
   if (espNowAvailable) {
-    esp_err_t result = esp_now_send(BROADCAST, (uint8_t*)&event, sizeof(event));
+    esp_err_t result = sendCarFrame(event, lastEventQuality(sensorId), detectedUs);
     if (result == ESP_OK) {
-      sendOkCount++;
       Serial.printf("SENT: %d:%d:%d:%d:%lu\n", NODE_ID, sensorId, car, (int)freq, event.timestamp);
     } else {
-      sendFailCount++;
       Serial.printf("SEND FAILED (err %d): %d:%d\n", result, NODE_ID, sensorId);
     }
   } else {
@@ -92,59 +322,151 @@ void sendCarEvent(uint8_t sensorId, int car, float freq) {
   displayNeedsUpdate = true;
 }
 
+// Once per pass, after the timeout: duration, edge times and speed
+void sendPassEvent(const PassInfo& pass) {
+  PassEvent event = toPassEvent(NODE_ID, pass);
+#if PARENT_CLOCK
+  ClockMap clock;
+  if (getParentClock(clock)) {
+    event.firstEdgeUs = clockToParent(clock, event.firstEdgeUs);
+    event.flags |= PASS_FLAG_PARENT_CLOCK;
+  }
+#endif
+  if (espNowAvailable) sendEspNow(&event, sizeof(event));
+  Serial.printf("PASS: %d:%d:%d %luus %umm/s (%s, %d pulses)\n", NODE_ID, pass.sensorId, pass.car,
+                (unsigned long)event.durationUs, pass.speedMmps, pass.speedFromTrap ? "trap" : "beam",
+                pass.pulseCount);
+}
+
+// Every HEALTH_REPORT_MS per sensor, and when a sensor's status changes
+void sendHealthReport(const HealthInfo& health) {
+  HealthEvent event = toHealthEvent(NODE_ID, health);
+  if (espNowAvailable) sendEspNow(&event, sizeof(event));
+  char msg[64];
+  formatHealthEvent(msg, sizeof(msg), event);
+  Serial.printf("HEALTH: %s\n", msg);
+}
+
+// Broadcasts always succeed once on the air; unicasts to the parent only if it ACKed
 void onDataSent(const uint8_t* mac, esp_now_send_status_t status) {
-  // Optional: handle send confirmation
+  bool ok = status == ESP_NOW_SEND_SUCCESS;
+  if (ok) {
+    sendOkCount++;
+  } else {
+    sendFailCount++;
+  }
+  if (memcmp(mac, BROADCAST, 6) == 0) return;
+  if (syncInFlight) {
+    syncInFlight = false;
+    return;
+  }
+  if (probeInFlight) {
+    probeInFlight = false;
+    probeAcked = ok;
+    return;
+  }
+  portENTER_CRITICAL(&batchLock);
+  reliableSent(reliableSender, ok, esp_timer_get_time());
+  portEXIT_CRITICAL(&batchLock);
 }
 
 void onDataReceived(const uint8_t* mac, const uint8_t* data, int len) {
+  // An answer to our probe, or a parent's beacon: only while looking for a parent
   if (len == sizeof(ProbeMsg) && data[0] == PROBE_RESPONSE_MAGIC) {
+    if (foundChannel != 0 || probeResponseReceived) return;
     ProbeMsg response;
     memcpy(&response, data, sizeof(response));
+    if (response.channel < 1 || response.channel > SCAN_CHANNEL_COUNT) return;
+    memcpy(parentMac, mac, 6);
     foundChannel = response.channel;
     probeResponseReceived = true;
   }
+#if PARENT_CLOCK
+  if (len == sizeof(SyncMsg) && data[0] == SYNC_RESPONSE_MAGIC) {
+    uint64_t receivedUs = esp_timer_get_time();
+    SyncMsg reply;
+    memcpy(&reply, data, sizeof(reply));
+    if (syncReplyReady || reply.nodeId != NODE_ID || reply.seq != syncSeq || memcmp(mac, parentMac, 6) != 0) return;
+    syncReply = reply;
+    syncReplyUs = receivedUs;
+    syncReplyReady = true;
+  }
+#endif
 }
 
+void drawScanRound(int round) {
+  display.clearDisplay();
+  display.setTextSize(1);
+  display.setCursor(0, 0);
+  display.printf("Child Node %d", NODE_ID);
+  display.setCursor(0, 16);
+  display.println("Scanning Ch: 1-13");
+  display.setCursor(0, 28);
+  display.printf("Round %d/%d", round + 1, SCAN_ROUNDS);
+  display.display();
+}
+
+// Probe the channels in scanStep's order until a parent answers (or, on the cached
+// channel, its radio ACKs the unicast probe). The OLED is redrawn once per round,
+// not per channel and not for the cached channel: a redraw is ~25 ms of I2C.
 bool findParentChannel() {
   ProbeMsg probe;
   probe.magic = PROBE_REQUEST_MAGIC;
   probe.nodeId = NODE_ID;
   probe.channel = 0;
 
-  for (int round = 0; round < 3; round++) {
-    for (uint8_t ch = 1; ch <= 13; ch++) {
-      esp_wifi_set_channel(ch, WIFI_SECOND_CHAN_NONE);
+  ScanStep step;
+  int drawnRound = -1;
+  for (int i = 0; scanStep(linkCache, i, step); i++) {
+    esp_wifi_set_channel(step.channel, WIFI_SECOND_CHAN_NONE);
+    if (hasDisplay && step.round >= 0 && step.round != drawnRound) {
+      drawnRound = step.round;
+      drawScanRound(step.round);
+    }
 
-      if (hasDisplay) {
-        display.clearDisplay();
-        display.setTextSize(1);
-        display.setCursor(0, 0);
-        display.printf("Child Node %d", NODE_ID);
-        display.setCursor(0, 16);
-        display.printf("Scanning Ch: %d", ch);
-        display.setCursor(0, 28);
-        display.printf("Round %d/3", round + 1);
-        display.display();
+    // The cached parent, unicast, unless an old batch's callback is still to come
+    probeAcked = false;
+    if (step.round < 0 && !probeInFlight) {
+      portENTER_CRITICAL(&batchLock);
+      bool idle = reliableSender.inFlightCount == 0;
+      portEXIT_CRITICAL(&batchLock);
+      if (idle && addPeer(linkCache.parentMac)) {
+        probeInFlight = true;
+        if (esp_now_send(linkCache.parentMac, (uint8_t*)&probe, sizeof(probe)) != ESP_OK) probeInFlight = false;
       }
-
-      probeResponseReceived = false;
-      esp_now_send(BROADCAST, (uint8_t*)&probe, sizeof(probe));
-
-      unsigned long start = millis();
-      while (millis() - start < 150) {
-        if (probeResponseReceived) {
-          // foundChannel already set by onDataReceived from parent's response
-          esp_wifi_set_channel(foundChannel, WIFI_SECOND_CHAN_NONE);
-          Serial.printf("Parent found on channel %d\n", foundChannel);
-          return true;
-        }
-        delay(1);
+    }
+    esp_now_send(BROADCAST, (uint8_t*)&probe, sizeof(probe));
+
+    unsigned long start = millis();
+    while (millis() - start < step.dwellMs) {
+      // foundChannel set by onDataReceived from the parent's answer
+      if (probeResponseReceived) return true;
+      if (step.round < 0 && probeAcked) {
+        memcpy(parentMac, linkCache.parentMac, 6);
+        foundChannel = step.channel;
+        probeResponseReceived = true;
+        return true;
       }
+      delay(1);
     }
   }
   return false;
 }
 
+// A parent answered or beaconed: its channel, remembered for the next boot
+void onParentFound() {
+  probeResponseReceived = false;
+  esp_wifi_set_channel(foundChannel, WIFI_SECOND_CHAN_NONE);
+  Serial.printf("Parent found on channel %d\n", foundChannel);
+  saveLinkCache(linkCache, foundChannel, parentMac);
+#if ESPNOW_RELIABLE
+  addParentPeer();
+#endif
+}
+
+// No parent: wait on the last one's channel for its beacon
+uint8_t waitChannel() { return linkCacheValid(linkCache) ? linkCache.channel : 1; }
+
 void updateDisplay() {
   display.clearDisplay();
 
@@ -227,11 +549,22 @@ void setup() {
     Serial.println("ESP-NOW init failed! Local sensors only.");
   }
 
-  // Find parent by probing all channels
+  // A random start, so the parent can tell a reboot from a late batch
+  batchInit(espNowBatch, NODE_ID, (uint16_t)esp_random());
+  reliableInit(reliableSender);
+  clockSyncInit(clockSync);
+
+  // Find parent: last boot's channel first, then all channels
   if (espNowAvailable) {
-    Serial.println("Scanning for parent...");
+    if (loadLinkCache(linkCache)) {
+      Serial.printf("Scanning for parent (last on channel %d)...\n", linkCache.channel);
+    } else {
+      Serial.println("Scanning for parent...");
+    }
+    unsigned long scanStart = millis();
     if (findParentChannel()) {
-      Serial.printf("Locked to channel %d\n", foundChannel);
+      onParentFound();
+      Serial.printf("Locked to channel %d (%lu ms)\n", foundChannel, millis() - scanStart);
       if (hasDisplay) {
         display.clearDisplay();
         display.setCursor(0, 0);
@@ -243,8 +576,8 @@ void setup() {
         display.display();
       }
     } else {
-      Serial.println("Parent not found! Staying on channel 1");
-      esp_wifi_set_channel(1, WIFI_SECOND_CHAN_NONE);
+      Serial.printf("Parent not found! Waiting on channel %d\n", waitChannel());
+      esp_wifi_set_channel(waitChannel(), WIFI_SECOND_CHAN_NONE);
       if (hasDisplay) {
         display.clearDisplay();
         display.setCursor(0, 0);
@@ -252,18 +585,25 @@ void setup() {
         display.setCursor(0, 16);
         display.println("Parent NOT FOUND");
         display.setCursor(0, 28);
-        display.println("Using Ch 1");
+        display.printf("Using Ch %d", waitChannel());
         display.display();
       }
     }
   }
 
   // Setup sensors
-  Serial.println("\nSensors:");
+  Serial.printf("\nSensors: %d (%u bytes detector state)\n", NUM_SENSORS, (unsigned)sizeof(sensors));
   initSensors();
   for (int i = 0; i < NUM_SENSORS; i++) {
     Serial.printf("  %d:%d - GPIO %d\n", NODE_ID, i, SENSOR_PINS[i]);
   }
+#if CAR_CALIBRATION
+  Serial.printf("Car calibration: %s\n", loadCalibration() ? "loaded from NVS" : "nominal bands");
+#endif
+#if DETECTION_TASK
+  startDetectionTask(sendCarEvent, sendPassEvent, sendHealthReport);
+  Serial.printf("Detection task: core %d\n", DETECTION_TASK_CORE);
+#endif
 
   // Start display on core 0 (loop runs on core 1)
   if (hasDisplay) {
@@ -276,17 +616,41 @@ void setup() {
 }
 
 void loop() {
-  // Retry parent discovery periodically if not found
-  if (espNowAvailable && foundChannel == 0 && millis() - lastScanAttempt > SCAN_RETRY_INTERVAL) {
+  // Heard a parent's beacon while waiting; else retry parent discovery periodically
+  if (espNowAvailable && probeResponseReceived) {
+    onParentFound();
+  } else if (espNowAvailable && foundChannel == 0 && millis() - lastScanAttempt > SCAN_RETRY_INTERVAL) {
     lastScanAttempt = millis();
     Serial.println("Retrying parent scan...");
     if (findParentChannel()) {
-      Serial.printf("Parent found on channel %d\n", foundChannel);
+      onParentFound();
+    } else {
+      esp_wifi_set_channel(waitChannel(), WIFI_SECOND_CHAN_NONE);
     }
   }
 
-  for (int i = 0; i < NUM_SENSORS; i++) {
-    processSensor(sensors[i], sendCarEvent);
+#if !DETECTION_TASK
+  processDeadlines(sendCarEvent, sendPassEvent);
+  processAllSensors(sendCarEvent);
+#if SENSOR_HEALTH
+  monitorSensorHealth(sendHealthReport);
+#endif
+#endif
+#if CAR_CALIBRATION
+  saveCalibrationIfDue();
+#endif
+  if (espNowAvailable) {
+    flushEspNowBatch();
+#if ESPNOW_RELIABLE
+    pumpReliable();
+    checkParentLink();
+    reportParentLink();
+#endif
+#if PARENT_CLOCK
+    updateClockSync();
+    requestClockSync();
+    reportClockSync();
+#endif
   }
   delay(1);
 }
@@ -3,12 +3,18 @@
 #include <esp_now.h>
 #include <esp_wifi.h>
 #include "scalextric_protocol.h"
+#include "espnow_batch.h"
+#include "clock_sync.h"
+#include "channel_scan.h"
 
 // Scalextric ESP-NOW USB Dongle
 // Receives car events from sensor nodes via ESP-NOW and forwards to PC via Serial
 // Plug into PC USB port, run ScalextricSerialClient to read events
 //
-// Output format: SEQ:NODE:SENSOR:CAR:FREQ:MILLIS
+// Output format: SEQ:NODE:SENSOR:CAR:FREQ:MILLIS[:Q:...] (see formatCarEvent)
+// After FORMAT:BIN, car events are written as binary CarRecords (encodeCarRecord)
+// between the text lines; the reader tells them apart by the first byte
+// Children's passes and sensor health go out as P: and H: lines, text either way
 // Sensor nodes auto-discover this dongle via channel probe (same as parent)
 
 const uint8_t ESPNOW_CHANNEL = 1;
@@ -19,7 +25,21 @@ uint32_t seqNumber = 0;
 // Serial.println in the callback blocks the WiFi task and causes packet loss
 const int EVENT_QUEUE_SIZE = 8;
 CarEvent eventQueue[EVENT_QUEUE_SIZE];
+EventQuality eventQualities[EVENT_QUEUE_SIZE];  // zero for events without quality data
+uint64_t eventReceiveUs[EVENT_QUEUE_SIZE];  // micros when the event arrived, or a synced child detected it
 volatile int eventQueueCount = 0;
+BatchTracker espNowBatches;  // children's batch frames (espnow_batch.h)
+
+// Children's completed passes and sensor health reports, passed on as P: and H: lines
+const int PASS_QUEUE_SIZE = 4;
+PassEvent passQueue[PASS_QUEUE_SIZE];
+volatile int passQueueCount = 0;
+const int HEALTH_QUEUE_SIZE = 16;
+HealthEvent healthQueue[HEALTH_QUEUE_SIZE];
+volatile int healthQueueCount = 0;
+
+// Event format (FORMAT:BIN / FORMAT:TEXT), text until the PC asks
+bool binaryFormat = false;
 
 void onDataReceived(const uint8_t* mac, const uint8_t* data, int len) {
   // Handle channel discovery probe from sensor nodes
@@ -39,11 +59,34 @@ void onDataReceived(const uint8_t* mac, const uint8_t* data, int len) {
     return;
   }
 
-  // Queue car events for Serial output in loop()
-  if (len != sizeof(CarEvent)) return;
+#if CLOCK_SYNC
+  // Clock sync from a child (clock_sync.h): its request back, with our clock added
+  if (replyClockSync(mac, data, len)) return;
+#endif
+
+  // A child's batch: each message as if it had come on its own
+  if (unpackBatch(mac, data, len, espNowBatches, onDataReceived)) return;
+
+  if (len == sizeof(PassEvent) && data[0] == PASS_EVENT_MAGIC) {
+    if (passQueueCount < PASS_QUEUE_SIZE) {
+      memcpy(&passQueue[passQueueCount], data, sizeof(PassEvent));
+      passQueueCount++;
+    }
+    return;
+  }
+  if (len == sizeof(HealthEvent) && data[0] == HEALTH_EVENT_MAGIC) {
+    if (healthQueueCount < HEALTH_QUEUE_SIZE) {
+      memcpy(&healthQueue[healthQueueCount], data, sizeof(HealthEvent));
+      healthQueueCount++;
+    }
+    return;
+  }
 
-  if (eventQueueCount < EVENT_QUEUE_SIZE) {
-    memcpy(&eventQueue[eventQueueCount], data, sizeof(CarEvent));
+  // Queue car events for Serial output in loop()
+  uint64_t detectedUs;
+  if (eventQueueCount < EVENT_QUEUE_SIZE &&
+      readCarEvent(data, len, eventQueue[eventQueueCount], eventQualities[eventQueueCount], &detectedUs)) {
+    eventReceiveUs[eventQueueCount] = eventTimeUs(detectedUs, esp_timer_get_time());
     eventQueueCount++;
   }
 }
@@ -62,13 +105,14 @@ void setup() {
 
   if (esp_now_init() == ESP_OK) {
     esp_now_register_recv_cb(onDataReceived);
+    startProbeBeacon();
     Serial.println("# ESP-NOW: OK");
   } else {
     Serial.println("# ESP-NOW: FAILED");
   }
 
   Serial.println("#");
-  Serial.println("# Format: SEQ:NODE:SENSOR:CAR:FREQ:MILLIS");
+  Serial.println("# Format: SEQ:NODE:SENSOR:CAR:FREQ:MILLIS[:Q:PULSES:VALID%:GLITCHES:OOB:IQR_US:MARGIN:OVERLAP%]");
   Serial.println("# Waiting for sensor nodes...\n");
 }
 
@@ -76,22 +120,50 @@ void loop() {
   // Flush queued events to Serial
   for (int i = 0; i < eventQueueCount; i++) {
     CarEvent& event = eventQueue[i];
+    if (binaryFormat) {
+      uint8_t record[RECORD_MAX_SIZE];
+      int n = encodeCarRecord(record, sizeof(record), seqNumber++, event, eventReceiveUs[i], eventQualities[i]);
+      Serial.write(record, n);
+    } else {
+      char msg[96];
+      formatCarEvent(msg, sizeof(msg), seqNumber++, event, eventReceiveUs[i], eventQualities[i]);
+      Serial.println(msg);
+    }
+  }
+  eventQueueCount = 0;
+  for (int i = 0; i < passQueueCount; i++) {
+    char msg[96];
+    formatPassEvent(msg, sizeof(msg), passQueue[i]);
+    Serial.println(msg);
+  }
+  passQueueCount = 0;
+  for (int i = 0; i < healthQueueCount; i++) {
     char msg[64];
-    snprintf(msg, sizeof(msg), "%lu:%d:%d:%d:%d:%lu",
-             seqNumber++, event.nodeId, event.sensorId, event.carNumber,
-             event.frequency, (unsigned long)millis());
+    formatHealthEvent(msg, sizeof(msg), healthQueue[i]);
     Serial.println(msg);
   }
-  eventQueueCount = 0;
+  healthQueueCount = 0;
 
   // Handle SYNC requests from PC for clock calibration
   if (Serial.available()) {
     String line = Serial.readStringUntil('\n');
     line.trim();
-    if (line.startsWith("SYNC")) {
+    bool binary;
+    if (parseFormatCommand(line.c_str(), binary)) {
+      binaryFormat = binary;
+      char reply[24];
+      formatFormatReply(reply, sizeof(reply), binary);
+      Serial.println(reply);
+    } else if (line.startsWith("SYNC")) {
       char reply[32];
       snprintf(reply, sizeof(reply), "SYNC:%lu", millis());
       Serial.println(reply);
     }
   }
+
+  // Our probe answer to any child waiting on our channel (channel_scan.h)
+  sendProbeBeacon(PARENT_NODE_ID, ESPNOW_CHANNEL);
+
+  // Children's batches lost on the air or resent (espnow_batch.h)
+  logBatchLoss(espNowBatches);
 }
@@ -3,13 +3,16 @@
 #include <esp_now.h>
 #include <esp_wifi.h>
 #include "scalextric_protocol.h"
+#include "espnow_batch.h"
+#include "channel_scan.h"
 
 // Scalextric ESP-NOW Receiver (ESP32-A of split relay)
 // Receives car events from sensor nodes via ESP-NOW and forwards to ESP32-B via Serial2
 // ESP32-B runs the BLE bridge (scalextric_ble_bridge.cpp)
 //
 // Wiring: GPIO25 (TX2) → ESP32-B GPIO26 (RX2), plus shared GND
-// Inter-board format: NODE:SENSOR:CAR:FREQ\n (no millis — ESP32-B adds its own)
+// Inter-board format: NODE:SENSOR:CAR:FREQ\n (no millis — ESP32-B adds its own), plus
+// children's P: and H: lines (formatPassEvent, formatHealthEvent), which ESP32-B passes on as they are
 //
 // USB Serial (Serial) remains available for debug monitoring
 
@@ -19,6 +22,15 @@ const uint8_t ESPNOW_CHANNEL = 1;
 const int EVENT_QUEUE_SIZE = 8;
 CarEvent eventQueue[EVENT_QUEUE_SIZE];
 volatile int eventQueueCount = 0;
+BatchTracker espNowBatches;  // children's batch frames (espnow_batch.h)
+
+// Children's completed passes and sensor health reports, passed on as P: and H: lines
+const int PASS_QUEUE_SIZE = 4;
+PassEvent passQueue[PASS_QUEUE_SIZE];
+volatile int passQueueCount = 0;
+const int HEALTH_QUEUE_SIZE = 16;
+HealthEvent healthQueue[HEALTH_QUEUE_SIZE];
+volatile int healthQueueCount = 0;
 
 void onDataReceived(const uint8_t* mac, const uint8_t* data, int len) {
   // Handle channel discovery probe from sensor nodes
@@ -38,11 +50,28 @@ void onDataReceived(const uint8_t* mac, const uint8_t* data, int len) {
     return;
   }
 
-  // Queue car events for Serial2 output in loop()
-  if (len != sizeof(CarEvent)) return;
+  // A child's batch: each message as if it had come on its own
+  if (unpackBatch(mac, data, len, espNowBatches, onDataReceived)) return;
+
+  if (len == sizeof(PassEvent) && data[0] == PASS_EVENT_MAGIC) {
+    if (passQueueCount < PASS_QUEUE_SIZE) {
+      memcpy(&passQueue[passQueueCount], data, sizeof(PassEvent));
+      passQueueCount++;
+    }
+    return;
+  }
+  if (len == sizeof(HealthEvent) && data[0] == HEALTH_EVENT_MAGIC) {
+    if (healthQueueCount < HEALTH_QUEUE_SIZE) {
+      memcpy(&healthQueue[healthQueueCount], data, sizeof(HealthEvent));
+      healthQueueCount++;
+    }
+    return;
+  }
 
-  if (eventQueueCount < EVENT_QUEUE_SIZE) {
-    memcpy(&eventQueue[eventQueueCount], data, sizeof(CarEvent));
+  // Queue car events for Serial2 output in loop(); the inter-board format has no
+  // room for EventQuality, so it is dropped here
+  EventQuality quality;
+  if (eventQueueCount < EVENT_QUEUE_SIZE && readCarEvent(data, len, eventQueue[eventQueueCount], quality)) {
     eventQueueCount++;
   }
 }
@@ -66,6 +95,7 @@ void setup() {
   // Init ESP-NOW
   if (esp_now_init() == ESP_OK) {
     esp_now_register_recv_cb(onDataReceived);
+    startProbeBeacon();
     Serial.println("# ESP-NOW: OK");
   } else {
     Serial.println("# ESP-NOW: FAILED");
@@ -87,4 +117,24 @@ void loop() {
     Serial.println(msg);  // Debug echo on USB
   }
   eventQueueCount = 0;
+  for (int i = 0; i < passQueueCount; i++) {
+    char msg[96];
+    formatPassEvent(msg, sizeof(msg), passQueue[i]);
+    Serial2.println(msg);
+    Serial.println(msg);
+  }
+  passQueueCount = 0;
+  for (int i = 0; i < healthQueueCount; i++) {
+    char msg[64];
+    formatHealthEvent(msg, sizeof(msg), healthQueue[i]);
+    Serial2.println(msg);
+    Serial.println(msg);
+  }
+  healthQueueCount = 0;
+
+  // Our probe answer to any child waiting on our channel (channel_scan.h)
+  sendProbeBeacon(PARENT_NODE_ID, ESPNOW_CHANNEL);
+
+  // Children's batches lost on the air or resent (espnow_batch.h)
+  logBatchLoss(espNowBatches);
 }
@@ -0,0 +1,64 @@
+#include <Arduino.h>
+#include "scalextric_protocol.h"
+#include "car_detection.h"
+
+// Scalextric Edge Trace Logger
+// Runs the normal detector with EDGE_TRACE=1 and streams the binary edge trace
+// (include/edge_trace.h) over USB serial: every raw edge, every car the detector
+// reported and any edges the rings dropped. Capture it on the PC, e.g.
+//   stty -F /dev/ttyUSB0 921600 raw && cat /dev/ttyUSB0 > car3_misread.sxt
+// then replay with scalextric_trace_replay. The reader skips the boot text.
+//
+// Sensor pins: SENSOR_PIN_LIST (scalextric_protocol.h), same circuit as the detector.
+// A busy track is ~2 bytes per edge: 4 sensors at 5.5 kHz is ~44 KB/s, half the link.
+
+#if !EDGE_TRACE
+#error "scalextric_trace_logger needs -DEDGE_TRACE=1"
+#endif
+
+#ifndef TRACE_BAUD
+#define TRACE_BAUD 921600  // Override via build_flags: -DTRACE_BAUD=2000000
+#endif
+
+const unsigned long STATUS_INTERVAL = 10000;  // ms, text status between frames
+unsigned long lastStatus = 0;
+uint32_t carsReported = 0;
+
+void onCarDetected(uint8_t sensorId, int car, float freq) {
+  (void)sensorId;
+  (void)car;
+  (void)freq;
+  carsReported++;  // already in the trace; no text on the binary stream
+}
+
+void setup() {
+  Serial.setTxBufferSize(4096);
+  Serial.begin(TRACE_BAUD);
+  Serial.println("\n# Scalextric Edge Trace Logger");
+  Serial.printf("# %d sensors, %u byte trace buffer, binary frames follow\n", NUM_SENSORS,
+                (unsigned)TRACE_BUFFER_SIZE);
+  initSensors();
+}
+
+void loop() {
+  processDeadlines(onCarDetected);
+  processAllSensors(onCarDetected);
+
+  // Only as much as the UART takes without blocking; the rest waits in the buffer
+  uint8_t chunk[256];
+  int room = Serial.availableForWrite();
+  while (room > 0) {
+    int n = edgeTrace.buffer.pop(chunk, room < (int)sizeof(chunk) ? room : (int)sizeof(chunk));
+    if (n == 0) break;
+    Serial.write(chunk, n);
+    room -= n;
+  }
+
+  // Status goes out as text between frames; the reader skips it
+  if (millis() - lastStatus > STATUS_INTERVAL && edgeTrace.buffer.size() == 0) {
+    lastStatus = millis();
+    Serial.printf("\n# cars %lu, dropped frames %lu\n", (unsigned long)carsReported,
+                  (unsigned long)edgeTrace.buffer.droppedFrames);
+  }
+  delay(1);
+}
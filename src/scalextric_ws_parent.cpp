@@ -12,16 +12,28 @@
 #include "wifi_credentials.h"
 #include "scalextric_protocol.h"
 #include "car_detection.h"
+#include "race_engine.h"
+#include "espnow_batch.h"
+#include "clock_sync.h"
+#include "channel_scan.h"
 
 // Scalextric Car Detector - ESP-NOW Parent Node
 // Detects cars locally AND receives events from child nodes via ESP-NOW
 // Serves car events via WebSocket on port 81
 // Discoverable via mDNS at scalextric.local
 //
-// Output format: SEQ:NODE:SENSOR:CAR:FREQ:MILLIS
+// Output format: SEQ:NODE:SENSOR:CAR:FREQ:MILLIS[:Q:PULSES:VALID%:GLITCHES:OOB:IQR_US:MARGIN:OVERLAP%]
 // e.g., 42:255:2:3:3704:123456 = Seq 42, Parent, Sensor 2, Car 3, 3704 Hz, millis=123456
 //       42:0:2:3:3704:123456 = Seq 42, Child 0, Sensor 2, Car 3, 3704 Hz, millis=123456
+// The :Q: tail is the detector's EventQuality, absent for children without it
 // Client maps millis to wall clock via SYNC handshake at connect
+// A client that sends FORMAT:BIN gets binary CarRecords instead (encodeCarRecord), as
+// WebSocket binary frames; FORMAT:TEXT goes back to text.
+//
+// Sensor health as H: lines, every 10s per sensor and on a change - see formatHealthEvent.
+// Race updates (laps, sectors, positions) as R: lines - see race_engine.h.
+// Clients set up timing lines with LINE:NODE:SENSOR:INDEX, clear with RESET,
+// and get the full standings on connect or with RACE.
 
 // ========== CONFIGURATION ==========
 #define WIFI_ENABLED 1  // Set to 0 to disable WiFi for testing
@@ -60,7 +72,21 @@ int carCounts[NUM_CARS] = {0};
 // Event queue - decouple detection from WebSocket sends
 const int EVENT_QUEUE_SIZE = 8;
 CarEvent eventQueue[EVENT_QUEUE_SIZE];
+uint64_t eventReceiveUs[EVENT_QUEUE_SIZE];  // micros when event was detected here, by a synced child, or received (race clock)
+EventQuality eventQualities[EVENT_QUEUE_SIZE];  // zero for events without quality data
 volatile int eventQueueCount = 0;
+portMUX_TYPE eventQueueMux = portMUX_INITIALIZER_UNLOCKED;  // detection task / ESP-NOW vs loop()
+BatchTracker espNowBatches;  // children's batch frames (espnow_batch.h)
+
+// Completed passes (speed / duration), same lock as the event queue
+const int PASS_QUEUE_SIZE = 4;
+PassEvent passQueue[PASS_QUEUE_SIZE];
+volatile int passQueueCount = 0;
+
+// Sensor health reports (local and children), same lock as the event queue
+const int HEALTH_QUEUE_SIZE = 16;
+HealthEvent healthQueue[HEALTH_QUEUE_SIZE];
+volatile int healthQueueCount = 0;
 
 // WiFi monitoring
 unsigned long lastWifiCheck = 0;
@@ -69,14 +95,96 @@ bool wifiWasConnected = false;
 // Sequence number for drop detection
 uint32_t seqNumber = 0;
 
-void broadcastEvent(CarEvent& event) {
+// Event format per client (FORMAT:BIN / FORMAT:TEXT), text until it asks
+bool clientBinary[WEBSOCKETS_SERVER_CLIENT_MAX] = {false};
+int binaryClients = 0;
+
+void setClientFormat(uint8_t num, bool binary) {
+  if (num >= WEBSOCKETS_SERVER_CLIENT_MAX || clientBinary[num] == binary) return;
+  clientBinary[num] = binary;
+  binaryClients += binary ? 1 : -1;
+}
+
+// Text is only formatted if some client wants it, the record only if some client wants that
+void broadcastEvent(CarEvent& event, uint64_t receiveUs, const EventQuality& quality) {
+  uint32_t seq = seqNumber++;
+  int clients = webSocket.connectedClients();
+  if (clients == 0) return;
+  char msg[96];
+  if (binaryClients < clients) {
+    formatCarEvent(msg, sizeof(msg), seq, event, receiveUs, quality);
+  }
+  if (binaryClients == 0) {
+    webSocket.broadcastTXT(msg);
+    return;
+  }
+  uint8_t record[RECORD_MAX_SIZE];
+  int n = encodeCarRecord(record, sizeof(record), seq, event, receiveUs, quality);
+  for (uint8_t num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX; num++) {
+    if (clientBinary[num]) {
+      webSocket.sendBIN(num, record, n);
+    } else if (webSocket.clientIsConnected(num)) {
+      webSocket.sendTXT(num, msg);
+    }
+  }
+}
+
+void broadcastPass(const PassEvent& pass) {
+  char msg[96];
+  formatPassEvent(msg, sizeof(msg), pass);
+  webSocket.broadcastTXT(msg);
+}
+
+void broadcastHealth(const HealthEvent& health) {
+  char msg[64];
+  formatHealthEvent(msg, sizeof(msg), health);
+  webSocket.broadcastTXT(msg);
+}
+
+// Laps, sectors and running order, fed from loop()
+RaceEngine race;
+
+void broadcastRaceUpdate(const RaceUpdate& update) {
   char msg[64];
-  snprintf(msg, sizeof(msg), "%lu:%d:%d:%d:%d:%lu",
-           seqNumber++, event.nodeId, event.sensorId, event.carNumber,
-           event.frequency, event.timestamp);
+  formatRaceUpdate(msg, sizeof(msg), update);
   webSocket.broadcastTXT(msg);
 }
 
+// A snapshot goes only to the client that connected or asked (RaceUpdateCallback has no context)
+uint8_t snapshotClient = 0;
+
+void sendRaceUpdate(const RaceUpdate& update) {
+  char msg[64];
+  formatRaceUpdate(msg, sizeof(msg), update);
+  webSocket.sendTXT(snapshotClient, msg);
+}
+
+void sendRaceSnapshot(uint8_t num) {
+  snapshotClient = num;
+  race.snapshot(sendRaceUpdate);
+}
+
+void queuePass(const PassEvent& pass) {
+  portENTER_CRITICAL(&eventQueueMux);
+  if (passQueueCount < PASS_QUEUE_SIZE) {
+    passQueue[passQueueCount] = pass;
+    passQueueCount++;
+  }
+  portEXIT_CRITICAL(&eventQueueMux);
+}
+
+// detectedUs: a child's detection time on our clock (CarEventTimed), 0 = now
+void queueEvent(const CarEvent& event, const EventQuality& quality, uint64_t detectedUs = 0) {
+  portENTER_CRITICAL(&eventQueueMux);
+  if (eventQueueCount < EVENT_QUEUE_SIZE) {
+    eventQueue[eventQueueCount] = event;
+    eventReceiveUs[eventQueueCount] = eventTimeUs(detectedUs, esp_timer_get_time());
+    eventQualities[eventQueueCount] = quality;
+    eventQueueCount++;
+  }
+  portEXIT_CRITICAL(&eventQueueMux);
+}
+
 void logEvent(CarEvent& event) {
   lastEvent = event;
   for (int i = LOG_SIZE - 1; i > 0; i--) {
@@ -102,10 +210,24 @@ void onLocalCarDetected(uint8_t sensorId, int car, float freq) {
 
   logEvent(event);
 
-  if (eventQueueCount < EVENT_QUEUE_SIZE) {
-    eventQueue[eventQueueCount] = event;
-    eventQueueCount++;
+  queueEvent(event, lastEventQuality(sensorId));
+}
+
+void onLocalPassComplete(const PassInfo& pass) {
+  queuePass(toPassEvent(PARENT_NODE_ID, pass));
+}
+
+void queueHealth(const HealthEvent& health) {
+  portENTER_CRITICAL(&eventQueueMux);
+  if (healthQueueCount < HEALTH_QUEUE_SIZE) {
+    healthQueue[healthQueueCount] = health;
+    healthQueueCount++;
   }
+  portEXIT_CRITICAL(&eventQueueMux);
+}
+
+void onLocalHealthReport(const HealthInfo& health) {
+  queueHealth(toHealthEvent(PARENT_NODE_ID, health));
 }
 
 void onDataReceived(const uint8_t* mac, const uint8_t* data, int len) {
@@ -127,18 +249,35 @@ void onDataReceived(const uint8_t* mac, const uint8_t* data, int len) {
     return;
   }
 
-  espNowRecvCount++;
-  if (len != sizeof(CarEvent)) return;
+#if CLOCK_SYNC
+  // Clock sync from a child (clock_sync.h): its request back, with our clock added
+  if (replyClockSync(mac, data, len)) return;
+#endif
+
+  // A child's batch: each message as if it had come on its own
+  if (unpackBatch(mac, data, len, espNowBatches, onDataReceived)) return;
 
+  espNowRecvCount++;
+  if (len == sizeof(PassEvent) && data[0] == PASS_EVENT_MAGIC) {
+    PassEvent pass;
+    memcpy(&pass, data, sizeof(pass));
+    queuePass(pass);
+    return;
+  }
+  if (len == sizeof(HealthEvent) && data[0] == HEALTH_EVENT_MAGIC) {
+    HealthEvent health;
+    memcpy(&health, data, sizeof(health));
+    queueHealth(health);
+    return;
+  }
   CarEvent event;
-  memcpy(&event, data, sizeof(event));
+  EventQuality quality;
+  uint64_t detectedUs;
+  if (!readCarEvent(data, len, event, quality, &detectedUs)) return;
 
   logEvent(event);
 
-  if (eventQueueCount < EVENT_QUEUE_SIZE) {
-    eventQueue[eventQueueCount] = event;
-    eventQueueCount++;
-  }
+  queueEvent(event, quality, detectedUs);
 
   // Check if this is a new child
   bool known = false;
@@ -155,19 +294,47 @@ void onDataReceived(const uint8_t* mac, const uint8_t* data, int len) {
   }
 }
 
+// Edge -> callback latency, printed every 10s (compare builds with/without DETECTION_TASK)
+const unsigned long LATENCY_REPORT_INTERVAL = 10000;
+unsigned long lastLatencyReport = 0;
+
+void reportLatency() {
+  if (millis() - lastLatencyReport < LATENCY_REPORT_INTERVAL) return;
+  lastLatencyReport = millis();
+  LatencyStats stats = detectionLatency;
+  if (stats.count == 0) return;
+  detectionLatency = {0, 0, 0};
+  Serial.printf("# LATENCY: n=%lu avg=%luus max=%luus\n", (unsigned long)stats.count,
+                (unsigned long)(stats.totalUs / stats.count), (unsigned long)stats.maxUs);
+}
+
 void webSocketEvent(uint8_t num, WStype_t type, uint8_t* payload, size_t length) {
   switch (type) {
     case WStype_CONNECTED:
+      setClientFormat(num, false);
+      sendRaceSnapshot(num);
       break;
     case WStype_DISCONNECTED:
+      setClientFormat(num, false);
       break;
-    case WStype_TEXT:
-      if (length >= 4 && memcmp(payload, "SYNC", 4) == 0) {
+    case WStype_TEXT: {
+      bool binary;
+      if (parseFormatCommand((const char*)payload, binary)) {
+        setClientFormat(num, binary);
+        char reply[24];
+        formatFormatReply(reply, sizeof(reply), binary);
+        webSocket.sendTXT(num, reply);
+      } else if (length >= 4 && memcmp(payload, "SYNC", 4) == 0) {
         char syncReply[32];
         snprintf(syncReply, sizeof(syncReply), "SYNC:%lu", millis());
         webSocket.sendTXT(num, syncReply);
+      } else if (length >= 4 && memcmp(payload, "RACE", 4) == 0) {
+        sendRaceSnapshot(num);
+      } else if (race.handleCommand((const char*)payload)) {
+        webSocket.sendTXT(num, "# RACE: reset");
       }
       break;
+    }
     default:
       break;
   }
@@ -312,16 +479,24 @@ void setup() {
   // Init ESP-NOW (works alongside WiFi STA)
   if (esp_now_init() == ESP_OK) {
     esp_now_register_recv_cb(onDataReceived);
+    startProbeBeacon();
   } else {
     Serial.println("# ESP-NOW init failed! Local sensors only.");
   }
 
   // Setup local sensors
-  Serial.println("# Local sensors:");
+  Serial.printf("# Local sensors: %d (%u bytes detector state)\n", NUM_SENSORS, (unsigned)sizeof(sensors));
   initSensors();
   for (int i = 0; i < NUM_SENSORS; i++) {
     Serial.printf("#   P:%d - GPIO %d\n", i, SENSOR_PINS[i]);
   }
+#if CAR_CALIBRATION
+  Serial.printf("# Car calibration: %s\n", loadCalibration() ? "loaded from NVS" : "nominal bands");
+#endif
+#if DETECTION_TASK
+  startDetectionTask(onLocalCarDetected, onLocalPassComplete, onLocalHealthReport);
+  Serial.printf("# Detection task: core %d\n", DETECTION_TASK_CORE);
+#endif
 
   if (hasDisplay) {
     xTaskCreatePinnedToCore(displayTask, "display", 4096, NULL, 1, NULL, 0);
@@ -329,23 +504,63 @@ void setup() {
   }
 
   Serial.println("#");
-  Serial.println("# Format: SEQ:NODE:SENSOR:CAR:FREQ:MILLIS");
+  Serial.println("# Format: SEQ:NODE:SENSOR:CAR:FREQ:MILLIS[:Q:PULSES:VALID%:GLITCHES:OOB:IQR_US:MARGIN:OVERLAP%]");
+  Serial.println("# Passes: P:NODE:SENSOR:CAR:FIRST_US:LAST_US:SPEED_MMPS:B|T:PULSES");
+  Serial.println("# Health: H:NODE:SENSOR:STATUS:EDGES/S:GLITCHES/S:OOB/S:IDLE_S:THROTTLES");
   Serial.println("# Parent node = 255, Children = 0,1,2...");
   Serial.println("# Listening for cars...\n");
 }
 
 void loop() {
+#if !DETECTION_TASK
   // Process sensors FIRST - detection is time-critical, no TCP writes here
-  for (int i = 0; i < NUM_SENSORS; i++) {
-    processSensor(sensors[i], onLocalCarDetected);
-  }
+  processDeadlines(onLocalCarDetected, onLocalPassComplete);
+  processAllSensors(onLocalCarDetected);
+#if SENSOR_HEALTH
+  monitorSensorHealth(onLocalHealthReport);
+#endif
+#endif
+#if CAR_CALIBRATION
+  saveCalibrationIfDue();
+#endif
+
+  // Take the queued events; TCP writes happen outside the lock
+  CarEvent pending[EVENT_QUEUE_SIZE];
+  uint64_t pendingUs[EVENT_QUEUE_SIZE];
+  EventQuality pendingQualities[EVENT_QUEUE_SIZE];
+  portENTER_CRITICAL(&eventQueueMux);
+  int pendingCount = eventQueueCount;
+  memcpy(pending, eventQueue, pendingCount * sizeof(CarEvent));
+  memcpy(pendingUs, eventReceiveUs, pendingCount * sizeof(uint64_t));
+  memcpy(pendingQualities, eventQualities, pendingCount * sizeof(EventQuality));
+  eventQueueCount = 0;
+  PassEvent pendingPasses[PASS_QUEUE_SIZE];
+  int pendingPassCount = passQueueCount;
+  memcpy(pendingPasses, passQueue, pendingPassCount * sizeof(PassEvent));
+  passQueueCount = 0;
+  HealthEvent pendingHealth[HEALTH_QUEUE_SIZE];
+  int pendingHealthCount = healthQueueCount;
+  memcpy(pendingHealth, healthQueue, pendingHealthCount * sizeof(HealthEvent));
+  healthQueueCount = 0;
+  portEXIT_CRITICAL(&eventQueueMux);
+
+  reportLatency();
 
 #if WIFI_ENABLED
   // Flush queued events FIRST - minimise time between detection and TCP send
-  for (int i = 0; i < eventQueueCount; i++) {
-    broadcastEvent(eventQueue[i]);
+  for (int i = 0; i < pendingCount; i++) {
+    broadcastEvent(pending[i], pendingUs[i], pendingQualities[i]);
+  }
+  for (int i = 0; i < pendingCount; i++) {
+    race.onCrossing(pending[i].nodeId, pending[i].sensorId, pending[i].carNumber, (uint32_t)(pendingUs[i] / 1000),
+                    broadcastRaceUpdate);
+  }
+  for (int i = 0; i < pendingPassCount; i++) {
+    broadcastPass(pendingPasses[i]);
+  }
+  for (int i = 0; i < pendingHealthCount; i++) {
+    broadcastHealth(pendingHealth[i]);
   }
-  eventQueueCount = 0;
 
   // Then process incoming WebSocket data (can block on TCP reads)
   webSocket.loop();
@@ -361,5 +576,11 @@ void loop() {
   }
 #endif
 
+  // Our probe answer to any child waiting on our channel (channel_scan.h)
+  sendProbeBeacon(PARENT_NODE_ID, WiFi.channel());
+
+  // Children's batches lost on the air or resent (espnow_batch.h)
+  logBatchLoss(espNowBatches);
+
   yield();  // Give RTOS a chance to run WiFi tasks without fixed 1ms delay
 }
@@ -6,13 +6,17 @@
 #include <ESPmDNS.h>
 #include "wifi_credentials.h"
 #include "scalextric_protocol.h"
+#include "espnow_batch.h"
+#include "clock_sync.h"
+#include "channel_scan.h"
 
 // Scalextric ESP-NOW → WebSocket Relay
 // Receives car events from sensor nodes via ESP-NOW and serves via WebSocket
 // No local sensors, no OLED - pure relay
 //
-// Output format: SEQ:NODE:SENSOR:CAR:FREQ:MILLIS
+// Output format: SEQ:NODE:SENSOR:CAR:FREQ:MILLIS[:Q:...] (see formatCarEvent)
 // Client maps millis to wall clock via SYNC handshake at connect
+// FORMAT:BIN switches a client to binary CarRecords (encodeCarRecord), FORMAT:TEXT back
 
 const int WEBSOCKET_PORT = 81;
 
@@ -26,7 +30,18 @@ int childCount = 0;
 // Event queue - decouple ESP-NOW callback from WebSocket TCP writes
 const int EVENT_QUEUE_SIZE = 8;
 CarEvent eventQueue[EVENT_QUEUE_SIZE];
+uint64_t eventReceiveUs[EVENT_QUEUE_SIZE];  // micros when the event arrived, or a synced child detected it
+EventQuality eventQualities[EVENT_QUEUE_SIZE];  // zero for events without quality data
 volatile int eventQueueCount = 0;
+BatchTracker espNowBatches;  // children's batch frames (espnow_batch.h)
+
+// Children's completed passes and sensor health reports, passed on as P: and H: lines
+const int PASS_QUEUE_SIZE = 4;
+PassEvent passQueue[PASS_QUEUE_SIZE];
+volatile int passQueueCount = 0;
+const int HEALTH_QUEUE_SIZE = 16;
+HealthEvent healthQueue[HEALTH_QUEUE_SIZE];
+volatile int healthQueueCount = 0;
 
 // WiFi monitoring
 unsigned long lastWifiCheck = 0;
@@ -35,11 +50,48 @@ bool wifiWasConnected = false;
 // Sequence number for drop detection
 uint32_t seqNumber = 0;
 
-void broadcastEvent(CarEvent& event) {
+// Event format per client (FORMAT:BIN / FORMAT:TEXT), text until it asks
+bool clientBinary[WEBSOCKETS_SERVER_CLIENT_MAX] = {false};
+int binaryClients = 0;
+
+void setClientFormat(uint8_t num, bool binary) {
+  if (num >= WEBSOCKETS_SERVER_CLIENT_MAX || clientBinary[num] == binary) return;
+  clientBinary[num] = binary;
+  binaryClients += binary ? 1 : -1;
+}
+
+void broadcastEvent(CarEvent& event, uint64_t receiveUs, const EventQuality& quality) {
+  uint32_t seq = seqNumber++;
+  int clients = webSocket.connectedClients();
+  if (clients == 0) return;
+  char msg[96];
+  if (binaryClients < clients) {
+    formatCarEvent(msg, sizeof(msg), seq, event, receiveUs, quality);
+  }
+  if (binaryClients == 0) {
+    webSocket.broadcastTXT(msg);
+    return;
+  }
+  uint8_t record[RECORD_MAX_SIZE];
+  int n = encodeCarRecord(record, sizeof(record), seq, event, receiveUs, quality);
+  for (uint8_t num = 0; num < WEBSOCKETS_SERVER_CLIENT_MAX; num++) {
+    if (clientBinary[num]) {
+      webSocket.sendBIN(num, record, n);
+    } else if (webSocket.clientIsConnected(num)) {
+      webSocket.sendTXT(num, msg);
+    }
+  }
+}
+
+void broadcastPass(const PassEvent& pass) {
+  char msg[96];
+  formatPassEvent(msg, sizeof(msg), pass);
+  webSocket.broadcastTXT(msg);
+}
+
+void broadcastHealth(const HealthEvent& health) {
   char msg[64];
-  snprintf(msg, sizeof(msg), "%lu:%d:%d:%d:%d:%lu",
-           seqNumber++, event.nodeId, event.sensorId, event.carNumber,
-           event.frequency, (unsigned long)millis());
+  formatHealthEvent(msg, sizeof(msg), health);
   webSocket.broadcastTXT(msg);
 }
 
@@ -61,14 +113,39 @@ void onDataReceived(const uint8_t* mac, const uint8_t* data, int len) {
     return;
   }
 
-  if (len != sizeof(CarEvent)) return;
+#if CLOCK_SYNC
+  // Clock sync from a child (clock_sync.h): its request back, with our clock added
+  if (replyClockSync(mac, data, len)) return;
+#endif
+
+  // A child's batch: each message as if it had come on its own
+  if (unpackBatch(mac, data, len, espNowBatches, onDataReceived)) return;
+
+  if (len == sizeof(PassEvent) && data[0] == PASS_EVENT_MAGIC) {
+    if (passQueueCount < PASS_QUEUE_SIZE) {
+      memcpy(&passQueue[passQueueCount], data, sizeof(PassEvent));
+      passQueueCount++;
+    }
+    return;
+  }
+  if (len == sizeof(HealthEvent) && data[0] == HEALTH_EVENT_MAGIC) {
+    if (healthQueueCount < HEALTH_QUEUE_SIZE) {
+      memcpy(&healthQueue[healthQueueCount], data, sizeof(HealthEvent));
+      healthQueueCount++;
+    }
+    return;
+  }
 
   CarEvent event;
-  memcpy(&event, data, sizeof(event));
+  EventQuality quality;
+  uint64_t detectedUs;
+  if (!readCarEvent(data, len, event, quality, &detectedUs)) return;
 
   // Queue for WebSocket broadcast (don't do TCP in callback)
   if (eventQueueCount < EVENT_QUEUE_SIZE) {
     eventQueue[eventQueueCount] = event;
+    eventReceiveUs[eventQueueCount] = eventTimeUs(detectedUs, esp_timer_get_time());
+    eventQualities[eventQueueCount] = quality;
     eventQueueCount++;
   }
 
@@ -86,16 +163,23 @@ void onDataReceived(const uint8_t* mac, const uint8_t* data, int len) {
 void webSocketEvent(uint8_t num, WStype_t type, uint8_t* payload, size_t length) {
   switch (type) {
     case WStype_CONNECTED:
-      break;
     case WStype_DISCONNECTED:
+      setClientFormat(num, false);
       break;
-    case WStype_TEXT:
-      if (length >= 4 && memcmp(payload, "SYNC", 4) == 0) {
+    case WStype_TEXT: {
+      bool binary;
+      if (parseFormatCommand((const char*)payload, binary)) {
+        setClientFormat(num, binary);
+        char reply[24];
+        formatFormatReply(reply, sizeof(reply), binary);
+        webSocket.sendTXT(num, reply);
+      } else if (length >= 4 && memcmp(payload, "SYNC", 4) == 0) {
         char syncReply[32];
         snprintf(syncReply, sizeof(syncReply), "SYNC:%lu", millis());
         webSocket.sendTXT(num, syncReply);
       }
       break;
+    }
     default:
       break;
   }
@@ -139,22 +223,31 @@ void setup() {
 
   if (esp_now_init() == ESP_OK) {
     esp_now_register_recv_cb(onDataReceived);
+    startProbeBeacon();
     Serial.println("# ESP-NOW: OK");
   } else {
     Serial.println("# ESP-NOW: FAILED");
   }
 
   Serial.println("#");
-  Serial.println("# Format: SEQ:NODE:SENSOR:CAR:FREQ:MILLIS");
+  Serial.println("# Format: SEQ:NODE:SENSOR:CAR:FREQ:MILLIS[:Q:PULSES:VALID%:GLITCHES:OOB:IQR_US:MARGIN:OVERLAP%]");
   Serial.println("# Waiting for sensor nodes...\n");
 }
 
 void loop() {
   // Flush queued events first - minimise time between detection and TCP send
   for (int i = 0; i < eventQueueCount; i++) {
-    broadcastEvent(eventQueue[i]);
+    broadcastEvent(eventQueue[i], eventReceiveUs[i], eventQualities[i]);
   }
   eventQueueCount = 0;
+  for (int i = 0; i < passQueueCount; i++) {
+    broadcastPass(passQueue[i]);
+  }
+  passQueueCount = 0;
+  for (int i = 0; i < healthQueueCount; i++) {
+    broadcastHealth(healthQueue[i]);
+  }
+  healthQueueCount = 0;
 
   // Then process incoming WebSocket data
   webSocket.loop();
@@ -165,5 +258,11 @@ void loop() {
     wifiWasConnected = (WiFi.status() == WL_CONNECTED);
   }
 
+  // Our probe answer to any child waiting on our channel (channel_scan.h)
+  sendProbeBeacon(PARENT_NODE_ID, WiFi.channel());
+
+  // Children's batches lost on the air or resent (espnow_batch.h)
+  logBatchLoss(espNowBatches);
+
   yield();
 }
@@ -0,0 +1,48 @@
+using System.Buffers.Binary;
+
+namespace ScalextricDesktopClient.Models;
+
+// Detector signal quality sent after ":Q:" or in a record's quality TLV (firmware
+// EventQuality, scalextric_protocol.h)
+public record EventQuality(
+    int Pulses,
+    int ValidPct,
+    int Glitches,
+    int OutOfBand,
+    int IqrUs,
+    int MarginPermille,
+    int OverlapPct
+)
+{
+    // Same thresholds as eventMarginal() in scalextric_protocol.h
+    public const int MinValidPct = 50;
+    public const int MinMarginPermille = 40;
+    public const int MaxIqrUs = 40;
+
+    public bool IsMarginal => ValidPct < MinValidPct || MarginPermille < MinMarginPermille || IqrUs > MaxIqrUs;
+
+    public string Summary =>
+        $"{ValidPct}% valid, {Glitches} glitch, IQR {IqrUs}us, margin {MarginPermille / 10.0:F1}%" +
+        (OverlapPct > 0 ? $", overlap {OverlapPct}%" : "");
+
+    // Fields after "Q" in SEQ:NODE:SENSOR:CAR:FREQ:MILLIS:Q:PULSES:VALID%:GLITCHES:OOB:IQR_US:MARGIN:OVERLAP%
+    public static EventQuality? Parse(string[] parts, int start)
+    {
+        if (parts.Length < start + 8 || parts[start] != "Q") return null;
+        var values = new int[7];
+        for (int i = 0; i < 7; i++)
+        {
+            if (!int.TryParse(parts[start + 1 + i], out values[i])) return null;
+        }
+        return new EventQuality(values[0], values[1], values[2], values[3], values[4], values[5], values[6]);
+    }
+
+    // The packed struct: PULSES VALID% GLITCHES OOB IQR_US(u16) MARGIN(u16) OVERLAP%, little-endian
+    public static EventQuality? FromBytes(ReadOnlySpan<byte> data)
+    {
+        if (data.Length < 9 || data[0] == 0) return null;
+        return new EventQuality(data[0], data[1], data[2], data[3],
+            BinaryPrimitives.ReadUInt16LittleEndian(data[4..]), BinaryPrimitives.ReadUInt16LittleEndian(data[6..]),
+            data[8]);
+    }
+}
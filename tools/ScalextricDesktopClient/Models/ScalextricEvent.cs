@@ -9,11 +9,14 @@ public record ScalextricEvent(
     long EspRecvMillis,
     DateTime ReceiveTimeUtc,
     DateTime? EventTimeLocal,
-    double? LatencyMs
+    double? LatencyMs,
+    EventQuality? Quality = null
 )
 {
     public string NodeName => NodeId == 255 ? "Parent" : $"Node {NodeId}";
     public string CarLabel => CarNumber == 0 ? "?" : CarNumber.ToString();
     public string TimeStr => EventTimeLocal?.ToString("HH:mm:ss.fff") ?? EspRecvMillis.ToString();
     public string LatencyStr => LatencyMs.HasValue ? $"{LatencyMs.Value:F0}ms" : "";
+    public bool IsMarginal => Quality?.IsMarginal ?? false;
+    public string QualityStr => Quality == null ? "" : (Quality.IsMarginal ? "! " : "") + Quality.Summary;
 }
@@ -0,0 +1,36 @@
+namespace ScalextricDesktopClient.Models;
+
+// Sensor health report line (firmware HealthEvent / formatHealthEvent, scalextric_protocol.h)
+public record SensorHealth(
+    int NodeId,
+    int SensorId,
+    string Status,
+    int EdgesPerSec,
+    int GlitchesPerSec,
+    int OutOfBandPerSec,
+    int IdleSec,
+    int Throttles
+)
+{
+    public bool IsHealthy => Status == "OK";
+
+    public string NodeName => NodeId == 255 ? "Parent" : $"Node {NodeId}";
+
+    public string Summary =>
+        $"{Status}: {EdgesPerSec} edges/s, {GlitchesPerSec} glitch/s, {OutOfBandPerSec} out-of-band/s, " +
+        $"idle {IdleSec}s" + (Throttles > 0 ? $", throttled {Throttles}x" : "");
+
+    // H:NODE:SENSOR:STATUS:EDGES/S:GLITCHES/S:OOB/S:IDLE_S:THROTTLES
+    public static SensorHealth? Parse(string message)
+    {
+        var parts = message.Split(':');
+        if (parts.Length < 9 || parts[0] != "H") return null;
+        var values = new int[8];
+        for (int i = 1; i < 9; i++)
+        {
+            if (i == 3) continue;
+            if (!int.TryParse(parts[i], out values[i - 1])) return null;
+        }
+        return new SensorHealth(values[0], values[1], parts[3], values[3], values[4], values[5], values[6], values[7]);
+    }
+}
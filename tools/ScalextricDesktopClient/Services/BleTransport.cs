@@ -23,9 +23,11 @@ public class BleTransport : ITransportClient
     private GattCharacteristic? _syncChar;
     private bool _connected;
     private TaskCompletionSource<(string Reply, DateTime ReceiveTime)>? _syncTcs;
+    private TaskCompletionSource<string>? _formatTcs;
 
     public string Name => "BLE";
     public event Action<string>? MessageReceived;
+    public event Action<byte[]>? RecordReceived;
     public event Action<string>? LogMessage;
     public event Action? Disconnected;
     public bool IsConnected => _connected;
@@ -190,6 +192,28 @@ public class BleTransport : ITransportClient
         }
     }
 
+    public async Task<string?> RequestFormatAsync(bool binary, CancellationToken ct)
+    {
+        if (_syncChar == null) return null;
+
+        _formatTcs = new TaskCompletionSource<string>();
+        var command = System.Text.Encoding.UTF8.GetBytes(binary ? "FORMAT:BIN" : "FORMAT:TEXT").AsBuffer();
+        var writeResult = await _syncChar.WriteValueAsync(command);
+        if (writeResult != GattCommunicationStatus.Success) return null;
+
+        using var cts = CancellationTokenSource.CreateLinkedTokenSource(ct);
+        cts.CancelAfter(TimeSpan.FromSeconds(2));
+
+        try
+        {
+            return await _formatTcs.Task.WaitAsync(cts.Token);
+        }
+        catch (OperationCanceledException)
+        {
+            return null;
+        }
+    }
+
     public async Task DisconnectAsync()
     {
         StopScan();
@@ -233,6 +257,11 @@ public class BleTransport : ITransportClient
     private void OnEventValueChanged(GattCharacteristic sender, GattValueChangedEventArgs args)
     {
         var bytes = args.CharacteristicValue.ToArray();
+        if (bytes.Length > 0 && EventParser.IsRecordStart(bytes[0]))
+        {
+            RecordReceived?.Invoke(bytes);
+            return;
+        }
         var message = System.Text.Encoding.UTF8.GetString(bytes);
         MessageReceived?.Invoke(message);
     }
@@ -245,6 +274,8 @@ public class BleTransport : ITransportClient
         // Ignore keepalive PINGs — only complete the TCS for actual SYNC replies
         if (reply.StartsWith("SYNC:"))
             _syncTcs?.TrySetResult((reply, receiveTime));
+        else if (reply.StartsWith("FORMAT:"))
+            _formatTcs?.TrySetResult(reply);
     }
 
     private void OnConnectionStatusChanged(BluetoothLEDevice sender, object args)
@@ -1,3 +1,4 @@
+using System.Buffers.Binary;
 using ScalextricDesktopClient.Models;
 
 namespace ScalextricDesktopClient.Services;
@@ -22,7 +23,46 @@ public class EventParser
         if (!int.TryParse(parts[3], out var car)) return null;
         if (!int.TryParse(parts[4], out var freq)) return null;
         if (!long.TryParse(parts[5], out var espRecvMillis)) return null;
+        var quality = EventQuality.Parse(parts, 6);  // optional tail, null from older nodes
 
+        return Build(seq, node, sensor, car, freq, espRecvMillis, quality, receiveTimeUtc);
+    }
+
+    // Binary CarRecord (encodeCarRecord in scalextric_protocol.h), sent instead of the
+    // text line after FORMAT:BIN. Null for a record of another type or version.
+    public const byte RecordMagic = 0xA0;
+    public const byte RecordVersion = 1;
+    public const int RecordSize = 20;
+    private const byte RecordCar = 1;
+    private const byte TlvQuality = 1;
+
+    public static bool IsRecordStart(byte b) => (b & 0xF0) == RecordMagic;
+
+    public ScalextricEvent? ParseRecord(ReadOnlySpan<byte> data, DateTime receiveTimeUtc)
+    {
+        if (data.Length < RecordSize || data[0] != (RecordMagic | RecordVersion) || data[1] != RecordCar) return null;
+        int length = data[2];
+        if (length < RecordSize || length > data.Length) return null;
+
+        long seq = BinaryPrimitives.ReadUInt32LittleEndian(data[3..]);
+        int freq = BinaryPrimitives.ReadUInt16LittleEndian(data[10..]);
+        var espRecvMicros = BinaryPrimitives.ReadUInt64LittleEndian(data[12..]);
+
+        // TLV extensions; types this client doesn't know are skipped
+        EventQuality? quality = null;
+        for (int i = RecordSize; i + 2 <= length; i += 2 + data[i + 1])
+        {
+            if (i + 2 + data[i + 1] > length) return null;
+            if (data[i] == TlvQuality)
+                quality = EventQuality.FromBytes(data.Slice(i + 2, data[i + 1]));
+        }
+
+        return Build(seq, data[7], data[8], data[9], freq, (long)(espRecvMicros / 1000), quality, receiveTimeUtc);
+    }
+
+    private ScalextricEvent Build(long seq, int node, int sensor, int car, int freq, long espRecvMillis,
+        EventQuality? quality, DateTime receiveTimeUtc)
+    {
         _clock.Update(receiveTimeUtc, espRecvMillis);
 
         DateTime? eventTimeLocal = null;
@@ -34,6 +74,6 @@ public class EventParser
         }
 
         return new ScalextricEvent(seq, node, sensor, car, freq, espRecvMillis,
-            receiveTimeUtc, eventTimeLocal, latencyMs);
+            receiveTimeUtc, eventTimeLocal, latencyMs, quality);
     }
 }
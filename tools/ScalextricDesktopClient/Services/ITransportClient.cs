@@ -4,10 +4,13 @@ public interface ITransportClient : IDisposable
 {
     string Name { get; }
     event Action<string> MessageReceived;
+    event Action<byte[]> RecordReceived;  // binary CarRecords, after RequestFormatAsync(true)
     event Action<string> LogMessage;
     event Action? Disconnected;
     Task ConnectAsync(CancellationToken ct);
     Task<(string? Reply, DateTime ReceiveTime)> SendSyncAsync(CancellationToken ct);
+    // FORMAT:BIN or FORMAT:TEXT; the node's FORMAT: reply, null if it doesn't know the command
+    Task<string?> RequestFormatAsync(bool binary, CancellationToken ct);
     Task DisconnectAsync();
     bool IsConnected { get; }
 }
@@ -1,4 +1,5 @@
 using System.IO.Ports;
+using System.Text;
 
 namespace ScalextricDesktopClient.Services;
 
@@ -8,9 +9,12 @@ public class SerialTransport : ITransportClient
     private CancellationTokenSource? _readCts;
     private bool _connected;
     private TaskCompletionSource<(string Reply, DateTime ReceiveTime)>? _syncTcs;
+    private TaskCompletionSource<string>? _formatTcs;
+    private readonly List<byte> _line = new();  // kept across read timeouts
 
     public string Name => "Serial";
     public event Action<string>? MessageReceived;
+    public event Action<byte[]>? RecordReceived;
     public event Action<string>? LogMessage;
     public event Action? Disconnected;
     public bool IsConnected => _connected;
@@ -63,6 +67,26 @@ public class SerialTransport : ITransportClient
         }
     }
 
+    public async Task<string?> RequestFormatAsync(bool binary, CancellationToken ct)
+    {
+        if (_port == null || !_port.IsOpen) return null;
+
+        _formatTcs = new TaskCompletionSource<string>();
+        _port.WriteLine(binary ? "FORMAT:BIN" : "FORMAT:TEXT");
+
+        using var cts = CancellationTokenSource.CreateLinkedTokenSource(ct);
+        cts.CancelAfter(TimeSpan.FromSeconds(2));
+
+        try
+        {
+            return await _formatTcs.Task.WaitAsync(cts.Token);
+        }
+        catch (OperationCanceledException)
+        {
+            return null;
+        }
+    }
+
     public Task DisconnectAsync()
     {
         _readCts?.Cancel();
@@ -86,7 +110,7 @@ public class SerialTransport : ITransportClient
         {
             try
             {
-                var line = _port.ReadLine().Trim();
+                var line = ReadLine().Trim();
                 if (line.StartsWith("#"))
                     LogMessage?.Invoke(line);
                 else if (line.Length > 0)
@@ -104,10 +128,12 @@ public class SerialTransport : ITransportClient
         {
             try
             {
-                var line = _port.ReadLine().Trim();
+                var line = ReadLine().Trim();
                 if (string.IsNullOrEmpty(line)) continue;
                 if (line.StartsWith("SYNC:"))
                     _syncTcs?.TrySetResult((line, DateTime.UtcNow));
+                else if (line.StartsWith("FORMAT:"))
+                    _formatTcs?.TrySetResult(line);
                 else
                     MessageReceived?.Invoke(line);
             }
@@ -120,4 +146,40 @@ public class SerialTransport : ITransportClient
         _connected = false;
         Disconnected?.Invoke();
     }
+
+    // Next text line; binary records (after FORMAT:BIN) in between go to RecordReceived.
+    // A record starts where a line would, with a byte no text line starts with, and
+    // carries its length in its third byte.
+    private string ReadLine()
+    {
+        while (true)
+        {
+            var b = (byte)_port!.ReadByte();
+            if (_line.Count == 0 && EventParser.IsRecordStart(b))
+            {
+                RecordReceived?.Invoke(ReadRecord(b));
+                continue;
+            }
+            if (b == '\n')
+            {
+                var line = Encoding.UTF8.GetString(_line.ToArray());
+                _line.Clear();
+                return line;
+            }
+            _line.Add(b);
+        }
+    }
+
+    private byte[] ReadRecord(byte first)
+    {
+        var type = (byte)_port!.ReadByte();
+        var length = Math.Max((byte)_port.ReadByte(), (byte)3);
+        var record = new byte[length];
+        record[0] = first;
+        record[1] = type;
+        record[2] = length;
+        for (int i = 3; i < length; i++)
+            record[i] = (byte)_port.ReadByte();
+        return record;
+    }
 }
@@ -10,9 +10,11 @@ public class WebSocketTransport : ITransportClient
     private CancellationTokenSource? _receiveCts;
     private string? _url;
     private TaskCompletionSource<(string Reply, DateTime ReceiveTime)>? _syncTcs;
+    private TaskCompletionSource<string>? _formatTcs;
 
     public string Name => "WebSocket";
     public event Action<string>? MessageReceived;
+    public event Action<byte[]>? RecordReceived;
     public event Action<string>? LogMessage;
     public event Action? Disconnected;
     public bool IsConnected => _ws?.State == WebSocketState.Open;
@@ -62,6 +64,27 @@ public class WebSocketTransport : ITransportClient
         }
     }
 
+    public async Task<string?> RequestFormatAsync(bool binary, CancellationToken ct)
+    {
+        if (_ws?.State != WebSocketState.Open) return null;
+
+        _formatTcs = new TaskCompletionSource<string>();
+        var command = Encoding.UTF8.GetBytes(binary ? "FORMAT:BIN" : "FORMAT:TEXT");
+        await _ws.SendAsync(command, WebSocketMessageType.Text, true, ct);
+
+        using var cts = CancellationTokenSource.CreateLinkedTokenSource(ct);
+        cts.CancelAfter(TimeSpan.FromSeconds(2));
+
+        try
+        {
+            return await _formatTcs.Task.WaitAsync(cts.Token);
+        }
+        catch (OperationCanceledException)
+        {
+            return null;
+        }
+    }
+
     public async Task DisconnectAsync()
     {
         _receiveCts?.Cancel();
@@ -90,9 +113,15 @@ public class WebSocketTransport : ITransportClient
                     var msg = Encoding.UTF8.GetString(buffer, 0, result.Count);
                     if (msg.StartsWith("SYNC:"))
                         _syncTcs?.TrySetResult((msg, DateTime.UtcNow));
+                    else if (msg.StartsWith("FORMAT:"))
+                        _formatTcs?.TrySetResult(msg);
                     else
                         MessageReceived?.Invoke(msg);
                 }
+                else if (result.MessageType == WebSocketMessageType.Binary)
+                {
+                    RecordReceived?.Invoke(buffer[..result.Count]);
+                }
             }
         }
         catch (OperationCanceledException) { }
@@ -131,6 +131,23 @@ public class MainViewModel : INotifyPropertyChanged
     private double _latencySum;
     private int _latencyCount;
 
+    // Events whose detector quality is below the firmware's eventMarginal() thresholds
+    private int _marginalCount;
+    public int MarginalCount
+    {
+        get => _marginalCount;
+        set { _marginalCount = value; OnPropertyChanged(); }
+    }
+
+    // Last reported health per (node, sensor); sensors whose status isn't OK
+    private readonly Dictionary<(int, int), string> _sensorStatus = new();
+    private int _unhealthyCount;
+    public int UnhealthyCount
+    {
+        get => _unhealthyCount;
+        set { _unhealthyCount = value; OnPropertyChanged(); }
+    }
+
     private string _avgLatency = "";
     public string AvgLatency
     {
@@ -187,6 +204,9 @@ public class MainViewModel : INotifyPropertyChanged
         AvgLatency = "";
         _latencySum = 0;
         _latencyCount = 0;
+        MarginalCount = 0;
+        _sensorStatus.Clear();
+        UnhealthyCount = 0;
         LogLines.Clear();
 
         _connectCts = new CancellationTokenSource();
@@ -202,6 +222,7 @@ public class MainViewModel : INotifyPropertyChanged
             };
 
             _transport.MessageReceived += OnMessage;
+            _transport.RecordReceived += OnRecord;
             _transport.LogMessage += OnLog;
 
             Status = "Connecting...";
@@ -215,6 +236,7 @@ public class MainViewModel : INotifyPropertyChanged
 
             // Run SYNC calibration
             await CalibrateAsync(_connectCts.Token);
+            await NegotiateFormatAsync(_connectCts.Token);
 
             Status = _clock.IsCalibrated
                 ? $"Connected (boot: {_clock.EspZeroTime.ToLocalTime():HH:mm:ss.fff})"
@@ -273,6 +295,16 @@ public class MainViewModel : INotifyPropertyChanged
         }
     }
 
+    // Binary event records where the node has them; older nodes don't answer and stay on text
+    private async Task NegotiateFormatAsync(CancellationToken ct)
+    {
+        if (_transport == null) return;
+        var reply = await _transport.RequestFormatAsync(true, ct);
+        LogLines.Add(reply != null && reply.StartsWith("FORMAT:BIN")
+            ? $"Event format: binary ({reply})"
+            : "Event format: text");
+    }
+
     public async Task DisconnectAsync()
     {
         StopBleScan();
@@ -286,6 +318,7 @@ public class MainViewModel : INotifyPropertyChanged
         if (_transport != null)
         {
             _transport.MessageReceived -= OnMessage;
+            _transport.RecordReceived -= OnRecord;
             _transport.LogMessage -= OnLog;
             _transport.Disconnected -= OnDisconnected;
             await _transport.DisconnectAsync();
@@ -300,6 +333,19 @@ public class MainViewModel : INotifyPropertyChanged
         Dispatcher.UIThread.Post(() => ProcessMessage(message, receiveTime));
     }
 
+    private void OnRecord(byte[] record)
+    {
+        var receiveTime = DateTime.UtcNow;
+        Dispatcher.UIThread.Post(() =>
+        {
+            var evt = _parser.ParseRecord(record, receiveTime);
+            if (evt == null)
+                LogLines.Add($"Unparsed record: {Convert.ToHexString(record)}");
+            else
+                ProcessEvent(evt);
+        });
+    }
+
     private void OnLog(string message)
     {
         Dispatcher.UIThread.Post(() => LogLines.Add(message));
@@ -314,6 +360,23 @@ public class MainViewModel : INotifyPropertyChanged
         });
     }
 
+    // Health reports repeat every 10s per sensor; only log a sensor when its status changes
+    private void ProcessHealth(string message)
+    {
+        var health = SensorHealth.Parse(message);
+        if (health == null)
+        {
+            LogLines.Add($"Unparsed: {message}");
+            return;
+        }
+        var key = (health.NodeId, health.SensorId);
+        var previous = _sensorStatus.GetValueOrDefault(key, "OK");
+        _sensorStatus[key] = health.Status;
+        UnhealthyCount = _sensorStatus.Values.Count(s => s != "OK");
+        if (health.Status != previous)
+            LogLines.Add($"Health: {health.NodeName} S{health.SensorId} {health.Summary}");
+    }
+
     private void ProcessMessage(string message, DateTime receiveTimeUtc)
     {
         if (message.StartsWith("#"))
@@ -321,7 +384,14 @@ public class MainViewModel : INotifyPropertyChanged
             LogLines.Add(message);
             return;
         }
-        if (message.StartsWith("SYNC")) return;
+        if (message.StartsWith("SYNC") || message.StartsWith("FORMAT:")) return;
+        // Pass timings (P:) and race standings (R:) are for lap timers; this client counts the car events only
+        if (message.StartsWith("P:") || message.StartsWith("R:")) return;
+        if (message.StartsWith("H:"))
+        {
+            ProcessHealth(message);
+            return;
+        }
 
         var evt = _parser.Parse(message, receiveTimeUtc);
         if (evt == null)
@@ -329,7 +399,11 @@ public class MainViewModel : INotifyPropertyChanged
             LogLines.Add($"Unparsed: {message}");
             return;
         }
+        ProcessEvent(evt);
+    }
 
+    private void ProcessEvent(ScalextricEvent evt)
+    {
         // Drop detection
         if (_expectedSeq >= 0 && evt.Sequence != _expectedSeq)
         {
@@ -351,6 +425,13 @@ public class MainViewModel : INotifyPropertyChanged
             .Where(c => _carCountMap.ContainsKey(c))
             .Select(c => $"C{c}:{_carCountMap[c]}"));
 
+        // A sensor that keeps producing marginal events is going to start missing cars
+        if (evt.IsMarginal)
+        {
+            MarginalCount++;
+            LogLines.Add($"Marginal: {evt.NodeName} S{evt.SensorId} car {evt.CarLabel}: {evt.Quality!.Summary}");
+        }
+
         // Update latency average
         if (evt.LatencyMs.HasValue)
         {